@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2019 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+/*
+ * Copy bandwidth test.  The client streams messages to the server, which
+ * reads the received data back after each window of messages, so the
+ * result includes the cost of consuming the data.  For providers that
+ * move messages through bounce buffers (e.g. shm, or rxm and rxd over
+ * their core providers) this is bound by the provider's copies.  Run it
+ * with different FI_COPY_NT_THRESHOLD values to see how non-temporal
+ * copies trade copy bandwidth against the receiver's cache.
+ */
+
+/* keeps the read back from being optimized out */
+static volatile uint64_t rx_sum;
+
+static void read_back(void)
+{
+	const uint8_t *data = (uint8_t *) rx_buf + ft_rx_prefix_size();
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < opts.transfer_size; i++)
+		sum += data[i];
+	rx_sum += sum;
+}
+
+static int copy_bw(void)
+{
+	int ret, i, j;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr) {
+		for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+			if (i == opts.warmup_iterations)
+				ft_start();
+
+			if (opts.transfer_size < fi->tx_attr->inject_size)
+				ret = ft_inject(ep, remote_fi_addr, opts.transfer_size);
+			else
+				ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+						 NO_CQ_DATA, &tx_ctx_arr[j].context);
+			if (ret)
+				return ret;
+
+			if (++j == opts.window_size) {
+				ret = ft_get_tx_comp(tx_seq);
+				if (ret)
+					return ret;
+				ret = ft_rx(ep, 4);
+				if (ret)
+					return ret;
+				j = 0;
+			}
+		}
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+		ret = ft_rx(ep, 4);
+	} else {
+		for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+			if (i == opts.warmup_iterations)
+				ft_start();
+
+			ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx_arr[j].context);
+			if (ret)
+				return ret;
+
+			if (++j == opts.window_size) {
+				/* rx_seq is always one ahead */
+				ret = ft_get_rx_comp(rx_seq - 1);
+				if (ret)
+					return ret;
+				read_back();
+				ret = ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+				if (ret)
+					return ret;
+				j = 0;
+			}
+		}
+		ret = ft_get_rx_comp(rx_seq - 1);
+		if (ret)
+			return ret;
+		read_back();
+		ret = ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+	}
+	if (ret)
+		return ret;
+	ft_stop();
+
+	show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 1);
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret = 0;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			init_test(&opts, test_name, sizeof(test_name));
+			ret = copy_bw();
+			if (ret)
+				goto out;
+		}
+	} else {
+		init_test(&opts, test_name, sizeof(test_name));
+		ret = copy_bw();
+		if (ret)
+			goto out;
+	}
+
+	ft_finalize();
+out:
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "h" CS_OPTS INFO_OPTS BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Copy bandwidth test for RDM endpoints, "
+				   "including reading back the received data.");
+			ft_benchmark_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2019 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_cm.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+/*
+ * Many-to-one bandwidth test.  A single invocation forks a number of
+ * sender processes which all stream messages to one receiving endpoint
+ * in the parent.  Addresses are exchanged over pipes, so no out-of-band
+ * connection is needed.  This is intended for on-node providers (e.g. shm)
+ * where many ranks target the same peer.
+ */
+
+static int num_senders = 4;
+static pid_t *sender_pids;
+static int addr_pipe[2] = { -1, -1 };	/* receiver -> senders */
+static int name_pipe[2] = { -1, -1 };	/* senders -> receiver */
+static int start_pipe[2] = { -1, -1 };	/* receiver -> senders */
+static char sender_port[12];
+
+/* Pipe writes of up to PIPE_BUF bytes are atomic, so the senders may
+ * share a single pipe as long as each address is one fixed size write. */
+static int write_addr(int fd)
+{
+	char buf[FT_MAX_CTRL_MSG];
+	size_t addrlen = sizeof(buf);
+	int ret;
+
+	memset(buf, 0, sizeof(buf));
+	ret = fi_getname(&ep->fid, buf, &addrlen);
+	if (ret) {
+		FT_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+		FT_PRINTERR("write", -errno);
+		return -errno;
+	}
+	return 0;
+}
+
+static int read_msg(int fd, char *buf)
+{
+	ssize_t ret;
+
+	ret = read(fd, buf, FT_MAX_CTRL_MSG);
+	if (ret != FT_MAX_CTRL_MSG) {
+		FT_PRINTERR("read", -errno);
+		return ret < 0 ? -errno : -FI_EIO;
+	}
+	return 0;
+}
+
+static int read_addr(int fd, fi_addr_t *fi_addr)
+{
+	char buf[FT_MAX_CTRL_MSG];
+	int ret;
+
+	ret = read_msg(fd, buf);
+	if (ret)
+		return ret;
+
+	return ft_av_insert(av, buf, 1, fi_addr, 0, NULL);
+}
+
+static int sender_run_size(void)
+{
+	char buf[FT_MAX_CTRL_MSG];
+	int ret, i, j;
+
+	/* wait until the receiver is ready for this size */
+	ret = read_msg(start_pipe[0], buf);
+	if (ret)
+		return ret;
+
+	for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (opts.transfer_size < fi->tx_attr->inject_size)
+			ret = ft_inject(ep, remote_fi_addr, opts.transfer_size);
+		else
+			ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+					 NO_CQ_DATA, &tx_ctx_arr[j].context);
+		if (ret)
+			return ret;
+
+		if (++j == opts.window_size) {
+			ret = ft_get_tx_comp(tx_seq);
+			if (ret)
+				return ret;
+			j = 0;
+		}
+	}
+	return ft_get_tx_comp(tx_seq);
+}
+
+/* Like ft_post_rx(), but accepts messages from any sender. */
+static int post_rx(void *ctx)
+{
+	struct fi_cq_tagged_entry comp;
+	ssize_t ret;
+
+	for (;;) {
+		ret = fi_recv(ep, rx_buf, rx_size + ft_rx_prefix_size(),
+			      mr_desc, FI_ADDR_UNSPEC, ctx);
+		if (ret != -FI_EAGAIN)
+			break;
+
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret > 0) {
+			rx_cq_cntr++;
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return (int) ret;
+		}
+	}
+	if (ret) {
+		FT_PRINTERR("fi_recv", ret);
+		return (int) ret;
+	}
+	rx_seq++;
+	return 0;
+}
+
+static int start_senders(void)
+{
+	char buf[FT_MAX_CTRL_MSG];
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	for (i = 0; i < num_senders; i++) {
+		if (write(start_pipe[1], buf, sizeof(buf)) != sizeof(buf)) {
+			FT_PRINTERR("write", -errno);
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+static int receiver_run_size(void)
+{
+	int ret, i, j, total, warmup;
+
+	total = num_senders * (opts.iterations + opts.warmup_iterations);
+	warmup = num_senders * opts.warmup_iterations;
+
+	ret = start_senders();
+	if (ret)
+		return ret;
+
+	for (i = j = 0; i < total; i++) {
+		if (i == warmup)
+			ft_start();
+
+		ret = post_rx(&rx_ctx_arr[j].context);
+		if (ret)
+			return ret;
+
+		if (++j == opts.window_size) {
+			ret = ft_get_rx_comp(rx_seq);
+			if (ret)
+				return ret;
+			j = 0;
+		}
+	}
+	ret = ft_get_rx_comp(rx_seq);
+	if (ret)
+		return ret;
+	ft_stop();
+
+	show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end,
+		  num_senders);
+	return 0;
+}
+
+static int run_sizes(int (*run_size)(void))
+{
+	int i, ret;
+
+	if (opts.options & FT_OPT_SIZE)
+		return run_size();
+
+	for (i = 0; i < TEST_CNT; i++) {
+		if (!ft_use_size(i, opts.sizes_enabled))
+			continue;
+		opts.transfer_size = test_size[i].size;
+		ret = run_size();
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int init_fabric(void)
+{
+	int ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_active_res(fi);
+	if (ret)
+		return ret;
+
+	/* ft_enable_ep_recv() would pre-post a receive bound to the first
+	 * peer, which messages from the other senders cannot match. */
+	return ft_enable_ep(ep, eq, av, txcq, rxcq, txcntr, rxcntr);
+}
+
+static int run_sender(void)
+{
+	int ret;
+
+	close(addr_pipe[1]);
+	close(name_pipe[0]);
+	close(start_pipe[1]);
+
+	ret = init_fabric();
+	if (ret)
+		return ret;
+
+	ret = read_addr(addr_pipe[0], &remote_fi_addr);
+	if (ret)
+		return ret;
+
+	ret = write_addr(name_pipe[1]);
+	if (ret)
+		return ret;
+
+	return run_sizes(sender_run_size);
+}
+
+static int run_receiver(void)
+{
+	fi_addr_t fi_addr;
+	int i, ret;
+
+	close(addr_pipe[0]);
+	close(name_pipe[1]);
+	close(start_pipe[0]);
+
+	ret = init_fabric();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < num_senders; i++) {
+		ret = write_addr(addr_pipe[1]);
+		if (ret)
+			return ret;
+	}
+
+	/* The receiver must also know its peers, e.g. for shm to reach a
+	 * sender's memory on the rendezvous path.  Senders report their
+	 * address once they have inserted the receiver's, and hold off
+	 * sending until they are started for each message size. */
+	for (i = 0; i < num_senders; i++) {
+		ret = read_addr(name_pipe[0], &fi_addr);
+		if (ret)
+			return ret;
+	}
+
+	return run_sizes(receiver_run_size);
+}
+
+static int wait_senders(int kill_senders)
+{
+	int i, status, ret = 0;
+
+	for (i = 0; i < num_senders; i++) {
+		if (kill_senders)
+			kill(sender_pids[i], SIGKILL);
+		if (waitpid(sender_pids[i], &status, 0) < 0) {
+			FT_PRINTERR("waitpid", -errno);
+			ret = -errno;
+		} else if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			ret = -FI_EOTHER;
+		}
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret, i;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "hn:" CS_OPTS INFO_OPTS BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'n':
+			num_senders = atoi(optarg);
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Many-to-one bandwidth test for RDM endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-n <senders>", "number of sending processes "
+					    "(default: 4)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_senders < 1) {
+		FT_ERR("number of senders must be positive");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	if (!opts.src_port)
+		opts.src_port = "9228";
+
+	opts.av_size = num_senders;
+	sender_pids = calloc(num_senders, sizeof(*sender_pids));
+	if (!sender_pids)
+		return EXIT_FAILURE;
+
+	if (pipe(addr_pipe) || pipe(name_pipe) || pipe(start_pipe)) {
+		FT_PRINTERR("pipe", -errno);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < num_senders; i++) {
+		sender_pids[i] = fork();
+		if (sender_pids[i] < 0) {
+			FT_PRINTERR("fork", -errno);
+			num_senders = i;
+			(void) wait_senders(1);
+			return EXIT_FAILURE;
+		}
+		if (!sender_pids[i]) {
+			/* Providers may derive the endpoint name from the
+			 * port, so every sender gets one of its own. */
+			snprintf(sender_port, sizeof(sender_port), "%d",
+				 atoi(opts.src_port) + i + 1);
+			opts.src_port = sender_port;
+			ret = run_sender();
+			ft_free_res();
+			return ft_exit_code(ret);
+		}
+	}
+
+	ret = run_receiver();
+	if (ret)
+		(void) wait_senders(1);
+	else
+		ret = wait_senders(0);
+
+	ft_free_res();
+	free(sender_pids);
+	return ft_exit_code(ret);
+}
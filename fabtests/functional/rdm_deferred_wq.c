@@ -43,10 +43,12 @@ static char *welcome_text = "Hello from Client!";
 static char *write_text = "This is a successful trigger";
 struct fi_deferred_work work;
 struct fid_cntr *test_cntr;
-uint64_t n_trig, rx_exp;
+uint64_t n_trig, rx_exp, cntr_base;
 static char *result_buf, *compare_buf;
 static struct fid_mr *mr_result, *mr_compare;
+static void *result_desc, *compare_desc;
 int use_alias = 0;
+int use_ep_cntr = 0;
 struct fid_ep *trig_ep;
 enum fi_op_type tested_op;
 
@@ -54,7 +56,7 @@ static void format_simple_msg(struct fi_msg *msg, struct iovec *iov, void *src,
 			      size_t size, void *ctx)
 {
 	msg->context = ctx;
-	msg->desc = mr_desc;
+	msg->desc = &mr_desc;
 	msg->iov_count = 1;
 	msg->addr = remote_fi_addr;
 	msg->data = 0;
@@ -69,7 +71,7 @@ static void format_simple_msg_tagged(struct fi_msg_tagged *msg, struct iovec *io
 			      uint64_t tag)
 {
 	msg->context = ctx;
-	msg->desc = mr_desc;
+	msg->desc = &mr_desc;
 	msg->iov_count = 1;
 	msg->addr = remote_fi_addr;
 	msg->data = 0;
@@ -85,7 +87,7 @@ static void format_simple_msg_rma(struct fi_msg_rma *msg, struct iovec *iov,
 			   size_t size, void *ctx)
 {
 	msg->context = ctx;
-	msg->desc = mr_desc;
+	msg->desc = &mr_desc;
 	msg->iov_count = 1;
 	msg->addr = remote_fi_addr;
 	msg->rma_iov_count = 1;
@@ -94,8 +96,8 @@ static void format_simple_msg_rma(struct fi_msg_rma *msg, struct iovec *iov,
 	iov->iov_len = size;
 	msg->msg_iov = iov;
 
-	rma_iov->addr = 0;
-	rma_iov->key = FT_MR_KEY;
+	rma_iov->addr = remote.addr;
+	rma_iov->key = remote.key;
 	rma_iov->len = size;
 	msg->rma_iov = rma_iov;
 }
@@ -106,7 +108,7 @@ static void format_simple_msg_atomic(struct fi_msg_atomic *msg, struct fi_ioc *i
 			      enum fi_op op)
 {
 	msg->context = ctx;
-	msg->desc = mr_desc;
+	msg->desc = &mr_desc;
 	msg->iov_count = 1;
 	msg->rma_iov_count = 1;
 	msg->addr = remote_fi_addr;
@@ -119,16 +121,16 @@ static void format_simple_msg_atomic(struct fi_msg_atomic *msg, struct fi_ioc *i
 	iov->count = size;
 	msg->msg_iov = iov;
 
-	rma_iov->addr = 0;
+	rma_iov->addr = remote.addr;
 	rma_iov->count = size;
-	rma_iov->key = FT_MR_KEY;
+	rma_iov->key = remote.key;
 	msg->rma_iov = rma_iov;
 }
 
 static void format_simple_msg_fetch(struct fi_msg_fetch *msg, struct fi_ioc *iov,
 				    void *src, size_t size)
 {
-	msg->desc = fi_mr_desc(mr_result);
+	msg->desc = &result_desc;
 
 	iov->addr = src;
 	iov->count = size;
@@ -140,7 +142,7 @@ static void format_simple_msg_fetch(struct fi_msg_fetch *msg, struct fi_ioc *iov
 static void format_simple_msg_compare(struct fi_msg_compare *msg, struct fi_ioc *iov,
 				      void *src, size_t size)
 {
-	msg->desc = fi_mr_desc(mr_compare);
+	msg->desc = &compare_desc;
 
 	iov->addr = src;
 	iov->count = size;
@@ -149,6 +151,21 @@ static void format_simple_msg_compare(struct fi_msg_compare *msg, struct fi_ioc
 	msg->msg_iov = iov;
 }
 
+/*
+ * The completion counter may not be bound to the endpoint, so the endpoint
+ * is progressed through the counters that are.
+ */
+static int wait_cntr(struct fid_cntr *cntr, uint64_t value)
+{
+	while (fi_cntr_read(cntr) < value) {
+		if (fi_cntr_readerr(cntr))
+			return -FI_EAVAIL;
+		(void) fi_cntr_read(txcntr);
+		(void) fi_cntr_read(rxcntr);
+	}
+	return 0;
+}
+
 static int check_data()
 {
 	int ret, i;
@@ -172,7 +189,7 @@ static int check_data()
 		break;
 	case FI_OP_CNTR_SET:
 	case FI_OP_CNTR_ADD:
-		ret  = fi_cntr_wait(test_cntr, 10, -1);
+		ret = wait_cntr(test_cntr, 10);
 		if (ret)
 			return ret;
 		break;
@@ -198,14 +215,15 @@ static int send_wait_check()
 
 	if (opts.dst_addr) {
 		ret = fi_write(ep, tx_buf, strlen(welcome_text), mr_desc,
-				remote_fi_addr, 0, FT_MR_KEY, &tx_ctx);
+				remote_fi_addr, remote.addr, remote.key, &tx_ctx);
  		if (ret) {
  			FT_PRINTERR("fi_write", ret);
  			return ret;
 		}
 	}
 
-	ret = fi_cntr_wait(test_cntr, n_trig, -1);
+	ret = wait_cntr(work.completion_cntr ? work.completion_cntr : test_cntr,
+			cntr_base + n_trig);
 	if (ret)
 		return ret;
 
@@ -213,7 +231,17 @@ static int send_wait_check()
 	if (ret)
 		return ret;
 
-	return check_data();
+	ret = check_data();
+	if (ret)
+		return ret;
+
+	//each triggered op is counted once, also on the endpoint's counter
+	if (work.completion_cntr &&
+	    fi_cntr_read(work.completion_cntr) != cntr_base + n_trig) {
+		printf("Completion counter mismatch...");
+		return 1;
+	}
+	return 0;
 }
 
 static int cntr_trigger()
@@ -259,8 +287,8 @@ static int rma_trigger()
 	format_simple_msg_rma(&msg, &iov, &rma_iov,
 			      result_buf, strlen(write_text), &work.context);
 	work.op_type = FI_OP_READ;
-	work.triggering_cntr = test_cntr;
-	work.threshold = 1;
+	work.triggering_cntr = work.completion_cntr;
+	work.threshold = cntr_base + 1;
 	return fi_control(&domain->fid, FI_QUEUE_WORK, &work);
 }
 
@@ -332,13 +360,13 @@ static int compare_atomic_trigger()
 	struct fi_ioc compare_iov;
 	struct fi_rma_ioc rma_iov;
 
-	ret = check_compare_atomic_op(ep, FI_CSWAP_LE, FI_UINT8, &count);
+	ret = check_compare_atomic_op(ep, FI_CSWAP_GE, FI_UINT8, &count);
 	if (ret)
 		return ret;
 
 	format_simple_msg_atomic(&msg, &iov, &rma_iov,
 				 tx_buf + strlen(welcome_text),
-				 strlen(welcome_text), &work.context, FI_UINT8, FI_CSWAP_LE);
+				 strlen(welcome_text), &work.context, FI_UINT8, FI_CSWAP_GE);
 	format_simple_msg_fetch(&fetch, &fetch_iov, result_buf, strlen(welcome_text));
 	format_simple_msg_compare(&compare, &compare_iov, compare_buf, strlen(welcome_text));
 
@@ -412,21 +440,30 @@ static int trigger()
 {
 	int ret;
 
-	//both sides start with both counters at 2, client will initiate triggering write
+	//client will initiate triggering write
 	//which will trigger txcntr on client and rxcntr on server
 	//rx_exp = number of rx completions we should expect on that side
 	//n_trig = total number of triggers on work queue to expect completed
+	//the counters hold the sends and receives so far, all completed
+	rx_exp = rx_seq;
 	if (opts.dst_addr) {
 		work.triggering_cntr = txcntr;
-		rx_exp = 2;
+		work.threshold = tx_seq + 1;
 	} else {
 		work.triggering_cntr = rxcntr;
-		rx_exp = 3;
+		work.threshold = rx_seq + 1;
+		rx_exp++;
 	}
-	work.threshold = 3;
 
-	if (tested_op != FI_OP_CNTR_ADD && tested_op != FI_OP_CNTR_SET)
-		work.completion_cntr = test_cntr;
+	//with -e, txcntr also counts the client's triggering write
+	if (tested_op != FI_OP_CNTR_ADD && tested_op != FI_OP_CNTR_SET) {
+		if (use_ep_cntr) {
+			work.completion_cntr = txcntr;
+			cntr_base = tx_seq + (opts.dst_addr ? 1 : 0);
+		} else {
+			work.completion_cntr = test_cntr;
+		}
+	}
 
 	switch (tested_op) {
 	case FI_OP_RECV:
@@ -511,10 +548,19 @@ static int run_test()
 	init_buf_vals();
 
 	//eat up first receive to make sure the triggered op doesn't go there instead
-	ret = ft_tx(ep, remote_fi_addr, strlen(welcome_text), &tx_ctx);
-	if (ret)
-		return ret;
-	ret = ft_get_rx_comp(rx_seq);
+	//the server replies once it has received, so that both messages have
+	//landed in rx_buf before the client starts writing to it
+	if (opts.dst_addr) {
+		ret = ft_tx(ep, remote_fi_addr, strlen(welcome_text), &tx_ctx);
+		if (ret)
+			return ret;
+		ret = ft_get_rx_comp(rx_seq);
+	} else {
+		ret = ft_get_rx_comp(rx_seq);
+		if (ret)
+			return ret;
+		ret = ft_tx(ep, remote_fi_addr, strlen(welcome_text), &tx_ctx);
+	}
 	if (ret)
 		return ret;
 
@@ -549,6 +595,7 @@ static int alloc_mr_res()
 		FT_PRINTERR("fi_mr_reg", ret);
 		return ret;
 	}
+	mr_desc = fi_mr_desc(mr);
 
 	ret = fi_mr_reg(domain, result_buf, buf_size, FT_RMA_MR_ACCESS,
 			0, FT_MR_KEY + 1, 0, &mr_result, NULL);
@@ -556,12 +603,15 @@ static int alloc_mr_res()
 		FT_PRINTERR("fi_mr_reg", ret);
 		return ret;
 	}
+	result_desc = fi_mr_desc(mr_result);
+
 	ret = fi_mr_reg(domain, compare_buf, buf_size, FT_RMA_MR_ACCESS,
 			0, FT_MR_KEY + 2, 0, &mr_compare, NULL);
 	if (ret) {
 		FT_PRINTERR("fi_mr_reg", ret);
 		return ret;
 	}
+	compare_desc = fi_mr_desc(mr_compare);
 	return 0;
 }
 
@@ -580,6 +630,8 @@ int main(int argc, char **argv)
 	opts = INIT_OPTS;
 	opts.options = FT_OPT_SIZE | FT_OPT_RX_CNTR | FT_OPT_TX_CNTR |
 		       FT_OPT_SKIP_REG_MR;
+	/* the counters are waited on */
+	opts.comp_method = FT_COMP_SREAD;
 	opts.mr_mode = FI_MR_LOCAL | FI_MR_VIRT_ADDR | FI_MR_ALLOCATED;
 
 	hints = fi_allocinfo();
@@ -588,7 +640,7 @@ int main(int argc, char **argv)
 
 	tested_op = FI_OP_CNTR_SET;
 
-	while ((op = getopt(argc, argv, "aT:h" ADDR_OPTS INFO_OPTS)) != -1) {
+	while ((op = getopt(argc, argv, "aeT:h" ADDR_OPTS INFO_OPTS)) != -1) {
 		switch (op) {
 		default:
 			ft_parse_addr_opts(op, optarg, &opts);
@@ -597,6 +649,9 @@ int main(int argc, char **argv)
 		case 'a':
 			use_alias = 1;
 			break;
+		case 'e':
+			use_ep_cntr = 1;
+			break;
 		case 'T':
 			if (!strncasecmp("msg", optarg, 3))
 				tested_op = FI_OP_RECV;
@@ -624,7 +679,7 @@ int main(int argc, char **argv)
 	hints->ep_attr->type = FI_EP_RDM;
 	hints->caps = FI_MSG | FI_RMA | FI_RMA_EVENT | FI_TRIGGER;
 
-	if (tested_op == FI_OP_TSEND)
+	if (tested_op == FI_OP_TRECV)
 		hints->caps |= FI_TAGGED;
 	else if (tested_op == FI_OP_ATOMIC ||
 		 tested_op == FI_OP_FETCH_ATOMIC ||
@@ -657,6 +712,10 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	ret = ft_exchange_keys(&remote);
+	if (ret)
+		return ret;
+
 	ret = run_test();
 	if (ret)
 		return ret;
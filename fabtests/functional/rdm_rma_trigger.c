@@ -126,6 +126,8 @@ int main(int argc, char **argv)
 
 	opts = INIT_OPTS;
 	opts.options = FT_OPT_SIZE | FT_OPT_RX_CNTR | FT_OPT_TX_CNTR;
+	/* the counters are waited on */
+	opts.comp_method = FT_COMP_SREAD;
 	opts.transfer_size = strlen(welcome_text1) + strlen(welcome_text2);
 
 	hints = fi_allocinfo();
@@ -143,6 +143,7 @@ short_tests=(
 	"fi_rma_bw -e rdm -o writedata -I 5"
 	"fi_rdm_atomic -I 5 -o all"
 	"fi_rdm_cntr_pingpong -I 5"
+	"fi_rdm_copy_bw -I 5"
 	"fi_multi_recv -e rdm -I 5"
 	"fi_multi_recv -e msg -I 5"
 	"fi_rdm_pingpong -I 5"
@@ -169,6 +170,7 @@ standard_tests=(
 	"fi_rma_bw -e rdm -o writedata"
 	"fi_rdm_atomic -o all -I 1000"
 	"fi_rdm_cntr_pingpong"
+	"fi_rdm_copy_bw"
 	"fi_multi_recv -e rdm"
 	"fi_multi_recv -e msg"
 	"fi_rdm_pingpong"
@@ -70,6 +70,26 @@ static inline int ofi_free_hugepage_buf(void *memptr, size_t size)
 	return -FI_ENOSYS;
 }
 
+static inline int ofi_numa_node_self(void)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_mbind_node(void *addr, size_t len, int node)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_mem_node(void *addr)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_madvise_hugepage(void *addr, size_t len)
+{
+	return -FI_ENOSYS;
+}
+
 static inline size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa)
 {
 	return 0;
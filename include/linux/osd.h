@@ -42,7 +42,11 @@
 #include <string.h>
 #include <assert.h>
 
+#include <errno.h>
 #include <ifaddrs.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "unix/osd.h"
 #include "rdma/fi_errno.h"
 
@@ -95,4 +99,126 @@ static inline int ofi_hugepage_enabled(void)
 
 size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa);
 
+/*
+ * Futexes on shared (not process private) memory, usable across processes
+ * mapping the same region.  ofi_futex_wait() sleeps as long as *addr still
+ * holds val; it returns 0 when woken or when the value has already changed
+ * (spurious wakeups are possible), and -FI_ETIMEDOUT on timeout (in ms,
+ * negative waits forever).
+ */
+static inline int ofi_futex_wait(int32_t *addr, int32_t val, int timeout)
+{
+	struct timespec ts, *tsp = NULL;
+
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		tsp = &ts;
+	}
+
+	if (!syscall(SYS_futex, addr, FUTEX_WAIT, val, tsp, NULL, 0))
+		return 0;
+
+	switch (errno) {
+	case EAGAIN:
+	case EINTR:
+		return 0;
+	case ETIMEDOUT:
+		return -FI_ETIMEDOUT;
+	default:
+		return -errno;
+	}
+}
+
+static inline void ofi_futex_wake(int32_t *addr, int cnt)
+{
+	(void) syscall(SYS_futex, addr, FUTEX_WAKE, cnt, NULL, NULL, 0);
+}
+
+/*
+ * Anonymous memory backed file, which other processes can open through
+ * /proc/<pid>/fd/<fd> to share the memory.  Returns the fd or -errno.
+ */
+static inline int ofi_memfd_create(const char *name)
+{
+#ifdef SYS_memfd_create
+	int fd;
+
+	fd = syscall(SYS_memfd_create, name, 1 /* MFD_CLOEXEC */);
+	return fd < 0 ? -errno : fd;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * NUMA placement of memory mappings, without requiring libnuma.  Node
+ * numbers beyond OFI_MAX_NUMA_NODES are not supported.
+ */
+#define OFI_MAX_NUMA_NODES 1024
+
+/* Node the calling thread currently runs on, or -errno */
+static inline int ofi_numa_node_self(void)
+{
+#ifdef SYS_getcpu
+	unsigned int cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL))
+		return -errno;
+	return (int) node;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
+/*
+ * Prefer allocating the pages of the range from the given node.  For
+ * shared mappings the policy is kept by the underlying object, so it also
+ * applies to pages first touched by other processes mapping it.
+ */
+static inline int ofi_mbind_node(void *addr, size_t len, int node)
+{
+#ifdef SYS_mbind
+	unsigned long mask[OFI_MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+
+	if (node < 0 || node >= OFI_MAX_NUMA_NODES)
+		return -FI_EINVAL;
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] |=
+		1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(SYS_mbind, addr, len, 1 /* MPOL_PREFERRED */, mask,
+		    OFI_MAX_NUMA_NODES + 1, 0))
+		return -errno;
+	return 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
+/* Node holding the page at addr (faulting it in if needed), or -errno */
+static inline int ofi_mem_node(void *addr)
+{
+#ifdef SYS_get_mempolicy
+	int node;
+
+	if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr,
+		    3 /* MPOL_F_NODE | MPOL_F_ADDR */))
+		return -errno;
+	return node;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
+/* Ask for transparent huge pages to back the range */
+static inline int ofi_madvise_hugepage(void *addr, size_t len)
+{
+#ifdef MADV_HUGEPAGE
+	return madvise(addr, len, MADV_HUGEPAGE) ? -errno : 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
 #endif /* _LINUX_OSD_H_ */
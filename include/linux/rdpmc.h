@@ -36,7 +36,10 @@ unsigned long long rdpmc_read(struct rdpmc_ctx *ctx);
 
 
 struct ofi_perf_ctx {
-	struct rdpmc_ctx ctx;
+	size_t cnt;
+	/* all counters of the group can be read with rdpmc */
+	int rdpmc;
+	struct rdpmc_ctx ctx[OFI_PERF_MAX_CNTRS];
 };
 
 
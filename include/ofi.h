@@ -141,6 +141,8 @@ enum {
 	OFI_CLFLUSHOPT_BIT	= (1 << 24),
 	OFI_CLFLUSH_REG		= 3,
 	OFI_CLFLUSH_BIT		= (1 << 23),
+	OFI_ERMS_REG		= 1,
+	OFI_ERMS_BIT		= (1 << 9),
 };
 
 int ofi_cpu_supports(unsigned func, unsigned reg, unsigned bit);
@@ -178,6 +180,7 @@ struct fi_provider *ofi_get_hook(const char *name);
 
 void fi_log_init(void);
 void fi_log_fini(void);
+void fi_log_async_fini(void);
 void fi_param_init(void);
 void fi_param_fini(void);
 void fi_param_undefine(const struct fi_provider *provider);
@@ -188,6 +191,32 @@ void ofi_hook_install(struct fid_fabric *hfabric, struct fid_fabric **fabric,
 void ofi_remove_comma(char *buffer);
 void ofi_strncatf(char *dest, size_t n, const char *fmt, ...);
 
+/*
+ * fi_getinfo cache:
+ * The key is a flat encoding of the fi_getinfo arguments.  Results are
+ * kept per process, and the lists of providers that returned results are
+ * kept in a file that other processes on the node may reuse.
+ */
+struct ofi_info_key {
+	uint8_t		*data;
+	size_t		len;
+	size_t		size;
+	uint64_t	hash;
+};
+
+void ofi_info_cache_init(void);
+void ofi_info_cache_fini(void);
+void ofi_info_cache_add_prov(const struct fi_provider *provider);
+int ofi_info_key_init(struct ofi_info_key *key, uint32_t version,
+		      const char *node, const char *service, uint64_t flags,
+		      const struct fi_info *hints);
+void ofi_info_key_free(struct ofi_info_key *key);
+int ofi_info_cache_get(struct ofi_info_key *key, struct fi_info **info,
+		       const char **provs);
+void ofi_info_cache_put(struct ofi_info_key *key, const struct fi_info *info,
+			const char *provs);
+int ofi_info_cache_listed(const char *provs, const char *prov_name);
+
 const char *ofi_hex_str(const uint8_t *data, size_t len);
 
 static inline uint64_t roundup_power_of_two(uint64_t n)
@@ -246,6 +275,7 @@ int ofi_check_rx_mode(const struct fi_info *info, uint64_t flags);
 
 uint64_t fi_gettime_ms(void);
 uint64_t fi_gettime_us(void);
+uint64_t ofi_gettime_ns(void);
 
 static inline uint64_t ofi_timeout_time(int timeout)
 {
@@ -37,6 +37,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <ofi_lock.h>
@@ -66,9 +67,13 @@ extern "C" {
 #ifdef HAVE_ATOMICS_LEAST_TYPES
 typedef atomic_int_least32_t	ofi_atomic_int32_t;
 typedef atomic_int_least64_t	ofi_atomic_int64_t;
+typedef int_least32_t		ofi_atomic_val32_t;
+typedef int_least64_t		ofi_atomic_val64_t;
 #else
 typedef atomic_int	ofi_atomic_int32_t;
 typedef atomic_long	ofi_atomic_int64_t;
+typedef int		ofi_atomic_val32_t;
+typedef long		ofi_atomic_val64_t;
 #endif
 
 #define OFI_ATOMIC_DEFINE(radix)									\
@@ -123,6 +128,16 @@ typedef atomic_long	ofi_atomic_int64_t;
 		ATOMIC_IS_INITIALIZED(atomic);								\
 		return (int##radix##_t)atomic_fetch_sub_explicit(&atomic->val, val,			\
 								 memory_order_acq_rel) - val;		\
+	}												\
+	static inline											\
+	bool ofi_atomic_cas_bool##radix(ofi_atomic##radix##_t *atomic,					\
+					int##radix##_t expected, int##radix##_t desired)		\
+	{												\
+		ofi_atomic_val##radix##_t cmp = expected;						\
+		ATOMIC_IS_INITIALIZED(atomic);								\
+		return atomic_compare_exchange_strong_explicit(&atomic->val, &cmp, desired,		\
+							       memory_order_acq_rel,			\
+							       memory_order_acquire);			\
 	}
 
 #elif defined HAVE_BUILTIN_ATOMICS
@@ -184,6 +199,13 @@ typedef atomic_long	ofi_atomic_int64_t;
 	{												\
 		*(ofi_atomic_ptr(atomic)) = value;							\
 		ATOMIC_INIT(atomic);									\
+	}												\
+	static inline											\
+	bool ofi_atomic_cas_bool##radix(ofi_atomic##radix##_t *atomic,					\
+					int##radix##_t expected, int##radix##_t desired)		\
+	{												\
+		ATOMIC_IS_INITIALIZED(atomic);								\
+		return ofi_atomic_cas_bool(radix, ofi_atomic_ptr(atomic), expected, desired);		\
 	}
 	
 #else /* HAVE_ATOMICS */
@@ -261,6 +283,20 @@ typedef atomic_long	ofi_atomic_int64_t;
 		v = atomic->val;								\
 		fastlock_release(&atomic->lock);						\
 		return v;									\
+	}											\
+	static inline										\
+	bool ofi_atomic_cas_bool##radix(ofi_atomic##radix##_t *atomic,				\
+					int##radix##_t expected,				\
+					int##radix##_t desired)					\
+	{											\
+		bool ret;									\
+		ATOMIC_IS_INITIALIZED(atomic);							\
+		fastlock_acquire(&atomic->lock);						\
+		ret = (atomic->val == expected);						\
+		if (ret)									\
+			atomic->val = desired;							\
+		fastlock_release(&atomic->lock);						\
+		return ret;									\
 	}
 #endif // HAVE_ATOMICS
 
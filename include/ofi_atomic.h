@@ -59,6 +59,30 @@ extern void (*ofi_atomic_swap_handlers[OFI_SWAP_OP_LAST][FI_DATATYPE_LAST])
 int ofi_atomic_valid(const struct fi_provider *prov,
 		     enum fi_datatype datatype, enum fi_op op, uint64_t flags);
 
+/*
+ * Vectorized, non-atomic write handlers for the arithmetic and bitwise
+ * operations, selected for the CPU at init.  Entries are NULL for
+ * unsupported op/datatype combinations.
+ */
+extern void (*ofi_atomic_reduce_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST])
+			(void *dst, const void *src, size_t cnt);
+
+void ofi_atomic_reduce_init(void);
+
+/*
+ * Execute an atomic write whose target is not updated concurrently,
+ * because the caller serializes all updates to it.
+ */
+static inline void
+ofi_atomic_write_locked(enum fi_op op, enum fi_datatype datatype,
+			void *dst, const void *src, size_t cnt)
+{
+	if (ofi_atomic_reduce_handlers[op][datatype])
+		ofi_atomic_reduce_handlers[op][datatype](dst, src, cnt);
+	else
+		ofi_atomic_write_handlers[op][datatype](dst, src, cnt);
+}
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2019 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef _OFI_ATOMIC_QUEUE_H_
+#define _OFI_ATOMIC_QUEUE_H_
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <ofi.h>
+#include <ofi_atom.h>
+#include <rdma/fi_errno.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef OFI_CACHE_LINE_SIZE
+#define OFI_CACHE_LINE_SIZE	64
+#endif
+
+/*
+ * Bounded lock-free queue template
+ *
+ * Every slot carries a sequence number.  A slot is free for position pos
+ * when seq == pos, and holds published data for pos when seq == pos + 1.
+ * Producers claim one or more consecutive positions with a CAS on the
+ * write position, fill them in and publish them; readers never block
+ * writers and a stalled writer only delays the entries it has claimed.
+ *
+ * The structure holds no pointers and may be placed in shared memory.
+ * _head()/_release() are for a single consumer; _dequeue() may be used
+ * by any number of consumers.
+ */
+#define OFI_DECLARE_ATOMIC_Q(entrytype, name)				\
+struct name ## _entry {							\
+	ofi_atomic64_t		seq;					\
+	entrytype		buf;					\
+};									\
+									\
+struct name {								\
+	union {								\
+		ofi_atomic64_t	write_pos;				\
+		uint8_t		pad0[OFI_CACHE_LINE_SIZE];		\
+	};								\
+	union {								\
+		ofi_atomic64_t	read_pos;				\
+		uint8_t		pad1[OFI_CACHE_LINE_SIZE];		\
+	};								\
+	int64_t			size;					\
+	int64_t			size_mask;				\
+	struct name ## _entry	entry[];				\
+};									\
+									\
+static inline void name ## _init(struct name *aq, size_t size)		\
+{									\
+	size_t i;							\
+	assert(size == roundup_power_of_two(size));			\
+	aq->size = size;						\
+	aq->size_mask = size - 1;					\
+	ofi_atomic_initialize64(&aq->write_pos, 0);			\
+	ofi_atomic_initialize64(&aq->read_pos, 0);			\
+	for (i = 0; i < size; i++)					\
+		ofi_atomic_initialize64(&aq->entry[i].seq, i);		\
+}									\
+									\
+static inline entrytype *name ## _buf(struct name *aq, int64_t pos)	\
+{									\
+	return &aq->entry[pos & aq->size_mask].buf;			\
+}									\
+									\
+static inline int name ## _next(struct name *aq, int cnt, int64_t *pos)\
+{									\
+	int64_t seq;							\
+	int i;								\
+									\
+	assert(cnt > 0 && cnt <= aq->size);				\
+	for (;;) {							\
+		*pos = ofi_atomic_get64(&aq->write_pos);		\
+		for (i = 0; i < cnt; i++) {				\
+			seq = ofi_atomic_get64(&aq->entry[(*pos + i) &	\
+					       aq->size_mask].seq);	\
+			if (seq != *pos + i)				\
+				break;					\
+		}							\
+		if (i < cnt) {						\
+			if (seq < *pos + i)				\
+				return -FI_EAGAIN;			\
+			continue;					\
+		}							\
+		if (ofi_atomic_cas_bool64(&aq->write_pos, *pos,	\
+					  *pos + cnt))			\
+			return FI_SUCCESS;				\
+	}								\
+}									\
+									\
+static inline void name ## _commit(struct name *aq, int64_t pos,	\
+				   int cnt)				\
+{									\
+	/* publish back to front: a reader that sees the first entry	\
+	 * of a multi-slot claim can consume the rest without waiting */\
+	while (cnt--) {							\
+		ofi_atomic_set64(&aq->entry[(pos + cnt) &		\
+				 aq->size_mask].seq, pos + cnt + 1);	\
+	}								\
+}									\
+									\
+static inline int name ## _isfull(struct name *aq)			\
+{									\
+	return ofi_atomic_get64(&aq->write_pos) -			\
+	       ofi_atomic_get64(&aq->read_pos) >= aq->size;		\
+}									\
+									\
+static inline entrytype *name ## _head(struct name *aq)		\
+{									\
+	struct name ## _entry *ce;					\
+	int64_t pos;							\
+									\
+	pos = ofi_atomic_get64(&aq->read_pos);				\
+	ce = &aq->entry[pos & aq->size_mask];				\
+	if (ofi_atomic_get64(&ce->seq) != pos + 1)			\
+		return NULL;						\
+	return &ce->buf;						\
+}									\
+									\
+static inline void name ## _release(struct name *aq)			\
+{									\
+	int64_t pos;							\
+									\
+	pos = ofi_atomic_get64(&aq->read_pos);				\
+	ofi_atomic_set64(&aq->entry[pos & aq->size_mask].seq,		\
+			 pos + aq->size);				\
+	ofi_atomic_set64(&aq->read_pos, pos + 1);			\
+}									\
+									\
+static inline int name ## _enqueue(struct name *aq, entrytype buf)	\
+{									\
+	int64_t pos;							\
+	int ret;							\
+									\
+	ret = name ## _next(aq, 1, &pos);				\
+	if (ret)							\
+		return ret;						\
+	*name ## _buf(aq, pos) = buf;					\
+	name ## _commit(aq, pos, 1);					\
+	return FI_SUCCESS;						\
+}									\
+									\
+static inline int name ## _dequeue(struct name *aq, entrytype *buf)	\
+{									\
+	struct name ## _entry *ce;					\
+	int64_t pos, seq;						\
+									\
+	for (;;) {							\
+		pos = ofi_atomic_get64(&aq->read_pos);			\
+		ce = &aq->entry[pos & aq->size_mask];			\
+		seq = ofi_atomic_get64(&ce->seq);			\
+		if (seq < pos + 1)					\
+			return -FI_EAGAIN;				\
+		if (seq == pos + 1 &&					\
+		    ofi_atomic_cas_bool64(&aq->read_pos, pos, pos + 1))	\
+			break;						\
+	}								\
+	*buf = ce->buf;							\
+	ofi_atomic_set64(&ce->seq, pos + aq->size);			\
+	return FI_SUCCESS;						\
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OFI_ATOMIC_QUEUE_H_ */
@@ -54,6 +54,7 @@
 enum ofi_hook_class {
 	HOOK_NOOP,
 	HOOK_PERF,
+	HOOK_TRACE,
 	MAX_HOOKS
 };
 
@@ -135,6 +136,7 @@ struct hook_cq {
 	struct fid_cq cq;
 	struct fid_cq *hcq;
 	struct hook_domain *domain;
+	enum fi_cq_format format;
 };
 
 int hook_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
@@ -158,6 +160,7 @@ struct hook_ep {
 	struct fid_ep ep;
 	struct fid_ep *hep;
 	struct hook_domain *domain;
+	void *hook_ctx;		/* owned by the hook class */
 };
 
 int hook_endpoint(struct fid_domain *domain, struct fi_info *info,
@@ -500,4 +500,21 @@ extern uint64_t OFI_RMA_PMEM;
 extern void (*ofi_pmem_commit)(const void *addr, size_t len);
 
 
+/*
+ * Copy engine for data moved by providers between user buffers and
+ * bounce, inject or staging buffers.  See src/mem.c.
+ */
+void ofi_copy_init(void);
+
+extern size_t ofi_copy_large_threshold;
+void *ofi_memcpy_large(void *dst, const void *src, size_t size);
+
+static inline void *ofi_memcpy(void *dst, const void *src, size_t size)
+{
+	if (size < ofi_copy_large_threshold)
+		return memcpy(dst, src, size);
+	return ofi_memcpy_large(dst, src, size);
+}
+
+
 #endif /* _OFI_MEM_H_ */
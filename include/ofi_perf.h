@@ -37,7 +37,10 @@
 
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 #include <ofi_osd.h>
+#include <ofi_lock.h>
+#include <ofi_list.h>
 #include <rdma/providers/fi_prov.h>
 
 
@@ -69,25 +72,41 @@ enum {
 	OFI_PMC_CACHE_L1_INSTR,
 	OFI_PMC_CACHE_TLB_DATA,
 	OFI_PMC_CACHE_TLB_INSTR,
+	OFI_PMC_CACHE_LL,
 };
 
 enum {
-	OFI_PMC_OS_PAGE_FAULT
+	OFI_PMC_OS_PAGE_FAULT,
+	OFI_PMC_OS_CTX_SWITCH,
 };
 
 /* NIC counters TBD */
 
+/*
+ * Counters are opened as one group per thread, so that they are scheduled
+ * on the PMU together and their values can be compared with each other.
+ */
+#define OFI_PERF_MAX_CNTRS	4
+/* Maximum depth of nested start/end calls made by a thread */
+#define OFI_PERF_MAX_DEPTH	8
+
+struct ofi_perf_cntr {
+	enum ofi_perf_domain	domain;
+	uint32_t		cntr_id;
+	uint32_t		flags;
+	const char		*name;
+};
+
 struct ofi_perf_data {
-	uint64_t	start;
-	uint64_t	sum;
+	uint64_t	sum[OFI_PERF_MAX_CNTRS];
 	uint64_t	events;
 };
 
 
 void ofi_perf_init(void);
-extern enum ofi_perf_domain	perf_domain;
-extern uint32_t			perf_cntr;
-extern uint32_t			perf_flags;
+void ofi_perf_fini(void);
+extern struct ofi_perf_cntr	perf_cntrs[OFI_PERF_MAX_CNTRS];
+extern size_t			perf_cntr_cnt;
 
 
 /*
@@ -97,6 +116,10 @@ extern uint32_t			perf_flags;
  * to access a PMU, it should define HAVE_LINUX_PERF_RDPMC and provide
  * implementations for the following functions.  Platforms that do not
  * support PMUs will default to no-op definitions.
+ *
+ * ofi_pmu_open() opens a group of counters that count events of the
+ * calling thread, and ofi_pmu_read() reads the values of all counters in
+ * the group.  Both must be called by the thread being measured.
  */
 
 #if HAVE_LINUX_PERF_RDPMC
@@ -104,8 +127,8 @@ extern uint32_t			perf_flags;
 struct ofi_perf_ctx;
 
 int ofi_pmu_open(struct ofi_perf_ctx **ctx,
-		 enum ofi_perf_domain domain, uint32_t cntr_id, uint32_t flags);
-uint64_t ofi_pmu_read(struct ofi_perf_ctx *ctx);
+		 const struct ofi_perf_cntr *cntrs, size_t cnt);
+void ofi_pmu_read(struct ofi_perf_ctx *ctx, uint64_t *values);
 void ofi_pmu_close(struct ofi_perf_ctx *ctx);
 
 #else /* HAVE_LINUX_PERF_RDPMC */
@@ -115,16 +138,15 @@ struct ofi_perf_ctx {
 };
 
 static inline int ofi_pmu_open(struct ofi_perf_ctx **ctx,
-			       enum ofi_perf_domain domain, uint32_t cntr_id,
-			       uint32_t flags)
+			       const struct ofi_perf_cntr *cntrs, size_t cnt)
 {
 	*ctx = NULL;
 	return 0;
 }
 
-static inline uint64_t ofi_pmu_read(struct ofi_perf_ctx *ctx)
+static inline void ofi_pmu_read(struct ofi_perf_ctx *ctx, uint64_t *values)
 {
-	return 0;
+	memset(values, 0, sizeof(*values) * OFI_PERF_MAX_CNTRS);
 }
 
 static inline void ofi_pmu_close(struct ofi_perf_ctx *ctx)
@@ -133,50 +155,78 @@ static inline void ofi_pmu_close(struct ofi_perf_ctx *ctx)
 #endif /* HAVE_LINUX_PERF_RDPMC */
 
 
-static inline void ofi_perf_reset(struct ofi_perf_data *data)
-{
-	memset(data, 0, sizeof *data);
-}
+/*
+ * Per thread state: the counter group of the thread, and the values read
+ * at the start of each measurement that is in progress.  Measurements may
+ * be nested, e.g. when a hook and the provider below it both take them.
+ */
+struct ofi_perf_thread {
+	struct dlist_entry	entry;
+	struct ofi_perf_ctx	*ctx;
+	int			err;
+	size_t			depth;
+	uint64_t		start[OFI_PERF_MAX_DEPTH][OFI_PERF_MAX_CNTRS];
+};
 
-static inline void ofi_perf_start(struct ofi_perf_ctx *ctx,
-				  struct ofi_perf_data *data)
-{
-	data->start = ofi_pmu_read(ctx);
-}
+extern pthread_key_t ofi_perf_key;
+struct ofi_perf_thread *ofi_perf_thread_init(void);
 
-static inline void ofi_perf_end(struct ofi_perf_ctx *ctx,
-				struct ofi_perf_data *data)
+static inline struct ofi_perf_thread *ofi_perf_thread(void)
 {
-	data->sum += ofi_pmu_read(ctx) - data->start;
-	data->events++;
+	struct ofi_perf_thread *thread;
+
+	thread = pthread_getspecific(ofi_perf_key);
+	return thread ? thread : ofi_perf_thread_init();
 }
 
 
 struct ofi_perfset {
 	const struct fi_provider *prov;
 	size_t			size;
-	struct ofi_perf_ctx	*ctx;
+	fastlock_t		lock;
 	struct ofi_perf_data	*data;
 };
 
 int ofi_perfset_create(const struct fi_provider *prov,
-		       struct ofi_perfset *set, size_t size,
-		       enum ofi_perf_domain domain, uint32_t cntr_id,
-		       uint32_t flags);
+		       struct ofi_perfset *set, size_t size);
 void ofi_perfset_close(struct ofi_perfset *set);
+void ofi_perfset_add(struct ofi_perfset *dst, struct ofi_perfset *src);
 
 void ofi_perfset_log(struct ofi_perfset *set, const char **names);
 
 static inline void ofi_perfset_start(struct ofi_perfset *set, size_t index)
 {
+	struct ofi_perf_thread *thread = ofi_perf_thread();
+
 	assert(index < set->size);
-	ofi_perf_start(set->ctx, &set->data[index]);
+	if (!thread || thread->err)
+		return;
+
+	if (thread->depth < OFI_PERF_MAX_DEPTH)
+		ofi_pmu_read(thread->ctx, thread->start[thread->depth]);
+	thread->depth++;
 }
 
 static inline void ofi_perfset_end(struct ofi_perfset *set, size_t index)
 {
+	struct ofi_perf_thread *thread = ofi_perf_thread();
+	uint64_t end[OFI_PERF_MAX_CNTRS];
+	size_t i;
+
 	assert(index < set->size);
-	ofi_perf_end(set->ctx, &set->data[index]);
+	if (!thread || thread->err || !thread->depth)
+		return;
+
+	if (--thread->depth >= OFI_PERF_MAX_DEPTH)
+		return;
+
+	ofi_pmu_read(thread->ctx, end);
+	fastlock_acquire(&set->lock);
+	for (i = 0; i < perf_cntr_cnt; i++)
+		set->data[index].sum[i] += end[i] -
+					   thread->start[thread->depth][i];
+	set->data[index].events++;
+	fastlock_release(&set->lock);
 }
 
 
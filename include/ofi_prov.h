@@ -247,6 +247,10 @@ PERF_HOOK_INI ;
 #  define PERF_HOOK_INIT NULL
 #endif
 
+#  define TRACE_HOOK_INI INI_SIG(fi_trace_hook_ini)
+#  define TRACE_HOOK_INIT fi_trace_hook_ini()
+TRACE_HOOK_INI ;
+
 #  define NOOP_HOOK_INI INI_SIG(fi_noop_hook_ini)
 #  define NOOP_HOOK_INIT fi_noop_hook_ini()
 NOOP_HOOK_INI ;
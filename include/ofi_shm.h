@@ -39,6 +39,8 @@
 #include <stddef.h>
 
 #include <ofi_atom.h>
+#include <ofi_atomic_queue.h>
+#include <ofi_indexer.h>
 #include <ofi_proto.h>
 #include <ofi_mem.h>
 #include <ofi_rbuf.h>
@@ -50,7 +52,7 @@ extern "C" {
 #endif
 
 
-#define SMR_VERSION	1
+#define SMR_VERSION	10
 
 #ifdef HAVE_ATOMICS
 #define SMR_FLAG_ATOMIC	(1 << 0)
@@ -74,11 +76,19 @@ enum {
 	smr_src_iov,	/* reference iovec via CMA */
 };
 
+/* SMR-internal cmd ops, following the generic ofi_op_* opcodes */
+enum {
+	smr_op_fbox = ofi_op_max, /* sender moves to fastbox hdr.data */
+	smr_op_fbox_detach,	  /* sender leaves fastbox hdr.data */
+	smr_op_fbox_release,	  /* sender gives fastbox hdr.data back */
+};
+
 #define SMR_REMOTE_CQ_DATA	(1 << 0)
 #define SMR_RMA_REQ		(1 << 1)
 #define SMR_TX_COMPLETION	(1 << 2)
 #define SMR_RX_COMPLETION	(1 << 3)
 #define SMR_MULTI_RECV		(1 << 4)
+#define SMR_HEAP_IOV		(1 << 5) /* iov in a heap segment, see smr_resp */
 
 /* 
  * Unique smr_op_hdr for smr message protocol:
@@ -160,46 +170,120 @@ struct smr_region;
 struct smr_peer {
 	struct smr_addr		peer;
 	struct smr_region	*region;
+	bool			no_cma;	/* CMA to this peer has failed */
+	bool			no_heap; /* peer's heap cannot be mapped */
 };
 
-#define SMR_MAX_PEERS	256
+/* Peers are indexed by AV index; bounded by the index map only */
+#define SMR_MAX_PEERS	(OFI_IDX_MAX_INDEX + 1)
 
+/*
+ * Peer entries are allocated as addresses are inserted.  A peer's region
+ * is mapped on first use, not at insert time.
+ */
 struct smr_map {
-	fastlock_t	lock;
-	struct smr_peer	peers[SMR_MAX_PEERS];
+	fastlock_t		lock;
+	int			max_peers;
+	struct index_map	peers;
 };
 
+/*
+ * Fastboxes are small cmd queues in the receiver's region, each owned by
+ * one sender, which keep that sender off the shared cmd queue and out of
+ * contention with other senders.  A sender claims one on first use by
+ * entering its peer id in the receiver's map, plus one, in fbox_owner, and
+ * announces it with an smr_op_fbox cmd through the shared queue; its later
+ * cmds go through the fastbox, which the receiver only polls after seeing
+ * the announcement, so they stay in order.  When its fastbox is full, the
+ * sender detaches with an smr_op_fbox_detach cmd and overflows into the
+ * shared queue; the receiver drains the fastbox when it reaches that cmd
+ * and clears the sender's bit in fbox_detached, after which the sender may
+ * announce the fastbox again.  A sender that removes the receiver or
+ * closes marks its fastbox SMR_FBOX_RELEASING, which keeps other senders
+ * from claiming it, and gives it back with an smr_op_fbox_release cmd; the
+ * receiver frees it once drained, before any cmd the sender posts later.
+ * Senders that find the pool used up stay on the shared queue.  Cmds take
+ * credits from the receiver either way.
+ */
+#define SMR_FBOX_COUNT		32
+#define SMR_FBOX_SIZE		64
+#define SMR_FBOX_RELEASING	-1
+
 struct smr_region {
 	uint8_t		version;
 	uint8_t		resv;
 	uint16_t	flags;
 	int		pid;
-	fastlock_t	lock; /* lock for shm access
-				 Must hold smr->lock before tx/rx cq locks
-				 in order to progress or post recv */
+	fastlock_t	lock; /* serializes local progress of this region;
+				 peers never take it.  Must hold smr->lock
+				 before tx/rx cq locks in order to progress */
 	struct smr_map	*map;
 
 	size_t		total_size;
-	size_t		cmd_cnt; /* Doubles as a tracker for number of cmds AND
-				    number of inject buffers available for use,
+	int		max_peers;
+	int		name_index_size;
+	ofi_atomic64_t	cmd_cnt; /* Credits for cmds AND inject buffers,
 				    to ensure 1:1 ratio of cmds to inject bufs.
+				    Senders take credits before claiming queue
+				    entries; credits are returned after the
+				    entry (and any inject buf) has been freed.
 				    Might not always be paired consistently with
 				    cmd alloc/free depending on protocol
 				    (Ex. unexpected messages, RMA requests) */
+	int32_t		signal;	/* doorbell; futex word bumped by peers with
+				   __atomic builtins */
+	ofi_atomic32_t	waiters; /* local threads asleep on the doorbell */
+	ofi_atomic32_t	fbox_owner[SMR_FBOX_COUNT]; /* sender peer id + 1,
+						       0 if free */
+	ofi_atomic32_t	fbox_detached; /* fastboxes left but not yet drained */
+	ofi_atomic32_t	mr_export_cnt; /* slots of the MR export table that
+					  may be in use */
 
 	/* offsets from start of smr_region */
 	size_t		cmd_queue_offset;
 	size_t		resp_queue_offset;
+	size_t		inject_queue_offset;
 	size_t		inject_pool_offset;
+	size_t		sar_pool_offset;
+	size_t		fbox_pool_offset;
+	size_t		mr_export_offset;
 	size_t		peer_addr_offset;
+	size_t		name_index_offset;
 	size_t		name_offset;
 };
 
+/* resp status while the target stages data through a SAR buffer;
+ * distinct from FI_EBUSY and any final (errno) status */
+#define SMR_STATUS_SAR	(1ULL << 32)
+
 struct smr_resp {
 	uint64_t	msg_id;
 	uint64_t	status;
+	uint64_t	sar_offset;	/* SAR buffer in the target's region */
+	uint64_t	sar_start;	/* buffer position the transfer starts at */
+
+	/* initiator's heap segment holding the iov, with SMR_HEAP_IOV */
+	uint64_t	heap_id;
+	uint64_t	heap_base;
+	uint64_t	heap_len;
+	int		heap_fd;
 };
 
+/*
+ * The target publishes a resp by setting its status last, after the data
+ * and the other resp fields it hands to the initiator; the initiator reads
+ * the status first.  Status accesses pair as release and acquire.
+ */
+static inline void smr_resp_set_status(struct smr_resp *resp, uint64_t status)
+{
+	__atomic_store_n(&resp->status, status, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t smr_resp_status(struct smr_resp *resp)
+{
+	return __atomic_load_n(&resp->status, __ATOMIC_ACQUIRE);
+}
+
 struct smr_inject_buf {
 	union {
 		uint8_t		data[SMR_INJECT_SIZE];
@@ -210,13 +294,76 @@ struct smr_inject_buf {
 	};
 };
 
-OFI_DECLARE_CIRQUE(struct smr_cmd, smr_cmd_queue);
-OFI_DECLARE_CIRQUE(struct smr_resp, smr_resp_queue);
-DECLARE_SMR_FREESTACK(struct smr_inject_buf, smr_inject_pool);
+/*
+ * Segmentation and reassembly (SAR) buffers are used for smr_src_iov
+ * transfers when the target cannot reach the initiator's memory through
+ * CMA.  The target assigns one of its buffers to the transfer and both
+ * sides then pipeline the data through it in chunks: one side copies in
+ * and advances produced, the other copies out and advances consumed.
+ * Positions only grow, so a transfer is identified by the position at
+ * which it started.
+ */
+#define SMR_SAR_COUNT		8
+#define SMR_SAR_SIZE		(1 << 18)
+#define SMR_SAR_CHUNK_SIZE	(SMR_SAR_SIZE / 4)
+
+struct smr_sar_buf {
+	union {
+		ofi_atomic64_t	produced;
+		uint8_t		pad0[OFI_CACHE_LINE_SIZE];
+	};
+	union {
+		ofi_atomic64_t	consumed;
+		uint8_t		pad1[OFI_CACHE_LINE_SIZE];
+	};
+	uint8_t			buf[SMR_SAR_SIZE];
+};
+
+OFI_DECLARE_ATOMIC_Q(struct smr_cmd, smr_cmd_queue);
+OFI_DECLARE_ATOMIC_Q(struct smr_resp, smr_resp_queue);
+OFI_DECLARE_ATOMIC_Q(uint64_t, smr_inject_queue);
+
+#define SMR_FBOX_BYTES							\
+	ofi_get_aligned_size(sizeof(struct smr_cmd_queue) +		\
+			     sizeof(struct smr_cmd_queue_entry) *	\
+			     SMR_FBOX_SIZE, OFI_CACHE_LINE_SIZE)
+
+/*
+ * Registrations of memory in the owner's heap segments (fi_ext_shm.h)
+ * that peers may target with atomics directly, without going through the
+ * owner's progress.  An entry describes the registration as
+ * ofi_mr_map_verify() would check it, and the segment holding it.  The
+ * owner updates entries under a sequence count, odd while an update is in
+ * progress; peers retry reads that overlap an update.  Unused entries have
+ * a len of 0.
+ */
+#define SMR_MR_EXPORT_COUNT	64
+
+struct smr_mr_export {
+	ofi_atomic32_t	seq;
+	int		heap_fd;
+	uint64_t	key;
+	uint64_t	base;
+	uint64_t	len;
+	uint64_t	offset;
+	uint64_t	access;
+	uint64_t	heap_id;
+	uint64_t	heap_base;
+	uint64_t	heap_len;
+};
+
+static inline struct smr_peer *smr_map_peer(struct smr_map *map, int id)
+{
+	if (id < 0 || id >= map->max_peers)
+		return NULL;
 
+	return ofi_idm_lookup(&map->peers, id);
+}
 static inline struct smr_region *smr_peer_region(struct smr_region *smr, int i)
 {
-	return smr->map->peers[i].region;
+	struct smr_peer *peer = smr_map_peer(smr->map, i);
+
+	return peer ? peer->region : NULL;
 }
 static inline struct smr_cmd_queue *smr_cmd_queue(struct smr_region *smr)
 {
@@ -226,14 +373,37 @@ static inline struct smr_resp_queue *smr_resp_queue(struct smr_region *smr)
 {
 	return (struct smr_resp_queue *) ((char *) smr + smr->resp_queue_offset);
 }
-static inline struct smr_inject_pool *smr_inject_pool(struct smr_region *smr)
+static inline struct smr_inject_queue *smr_inject_queue(struct smr_region *smr)
+{
+	return (struct smr_inject_queue *) ((char *) smr + smr->inject_queue_offset);
+}
+static inline struct smr_inject_buf *smr_inject_pool(struct smr_region *smr)
+{
+	return (struct smr_inject_buf *) ((char *) smr + smr->inject_pool_offset);
+}
+static inline struct smr_sar_buf *smr_sar_pool(struct smr_region *smr)
+{
+	return (struct smr_sar_buf *) ((char *) smr + smr->sar_pool_offset);
+}
+static inline struct smr_cmd_queue *smr_fbox(struct smr_region *smr, int i)
 {
-	return (struct smr_inject_pool *) ((char *) smr + smr->inject_pool_offset);
+	return (struct smr_cmd_queue *) ((char *) smr + smr->fbox_pool_offset +
+					 SMR_FBOX_BYTES * i);
+}
+static inline struct smr_mr_export *smr_mr_export(struct smr_region *smr)
+{
+	return (struct smr_mr_export *) ((char *) smr + smr->mr_export_offset);
 }
 static inline struct smr_addr *smr_peer_addr(struct smr_region *smr)
 {
 	return (struct smr_addr *) ((char *) smr + smr->peer_addr_offset); 
 }
+/* Open-addressed hash of peer names: 0 is empty, -1 a deleted entry,
+ * otherwise the index into the peer address table plus one. */
+static inline int32_t *smr_name_index(struct smr_region *smr)
+{
+	return (int32_t *) ((char *) smr + smr->name_index_offset);
+}
 static inline const char *smr_name(struct smr_region *smr)
 {
 	return (const char *) smr + smr->name_offset;
@@ -244,16 +414,60 @@ static inline void smr_set_map(struct smr_region *smr, struct smr_map *map)
 	smr->map = map;
 }
 
+static inline bool smr_get_cmd_credit(struct smr_region *smr, int cnt)
+{
+	int64_t avail;
+
+	do {
+		avail = ofi_atomic_get64(&smr->cmd_cnt);
+		if (avail < cnt)
+			return false;
+	} while (!ofi_atomic_cas_bool64(&smr->cmd_cnt, avail, avail - cnt));
+
+	return true;
+}
+
+static inline void smr_put_cmd_credit(struct smr_region *smr, int cnt)
+{
+	ofi_atomic_add64(&smr->cmd_cnt, cnt);
+}
+
+/* Holding a credit guarantees a free inject buffer, but the pop can still
+ * miss one that another process is in the middle of returning.
+ */
+static inline struct smr_inject_buf *smr_get_inject_buf(struct smr_region *smr)
+{
+	uint64_t index;
+
+	if (smr_inject_queue_dequeue(smr_inject_queue(smr), &index))
+		return NULL;
+
+	return &smr_inject_pool(smr)[index];
+}
+
+static inline void smr_put_inject_buf(struct smr_region *smr,
+				      struct smr_inject_buf *buf)
+{
+	uint64_t index = buf - smr_inject_pool(smr);
+
+	/* cannot overflow; only waits out a concurrent dequeue of the slot */
+	while (smr_inject_queue_enqueue(smr_inject_queue(smr), index))
+		;
+}
+
+#define SMR_ATTR_HUGEPAGES	(1 << 0)
+
 struct smr_attr {
 	const char	*name;
 	size_t		rx_count;
 	size_t		tx_count;
+	uint64_t	flags;
 };
 
 int	smr_map_create(const struct fi_provider *prov, int peer_count,
 		       struct smr_map **map);
 int	smr_map_to_region(const struct fi_provider *prov,
-			  struct smr_peer *peer_buf);
+			  struct smr_map *map, int id);
 void	smr_map_to_endpoint(struct smr_region *region, int index);
 void	smr_unmap_from_endpoint(struct smr_region *region, int index);
 void	smr_exchange_all_peers(struct smr_region *region);
@@ -262,8 +476,6 @@ int	smr_map_add(const struct fi_provider *prov,
 void	smr_map_del(struct smr_map *map, int id);
 void	smr_map_free(struct smr_map *map);
 
-struct smr_region *smr_map_get(struct smr_map *map, int id);
-
 int	smr_create(const struct fi_provider *prov, struct smr_map *map,
 		   const struct smr_attr *attr, struct smr_region **smr);
 void	smr_free(struct smr_region *smr);
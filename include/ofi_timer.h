@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _OFI_TIMER_H_
+#define _OFI_TIMER_H_
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <ofi_list.h>
+
+/*
+ * Timer wheel:
+ * A hierarchical timer wheel holds timers that expire at a given tick.
+ * Starting, stopping and expiring a timer cost O(1), independent of the
+ * number of timers, and advancing the wheel only visits slots that may
+ * hold expired timers.  Level 0 has one slot per tick; each higher level
+ * has one slot per revolution of the level below.  Timers are moved down
+ * a level as their slot comes due, and timers beyond the range of the
+ * wheel wait in the last slot of the top level.
+ *
+ * The unit of a tick is left to the user, who passes in the current
+ * time in ticks.  Callbacks run from ofi_timer_wheel_run() and may
+ * start or stop any timer, including their own.  Synchronization must
+ * be provided by the caller.
+ */
+
+#define OFI_TIMER_BITS		6
+#define OFI_TIMER_SLOTS		(1 << OFI_TIMER_BITS)
+#define OFI_TIMER_LEVELS	4
+#define OFI_TIMER_NONE		UINT64_MAX
+
+struct ofi_timer_wheel;
+struct ofi_timer;
+
+typedef void (*ofi_timer_cb)(struct ofi_timer_wheel *wheel,
+			     struct ofi_timer *timer);
+
+struct ofi_timer {
+	struct dlist_entry	entry;
+	uint64_t		expires;
+	int			level;
+	ofi_timer_cb		cb;
+};
+
+struct ofi_timer_wheel {
+	/* first tick not yet processed */
+	uint64_t		now;
+	size_t			cnt;
+	size_t			level_cnt[OFI_TIMER_LEVELS];
+	struct dlist_entry	slots[OFI_TIMER_LEVELS][OFI_TIMER_SLOTS];
+};
+
+void ofi_timer_wheel_init(struct ofi_timer_wheel *wheel, uint64_t now);
+int ofi_timer_wheel_run(struct ofi_timer_wheel *wheel, uint64_t now);
+uint64_t ofi_timer_wheel_next(struct ofi_timer_wheel *wheel);
+
+void ofi_timer_start(struct ofi_timer_wheel *wheel, struct ofi_timer *timer,
+		     uint64_t expires);
+void ofi_timer_stop(struct ofi_timer_wheel *wheel, struct ofi_timer *timer);
+
+static inline void ofi_timer_init(struct ofi_timer *timer, ofi_timer_cb cb)
+{
+	dlist_init(&timer->entry);
+	timer->cb = cb;
+}
+
+static inline int ofi_timer_pending(struct ofi_timer *timer)
+{
+	return !dlist_empty(&timer->entry);
+}
+
+/* Start the timer unless it is pending to expire no later */
+static inline void ofi_timer_start_before(struct ofi_timer_wheel *wheel,
+					  struct ofi_timer *timer,
+					  uint64_t expires)
+{
+	if (!ofi_timer_pending(timer) || expires < timer->expires)
+		ofi_timer_start(wheel, timer, expires);
+}
+
+#endif /* _OFI_TIMER_H_ */
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _OFI_TRACE_H_
+#define _OFI_TRACE_H_
+
+#include <stdint.h>
+
+#include "ofi.h"
+
+/*
+ * Call trace file format:
+ * The trace hook writes one file per fabric, made of a header followed
+ * by fixed size records in the order the calls were made.  Data transfer
+ * calls are recorded when they are accepted or fail with an error other
+ * than -FI_EAGAIN.  A completion record is written for every completion
+ * read from a CQ, referring back to the record of the operation that it
+ * completes.  Values are stored in host byte order.
+ */
+
+#define OFI_TRACE_MAGIC		"OFITRACE"
+#define OFI_TRACE_VERSION	1
+
+#define OFI_TRACE_FOREACH(DECL)		\
+	DECL(OFI_TRACE_RECV),		\
+	DECL(OFI_TRACE_RECVV),		\
+	DECL(OFI_TRACE_RECVMSG),	\
+	DECL(OFI_TRACE_SEND),		\
+	DECL(OFI_TRACE_SENDV),		\
+	DECL(OFI_TRACE_SENDMSG),	\
+	DECL(OFI_TRACE_INJECT),		\
+	DECL(OFI_TRACE_SENDDATA),	\
+	DECL(OFI_TRACE_INJECTDATA),	\
+	DECL(OFI_TRACE_READ),		\
+	DECL(OFI_TRACE_READV),		\
+	DECL(OFI_TRACE_READMSG),	\
+	DECL(OFI_TRACE_WRITE),		\
+	DECL(OFI_TRACE_WRITEV),		\
+	DECL(OFI_TRACE_WRITEMSG),	\
+	DECL(OFI_TRACE_INJECT_WRITE),	\
+	DECL(OFI_TRACE_WRITEDATA),	\
+	DECL(OFI_TRACE_INJECT_WRITEDATA), \
+	DECL(OFI_TRACE_TRECV),		\
+	DECL(OFI_TRACE_TRECVV),		\
+	DECL(OFI_TRACE_TRECVMSG),	\
+	DECL(OFI_TRACE_TSEND),		\
+	DECL(OFI_TRACE_TSENDV),		\
+	DECL(OFI_TRACE_TSENDMSG),	\
+	DECL(OFI_TRACE_TINJECT),	\
+	DECL(OFI_TRACE_TSENDDATA),	\
+	DECL(OFI_TRACE_TINJECTDATA),	\
+	DECL(OFI_TRACE_COMP),		\
+	DECL(OFI_TRACE_COMP_ERR),	\
+	DECL(OFI_TRACE_CNTR_ADD),	\
+	DECL(OFI_TRACE_CNTR_SET),	\
+	DECL(OFI_TRACE_CNTR_ADDERR),	\
+	DECL(OFI_TRACE_CNTR_SETERR),	\
+	DECL(OFI_TRACE_CNTR_WAIT),	\
+	DECL(OFI_TRACE_OP_MAX)
+
+enum ofi_trace_op {
+	OFI_TRACE_FOREACH(OFI_ENUM_VAL)
+};
+
+struct ofi_trace_hdr {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		rec_size;
+	/* wall clock time of the start of the trace, in us */
+	uint64_t		start;
+	char			prov_name[64];
+};
+
+/*
+ * addr holds the fi_addr_t of a transfer, and the index of the record
+ * of the completed operation in a completion (UINT64_MAX if unknown).
+ * value holds the number of completions read before a transfer was
+ * posted, the latency of a completion in ns, or the value of a counter
+ * call.  data holds remote CQ data, or the ignore mask of a tagged
+ * receive.
+ */
+struct ofi_trace_rec {
+	uint64_t		time;	/* ns since the start of the trace */
+	uint64_t		len;
+	uint64_t		addr;
+	uint64_t		tag;
+	uint64_t		flags;
+	uint64_t		data;
+	uint64_t		value;
+	uint32_t		duration;	/* ns spent in the call */
+	int16_t			ret;
+	uint8_t			op;
+	uint8_t			count;		/* number of iovs */
+};
+
+static inline int ofi_trace_is_recv(int op)
+{
+	return (op >= OFI_TRACE_RECV && op <= OFI_TRACE_RECVMSG) ||
+	       (op >= OFI_TRACE_TRECV && op <= OFI_TRACE_TRECVMSG);
+}
+
+static inline int ofi_trace_is_tagged(int op)
+{
+	return op >= OFI_TRACE_TRECV && op <= OFI_TRACE_TINJECTDATA;
+}
+
+static inline int ofi_trace_is_rma(int op)
+{
+	return op >= OFI_TRACE_READ && op <= OFI_TRACE_INJECT_WRITEDATA;
+}
+
+static inline int ofi_trace_is_xfer(int op)
+{
+	return op < OFI_TRACE_COMP;
+}
+
+#endif /* _OFI_TRACE_H_ */
@@ -64,6 +64,7 @@
 #include <ofi_indexer.h>
 #include <ofi_epoll.h>
 #include <ofi_proto.h>
+#include <ofi_atomic_queue.h>
 
 #include "rbtree.h"
 #include "uthash.h"
@@ -196,12 +197,66 @@ struct util_domain {
 	struct ofi_mr_map	mr_map;
 	enum fi_threading	threading;
 	enum fi_progress	data_progress;
+
+	/* deferred work: counters with queued work, and issued work */
+	fastlock_t		work_lock;
+	struct dlist_entry	work_cntr_list;
+	struct ofi_rbmap	work_map;
+	ofi_atomic32_t		work_active;
+	uint64_t		work_seq;
 };
 
 int ofi_domain_init(struct fid_fabric *fabric_fid, const struct fi_info *info,
 		     struct util_domain *domain, void *context);
 int ofi_domain_bind_eq(struct util_domain *domain, struct util_eq *eq);
 int ofi_domain_close(struct util_domain *domain);
+int ofi_domain_control(struct fid *fid, int command, void *arg);
+
+struct util_cntr;
+
+/*
+ * Deferred work:
+ * Work queued through fi_control(FI_QUEUE_WORK) is copied and kept in a
+ * min-heap on its triggering counter, ordered by threshold and then by
+ * submission.  Ready work is issued through the regular data transfer
+ * calls from the progress calls made by the application, using the copy
+ * as the operation context.  Completions of issued work are taken out of
+ * the CQ and counted on the completion counter instead, unless requested
+ * with FI_COMPLETION.  Data transfers therefore require the endpoint to
+ * have a CQ for their direction.  The endpoint's own counters are updated
+ * as for any transfer, and a completion counter that is also the
+ * endpoint's counter for the operation is only updated once.
+ */
+int ofi_queue_work(struct util_domain *domain, struct fi_deferred_work *work);
+int ofi_cancel_work(struct util_domain *domain, struct fi_deferred_work *work);
+int ofi_flush_work(struct util_domain *domain, struct util_cntr *cntr);
+void ofi_run_work(struct util_domain *domain);
+int ofi_complete_work(struct util_domain *domain, void **context, int err);
+
+int ofi_trigger_msg(struct fid_ep *ep, const struct fi_msg *msg,
+		    uint64_t flags, enum fi_op_type op_type);
+int ofi_trigger_tagged(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		       uint64_t flags, enum fi_op_type op_type);
+int ofi_trigger_rma(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		    uint64_t flags, enum fi_op_type op_type);
+int ofi_trigger_atomic(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       uint64_t flags);
+int ofi_trigger_fetch_atomic(struct fid_ep *ep,
+			     const struct fi_msg_atomic *msg,
+			     struct fi_ioc *resultv, void **result_desc,
+			     size_t result_count, uint64_t flags);
+int ofi_trigger_compare_atomic(struct fid_ep *ep,
+			       const struct fi_msg_atomic *msg,
+			       const struct fi_ioc *comparev,
+			       void **compare_desc, size_t compare_count,
+			       struct fi_ioc *resultv, void **result_desc,
+			       size_t result_count, uint64_t flags);
+
+static inline void ofi_progress_work(struct util_domain *domain)
+{
+	if (OFI_UNLIKELY(!dlist_empty(&domain->work_cntr_list)))
+		ofi_run_work(domain);
+}
 
 static const uint64_t ofi_rx_mr_flags[] = {
 	[ofi_op_msg] = FI_RECV,
@@ -286,6 +341,8 @@ struct util_ep {
 	fastlock_t		lock;
 	ofi_fastlock_acquire_t	lock_acquire;
 	ofi_fastlock_release_t	lock_release;
+	/* FI_ALIAS endpoints still open */
+	ofi_atomic32_t		ref;
 };
 
 int ofi_ep_bind_av(struct util_ep *util_ep, struct util_av *av);
@@ -298,6 +355,8 @@ int ofi_endpoint_init(struct fid_domain *domain, const struct util_prov *util_pr
 		      ofi_ep_progress_func progress);
 
 int ofi_endpoint_close(struct util_ep *util_ep);
+int ofi_ep_alias(struct util_ep *ep, struct fi_alias *alias);
+struct util_ep *ofi_ep_unalias(struct fid_ep *ep_fid);
 
 static inline int
 ofi_ep_fid_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
@@ -510,10 +569,26 @@ ofi_cq_write_comp_entry(struct util_cq *cq, void *context, uint64_t flags,
 	ofi_cirque_commit(cq->cirq);
 }
 
+/*
+ * Returns true if the completion is that of deferred work and should not be
+ * reported.  Otherwise, the context of reported deferred work is replaced
+ * by the application's.
+ */
+static inline int ofi_cq_complete_work(struct util_cq *cq, void **context,
+				       int err)
+{
+	if (OFI_LIKELY(!ofi_atomic_get32(&cq->domain->work_active)))
+		return 0;
+	return ofi_complete_work(cq->domain, context, err);
+}
+
 static inline int
 ofi_cq_write_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags,
 			   size_t len, void *buf, uint64_t data, uint64_t tag)
 {
+	if (OFI_UNLIKELY(ofi_cq_complete_work(cq, &context, 0)))
+		return 0;
+
 	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
@@ -539,6 +614,9 @@ static inline int
 ofi_cq_write_src_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 			       void *buf, uint64_t data, uint64_t tag, fi_addr_t src)
 {
+	if (OFI_UNLIKELY(ofi_cq_complete_work(cq, &context, 0)))
+		return 0;
+
 	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
@@ -594,6 +672,29 @@ static inline uint64_t ofi_tx_cq_flags(uint32_t op)
  */
 typedef void (*ofi_cntr_progress_func)(struct util_cntr *cntr);
 
+struct util_work;
+
+struct util_trigger {
+	uint64_t		threshold;
+	uint64_t		seq;
+	struct util_work	*work;
+};
+
+/*
+ * Striped counters:
+ * With FI_CNTR_STRIPES set, every counter spreads its increments across
+ * that many cells, each on its own cache line, so that threads completing
+ * operations concurrently do not contend for a single line.  Threads are
+ * assigned cells round robin when they first update a counter.  The value
+ * of a counter is cnt plus the sum of its cells.  Since cells only grow,
+ * a read never returns more than the counter has reached, and a threshold
+ * seen as reached remains so.  Errors are rare and are not striped.
+ */
+union util_cntr_cell {
+	ofi_atomic64_t		cnt;
+	uint8_t			pad[OFI_CACHE_LINE_SIZE];
+};
+
 struct util_cntr {
 	struct fid_cntr		cntr_fid;
 	struct util_domain	*domain;
@@ -602,6 +703,8 @@ struct util_cntr {
 
 	ofi_atomic64_t		cnt;
 	ofi_atomic64_t		err;
+	union util_cntr_cell	*cells;
+	size_t			cell_mask;
 
 	uint64_t		checkpoint_cnt;
 	uint64_t		checkpoint_err;
@@ -611,6 +714,12 @@ struct util_cntr {
 
 	int			internal_wait;
 	ofi_cntr_progress_func	progress;
+
+	/* deferred work heap, protected by domain->work_lock */
+	struct util_trigger	*work_heap;
+	size_t			work_cnt;
+	size_t			work_size;
+	struct dlist_entry	work_entry;
 };
 
 void ofi_cntr_progress(struct util_cntr *cntr);
@@ -618,12 +727,53 @@ int ofi_cntr_init(const struct fi_provider *prov, struct fid_domain *domain,
 		  struct fi_cntr_attr *attr, struct util_cntr *cntr,
 		  ofi_cntr_progress_func progress, void *context);
 int ofi_cntr_cleanup(struct util_cntr *cntr);
+uint64_t ofi_cntr_read(struct fid_cntr *cntr_fid);
+uint64_t ofi_cntr_readerr(struct fid_cntr *cntr_fid);
+int ofi_cntr_add(struct fid_cntr *cntr_fid, uint64_t value);
+int ofi_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value);
+int ofi_cntr_set(struct fid_cntr *cntr_fid, uint64_t value);
+int ofi_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value);
 static inline void util_cntr_signal(struct util_cntr *cntr)
 {
 	assert(cntr->wait);
 	cntr->wait->signal(cntr->wait);
 }
 
+extern size_t ofi_cntr_stripes;
+extern pthread_key_t ofi_cntr_key;
+void ofi_cntr_stripe_init(void);
+void ofi_cntr_stripe_fini(void);
+uintptr_t ofi_cntr_thread_init(void);
+
+static inline uint64_t ofi_cntr_value(struct util_cntr *cntr)
+{
+	uint64_t value;
+	size_t i;
+
+	value = ofi_atomic_get64(&cntr->cnt);
+	if (cntr->cells) {
+		for (i = 0; i <= cntr->cell_mask; i++)
+			value += ofi_atomic_get64(&cntr->cells[i].cnt);
+	}
+	return value;
+}
+
+/* Count completions without signaling the wait object */
+static inline void ofi_cntr_add_value(struct util_cntr *cntr, uint64_t value)
+{
+	uintptr_t id;
+
+	if (!cntr->cells) {
+		ofi_atomic_add64(&cntr->cnt, value);
+		return;
+	}
+
+	id = (uintptr_t) pthread_getspecific(ofi_cntr_key);
+	if (OFI_UNLIKELY(!id))
+		id = ofi_cntr_thread_init();
+	ofi_atomic_add64(&cntr->cells[id & cntr->cell_mask].cnt, value);
+}
+
 static inline void ofi_cntr_inc_noop(struct util_cntr *cntr)
 {
 	OFI_UNUSED(cntr);
@@ -285,9 +285,12 @@ OFI_DEF_COMPLEX_OPS(long_double)
 #ifdef HAVE_BUILTIN_ATOMICS
 #define ofi_atomic_add_and_fetch(radix, ptr, val) __sync_add_and_fetch((ptr), (val))
 #define ofi_atomic_sub_and_fetch(radix, ptr, val) __sync_sub_and_fetch((ptr), (val))
+#define ofi_atomic_cas_bool(radix, ptr, expected, desired)	\
+	__sync_bool_compare_and_swap((ptr), (expected), (desired))
 #endif /* HAVE_BUILTIN_ATOMICS */
 
 int ofi_set_thread_affinity(const char *s);
+int ofi_getrandom(void *buf, size_t len);
 
 
 #if defined(HAVE_CPUID) && (defined(__x86_64__) || defined(__amd64__))
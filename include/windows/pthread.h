@@ -129,6 +129,30 @@ static inline int pthread_cancel(pthread_t thread)
 	return ENOSYS;
 }
 
+typedef DWORD pthread_key_t;
+
+static inline int pthread_key_create(pthread_key_t *key,
+				     void (*destructor)(void *))
+{
+	*key = FlsAlloc((PFLS_CALLBACK_FUNCTION) destructor);
+	return *key == FLS_OUT_OF_INDEXES ? ENOMEM : 0;
+}
+
+static inline int pthread_key_delete(pthread_key_t key)
+{
+	return FlsFree(key) ? 0 : EINVAL;
+}
+
+static inline void *pthread_getspecific(pthread_key_t key)
+{
+	return FlsGetValue(key);
+}
+
+static inline int pthread_setspecific(pthread_key_t key, const void *value)
+{
+	return FlsSetValue(key, (void *) value) ? 0 : EINVAL;
+}
+
 static inline pthread_t pthread_self(void)
 {
 	/*
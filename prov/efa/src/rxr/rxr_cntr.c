@@ -52,7 +52,7 @@ static int rxr_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 
 	for (tryid = 0; tryid < numtry; ++tryid) {
 		cntr->progress(cntr);
-		if (threshold <= ofi_atomic_get64(&cntr->cnt))
+		if (threshold <= ofi_cntr_value(cntr))
 			return FI_SUCCESS;
 
 		if (errcnt != ofi_atomic_get64(&cntr->err))
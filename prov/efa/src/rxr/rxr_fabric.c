@@ -126,8 +126,7 @@ int rxr_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 
 #ifdef RXR_PERF_ENABLED
 	ret = ofi_perfset_create(&rxr_prov, &rxr_fabric->perf_set,
-				 rxr_perf_size, perf_domain, perf_cntr,
-				 perf_flags);
+				 rxr_perf_size);
 
 	if (ret)
 		FI_WARN(&rxr_prov, FI_LOG_FABRIC,
@@ -18,9 +18,13 @@ int hook_close(struct fid *fid);
 #define perf_tagged_ops hook_tagged_ops
 #define perf_cntr_ops hook_cntr_ops
 #define perf_cq_ops hook_cq_ops
+#define perf_ep_init(ep, fclass) do { } while (0)
 
 #define hook_perf_create hook_fabric_create
 #define hook_perf_destroy hook_fabric_destroy
 
 #endif /* HAVE_PERF */
+
+#include "hook_trace.h"
+
 #endif /* HOOK_PROV_H */
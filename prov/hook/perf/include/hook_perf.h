@@ -38,12 +38,28 @@
 #include "ofi_perf.h"
 
 
+/*
+ * Calls on endpoints are counted per endpoint, and the counts are added
+ * to those of the fabric when it is closed.  Endpoints whose set cannot
+ * be allocated count directly into the set of the fabric.
+ */
 struct perf_fabric {
 	struct hook_fabric fabric_hook;
 	struct ofi_perfset perf_set;
+	fastlock_t lock;
+	struct dlist_entry ep_list;
+	int ep_cnt;
+};
+
+struct perf_ep {
+	struct dlist_entry entry;
+	int id;
+	int fclass;
+	struct ofi_perfset perf_set;
 };
 
 int perf_hook_destroy(struct fid *fabric);
+void perf_ep_init(struct hook_ep *ep, int fclass);
 
 
 #define HOOK_FOREACH(DECL)		\
@@ -42,6 +42,9 @@ const char *perf_counters_str[] = {
 
 static inline struct ofi_perfset *perf_set(struct hook_ep *ep)
 {
+	if (ep->hook_ctx)
+		return &((struct perf_ep *) ep->hook_ctx)->perf_set;
+
 	return &container_of(ep->domain->fabric, struct perf_fabric,
 			     fabric_hook)->perf_set;
 }
@@ -851,13 +854,89 @@ static struct fi_ops perf_fabric_fid_ops = {
 	.ops_open = hook_ops_open,
 };
 
+void perf_ep_init(struct hook_ep *ep, int fclass)
+{
+	struct perf_fabric *fab;
+	struct perf_ep *perf_ep;
+
+	if (fclass == FI_CLASS_SEP)
+		return;
+
+	fab = container_of(ep->domain->fabric, struct perf_fabric,
+			   fabric_hook);
+	perf_ep = calloc(1, sizeof(*perf_ep));
+	if (!perf_ep)
+		return;
+
+	if (ofi_perfset_create(fab->fabric_hook.prov, &perf_ep->perf_set,
+			       perf_size)) {
+		free(perf_ep);
+		return;
+	}
+
+	perf_ep->fclass = fclass;
+	fastlock_acquire(&fab->lock);
+	perf_ep->id = fab->ep_cnt++;
+	dlist_insert_tail(&perf_ep->entry, &fab->ep_list);
+	fastlock_release(&fab->lock);
+	ep->hook_ctx = perf_ep;
+}
+
+static const char *perf_ep_str(int fclass)
+{
+	switch (fclass) {
+	case FI_CLASS_EP:
+		return "endpoint";
+	case FI_CLASS_TX_CTX:
+		return "tx context";
+	case FI_CLASS_RX_CTX:
+		return "rx context";
+	case FI_CLASS_SRX_CTX:
+		return "shared rx context";
+	default:
+		return "unknown";
+	}
+}
+
+static int perf_set_empty(struct ofi_perfset *set)
+{
+	size_t i;
+
+	for (i = 0; i < set->size; i++) {
+		if (set->data[i].events)
+			return 0;
+	}
+	return 1;
+}
+
 int perf_hook_destroy(struct fid *fid)
 {
 	struct perf_fabric *fab;
+	struct perf_ep *perf_ep;
+	struct fi_provider *hprov;
 
 	fab = container_of(fid, struct perf_fabric, fabric_hook);
+	hprov = fab->fabric_hook.prov;
+
+	dlist_foreach_container(&fab->ep_list, struct perf_ep, perf_ep, entry)
+		ofi_perfset_add(&fab->perf_set, &perf_ep->perf_set);
+	FI_TRACE(hprov, FI_LOG_CORE, "\n");
+	FI_TRACE(hprov, FI_LOG_CORE, "\tfabric:\n");
 	ofi_perfset_log(&fab->perf_set, perf_counters_str);
 	ofi_perfset_close(&fab->perf_set);
+
+	while (!dlist_empty(&fab->ep_list)) {
+		dlist_pop_front(&fab->ep_list, struct perf_ep, perf_ep, entry);
+		if (!perf_set_empty(&perf_ep->perf_set)) {
+			FI_TRACE(hprov, FI_LOG_CORE, "\n");
+			FI_TRACE(hprov, FI_LOG_CORE, "\t%s %d:\n",
+				 perf_ep_str(perf_ep->fclass), perf_ep->id);
+			ofi_perfset_log(&perf_ep->perf_set, perf_counters_str);
+		}
+		ofi_perfset_close(&perf_ep->perf_set);
+		free(perf_ep);
+	}
+	fastlock_destroy(&fab->lock);
 	hook_close(fid);
 
 	return FI_SUCCESS;
@@ -875,13 +954,15 @@ static int perf_hook_fabric(struct fi_fabric_attr *attr,
 	if (!fab)
 		return -FI_ENOMEM;
 
-	ret = ofi_perfset_create(hprov, &fab->perf_set, perf_size,
-				 perf_domain, perf_cntr, perf_flags);
+	ret = ofi_perfset_create(hprov, &fab->perf_set, perf_size);
 	if (ret) {
 		free(fab);
 		return ret;
 	}
 
+	fastlock_init(&fab->lock);
+	dlist_init(&fab->ep_list);
+
 	hook_fabric_init(&fab->fabric_hook, HOOK_PERF, attr->fabric, hprov,
 			 &perf_fabric_fid_ops);
 	*fabric = &fab->fabric_hook.fabric;
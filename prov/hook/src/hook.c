@@ -260,8 +260,9 @@ void ofi_hook_init(void)
 
 	fi_param_define(NULL, "hook", FI_PARAM_STRING,
 			"Intercept calls to underlying provider and apply "
-			"the specified functionality to them.  Hook option: "
-			"perf (gather performance data)");
+			"the specified functionality to them.  Hook options: "
+			"perf (gather performance data), trace (record "
+			"data transfer calls to a file)");
 	fi_param_get_str(NULL, "hook", &param_val);
 
 	if (!param_val)
@@ -115,6 +115,9 @@ int hook_cntr_open(struct fid_domain *domain, struct fi_cntr_attr *attr,
 	case HOOK_PERF:
 		mycntr->cntr.ops = &perf_cntr_ops;
 		break;
+	case HOOK_TRACE:
+		mycntr->cntr.ops = &trace_cntr_ops;
+		break;
 	default:
 		mycntr->cntr.ops = &hook_cntr_ops;
 		break;
@@ -115,6 +115,7 @@ int hook_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		return -FI_ENOMEM;
 
 	mycq->domain = dom;
+	mycq->format = attr->format;
 	mycq->cq.fid.fclass = FI_CLASS_CQ;
 	mycq->cq.fid.context = context;
 	mycq->cq.fid.ops = &hook_fid_ops;
@@ -123,6 +124,9 @@ int hook_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	case HOOK_PERF:
 		mycq->cq.ops = &perf_cq_ops;
 		break;
+	case HOOK_TRACE:
+		mycq->cq.ops = &trace_cq_ops;
+		break;
 	default:
 		mycq->cq.ops = &hook_cq_ops;
 		break;
@@ -97,10 +97,16 @@ static void hook_setup_ep(enum ofi_hook_class hclass, struct fid_ep *ep,
 
 	switch (hclass) {
 	case HOOK_PERF:
+		perf_ep_init(container_of(ep, struct hook_ep, ep), fclass);
 		ep->msg = &perf_msg_ops;
 		ep->rma = &perf_rma_ops;
 		ep->tagged = &perf_tagged_ops;
 		break;
+	case HOOK_TRACE:
+		ep->msg = &trace_msg_ops;
+		ep->rma = &trace_rma_ops;
+		ep->tagged = &trace_tagged_ops;
+		break;
 	default:
 		ep->msg = &hook_msg_ops;
 		ep->rma = &hook_rma_ops;
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HOOK_TRACE_H_
+#define _HOOK_TRACE_H_
+
+#include <stdio.h>
+
+#include "ofi_hook.h"
+#include "ofi.h"
+#include "ofi_lock.h"
+#include "ofi_mem.h"
+#include "ofi_tree.h"
+#include "ofi_trace.h"
+
+
+#define TRACE_BUF_CNT	4096
+
+struct trace_fabric {
+	struct hook_fabric	fabric_hook;
+	fastlock_t		lock;
+	FILE			*file;
+	uint64_t		start;
+	uint64_t		seq;
+	uint64_t		comp_cnt;
+	size_t			buf_cnt;
+	struct ofi_trace_rec	buf[TRACE_BUF_CNT];
+	/* operations waiting for a completion, by context */
+	struct ofi_rbmap	pending_map;
+	struct ofi_bufpool	*pending_pool;
+};
+
+int trace_hook_destroy(struct fid *fabric);
+
+extern struct fi_ops_msg trace_msg_ops;
+extern struct fi_ops_rma trace_rma_ops;
+extern struct fi_ops_tagged trace_tagged_ops;
+extern struct fi_ops_cq trace_cq_ops;
+extern struct fi_ops_cntr trace_cntr_ops;
+
+
+#endif /* _HOOK_TRACE_H_ */
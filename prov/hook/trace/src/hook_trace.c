@@ -0,0 +1,993 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "ofi_prov.h"
+#include "ofi_iov.h"
+#include "hook_prov.h"
+
+
+static ofi_atomic32_t trace_fabric_idx;
+
+struct trace_pending {
+	void			*context;
+	uint64_t		seq;
+	uint64_t		time;
+};
+
+static struct trace_fabric *trace_fab(struct hook_domain *domain)
+{
+	return container_of(domain->fabric, struct trace_fabric, fabric_hook);
+}
+
+static int trace_pending_compare(struct ofi_rbmap *map, void *key, void *data)
+{
+	void *context = ((struct trace_pending *) data)->context;
+
+	return (key < context) ? -1 : (key > context);
+}
+
+static void trace_flush(struct trace_fabric *fab)
+{
+	if (fab->buf_cnt &&
+	    fwrite(fab->buf, sizeof(*fab->buf), fab->buf_cnt,
+		   fab->file) != fab->buf_cnt)
+		FI_WARN(fab->fabric_hook.prov, FI_LOG_FABRIC,
+			"Unable to write call trace\n");
+	fab->buf_cnt = 0;
+}
+
+/* Called with the lock held */
+static struct ofi_trace_rec *
+trace_rec(struct trace_fabric *fab, int op, uint64_t start, uint64_t now)
+{
+	struct ofi_trace_rec *rec;
+
+	if (fab->buf_cnt == TRACE_BUF_CNT)
+		trace_flush(fab);
+
+	rec = &fab->buf[fab->buf_cnt++];
+	rec->time = start - fab->start;
+	rec->duration = (uint32_t) MIN(now - start, UINT32_MAX);
+	rec->op = (uint8_t) op;
+	fab->seq++;
+	return rec;
+}
+
+static void trace_xfer(struct hook_ep *ep, int op, uint64_t start,
+		       ssize_t ret, size_t len, size_t count, fi_addr_t addr,
+		       uint64_t tag, uint64_t data, uint64_t flags,
+		       void *context)
+{
+	struct trace_fabric *fab = trace_fab(ep->domain);
+	struct trace_pending *pending;
+	struct ofi_trace_rec *rec;
+	struct ofi_rbnode *node;
+	uint64_t now;
+
+	if (ret == -FI_EAGAIN)
+		return;
+
+	now = ofi_gettime_ns();
+	fastlock_acquire(&fab->lock);
+	rec = trace_rec(fab, op, start, now);
+	rec->len = len;
+	rec->count = (uint8_t) MIN(count, UINT8_MAX);
+	rec->addr = addr;
+	rec->tag = tag;
+	rec->data = data;
+	rec->flags = flags;
+	rec->value = fab->comp_cnt;
+	rec->ret = (int16_t) MAX(ret, INT16_MIN);
+
+	if (ret || !context)
+		goto unlock;
+
+	node = ofi_rbmap_find(&fab->pending_map, context);
+	if (node) {
+		pending = node->data;
+	} else {
+		pending = ofi_buf_alloc(fab->pending_pool);
+		if (!pending)
+			goto unlock;
+		pending->context = context;
+		if (ofi_rbmap_insert(&fab->pending_map, context, pending)) {
+			ofi_buf_free(pending);
+			goto unlock;
+		}
+	}
+	pending->seq = fab->seq - 1;
+	pending->time = start;
+unlock:
+	fastlock_release(&fab->lock);
+}
+
+/* Match a completion against the operation that it completes */
+static void trace_comp(struct trace_fabric *fab, struct ofi_trace_rec *rec,
+		       void *context, uint64_t now)
+{
+	struct trace_pending *pending;
+	struct ofi_rbnode *node;
+
+	fab->comp_cnt++;
+	node = context ? ofi_rbmap_find(&fab->pending_map, context) : NULL;
+	if (!node) {
+		rec->addr = UINT64_MAX;
+		rec->value = 0;
+		return;
+	}
+
+	pending = node->data;
+	rec->addr = pending->seq;
+	rec->value = now - pending->time;
+	ofi_rbmap_delete(&fab->pending_map, node);
+	ofi_buf_free(pending);
+}
+
+static void trace_cq_comps(struct hook_cq *cq, uint64_t start,
+			   const void *buf, ssize_t count)
+{
+	struct trace_fabric *fab = trace_fab(cq->domain);
+	const struct fi_cq_tagged_entry *entry;
+	struct ofi_trace_rec *rec;
+	size_t size;
+	uint64_t now;
+	ssize_t i;
+
+	if (count <= 0)
+		return;
+
+	switch (cq->format) {
+	case FI_CQ_FORMAT_MSG:
+		size = sizeof(struct fi_cq_msg_entry);
+		break;
+	case FI_CQ_FORMAT_DATA:
+		size = sizeof(struct fi_cq_data_entry);
+		break;
+	case FI_CQ_FORMAT_TAGGED:
+		size = sizeof(struct fi_cq_tagged_entry);
+		break;
+	default:
+		size = sizeof(struct fi_cq_entry);
+		break;
+	}
+
+	now = ofi_gettime_ns();
+	fastlock_acquire(&fab->lock);
+	for (i = 0; i < count; i++) {
+		entry = (const void *) ((const char *) buf + i * size);
+		rec = trace_rec(fab, OFI_TRACE_COMP, start, now);
+		rec->len = 0;
+		rec->count = 0;
+		rec->tag = 0;
+		rec->data = 0;
+		rec->flags = 0;
+		rec->ret = 0;
+
+		switch (cq->format) {
+		case FI_CQ_FORMAT_TAGGED:
+			rec->tag = entry->tag;
+			/* fall through */
+		case FI_CQ_FORMAT_DATA:
+			rec->data = entry->data;
+			/* fall through */
+		case FI_CQ_FORMAT_MSG:
+			rec->flags = entry->flags;
+			rec->len = entry->len;
+			break;
+		default:
+			break;
+		}
+		trace_comp(fab, rec, entry->op_context, now);
+	}
+	fastlock_release(&fab->lock);
+}
+
+static void trace_cq_err(struct hook_cq *cq, uint64_t start,
+			 const struct fi_cq_err_entry *entry)
+{
+	struct trace_fabric *fab = trace_fab(cq->domain);
+	struct ofi_trace_rec *rec;
+	uint64_t now;
+
+	now = ofi_gettime_ns();
+	fastlock_acquire(&fab->lock);
+	rec = trace_rec(fab, OFI_TRACE_COMP_ERR, start, now);
+	rec->len = entry->len;
+	rec->count = 0;
+	rec->tag = entry->tag;
+	rec->data = entry->data;
+	rec->flags = entry->flags;
+	rec->ret = (int16_t) -MIN(entry->err, INT16_MAX);
+	trace_comp(fab, rec, entry->op_context, now);
+	fastlock_release(&fab->lock);
+}
+
+static void trace_cntr(struct hook_cntr *cntr, int op, uint64_t start,
+		       int ret, uint64_t value)
+{
+	struct trace_fabric *fab = trace_fab(cntr->domain);
+	struct ofi_trace_rec *rec;
+	uint64_t now;
+
+	now = ofi_gettime_ns();
+	fastlock_acquire(&fab->lock);
+	rec = trace_rec(fab, op, start, now);
+	memset(&rec->len, 0, offsetof(struct ofi_trace_rec, value) -
+	       offsetof(struct ofi_trace_rec, len));
+	rec->value = value;
+	rec->count = 0;
+	rec->ret = (int16_t) MAX(ret, INT16_MIN);
+	fastlock_release(&fab->lock);
+}
+
+
+static ssize_t
+trace_msg_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	       fi_addr_t src_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_recv(myep->hep, buf, len, desc, src_addr, context);
+	trace_xfer(myep, OFI_TRACE_RECV, start, ret, len, 1, src_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t src_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_recvv(myep->hep, iov, desc, count, src_addr, context);
+	trace_xfer(myep, OFI_TRACE_RECVV, start, ret,
+		   ofi_total_iov_len(iov, count), count, src_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_recvmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_recvmsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_RECVMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, 0, msg->data, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	       fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_send(myep->hep, buf, len, desc, dest_addr, context);
+	trace_xfer(myep, OFI_TRACE_SEND, start, ret, len, 1, dest_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_sendv(myep->hep, iov, desc, count, dest_addr, context);
+	trace_xfer(myep, OFI_TRACE_SENDV, start, ret,
+		   ofi_total_iov_len(iov, count), count, dest_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
+		  uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_sendmsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_SENDMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, 0, msg->data, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_inject(struct fid_ep *ep, const void *buf, size_t len,
+		 fi_addr_t dest_addr)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_inject(myep->hep, buf, len, dest_addr);
+	trace_xfer(myep, OFI_TRACE_INJECT, start, ret, len, 1, dest_addr,
+		   0, 0, 0, NULL);
+	return ret;
+}
+
+static ssize_t
+trace_msg_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		   uint64_t data, fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_senddata(myep->hep, buf, len, desc, data, dest_addr, context);
+	trace_xfer(myep, OFI_TRACE_SENDDATA, start, ret, len, 1, dest_addr,
+		   0, data, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_msg_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		     uint64_t data, fi_addr_t dest_addr)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_injectdata(myep->hep, buf, len, data, dest_addr);
+	trace_xfer(myep, OFI_TRACE_INJECTDATA, start, ret, len, 1, dest_addr,
+		   0, data, 0, NULL);
+	return ret;
+}
+
+struct fi_ops_msg trace_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = trace_msg_recv,
+	.recvv = trace_msg_recvv,
+	.recvmsg = trace_msg_recvmsg,
+	.send = trace_msg_send,
+	.sendv = trace_msg_sendv,
+	.sendmsg = trace_msg_sendmsg,
+	.inject = trace_msg_inject,
+	.senddata = trace_msg_senddata,
+	.injectdata = trace_msg_injectdata,
+};
+
+
+static ssize_t
+trace_rma_read(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	       fi_addr_t src_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_read(myep->hep, buf, len, desc, src_addr, addr, key, context);
+	trace_xfer(myep, OFI_TRACE_READ, start, ret, len, 1, src_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_readv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t src_addr, uint64_t addr, uint64_t key,
+		void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_readv(myep->hep, iov, desc, count, src_addr,
+		       addr, key, context);
+	trace_xfer(myep, OFI_TRACE_READV, start, ret,
+		   ofi_total_iov_len(iov, count), count, src_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		  uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_readmsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_READMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, 0, msg->data, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		fi_addr_t dest_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_write(myep->hep, buf, len, desc, dest_addr, addr, key,
+		       context);
+	trace_xfer(myep, OFI_TRACE_WRITE, start, ret, len, 1, dest_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_writev(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		 size_t count, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		 void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_writev(myep->hep, iov, desc, count, dest_addr,
+			addr, key, context);
+	trace_xfer(myep, OFI_TRACE_WRITEV, start, ret,
+		   ofi_total_iov_len(iov, count), count, dest_addr,
+		   0, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		   uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_writemsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_WRITEMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, 0, msg->data, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_inject(struct fid_ep *ep, const void *buf, size_t len,
+		 fi_addr_t dest_addr, uint64_t addr, uint64_t key)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_inject_write(myep->hep, buf, len, dest_addr, addr, key);
+	trace_xfer(myep, OFI_TRACE_INJECT_WRITE, start, ret, len, 1, dest_addr,
+		   0, 0, 0, NULL);
+	return ret;
+}
+
+static ssize_t
+trace_rma_writedata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		    uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		    uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_writedata(myep->hep, buf, len, desc, data, dest_addr,
+			   addr, key, context);
+	trace_xfer(myep, OFI_TRACE_WRITEDATA, start, ret, len, 1, dest_addr,
+		   0, data, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_rma_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		     uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		     uint64_t key)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_inject_writedata(myep->hep, buf, len, data, dest_addr,
+				  addr, key);
+	trace_xfer(myep, OFI_TRACE_INJECT_WRITEDATA, start, ret, len, 1,
+		   dest_addr, 0, data, 0, NULL);
+	return ret;
+}
+
+struct fi_ops_rma trace_rma_ops = {
+	.size = sizeof(struct fi_ops_rma),
+	.read = trace_rma_read,
+	.readv = trace_rma_readv,
+	.readmsg = trace_rma_readmsg,
+	.write = trace_rma_write,
+	.writev = trace_rma_writev,
+	.writemsg = trace_rma_writemsg,
+	.inject = trace_rma_inject,
+	.writedata = trace_rma_writedata,
+	.injectdata = trace_rma_injectdata,
+};
+
+
+static ssize_t
+trace_tagged_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+		  fi_addr_t src_addr, uint64_t tag, uint64_t ignore,
+		  void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_trecv(myep->hep, buf, len, desc, src_addr, tag, ignore,
+		       context);
+	trace_xfer(myep, OFI_TRACE_TRECV, start, ret, len, 1, src_addr,
+		   tag, ignore, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		   size_t count, fi_addr_t src_addr, uint64_t tag,
+		   uint64_t ignore, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_trecvv(myep->hep, iov, desc, count, src_addr,
+			tag, ignore, context);
+	trace_xfer(myep, OFI_TRACE_TRECVV, start, ret,
+		   ofi_total_iov_len(iov, count), count, src_addr,
+		   tag, ignore, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_recvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		     uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_trecvmsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_TRECVMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, msg->tag, msg->ignore, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		  fi_addr_t dest_addr, uint64_t tag, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tsend(myep->hep, buf, len, desc, dest_addr, tag, context);
+	trace_xfer(myep, OFI_TRACE_TSEND, start, ret, len, 1, dest_addr,
+		   tag, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		   size_t count, fi_addr_t dest_addr, uint64_t tag,
+		   void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tsendv(myep->hep, iov, desc, count, dest_addr, tag, context);
+	trace_xfer(myep, OFI_TRACE_TSENDV, start, ret,
+		   ofi_total_iov_len(iov, count), count, dest_addr,
+		   tag, 0, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_sendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		     uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tsendmsg(myep->hep, msg, flags);
+	trace_xfer(myep, OFI_TRACE_TSENDMSG, start, ret,
+		   ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		   msg->iov_count, msg->addr, msg->tag, msg->data, flags,
+		   msg->context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_inject(struct fid_ep *ep, const void *buf, size_t len,
+		    fi_addr_t dest_addr, uint64_t tag)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tinject(myep->hep, buf, len, dest_addr, tag);
+	trace_xfer(myep, OFI_TRACE_TINJECT, start, ret, len, 1, dest_addr,
+		   tag, 0, 0, NULL);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_senddata(struct fid_ep *ep, const void *buf, size_t len,
+		      void *desc, uint64_t data, fi_addr_t dest_addr,
+		      uint64_t tag, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tsenddata(myep->hep, buf, len, desc, data, dest_addr,
+			   tag, context);
+	trace_xfer(myep, OFI_TRACE_TSENDDATA, start, ret, len, 1, dest_addr,
+		   tag, data, 0, context);
+	return ret;
+}
+
+static ssize_t
+trace_tagged_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+			uint64_t data, fi_addr_t dest_addr, uint64_t tag)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_tinjectdata(myep->hep, buf, len, data, dest_addr, tag);
+	trace_xfer(myep, OFI_TRACE_TINJECTDATA, start, ret, len, 1, dest_addr,
+		   tag, data, 0, NULL);
+	return ret;
+}
+
+struct fi_ops_tagged trace_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = trace_tagged_recv,
+	.recvv = trace_tagged_recvv,
+	.recvmsg = trace_tagged_recvmsg,
+	.send = trace_tagged_send,
+	.sendv = trace_tagged_sendv,
+	.sendmsg = trace_tagged_sendmsg,
+	.inject = trace_tagged_inject,
+	.senddata = trace_tagged_senddata,
+	.injectdata = trace_tagged_injectdata,
+};
+
+
+static ssize_t trace_cq_read_op(struct fid_cq *cq, void *buf, size_t count)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_cq_read(mycq->hcq, buf, count);
+	trace_cq_comps(mycq, start, buf, ret);
+	return ret;
+}
+
+static ssize_t
+trace_cq_readerr_op(struct fid_cq *cq, struct fi_cq_err_entry *buf,
+		    uint64_t flags)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_cq_readerr(mycq->hcq, buf, flags);
+	if (ret > 0)
+		trace_cq_err(mycq, start, buf);
+	return ret;
+}
+
+static ssize_t
+trace_cq_readfrom_op(struct fid_cq *cq, void *buf, size_t count,
+		     fi_addr_t *src_addr)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_cq_readfrom(mycq->hcq, buf, count, src_addr);
+	trace_cq_comps(mycq, start, buf, ret);
+	return ret;
+}
+
+static ssize_t
+trace_cq_sread_op(struct fid_cq *cq, void *buf, size_t count,
+		  const void *cond, int timeout)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_cq_sread(mycq->hcq, buf, count, cond, timeout);
+	trace_cq_comps(mycq, start, buf, ret);
+	return ret;
+}
+
+static ssize_t
+trace_cq_sreadfrom_op(struct fid_cq *cq, void *buf, size_t count,
+		      fi_addr_t *src_addr, const void *cond, int timeout)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = ofi_gettime_ns();
+	ssize_t ret;
+
+	ret = fi_cq_sreadfrom(mycq->hcq, buf, count, src_addr, cond, timeout);
+	trace_cq_comps(mycq, start, buf, ret);
+	return ret;
+}
+
+static int trace_cq_signal_op(struct fid_cq *cq)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+
+	return fi_cq_signal(mycq->hcq);
+}
+
+struct fi_ops_cq trace_cq_ops = {
+	.size = sizeof(struct fi_ops_cq),
+	.read = trace_cq_read_op,
+	.readfrom = trace_cq_readfrom_op,
+	.readerr = trace_cq_readerr_op,
+	.sread = trace_cq_sread_op,
+	.sreadfrom = trace_cq_sreadfrom_op,
+	.signal = trace_cq_signal_op,
+	.strerror = hook_cq_strerror,
+};
+
+
+static uint64_t trace_cntr_read_op(struct fid_cntr *cntr)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+
+	return fi_cntr_read(mycntr->hcntr);
+}
+
+static uint64_t trace_cntr_readerr_op(struct fid_cntr *cntr)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+
+	return fi_cntr_readerr(mycntr->hcntr);
+}
+
+static int trace_cntr_add_op(struct fid_cntr *cntr, uint64_t value)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+	uint64_t start = ofi_gettime_ns();
+	int ret;
+
+	ret = fi_cntr_add(mycntr->hcntr, value);
+	trace_cntr(mycntr, OFI_TRACE_CNTR_ADD, start, ret, value);
+	return ret;
+}
+
+static int trace_cntr_set_op(struct fid_cntr *cntr, uint64_t value)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+	uint64_t start = ofi_gettime_ns();
+	int ret;
+
+	ret = fi_cntr_set(mycntr->hcntr, value);
+	trace_cntr(mycntr, OFI_TRACE_CNTR_SET, start, ret, value);
+	return ret;
+}
+
+static int trace_cntr_wait_op(struct fid_cntr *cntr, uint64_t threshold,
+			      int timeout)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+	uint64_t start = ofi_gettime_ns();
+	int ret;
+
+	ret = fi_cntr_wait(mycntr->hcntr, threshold, timeout);
+	trace_cntr(mycntr, OFI_TRACE_CNTR_WAIT, start, ret, threshold);
+	return ret;
+}
+
+static int trace_cntr_adderr_op(struct fid_cntr *cntr, uint64_t value)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+	uint64_t start = ofi_gettime_ns();
+	int ret;
+
+	ret = fi_cntr_adderr(mycntr->hcntr, value);
+	trace_cntr(mycntr, OFI_TRACE_CNTR_ADDERR, start, ret, value);
+	return ret;
+}
+
+static int trace_cntr_seterr_op(struct fid_cntr *cntr, uint64_t value)
+{
+	struct hook_cntr *mycntr = container_of(cntr, struct hook_cntr, cntr);
+	uint64_t start = ofi_gettime_ns();
+	int ret;
+
+	ret = fi_cntr_seterr(mycntr->hcntr, value);
+	trace_cntr(mycntr, OFI_TRACE_CNTR_SETERR, start, ret, value);
+	return ret;
+}
+
+struct fi_ops_cntr trace_cntr_ops = {
+	.size = sizeof(struct fi_ops_cntr),
+	.read = trace_cntr_read_op,
+	.readerr = trace_cntr_readerr_op,
+	.add = trace_cntr_add_op,
+	.set = trace_cntr_set_op,
+	.wait = trace_cntr_wait_op,
+	.adderr = trace_cntr_adderr_op,
+	.seterr = trace_cntr_seterr_op,
+};
+
+
+static struct fi_ops trace_fabric_fid_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = trace_hook_destroy,
+	.bind = hook_bind,
+	.control = hook_control,
+	.ops_open = hook_ops_open,
+};
+
+static void trace_fabric_free(struct trace_fabric *fab)
+{
+	if (fab->file) {
+		trace_flush(fab);
+		fclose(fab->file);
+	}
+	ofi_rbmap_cleanup(&fab->pending_map);
+	if (fab->pending_pool)
+		ofi_bufpool_destroy(fab->pending_pool);
+	fastlock_destroy(&fab->lock);
+	free(fab);
+}
+
+int trace_hook_destroy(struct fid *fid)
+{
+	struct trace_fabric *fab;
+	int ret;
+
+	fab = container_of(fid, struct trace_fabric, fabric_hook.fabric.fid);
+	ret = fi_close(&fab->fabric_hook.hfabric->fid);
+	if (ret)
+		return ret;
+
+	trace_fabric_free(fab);
+	return FI_SUCCESS;
+}
+
+static int trace_open(struct trace_fabric *fab, struct fi_provider *hprov)
+{
+	struct ofi_trace_hdr hdr;
+	char *prefix = "fi_trace";
+	char name[PATH_MAX];
+
+	fi_param_get_str(NULL, "trace_file", &prefix);
+	snprintf(name, sizeof(name), "%s.%d.%d", prefix, getpid(),
+		 ofi_atomic_inc32(&trace_fabric_idx) - 1);
+	fab->file = fopen(name, "wb");
+	if (!fab->file) {
+		FI_WARN(hprov, FI_LOG_FABRIC,
+			"Unable to open call trace file %s: %s\n",
+			name, strerror(errno));
+		return -errno;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, OFI_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = OFI_TRACE_VERSION;
+	hdr.rec_size = sizeof(struct ofi_trace_rec);
+	hdr.start = fi_gettime_us();
+	strncpy(hdr.prov_name, hprov->name, sizeof(hdr.prov_name) - 1);
+	if (fwrite(&hdr, sizeof hdr, 1, fab->file) != 1)
+		return -FI_EIO;
+
+	FI_INFO(hprov, FI_LOG_FABRIC, "Recording calls to %s\n", name);
+	return 0;
+}
+
+static int trace_hook_fabric(struct fi_fabric_attr *attr,
+			     struct fid_fabric **fabric, void *context)
+{
+	struct fi_provider *hprov = context;
+	struct trace_fabric *fab;
+	int ret;
+
+	FI_TRACE(hprov, FI_LOG_FABRIC, "Installing trace hook\n");
+	fab = calloc(1, sizeof *fab);
+	if (!fab)
+		return -FI_ENOMEM;
+
+	fastlock_init(&fab->lock);
+	ofi_rbmap_init(&fab->pending_map, trace_pending_compare);
+	/* operations may still be outstanding when the fabric is closed */
+	ret = ofi_bufpool_create(&fab->pending_pool,
+				 sizeof(struct trace_pending), 16, 0, 64,
+				 OFI_BUFPOOL_NO_TRACK);
+	if (ret)
+		goto err;
+
+	ret = trace_open(fab, hprov);
+	if (ret)
+		goto err;
+
+	fab->start = ofi_gettime_ns();
+	hook_fabric_init(&fab->fabric_hook, HOOK_TRACE, attr->fabric, hprov,
+			 &trace_fabric_fid_ops);
+	*fabric = &fab->fabric_hook.fabric;
+	return 0;
+err:
+	trace_fabric_free(fab);
+	return ret;
+}
+
+struct fi_provider trace_hook_prov = {
+	.version = FI_VERSION(1,0),
+	/* We're a pass-through provider, so the fi_version is always the latest */
+	.fi_version = FI_VERSION(FI_MAJOR_VERSION, FI_MINOR_VERSION),
+	.name = "ofi_trace_hook",
+	.getinfo = NULL,
+	.fabric = trace_hook_fabric,
+	.cleanup = NULL,
+};
+
+TRACE_HOOK_INI
+{
+	ofi_atomic_initialize32(&trace_fabric_idx, 0);
+	fi_param_define(NULL, "trace_file", FI_PARAM_STRING,
+			"Path prefix of the files written by the trace hook, "
+			"which appends the process id and fabric number "
+			"(default: fi_trace)");
+	return &trace_hook_prov;
+}
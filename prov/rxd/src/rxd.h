@@ -53,6 +53,7 @@
 #include <ofi_list.h>
 #include <ofi_util.h>
 #include <ofi_tree.h>
+#include <ofi_timer.h>
 #include <ofi_atomic.h>
 #include "rxd_proto.h"
 
@@ -61,7 +62,7 @@
 
 #define RXD_MAJOR_VERSION 	(1)
 #define RXD_MINOR_VERSION 	(0)
-#define RXD_PROTOCOL_VERSION 	(2)
+#define RXD_PROTOCOL_VERSION 	(4)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -72,11 +73,29 @@
 #define RXD_BUF_POOL_ALIGNMENT	16
 #define RXD_TX_POOL_CHUNK_CNT	1024
 #define RXD_RX_POOL_CHUNK_CNT	1024
+#define RXD_PEER_POOL_CHUNK_CNT	64
 #define RXD_MAX_PENDING		128
 #define RXD_MAX_PKT_RETRY	50
+#define RXD_INIT_RTO		1000
+#define RXD_MIN_RTO		200
+#define RXD_MAX_RTO		4000000
+#define RXD_DUP_ACK_THRESH	3
+#define RXD_INIT_CWND		16
+#define RXD_MIN_SSTHRESH	2
+#define RXD_PACE_BURST		16
+#define RXD_ACK_DELAY		100
+#define RXD_TICK_SHIFT		6	/* timer wheel ticks of 64 usec */
+#define RXD_CQ_READ_BATCH	16
+#define RXD_AGGR_PKT_SIZE	256	/* largest packet packed with others */
+#define RXD_PEER_CHUNK_BITS	8
+#define RXD_PEER_CHUNK_SIZE	(1 << RXD_PEER_CHUNK_BITS)
+#define RXD_PEER_IDLE_TIME	1000000	/* usec before idle peer state is freed */
 
 #define RXD_PKT_IN_USE		(1 << 0)
 #define RXD_PKT_ACKED		(1 << 1)
+#define RXD_PKT_SACKED		(1 << 2)
+#define RXD_PKT_RETX		(1 << 3)
+#define RXD_PKT_LOST		(1 << 4)	/* resend once acks allow */
 
 #define RXD_REMOTE_CQ_DATA	(1 << 0)
 #define RXD_NO_TX_COMP		(1 << 1)
@@ -85,6 +104,8 @@
 #define RXD_TAG_HDR		(1 << 4)
 #define RXD_INLINE		(1 << 5)
 #define RXD_MULTI_RECV		(1 << 6)
+#define RXD_ACK_REQ		(1 << 7)
+#define RXD_MORE		(1 << 8)
 
 struct rxd_env {
 	int spin_count;
@@ -118,10 +139,13 @@ struct rxd_domain {
 	ssize_t max_inline_atom;
 	ssize_t max_seg_sz;
 	struct ofi_mr_map mr_map;//TODO use util_domain mr_map instead
+	/* serializes execution of atomics targeting the domain */
+	fastlock_t atomic_lock;
 };
 
 struct rxd_peer {
 	struct dlist_entry entry;
+	fi_addr_t addr;
 	fi_addr_t peer_addr;
 	uint64_t tx_seq_no;
 	uint64_t rx_seq_no;
@@ -130,14 +154,45 @@ struct rxd_peer {
 	uint16_t rx_window;
 	uint16_t tx_window;
 	int retry_cnt;
+	int dup_acks;
+
+	/* smoothed round trip time estimate and timeout, in usec */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+
+	/* AIMD congestion window, in packets, and pacing clock */
+	uint16_t cwnd;
+	uint16_t ssthresh;
+	uint16_t cwnd_cnt;
+	uint64_t pace_time;
+
+	/* window before a timeout, restored if the timeout was spurious */
+	uint16_t prior_cwnd;
+	uint16_t prior_ssthresh;
+	uint64_t rto_time;
+
+	struct ofi_timer retry_timer;
+	struct ofi_timer tx_timer;
+	struct ofi_timer ack_timer;
+	struct ofi_timer idle_timer;
+
+	/* small packets waiting to be packed into one datagram */
+	struct slist aggr_list;
+	struct dlist_entry aggr_entry;
+	struct rxd_pkt_entry *aggr_ack;
+	size_t aggr_size;
 
 	uint16_t unacked_cnt;
 	uint8_t active;
+	uint8_t busy;		/* sent to since the idle timer last ran */
+	uint8_t lost;		/* packets marked RXD_PKT_LOST */
 
 	uint16_t curr_rx_id;
 	uint16_t curr_tx_id;
 
 	struct rxd_unexp_msg *curr_unexp;
+	size_t unexp_cnt;
 	struct dlist_entry tx_list;
 	struct dlist_entry rx_list;
 	struct dlist_entry rma_rx_list;
@@ -145,6 +200,19 @@ struct rxd_peer {
 	struct dlist_entry buf_pkts;
 };
 
+/*
+ * Entry of an endpoint's peer table, indexed by rxd address.  The peer
+ * state is allocated on first contact and freed again once the peer has
+ * been idle for a while, leaving only what is needed to resume talking
+ * to it: its address for us and the sequence numbers.
+ */
+struct rxd_peer_slot {
+	struct rxd_peer *peer;
+	fi_addr_t peer_addr;
+	uint64_t tx_seq_no;
+	uint64_t rx_seq_no;
+};
+
 struct rxd_addr {
 	fi_addr_t fi_addr;
 	fi_addr_t dg_addr;
@@ -159,6 +227,7 @@ struct rxd_av {
 
 	int dg_av_used;
 	size_t dg_addrlen;
+	size_t rxd_addr_cnt;
 
 	fi_addr_t *fi_addr_table;
 	struct rxd_addr *rxd_addr_table;
@@ -184,7 +253,7 @@ struct rxd_ep {
 	uint32_t posted_bufs;
 	size_t min_multi_recv_size;
 	int do_local_mr;
-	int next_retry;
+	int next_retry;		/* msec to next timer or -1 */
 	int dg_cq_fd;
 	uint32_t tx_flags;
 	uint32_t rx_flags;
@@ -201,6 +270,11 @@ struct rxd_ep {
 	struct ofi_bufpool *tx_entry_pool;
 	struct ofi_bufpool *rx_entry_pool;
 
+	/* peer table, in chunks allocated as addresses are first used */
+	struct rxd_peer_slot **peer_table;
+	size_t peer_chunk_cnt;
+	struct ofi_bufpool *peer_pool;
+
 	struct dlist_entry unexp_list;
 	struct dlist_entry unexp_tag_list;
 	struct dlist_entry rx_list;
@@ -209,9 +283,86 @@ struct rxd_ep {
 	struct dlist_entry rts_sent_list;
 	struct dlist_entry ctrl_pkts;
 
-	struct rxd_peer peers[];
+	/* peer retransmit, paced send and delayed ack timers */
+	struct ofi_timer_wheel timers;
+
+	/* peers with packets to pack, sent when the outermost batch ends */
+	struct dlist_entry aggr_peers;
+	int aggr_depth;
+	int aggr_held;
+
+	/* statistics, logged when the endpoint is closed */
+	size_t retrans_cnt;
+	size_t fast_retrans_cnt;
+	size_t timeout_cnt;
+	size_t spurious_cnt;
+	size_t drop_cnt;
+	size_t aggr_cnt;
+	size_t aggr_pkt_cnt;
+	size_t peer_alloc_cnt;
+	size_t peer_idle_cnt;
 };
 
+static inline struct rxd_peer_slot *rxd_peer_slot(struct rxd_ep *ep,
+						  fi_addr_t addr)
+{
+	size_t chunk = addr >> RXD_PEER_CHUNK_BITS;
+
+	return chunk < ep->peer_chunk_cnt && ep->peer_table[chunk] ?
+	       &ep->peer_table[chunk][addr & (RXD_PEER_CHUNK_SIZE - 1)] : NULL;
+}
+
+/* State of a peer that is known to be allocated, see rxd_peer_get() */
+static inline struct rxd_peer *rxd_peer(struct rxd_ep *ep, fi_addr_t addr)
+{
+	return ep->peer_table[addr >> RXD_PEER_CHUNK_BITS]
+			     [addr & (RXD_PEER_CHUNK_SIZE - 1)].peer;
+}
+
+struct rxd_peer *rxd_peer_get(struct rxd_ep *ep, fi_addr_t addr);
+
+/* Packets a peer may have in flight: receiver and congestion window */
+static inline uint16_t rxd_peer_window(struct rxd_peer *peer)
+{
+	return MIN(peer->tx_window, peer->cwnd);
+}
+
+/*
+ * Pace packets at twice the congestion window per round trip, so
+ * that pacing smooths bursts without limiting the window: a token bucket
+ * holding up to RXD_PACE_BURST packets, kept as the time at which the
+ * bucket would be empty.  No pacing until the RTT has been measured.
+ */
+static inline int rxd_peer_pace(struct rxd_peer *peer, uint64_t now)
+{
+	uint64_t interval;
+
+	interval = peer->srtt / (2 * peer->cwnd);
+	if (!interval)
+		return 1;
+
+	if (peer->pace_time > now)
+		return 0;
+
+	peer->pace_time = MAX(peer->pace_time,
+			      now - RXD_PACE_BURST * interval) + interval;
+	return 1;
+}
+
+/* Timer wheel tick of a time in usec, rounded up */
+static inline uint64_t rxd_tick(uint64_t usec)
+{
+	return (usec + (1 << RXD_TICK_SHIFT) - 1) >> RXD_TICK_SHIFT;
+}
+
+/* Restart the sends held back by pacing (or a lack of packets) later */
+static inline void rxd_peer_defer_tx(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	ofi_timer_start_before(&ep->timers, &peer->tx_timer,
+			       MAX(rxd_tick(peer->pace_time),
+				   rxd_tick(fi_gettime_us()) + 1));
+}
+
 static inline struct rxd_domain *rxd_ep_domain(struct rxd_ep *ep)
 {
 	return container_of(ep->util_ep.domain, struct rxd_domain, util_domain);
@@ -265,6 +416,8 @@ static inline uint32_t rxd_tx_flags(uint64_t fi_flags)
 		rxd_flags |= RXD_REMOTE_CQ_DATA;
 	if (fi_flags & FI_INJECT)
 		rxd_flags |= RXD_INJECT;
+	if (fi_flags & FI_MORE)
+		rxd_flags |= RXD_MORE;
 	if (fi_flags & FI_COMPLETION)
 		return rxd_flags;
 
@@ -395,13 +548,22 @@ int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 			  void *context);
 
 /* Pkt resource functions */
-int rxd_ep_post_buf(struct rxd_ep *ep);
+void rxd_ep_post_bufs(struct rxd_ep *ep);
 void rxd_release_repost_rx(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
 void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer);
 struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep);
+struct rxd_pkt_entry *rxd_get_rx_pkt(struct rxd_ep *ep);
 struct rxd_x_entry *rxd_get_tx_entry(struct rxd_ep *ep, uint32_t op);
 struct rxd_x_entry *rxd_get_rx_entry(struct rxd_ep *ep, uint32_t op);
-int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+int rxd_ep_send_pkt_flags(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			  uint64_t flags);
+static inline int rxd_ep_send_pkt(struct rxd_ep *ep,
+				  struct rxd_pkt_entry *pkt_entry)
+{
+	return rxd_ep_send_pkt_flags(ep, pkt_entry, 0);
+}
+void rxd_ep_aggr_begin(struct rxd_ep *ep);
+void rxd_ep_aggr_end(struct rxd_ep *ep, int more);
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 			struct rxd_pkt_entry *pkt_entry);
@@ -440,8 +602,7 @@ struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 			uint32_t op, uint32_t flags);
 void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry);
-int rxd_get_timeout(uint8_t retry_cnt);
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt);
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt);
 
 /* Generic message functions */
 ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
@@ -461,6 +622,7 @@ void rxd_tx_entry_progress(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 			   int try_send);
 void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp);
 void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp);
+int rxd_tx_pkt_done(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
 void rxd_handle_error(struct rxd_ep *ep);
 void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 		     struct rxd_pkt_entry *pkt_entry,
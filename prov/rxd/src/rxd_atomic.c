@@ -134,6 +134,7 @@ static ssize_t rxd_generic_atomic(struct rxd_ep *rxd_ep,
 	ofi_rma_ioc_to_iov(rma_ioc, rma_iov, rma_count, ofi_datatype_size(datatype));
 
 	fastlock_acquire(&rxd_ep->util_ep.lock);
+	rxd_ep_aggr_begin(rxd_ep);
 
 	if (ofi_cirque_isfull(rxd_ep->util_ep.tx_cq->cirq))
 		goto out;
@@ -149,10 +150,11 @@ static ssize_t rxd_generic_atomic(struct rxd_ep *rxd_ep,
 	if (!tx_entry)
 		goto out;
 
-	if (rxd_ep->peers[rxd_addr].peer_addr != FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr != FI_ADDR_UNSPEC)
 		(void) rxd_start_xfer(rxd_ep, tx_entry);
 
 out:
+	rxd_ep_aggr_end(rxd_ep, rxd_flags & RXD_MORE);
 	fastlock_release(&rxd_ep->util_ep.lock);
 	return ret;
 }
@@ -164,6 +166,9 @@ static ssize_t rxd_atomic_writemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_atomic(ep_fid, msg, flags);
+
 	return rxd_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  NULL, NULL, 0, NULL, NULL, 0, msg->addr,
 				  msg->rma_iov, msg->rma_iov_count, msg->data,
@@ -250,7 +255,7 @@ static ssize_t rxd_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	if (!tx_entry)
 		goto out;
 
-	if (rxd_ep->peers[rxd_addr].peer_addr == FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr == FI_ADDR_UNSPEC)
 		goto out;
 
 	(void) rxd_start_xfer(rxd_ep, tx_entry);
@@ -267,6 +272,11 @@ static ssize_t rxd_atomic_readwritemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_fetch_atomic(ep_fid, msg, resultv,
+						result_desc, result_count,
+						flags);
+
 	return rxd_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  NULL, NULL, 0, resultv, result_desc,
 				  result_count, msg->addr,
@@ -336,6 +346,12 @@ static ssize_t rxd_atomic_compwritemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_compare_atomic(ep_fid, msg, comparev,
+						  compare_desc, compare_count,
+						  resultv, result_desc,
+						  result_count, flags);
+
 	return rxd_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  comparev, compare_desc, compare_count,
 				  resultv, result_desc,
@@ -33,7 +33,8 @@
 #include "rxd.h"
 
 #define RXD_EP_CAPS (FI_MSG | FI_TAGGED | FI_RMA | FI_ATOMIC | FI_SOURCE |  \
-			FI_DIRECTED_RECV | FI_MULTI_RECV | FI_RMA_EVENT)
+			FI_DIRECTED_RECV | FI_MULTI_RECV | FI_RMA_EVENT | \
+			FI_TRIGGER)
 #define RXD_TX_CAPS (FI_SEND | FI_WRITE | FI_READ)
 #define RXD_RX_CAPS (FI_RECV | FI_REMOTE_READ | FI_REMOTE_WRITE)
 #define RXD_DOMAIN_CAPS (FI_LOCAL_COMM | FI_REMOTE_COMM)
@@ -116,12 +116,12 @@ static fi_addr_t rxd_set_rxd_addr(struct rxd_av *av, fi_addr_t dg_addr)
 	int tries = 0;
 
 	while (av->rxd_addr_table[av->rxd_addr_idx].dg_addr != FI_ADDR_UNSPEC &&
-	       tries < av->util_av.count) {
-		if (++av->rxd_addr_idx == av->util_av.count)
+	       tries < av->rxd_addr_cnt) {
+		if (++av->rxd_addr_idx == av->rxd_addr_cnt)
 			av->rxd_addr_idx = 0;
 		tries++;
 	}
-	assert(av->rxd_addr_idx < av->util_av.count && tries < av->util_av.count);
+	assert(av->rxd_addr_idx < av->rxd_addr_cnt && tries < av->rxd_addr_cnt);
 	av->rxd_addr_table[av->rxd_addr_idx].dg_addr = dg_addr;
 
 	return av->rxd_addr_idx;
@@ -379,8 +379,10 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 	av = calloc(1, sizeof(*av));
 	if (!av)
 		return -FI_ENOMEM;
+	/* peers may contact us before they are inserted */
+	av->rxd_addr_cnt = MAX(attr->count, rxd_env.max_peers);
 	av->fi_addr_table = calloc(1, attr->count * sizeof(fi_addr_t));
-	av->rxd_addr_table = calloc(1, rxd_env.max_peers * sizeof(struct rxd_addr));
+	av->rxd_addr_table = calloc(1, av->rxd_addr_cnt * sizeof(struct rxd_addr));
 	if (!av->fi_addr_table || !av->rxd_addr_table) {
 		ret = -FI_ENOMEM;
 		goto err1;
@@ -400,7 +402,7 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 	ofi_rbmap_init(&av->rbmap, rxd_tree_compare);
 	for (i = 0; i < attr->count; av->fi_addr_table[i++] = FI_ADDR_UNSPEC)
 		;
-	for (i = 0; i < rxd_env.max_peers; i++) {
+	for (i = 0; i < av->rxd_addr_cnt; i++) {
 		av->rxd_addr_table[i].fi_addr = FI_ADDR_UNSPEC;
 		av->rxd_addr_table[i].dg_addr = FI_ADDR_UNSPEC;
 	}
@@ -50,7 +50,7 @@ static int rxd_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 
 	do {
 		cntr->progress(cntr);
-		if (threshold <= ofi_atomic_get64(&cntr->cnt))
+		if (threshold <= ofi_cntr_value(cntr))
 			return FI_SUCCESS;
 
 		if (errcnt != ofi_atomic_get64(&cntr->err))
@@ -73,7 +73,7 @@ static int rxd_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 		fastlock_release(&cntr->ep_list_lock);
 
 		ret = fi_wait(&cntr->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
 	} while (!ret);
@@ -107,10 +107,10 @@ static void rxd_remove_rx_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry
 	}
 }
 
+/* The buffer is replaced by the next batch of reposts in rxd_ep_progress */
 void rxd_release_repost_rx(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	ofi_buf_free(pkt_entry);
-	rxd_ep_post_buf(ep);
 }
 
 static void rxd_complete_rx(struct rxd_ep *ep, struct rxd_x_entry *rx_entry)
@@ -168,13 +168,14 @@ static int rxd_comp_pkt_seq_no(struct dlist_entry *item, const void *arg)
 	new_hdr = rxd_get_base_hdr(container_of((struct dlist_entry *) arg,
 				  struct rxd_pkt_entry, d_entry));
 
-	return new_hdr->seq_no > list_hdr->seq_no;
+	return ofi_before(new_hdr->seq_no, list_hdr->seq_no);
 }
 
 void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		      struct rxd_data_pkt *pkt, size_t size)
 {
 	struct rxd_domain *rxd_domain = rxd_ep_domain(ep);
+	struct rxd_peer *peer;
 	uint64_t done;
 	struct iovec *iov;
 	size_t iov_count;
@@ -196,9 +197,13 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 	x_entry->next_seg_no++;
 
 	if (x_entry->next_seg_no < x_entry->num_segs) {
-		if (!(ep->peers[pkt->base_hdr.peer].rx_seq_no %
-		    ep->peers[pkt->base_hdr.peer].rx_window))
+		peer = rxd_peer(ep, pkt->base_hdr.peer);
+		if (pkt->base_hdr.flags & RXD_ACK_REQ ||
+		    !(peer->rx_seq_no % peer->rx_window))
 			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		else
+			ofi_timer_start_before(&ep->timers, &peer->ack_timer,
+				rxd_tick(fi_gettime_us() + RXD_ACK_DELAY));
 		return;
 	}
 	rxd_ep_send_ack(ep, pkt->base_hdr.peer);
@@ -209,54 +214,67 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		rxd_complete_rx(ep, x_entry);
 }
 
-static void rxd_verify_active(struct rxd_ep *ep, fi_addr_t addr, fi_addr_t peer_addr)
+static void rxd_verify_active(struct rxd_ep *ep, struct rxd_peer *peer,
+			      fi_addr_t peer_addr)
 {
 	struct rxd_pkt_entry *pkt_entry;
 
-	if (ep->peers[addr].peer_addr != FI_ADDR_UNSPEC &&
-	    ep->peers[addr].peer_addr != peer_addr)
+	if (peer->peer_addr != FI_ADDR_UNSPEC &&
+	    peer->peer_addr != peer_addr)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 			"overwriting active peer - unexpected behavior\n");
 
-	ep->peers[addr].peer_addr = peer_addr;
+	peer->peer_addr = peer_addr;
 
-	if (!dlist_empty(&ep->peers[addr].unacked) && 
-	    rxd_get_base_hdr(container_of((&ep->peers[addr].unacked)->next,
+	if (!dlist_empty(&peer->unacked) && 
+	    rxd_get_base_hdr(container_of((&peer->unacked)->next,
 			     struct rxd_pkt_entry, d_entry))->type == RXD_RTS) {
-		dlist_pop_front(&ep->peers[addr].unacked,
+		dlist_pop_front(&peer->unacked,
 				struct rxd_pkt_entry, pkt_entry, d_entry);
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
 			pkt_entry->flags |= RXD_PKT_ACKED;
 		} else {
 			ofi_buf_free(pkt_entry);
-			ep->peers[addr].unacked_cnt--;
+			peer->unacked_cnt--;
 		}
-		dlist_remove(&ep->peers[addr].entry);
+		dlist_remove(&peer->entry);
 	}
 
-	if (!ep->peers[addr].active) {
-		dlist_insert_tail(&ep->peers[addr].entry, &ep->active_peers);
-		ep->peers[addr].retry_cnt = 0;
-		ep->peers[addr].active = 1;
+	if (!peer->active) {
+		dlist_insert_tail(&peer->entry, &ep->active_peers);
+		peer->retry_cnt = 0;
+		peer->active = 1;
 	}
 }
 
 int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 	struct rxd_base_hdr *hdr = rxd_get_base_hdr(tx_entry->pkt);
+	struct rxd_x_entry *prev;
 
-	if (ep->peers[tx_entry->peer].unacked_cnt >=
-	    ep->peers[tx_entry->peer].tx_window)
+	if (peer->unacked_cnt >= rxd_peer_window(peer))
 		return 0;
 
-	tx_entry->start_seq = rxd_set_pkt_seq(&ep->peers[tx_entry->peer],
-					      tx_entry->pkt);
-	if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1) {
-		ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-						      tx_entry->num_segs;
+	/* Pacing can hold back the transfer ahead of this one with data
+	 * still to send, which must go out first. */
+	if (tx_entry->entry.prev != &peer->tx_list) {
+		prev = container_of(tx_entry->entry.prev, struct rxd_x_entry,
+				    entry);
+		if (prev->pkt || prev->bytes_done != prev->cq_entry.len)
+			return 0;
+	}
+
+	if (!rxd_peer_pace(peer, fi_gettime_us())) {
+		rxd_peer_defer_tx(ep, peer);
+		return 0;
 	}
-	hdr->peer = ep->peers[tx_entry->peer].peer_addr;
+
+	tx_entry->start_seq = rxd_set_pkt_seq(peer, tx_entry->pkt);
+	if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1)
+		peer->tx_seq_no = tx_entry->start_seq + tx_entry->num_segs;
+	hdr->peer = peer->peer_addr;
 	rxd_ep_send_pkt(ep, tx_entry->pkt);
 	rxd_insert_unacked(ep, tx_entry->peer, tx_entry->pkt);
 	tx_entry->pkt = NULL;
@@ -264,12 +282,10 @@ int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	if (tx_entry->op == RXD_READ_REQ || tx_entry->op == RXD_ATOMIC_FETCH ||
 	    tx_entry->op == RXD_ATOMIC_COMPARE) {
 		dlist_remove(&tx_entry->entry);
-		dlist_insert_tail(&tx_entry->entry,
-				  &ep->peers[tx_entry->peer].rma_rx_list);
+		dlist_insert_tail(&tx_entry->entry, &peer->rma_rx_list);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt <
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt < rxd_peer_window(peer);
 }
 
 void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -277,7 +293,7 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 	struct dlist_entry *tmp_entry;
 	struct rxd_x_entry *tx_entry;
 	uint64_t head_seq = peer->last_rx_ack;
-	int ret = 0, inc = 0;
+	int ret = 0, inc = 0, stalled = 0;
 
 	if (!dlist_empty(&peer->unacked)) {
 		head_seq = rxd_get_base_hdr(container_of(
@@ -292,8 +308,10 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 				tx_entry, entry, tmp_entry) {
 		if (tx_entry->pkt) {
 			if (!rxd_start_xfer(ep, tx_entry) ||
-			    tx_entry->op == RXD_READ_REQ)
+			    tx_entry->op == RXD_READ_REQ) {
+				stalled = 1;
 				break;
+			}
 		}
 
 		if (tx_entry->bytes_done == tx_entry->cq_entry.len) {
@@ -310,33 +328,47 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		}
 				
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
-			if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    	    ep->peers[tx_entry->peer].tx_window) {
+			if (peer->unacked_cnt >= rxd_peer_window(peer) ||
+			    peer->pace_time > fi_gettime_us()) {
+				stalled = 1;
 				break;
 			} 
-			tx_entry->start_seq = ep->peers[tx_entry->peer].tx_seq_no;
-			ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-							      tx_entry->num_segs;
+			tx_entry->start_seq = peer->tx_seq_no;
+			peer->tx_seq_no = tx_entry->start_seq +
+					  tx_entry->num_segs;
 			inc = 1;
 		}
 
 		ret = rxd_ep_post_data_pkts(ep, tx_entry);
 		if (ret) {
 			if (ret == -FI_ENOMEM && inc)
-				ep->peers[tx_entry->peer].tx_seq_no -=
-							  tx_entry->num_segs;
+				peer->tx_seq_no -= tx_entry->num_segs;
+			stalled = 1;
 			break;
 		}
 	}
 
 	if (dlist_empty(&peer->tx_list))
 		peer->retry_cnt = 0;
+
+	/* An ack reopening the window restarts sending, otherwise (pacing,
+	 * or out of packets) try again once the pacing allows. */
+	if (stalled && peer->unacked_cnt < rxd_peer_window(peer))
+		rxd_peer_defer_tx(ep, peer);
 }
 
-static void rxd_update_peer(struct rxd_ep *ep, fi_addr_t peer, fi_addr_t peer_addr)
+static int rxd_update_peer(struct rxd_ep *ep, fi_addr_t addr,
+			   fi_addr_t peer_addr)
 {
+	struct rxd_peer *peer;
+
+	peer = rxd_peer_get(ep, addr);
+	if (!peer)
+		return -FI_ENOMEM;
+
 	rxd_verify_active(ep, peer, peer_addr);
-	rxd_progress_tx_list(ep, &ep->peers[peer]);
+	rxd_progress_tx_list(ep, peer);
+	return 0;
 }
 
 static int rxd_send_cts(struct rxd_ep *rxd_ep, struct rxd_rts_pkt *rts_pkt,
@@ -344,9 +376,11 @@ static int rxd_send_cts(struct rxd_ep *rxd_ep, struct rxd_rts_pkt *rts_pkt,
 {
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_cts_pkt *cts;
-	int ret = 0;
+	int ret;
 
-	rxd_update_peer(rxd_ep, peer, rts_pkt->rts_addr);
+	ret = rxd_update_peer(rxd_ep, peer, rts_pkt->rts_addr);
+	if (ret)
+		return ret;
 
 	pkt_entry = rxd_get_tx_pkt(rxd_ep);
 	if (!pkt_entry)
@@ -520,12 +554,13 @@ static struct rxd_x_entry *rxd_match_rx(struct rxd_ep *ep,
 	}
 
 	if (!match) {
-		assert(!ep->peers[base->peer].curr_unexp);
+		assert(!rxd_peer(ep, base->peer)->curr_unexp);
 		unexp_msg = rxd_init_unexp(ep, pkt_entry, base, op,
 					   tag, data, msg, msg_size);
 		if (unexp_msg) {
 			dlist_insert_tail(&unexp_msg->entry, unexp_list);
-			ep->peers[base->peer].curr_unexp = unexp_msg;
+			rxd_peer(ep, base->peer)->curr_unexp = unexp_msg;
+			rxd_peer(ep, base->peer)->unexp_cnt++;
 		}
 		return NULL;
 	}
@@ -602,9 +637,9 @@ static struct rxd_x_entry *rxd_rma_read_entry_init(struct rxd_ep *ep,
 	rx_entry->cq_entry.flags = ofi_rx_cq_flags(RXD_READ_REQ);
 	rx_entry->cq_entry.len = sar_hdr->size;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, rx_entry->peer)->tx_list);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -677,11 +712,11 @@ static struct rxd_x_entry *rxd_rx_atomic_fetch(struct rxd_ep *ep,
 	if (rx_entry->bytes_done != rx_entry->cq_entry.len)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "fetch data length mismatch\n");
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, rx_entry->peer)->tx_list);
 
 	rxd_ep_send_ack(ep, base_hdr->peer);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -793,7 +828,7 @@ void rxd_do_atomic(void *src, void *dst, void *cmp, enum fi_datatype datatype,
 		ofi_atomic_swap_handlers[atomic_op - OFI_SWAP_OP_START][datatype](dst,
 			src, cmp, tmp_result, cnt);
 	} else if (atomic_op != FI_ATOMIC_READ) {
-		ofi_atomic_write_handlers[atomic_op][datatype](dst, src, cnt);
+		ofi_atomic_write_locked(atomic_op, datatype, dst, src, cnt);
 	}
 }
 
@@ -809,6 +844,7 @@ void rxd_progress_atom_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 			  struct rxd_rma_hdr *rma_hdr, struct rxd_atom_hdr *atom_hdr,
 			  void **msg, size_t msg_size)
 {
+	struct rxd_domain *domain = rxd_ep_domain(ep);
 	char *src, *cmp;
 	size_t len;
 	int i, iov_count;
@@ -818,6 +854,7 @@ void rxd_progress_atom_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 		(msg_size / 2) : NULL;
 
 	iov_count = sar_hdr ? sar_hdr->iov_count : 1;
+	fastlock_acquire(&domain->atomic_lock);
 	for (i = len = 0; i < iov_count; i++) {
 		rxd_do_atomic(&src[len], rx_entry->iov[i].iov_base,
 			      cmp ? &cmp[len] : NULL, atom_hdr->datatype,
@@ -825,6 +862,7 @@ void rxd_progress_atom_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 			      ofi_datatype_size(atom_hdr->datatype));
 		len += rx_entry->iov[i].iov_len;
 	}
+	fastlock_release(&domain->atomic_lock);
 
 	if (base_hdr->type == RXD_ATOMIC)
 		rx_entry->bytes_done = len;
@@ -841,9 +879,9 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 		     void **msg, size_t size)
 {
 	if (sar_hdr)
-		ep->peers[base_hdr->peer].curr_tx_id = sar_hdr->tx_id;
+		rxd_peer(ep, base_hdr->peer)->curr_tx_id = sar_hdr->tx_id;
 
-	ep->peers[base_hdr->peer].curr_rx_id = rx_entry->rx_id;
+	rxd_peer(ep, base_hdr->peer)->curr_rx_id = rx_entry->rx_id;
 
 	if (base_hdr->type == RXD_READ_REQ)
 		return;
@@ -877,7 +915,7 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 	rx_entry->next_seg_no++;
 	rx_entry->start_seq = base_hdr->seq_no;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[base_hdr->peer].rx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, base_hdr->peer)->rx_list);
 }
 
 static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
@@ -885,13 +923,14 @@ static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
 {
 	if (data_pkt->base_hdr.type == RXD_DATA)
 		return ofi_bufpool_get_ibuf(ep->rx_entry_pool,
-			     ep->peers[data_pkt->base_hdr.peer].curr_rx_id);
+			     rxd_peer(ep, data_pkt->base_hdr.peer)->curr_rx_id);
 
 	return ofi_bufpool_get_ibuf(ep->tx_entry_pool, data_pkt->ext_hdr.tx_id);
 }
 
-static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
+static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t addr)
 {
+	struct rxd_peer *peer = rxd_peer(ep, addr);
 	struct fi_cq_err_entry err_entry;
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_base_hdr *base_hdr;
@@ -905,18 +944,44 @@ static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
 	size_t msg_size;
 	struct rxd_x_entry *rx_entry = NULL;
 	struct rxd_data_pkt *data_pkt;
+	struct rxd_unexp_msg *unexp_msg;
 
-	while (!dlist_empty(&ep->peers[peer].buf_pkts)) {
-		pkt_entry = container_of((&ep->peers[peer].buf_pkts)->next,
+	while (!dlist_empty(&peer->buf_pkts)) {
+		pkt_entry = container_of((&peer->buf_pkts)->next,
 					struct rxd_pkt_entry, d_entry);
 		base_hdr = rxd_get_base_hdr(pkt_entry);
-		if (base_hdr->seq_no != ep->peers[peer].rx_seq_no)
+		if (ofi_before(base_hdr->seq_no, peer->rx_seq_no)) {
+			dlist_remove(&pkt_entry->d_entry);
+			rxd_release_repost_rx(ep, pkt_entry);
+			continue;
+		}
+		if (base_hdr->seq_no != peer->rx_seq_no)
 			return;
 
+		if (base_hdr->type == RXD_DATA && peer->curr_unexp) {
+			data_pkt = (struct rxd_data_pkt *) pkt_entry->pkt;
+			unexp_msg = peer->curr_unexp;
+			peer->rx_seq_no++;
+			dlist_remove(&pkt_entry->d_entry);
+			dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
+			if (data_pkt->ext_hdr.seg_no + 1 ==
+			    unexp_msg->sar_hdr->num_segs - 1) {
+				peer->curr_unexp = NULL;
+				rxd_ep_send_ack(ep, addr);
+			}
+			continue;
+		}
+
 		if (base_hdr->type == RXD_DATA || base_hdr->type == RXD_DATA_READ) {
+			/* advance first, so that acks sent from recv_data
+			 * cover this packet */
+			peer->rx_seq_no++;
 			data_pkt = (struct rxd_data_pkt *) pkt_entry->pkt;
 			rx_entry = rxd_get_data_x_entry(ep, data_pkt);
 			rxd_ep_recv_data(ep, rx_entry, data_pkt, pkt_entry->pkt_size);
+			dlist_remove(&pkt_entry->d_entry);
+			rxd_release_repost_rx(ep, pkt_entry);
+			continue;
 		} else {
 			ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
 					      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
@@ -930,7 +995,7 @@ static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
 				if (ret)
 					FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 						"could not write error entry\n");
-				ep->peers[base_hdr->peer].rx_seq_no++;
+				peer->rx_seq_no++;
 				dlist_remove(&pkt_entry->d_entry);
 				rxd_release_repost_rx(ep, pkt_entry);
 				continue;
@@ -938,7 +1003,7 @@ static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
 			if (!rx_entry) {
 				if (base_hdr->type == RXD_MSG ||
 				    base_hdr->type == RXD_TAGGED) {
-					ep->peers[base_hdr->peer].rx_seq_no++;
+					peer->rx_seq_no++;
 					continue;
 				}
 				break;
@@ -949,17 +1014,46 @@ static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
 					atom_hdr, &msg, msg_size);
 		}
 
-		ep->peers[base_hdr->peer].rx_seq_no++;
+		peer->rx_seq_no++;
 		dlist_remove(&pkt_entry->d_entry);
 		rxd_release_repost_rx(ep, pkt_entry);
 	}
 }
 
+/*
+ * Hold on to a data packet that arrived ahead of a missing one, so that
+ * the peer only has to resend what was lost.  The acks report buffered
+ * packets as sack blocks.  Returns 1 if the packet was kept.
+ */
+static int rxd_buf_ooo_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, hdr->peer);
+	struct rxd_pkt_entry *buf_entry;
+
+	if (!ofi_before(peer->rx_seq_no, hdr->seq_no) ||
+	    ofi_after_eq(hdr->seq_no, peer->rx_seq_no + rxd_env.max_unacked))
+		return 0;
+
+	dlist_foreach_container(&peer->buf_pkts, struct rxd_pkt_entry,
+				buf_entry, d_entry) {
+		if (rxd_get_base_hdr(buf_entry)->seq_no == hdr->seq_no)
+			return 0;
+	}
+
+	rxd_remove_rx_pkt(ep, pkt_entry);
+	dlist_insert_order(&peer->buf_pkts, &rxd_comp_pkt_seq_no,
+			   &pkt_entry->d_entry);
+	return 1;
+}
+
 static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	struct rxd_peer *peer = rxd_peer(ep, pkt->base_hdr.peer);
 	struct rxd_x_entry *x_entry;
 	struct rxd_unexp_msg *unexp_msg;
+	int kept;
 
 	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
 		FI_WARN(&rxd_prov, FI_LOG_CQ,
@@ -967,30 +1061,36 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		goto free;
 	}
 
-	if (pkt->base_hdr.seq_no == ep->peers[pkt->base_hdr.peer].rx_seq_no) {
-		ep->peers[pkt->base_hdr.peer].rx_seq_no++;
+	if (pkt->base_hdr.seq_no == peer->rx_seq_no) {
+		peer->rx_seq_no++;
 		if (pkt->base_hdr.type == RXD_DATA &&
-		    ep->peers[pkt->base_hdr.peer].curr_unexp) {
-			unexp_msg = ep->peers[pkt->base_hdr.peer].curr_unexp;
+		    peer->curr_unexp) {
+			unexp_msg = peer->curr_unexp;
 			dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
 			if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
-				ep->peers[pkt->base_hdr.peer].curr_unexp = NULL;
+				peer->curr_unexp = NULL;
 				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 			}
 			rxd_remove_rx_pkt(ep, pkt_entry);
+			if (!dlist_empty(&peer->buf_pkts))
+				rxd_progress_buf_pkts(ep, pkt->base_hdr.peer);
 			return;
 		}
 		x_entry = rxd_get_data_x_entry(ep, pkt);
 		rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
-		if (!dlist_empty(&ep->peers[pkt->base_hdr.peer].buf_pkts))
+		if (!dlist_empty(&peer->buf_pkts))
 			rxd_progress_buf_pkts(ep, pkt->base_hdr.peer);
 	} else if (!rxd_env.retry) {
 		rxd_remove_rx_pkt(ep, pkt_entry);
-		dlist_insert_order(&ep->peers[pkt->base_hdr.peer].buf_pkts,
+		dlist_insert_order(&peer->buf_pkts,
 				   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
 		return;
-	} else if (ep->peers[pkt->base_hdr.peer].peer_addr != FI_ADDR_UNSPEC) {
+	} else if (peer->peer_addr != FI_ADDR_UNSPEC) {
+		kept = rxd_buf_ooo_pkt(ep, pkt_entry);
 		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		if (kept)
+			return;
+		ep->drop_cnt++;
 	}
 free:
 	rxd_remove_rx_pkt(ep, pkt_entry);
@@ -1001,6 +1101,7 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_x_entry *rx_entry;
 	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, base_hdr->peer);
 	struct rxd_sar_hdr *sar_hdr;
 	struct rxd_tag_hdr *tag_hdr;
 	struct rxd_data_hdr *data_hdr;
@@ -1010,20 +1111,21 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	size_t msg_size;
 	int ret;
 
-	if (base_hdr->seq_no != ep->peers[base_hdr->peer].rx_seq_no) {
+	if (base_hdr->seq_no != peer->rx_seq_no) {
 		if (!rxd_env.retry) {
 			rxd_remove_rx_pkt(ep, pkt_entry);
-			dlist_insert_order(&ep->peers[base_hdr->peer].buf_pkts,
+			dlist_insert_order(&peer->buf_pkts,
 					   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
 			return;
 		}
 
-		if (ep->peers[base_hdr->peer].peer_addr != FI_ADDR_UNSPEC)
+		ep->drop_cnt++;
+		if (peer->peer_addr != FI_ADDR_UNSPEC)
 			goto ack;
 		goto release;
 	}
 
-	if (ep->peers[base_hdr->peer].peer_addr == FI_ADDR_UNSPEC)
+	if (peer->peer_addr == FI_ADDR_UNSPEC)
 		goto release;
 
 	ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
@@ -1034,28 +1136,30 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 
 	if (!rx_entry) {
 		if (base_hdr->type == RXD_MSG || base_hdr->type == RXD_TAGGED) {
-			if (!ep->peers[base_hdr->peer].curr_unexp)
+			if (!peer->curr_unexp)
 				goto ack;
 
-			ep->peers[base_hdr->peer].rx_seq_no++;
+			peer->rx_seq_no++;
 			rxd_remove_rx_pkt(ep, pkt_entry);
 
 			if (!sar_hdr)
-				ep->peers[base_hdr->peer].curr_unexp = NULL;
+				peer->curr_unexp = NULL;
 
+			if (!dlist_empty(&peer->buf_pkts))
+				rxd_progress_buf_pkts(ep, base_hdr->peer);
 			rxd_ep_send_ack(ep, base_hdr->peer);
 			return;
 		}
-		ep->peers[base_hdr->peer].rx_window = 0;
+		peer->rx_window = 0;
 		goto ack;
 	}
 
-	ep->peers[base_hdr->peer].rx_seq_no++;
-	ep->peers[base_hdr->peer].rx_window = rxd_env.max_unacked;
+	peer->rx_seq_no++;
+	peer->rx_window = rxd_env.max_unacked;
 	rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr, sar_hdr, tag_hdr,
 			data_hdr, rma_hdr, atom_hdr, &msg, msg_size);
 
-	if (!dlist_empty(&ep->peers[base_hdr->peer].buf_pkts))
+	if (!dlist_empty(&peer->buf_pkts))
 		rxd_progress_buf_pkts(ep, base_hdr->peer);
 
 ack:
@@ -1078,31 +1182,198 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
+/*
+ * Mark the unacked packets covered by the ack's sack blocks so that they
+ * are not resent.  Returns the number of packets newly marked.
+ */
+static int rxd_ack_sack(struct rxd_peer *peer, struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t seq_no, rtt_start = 0;
+	uint32_t i = 0;
+	int cnt = 0;
+
+	if (!ack->sack_cnt)
+		return 0;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		while (i < ack->sack_cnt && i < RXD_MAX_SACK_BLKS &&
+		       ofi_after_eq(seq_no, ack->sack[i].end))
+			i++;
+		if (i == ack->sack_cnt || i == RXD_MAX_SACK_BLKS)
+			break;
+		if (ofi_before(seq_no, ack->sack[i].start) ||
+		    pkt_entry->flags & RXD_PKT_SACKED)
+			continue;
+		if (!(pkt_entry->flags & RXD_PKT_RETX))
+			rtt_start = pkt_entry->timestamp;
+		pkt_entry->flags |= RXD_PKT_SACKED;
+		cnt++;
+	}
+
+	if (rtt_start)
+		rxd_peer_rtt_sample(peer, fi_gettime_us() - rtt_start);
+	return cnt;
+}
+
+/*
+ * Resend the packets the peer is missing without waiting for their
+ * timeout: every packet below the highest one selectively acked that has
+ * neither been acked itself nor resent yet.
+ */
+static void rxd_fast_retransmit(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t high = 0;
+	int sacked = 0;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (pkt_entry->flags & RXD_PKT_SACKED) {
+			high = rxd_get_base_hdr(pkt_entry)->seq_no;
+			sacked = 1;
+		}
+	}
+	if (!sacked)
+		return;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (!ofi_before(rxd_get_base_hdr(pkt_entry)->seq_no, high))
+			break;
+		if (pkt_entry->flags & (RXD_PKT_SACKED | RXD_PKT_RETX |
+					RXD_PKT_IN_USE | RXD_PKT_ACKED))
+			continue;
+		pkt_entry->flags = (pkt_entry->flags & ~RXD_PKT_LOST) |
+				   RXD_PKT_RETX;
+		if (rxd_ep_send_pkt(ep, pkt_entry))
+			break;
+		ep->retrans_cnt++;
+		ep->fast_retrans_cnt++;
+	}
+}
+
+/*
+ * Resend the packets a timeout marked lost, up to a window per ack.  An
+ * ack for the original packets, sent before the timeout was noticed,
+ * frees them instead.
+ */
+static void rxd_resend_lost(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint16_t sent = 0;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (!(pkt_entry->flags & RXD_PKT_LOST))
+			continue;
+		if (pkt_entry->flags & RXD_PKT_SACKED) {
+			pkt_entry->flags &= ~RXD_PKT_LOST;
+			continue;
+		}
+		if (sent == peer->cwnd)
+			return;
+		pkt_entry->flags = (pkt_entry->flags & ~RXD_PKT_LOST) |
+				   RXD_PKT_RETX;
+		if (rxd_ep_send_pkt(ep, pkt_entry)) {
+			pkt_entry->flags |= RXD_PKT_LOST;
+			return;
+		}
+		ep->retrans_cnt++;
+		sent++;
+	}
+	peer->lost = 0;
+}
+
+/*
+ * AIMD: grow the window by the packets acked, exponentially below the
+ * slow start threshold and by one packet per window above it.
+ */
+static void rxd_cwnd_ack(struct rxd_peer *peer, int acked)
+{
+	if (peer->cwnd < peer->ssthresh) {
+		peer->cwnd = MIN(peer->cwnd + acked, peer->ssthresh);
+		return;
+	}
+
+	peer->cwnd_cnt += acked;
+	while (peer->cwnd_cnt >= peer->cwnd) {
+		peer->cwnd_cnt -= peer->cwnd;
+		if (peer->cwnd < rxd_env.max_unacked)
+			peer->cwnd++;
+	}
+}
+
+/*
+ * An ack for the packets resent on a timeout that arrives well within a
+ * round trip of the resend was sent for the original packets: the timeout
+ * was caused by a delay rather than a loss, so restore the window, and
+ * drop the pacing delay built up while the window was collapsed.
+ */
+static void rxd_cwnd_undo(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	if (fi_gettime_us() - peer->rto_time < peer->srtt / 2) {
+		peer->cwnd = MAX(peer->cwnd, peer->prior_cwnd);
+		peer->ssthresh = MAX(peer->ssthresh, peer->prior_ssthresh);
+		peer->pace_time = 0;
+		ep->spurious_cnt++;
+	}
+	peer->rto_time = 0;
+}
+
+/* Loss signalled by duplicate acks halves the window. */
+static void rxd_cwnd_loss(struct rxd_peer *peer)
+{
+	peer->ssthresh = MAX(peer->cwnd / 2, RXD_MIN_SSTHRESH);
+	peer->cwnd = peer->ssthresh;
+	peer->cwnd_cnt = 0;
+}
+
 static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 {
 	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
-	fi_addr_t peer = ack->base_hdr.peer;
+	struct rxd_peer *peer = rxd_peer(ep, ack->base_hdr.peer);
 	struct rxd_base_hdr *hdr;
+	uint64_t rtt_start = 0;
+	int recovery, acked = 0;
 
-	ep->peers[peer].tx_window = ack->ext_hdr.rx_id;
+	peer->tx_window = ack->ext_hdr.rx_id;
 
-	if (ep->peers[peer].last_rx_ack == ack->base_hdr.seq_no)
+	if (peer->last_rx_ack == ack->base_hdr.seq_no) {
+		if (dlist_empty(&peer->unacked) ||
+		    !rxd_ack_sack(peer, ack))
+			return;
+		if (++peer->dup_acks == RXD_DUP_ACK_THRESH) {
+			rxd_cwnd_loss(peer);
+			rxd_fast_retransmit(ep, peer);
+		}
 		return;
+	}
 
-	ep->peers[peer].last_rx_ack = ack->base_hdr.seq_no;
+	peer->last_rx_ack = ack->base_hdr.seq_no;
+	recovery = peer->dup_acks >= RXD_DUP_ACK_THRESH;
+	peer->dup_acks = 0;
 
-	if (dlist_empty(&ep->peers[peer].unacked))
+	if (dlist_empty(&peer->unacked))
 		return;
 
-	pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+	pkt_entry = container_of((&peer->unacked)->next,
 				struct rxd_pkt_entry, d_entry);
 
-	while (&pkt_entry->d_entry != &ep->peers[peer].unacked) {
+	while (&pkt_entry->d_entry != &peer->unacked) {
 		hdr = rxd_get_base_hdr(pkt_entry);
 		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
 			break;
 
+		/* Karn: only sample packets that were sent once, and
+		 * only on the first ack that covers them */
+		if (!(pkt_entry->flags & (RXD_PKT_RETX | RXD_PKT_SACKED)))
+			rtt_start = pkt_entry->timestamp;
+		acked++;
+
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			pkt_entry->flags |= RXD_PKT_ACKED;
 			pkt_entry = container_of((&pkt_entry->d_entry)->next,
@@ -1111,58 +1382,136 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 		}
 		dlist_remove(&pkt_entry->d_entry);
 		ofi_buf_free(pkt_entry);
-	     	ep->peers[peer].unacked_cnt--;
-		ep->peers[peer].retry_cnt = 0;
+	     	peer->unacked_cnt--;
+		peer->retry_cnt = 0;
 
-		pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+		pkt_entry = container_of((&peer->unacked)->next,
 					struct rxd_pkt_entry, d_entry);
 	}
 
-	rxd_progress_tx_list(ep, &ep->peers[ack->base_hdr.peer]);
+	if (peer->rto_time && acked)
+		rxd_cwnd_undo(ep, peer);
+
+	if (rtt_start)
+		rxd_peer_rtt_sample(peer, fi_gettime_us() - rtt_start);
+
+	if (!recovery)
+		rxd_cwnd_ack(peer, acked);
+
+	/* a partial ack during recovery points at the next hole */
+	if (rxd_ack_sack(peer, ack) && recovery) {
+		peer->dup_acks = RXD_DUP_ACK_THRESH;
+		rxd_fast_retransmit(ep, peer);
+	}
+	if (peer->lost)
+		rxd_resend_lost(ep, peer);
+	rxd_progress_tx_list(ep, peer);
 } 
 
-void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
+/*
+ * Release a sent packet, or mark it as no longer in use if it still waits
+ * for an ack.  Returns 1 if an acked packet was released, opening the
+ * peer's window.
+ */
+int rxd_tx_pkt_done(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
-	struct rxd_pkt_entry *pkt_entry =
-		container_of(comp->op_context, struct rxd_pkt_entry, context);
 	fi_addr_t peer;
 
-	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
-	       "got send completion (type: %s)\n",
-	       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
-
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_CTS:
 	case RXD_ACK:
 		dlist_remove(&pkt_entry->d_entry);
 		ofi_buf_free(pkt_entry);
-		break;
+		return 0;
 	default:
 		if (pkt_entry->flags & RXD_PKT_ACKED) {
 			peer = pkt_entry->peer;
 			dlist_remove(&pkt_entry->d_entry);
 			ofi_buf_free(pkt_entry);
-	     		ep->peers[peer].unacked_cnt--;
-			rxd_progress_tx_list(ep, &ep->peers[peer]);
-		} else {
-			pkt_entry->flags &= ~RXD_PKT_IN_USE;
+	     		rxd_peer(ep, peer)->unacked_cnt--;
+			return 1;
 		}
+		pkt_entry->flags &= ~RXD_PKT_IN_USE;
+		return 0;
 	}
 }
 
-void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
+void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
 		container_of(comp->op_context, struct rxd_pkt_entry, context);
+	fi_addr_t peer = pkt_entry->peer;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
-	       "got recv completion (type: %s)\n",
+	       "got send completion (type: %s)\n",
 	       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
 
-	ep->posted_bufs--;
+	if (rxd_pkt_type(pkt_entry) == RXD_AGGR)
+		ofi_buf_free(pkt_entry);
+	else if (rxd_tx_pkt_done(ep, pkt_entry))
+		rxd_progress_tx_list(ep, rxd_peer(ep, peer));
+}
 
-	pkt_entry->pkt_size = comp->len;
-	switch (rxd_pkt_type(pkt_entry)) {
+static void rxd_handle_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+
+/*
+ * Unpack an aggregate into packets of their own, posted as if they had
+ * been received one by one.  Packets that cannot be unpacked are dropped
+ * and recovered by retransmission.
+ */
+static void rxd_handle_aggr(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_aggr_hdr *aggr_hdr;
+	struct rxd_pkt_entry *sub_entry;
+	char *ptr, *end;
+
+	if (rxd_get_base_hdr(pkt_entry)->version != RXD_PROTOCOL_VERSION) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"aggregate packet version mismatch\n");
+		return;
+	}
+
+	ptr = (char *) pkt_entry->pkt + sizeof(struct rxd_base_hdr);
+	end = (char *) pkt_entry->pkt + pkt_entry->pkt_size -
+	      ep->rx_prefix_size;
+	while (ptr + sizeof(*aggr_hdr) <= end) {
+		aggr_hdr = (struct rxd_aggr_hdr *) ptr;
+		ptr += sizeof(*aggr_hdr);
+		if (aggr_hdr->len < sizeof(struct rxd_base_hdr) ||
+		    aggr_hdr->len > end - ptr ||
+		    ((struct rxd_base_hdr *) ptr)->type == RXD_AGGR) {
+			FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+				"malformed aggregate packet\n");
+			return;
+		}
+
+		sub_entry = rxd_get_rx_pkt(ep);
+		if (!sub_entry) {
+			FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+				"Unable to unpack aggregate packet\n");
+			return;
+		}
+		memcpy(sub_entry->pkt, ptr, aggr_hdr->len);
+		sub_entry->pkt_size = aggr_hdr->len + ep->rx_prefix_size;
+		slist_insert_head(&sub_entry->s_entry, &ep->rx_pkt_list);
+		rxd_handle_pkt(ep, sub_entry);
+
+		ptr += ofi_get_aligned_size(aggr_hdr->len, RXD_AGGR_ALIGN);
+	}
+}
+
+static void rxd_handle_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	int type = rxd_pkt_type(pkt_entry);
+
+	/* allocate the state of a peer freed while idle */
+	if (type != RXD_RTS && type != RXD_CTS && type != RXD_AGGR &&
+	    !rxd_peer_get(ep, rxd_get_base_hdr(pkt_entry)->peer)) {
+		ep->drop_cnt++;
+		goto release;
+	}
+
+	switch (type) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
 		break;
@@ -1172,6 +1521,9 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	case RXD_ACK:
 		rxd_handle_ack(ep, pkt_entry);
 		break;
+	case RXD_AGGR:
+		rxd_handle_aggr(ep, pkt_entry);
+		break;
 	case RXD_DATA:
 	case RXD_DATA_READ:
 		rxd_handle_data(ep, pkt_entry);
@@ -1187,10 +1539,26 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 		return;
 	}
 
+release:
 	rxd_remove_rx_pkt(ep, pkt_entry);
 	rxd_release_repost_rx(ep, pkt_entry);
 }
 
+void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
+{
+	struct rxd_pkt_entry *pkt_entry =
+		container_of(comp->op_context, struct rxd_pkt_entry, context);
+
+	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
+	       "got recv completion (type: %s)\n",
+	       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
+
+	ep->posted_bufs--;
+
+	pkt_entry->pkt_size = comp->len;
+	rxd_handle_pkt(ep, pkt_entry);
+}
+
 void rxd_handle_error(struct rxd_ep *ep)
 {
 	struct fi_cq_err_entry err = {0};
@@ -1268,7 +1636,7 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		cq->cq_fastlock_release(&cq->ep_list_lock);
 
 		ret = fi_wait(&cq->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
@@ -66,6 +66,7 @@ static int rxd_domain_close(fid_t fid)
 		return ret;
 
 	ofi_mr_map_close(&rxd_domain->mr_map);
+	fastlock_destroy(&rxd_domain->atomic_lock);
 	free(rxd_domain);
 	return 0;
 }
@@ -74,7 +75,7 @@ static struct fi_ops rxd_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = rxd_domain_close,
 	.bind = fi_no_bind,
-	.control = fi_no_control,
+	.control = ofi_domain_control,
 	.ops_open = fi_no_ops_open,
 };
 
@@ -150,6 +151,7 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	(*domain)->fid.ops = &rxd_domain_fi_ops;
 	(*domain)->ops = &rxd_domain_ops;
 	(*domain)->mr = &rxd_mr_ops;
+	fastlock_init(&rxd_domain->atomic_lock);
 	fi_freeinfo(dg_info);
 	return 0;
 err4:
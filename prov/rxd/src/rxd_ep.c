@@ -55,7 +55,7 @@ struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep)
 	return pkt_entry;
 }
 
-static struct rxd_pkt_entry *rxd_get_rx_pkt(struct rxd_ep *ep)
+struct rxd_pkt_entry *rxd_get_rx_pkt(struct rxd_ep *ep)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	void *mr = NULL;
@@ -253,19 +253,30 @@ static inline void *rxd_mr_desc(struct fid_mr *mr, struct rxd_ep *ep)
 	return (ep->do_local_mr) ? fi_mr_desc(mr) : NULL;
 }
 
-int rxd_ep_post_buf(struct rxd_ep *ep)
+static int rxd_ep_post_buf(struct rxd_ep *ep, uint64_t flags)
 {
 	struct rxd_pkt_entry *pkt_entry;
+	struct fi_msg msg;
+	struct iovec iov;
+	void *desc;
 	ssize_t ret;
 
 	pkt_entry = rxd_get_rx_pkt(ep);
 	if (!pkt_entry)
 		return -FI_ENOMEM;
 
-	ret = fi_recv(ep->dg_ep, rxd_pkt_start(pkt_entry),
-		      rxd_ep_domain(ep)->max_mtu_sz,
-		      rxd_mr_desc(pkt_entry->mr, ep),
-		      FI_ADDR_UNSPEC, &pkt_entry->context);
+	iov.iov_base = rxd_pkt_start(pkt_entry);
+	iov.iov_len = rxd_ep_domain(ep)->max_mtu_sz;
+	desc = rxd_mr_desc(pkt_entry->mr, ep);
+
+	msg.msg_iov = &iov;
+	msg.desc = &desc;
+	msg.iov_count = 1;
+	msg.addr = FI_ADDR_UNSPEC;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = fi_recvmsg(ep->dg_ep, &msg, flags);
 	if (ret) {
 		ofi_buf_free(pkt_entry);
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "failed to repost\n");
@@ -278,9 +289,22 @@ int rxd_ep_post_buf(struct rxd_ep *ep)
 	return 0;
 }
 
+/*
+ * Top up the receive buffers posted to the core provider.  Released
+ * buffers are reposted here in a batch rather than one at a time, with
+ * all but the last post flagged FI_MORE.
+ */
+void rxd_ep_post_bufs(struct rxd_ep *ep)
+{
+	while (ep->posted_bufs < ep->rx_size) {
+		if (rxd_ep_post_buf(ep, ep->posted_bufs + 1 < ep->rx_size ?
+				    FI_MORE : 0))
+			break;
+	}
+}
+
 static int rxd_ep_enable(struct rxd_ep *ep)
 {
-	size_t i;
 	ssize_t ret;
 
 	ret = fi_ep_bind(ep->dg_ep, &ep->dg_cq->fid, FI_TRANSMIT | FI_RECV);
@@ -295,27 +319,30 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 	ep->rx_flags = rxd_rx_flags(ep->util_ep.rx_op_flags);
 
 	fastlock_acquire(&ep->util_ep.lock);
-	for (i = 0; i < ep->rx_size; i++) {
-		ret = rxd_ep_post_buf(ep);
-		if (ret)
-			break;
-	}
-
+	rxd_ep_post_bufs(ep);
 	fastlock_release(&ep->util_ep.lock);
 	return 0;
 }
 
 /*
- * Exponential back-off starting at 1ms, max 4s.
+ * RTT estimator and retransmission timeout (usec) as in RFC 6298, with a
+ * lower bound suited to datagram fabrics rather than the Internet.  The
+ * timeout is backed off on expiry and kept until the next valid sample.
  */
-int rxd_get_timeout(uint8_t retry_cnt)
-{
-	return MIN(1 << retry_cnt, 4000);
-}
-
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt)
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt)
 {
-	return start + rxd_get_timeout(retry_cnt);
+	uint64_t delta;
+
+	if (!peer->srtt) {
+		peer->srtt = rtt ? rtt : 1;
+		peer->rttvar = rtt / 2;
+	} else {
+		delta = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+		peer->rttvar = (3 * peer->rttvar + delta) / 4;
+		peer->srtt = (7 * peer->srtt + rtt) / 8;
+	}
+	peer->rto = MIN(MAX(peer->srtt + 4 * peer->rttvar, RXD_MIN_RTO),
+			RXD_MAX_RTO);
 }
 
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
@@ -336,7 +363,7 @@ void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 	data_pkt->ext_hdr.rx_id = tx_entry->rx_id;
 	data_pkt->ext_hdr.tx_id = tx_entry->tx_id;
 	data_pkt->ext_hdr.seg_no = tx_entry->next_seg_no++;
-	data_pkt->base_hdr.peer = ep->peers[tx_entry->peer].peer_addr;
+	data_pkt->base_hdr.peer = rxd_peer(ep, tx_entry->peer)->peer_addr;
 
 	pkt_entry->pkt_size = ofi_copy_from_iov(data_pkt->msg, seg_size,
 						tx_entry->iov,
@@ -369,7 +396,7 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 
 	tx_entry->op = op;
 	tx_entry->peer = addr;
-	tx_entry->flags = flags;
+	tx_entry->flags = flags & ~RXD_MORE;
 	tx_entry->bytes_done = 0;
 	tx_entry->offset = 0;
 	tx_entry->next_seg_no = 0;
@@ -386,7 +413,7 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 	tx_entry->pkt->peer = tx_entry->peer;
 
 	dlist_insert_tail(&tx_entry->entry,
-			  &ep->peers[tx_entry->peer].tx_list);
+			  &rxd_peer(ep, tx_entry->peer)->tx_list);
 
 	return tx_entry;
 }
@@ -399,23 +426,34 @@ void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	ofi_ibuf_free(tx_entry);
 }
 
-void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
+void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t addr,
 			struct rxd_pkt_entry *pkt_entry)
 {
-	dlist_insert_tail(&pkt_entry->d_entry,
-			  &ep->peers[peer].unacked);
-	ep->peers[peer].unacked_cnt++;
+	struct rxd_peer *peer = rxd_peer(ep, addr);
+
+	dlist_insert_tail(&pkt_entry->d_entry, &peer->unacked);
+	peer->unacked_cnt++;
+
+	if (rxd_env.retry && !ofi_timer_pending(&peer->retry_timer))
+		ofi_timer_start(&ep->timers, &peer->retry_timer,
+				rxd_tick(pkt_entry->timestamp + peer->rto));
 }
 
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_data_pkt *data;
+	uint64_t now = fi_gettime_us();
+	int last;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
-		if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    ep->peers[tx_entry->peer].tx_window)
+		if (peer->unacked_cnt >= rxd_peer_window(peer))
 			return 0;
+		if (!rxd_peer_pace(peer, now)) {
+			rxd_peer_defer_tx(ep, peer);
+			return 1;
+		}
 
 		pkt_entry = rxd_get_tx_pkt(ep);
 		if (!pkt_entry)
@@ -429,24 +467,41 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
 
-		rxd_ep_send_pkt(ep, pkt_entry);
+		/* Hint that more follow while the window stays open.  When
+		 * the window closes mid-message, ask the peer to ack now
+		 * rather than at its next ack interval. */
+		last = tx_entry->bytes_done == tx_entry->cq_entry.len;
+		if (!last && peer->unacked_cnt + 1 >= rxd_peer_window(peer))
+			data->base_hdr.flags |= RXD_ACK_REQ;
+		rxd_ep_send_pkt_flags(ep, pkt_entry,
+			!last && !(data->base_hdr.flags & RXD_ACK_REQ) ?
+			FI_MORE : 0);
 		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt >=
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt >= rxd_peer_window(peer);
 }
 
-int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+static int rxd_ep_post_send(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			    uint64_t flags)
 {
+	struct fi_msg msg;
+	struct iovec iov;
+	void *desc;
 	int ret;
 
-	pkt_entry->timestamp = fi_gettime_ms();
+	iov.iov_base = rxd_pkt_start(pkt_entry);
+	iov.iov_len = pkt_entry->pkt_size;
+	desc = rxd_mr_desc(pkt_entry->mr, ep);
 
-	ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
-		      pkt_entry->pkt_size, rxd_mr_desc(pkt_entry->mr, ep),
-		      rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr,
-		      &pkt_entry->context);
+	msg.msg_iov = &iov;
+	msg.desc = &desc;
+	msg.iov_count = 1;
+	msg.addr = rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = fi_sendmsg(ep->dg_ep, &msg, flags);
 	if (ret) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
 			ret, fi_strerror(-ret));
@@ -457,6 +512,198 @@ int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	return 0;
 }
 
+static inline size_t rxd_aggr_len(struct rxd_ep *ep,
+				  struct rxd_pkt_entry *pkt_entry)
+{
+	return sizeof(struct rxd_aggr_hdr) +
+	       ofi_get_aligned_size(pkt_entry->pkt_size - ep->tx_prefix_size,
+				    RXD_AGGR_ALIGN);
+}
+
+/*
+ * Send the packets waiting for a peer, packed into one datagram when there
+ * is more than one.  The packets are copied out, so they are completed
+ * right away, as if their own sends had completed.  Acks are piggybacked
+ * on the datagram when one is due.  Releasing an acked packet may open
+ * the window; the sends it allows are started here when 'progress' is
+ * set, and otherwise from the timer wheel, as the caller may be in the
+ * middle of posting data for the same peer.
+ */
+static void rxd_peer_aggr_flush(struct rxd_ep *ep, struct rxd_peer *peer,
+				int progress)
+{
+	struct rxd_pkt_entry *pkt_entry, *aggr_entry = NULL;
+	struct rxd_base_hdr *base_hdr;
+	struct rxd_aggr_hdr *aggr_hdr;
+	struct slist_entry *item;
+	struct slist list;
+	size_t len, cnt = 0;
+	char *ptr;
+	int opened = 0;
+
+	if (!peer->aggr_ack && ofi_timer_pending(&peer->ack_timer) &&
+	    peer->aggr_size + sizeof(struct rxd_aggr_hdr) +
+	    sizeof(struct rxd_ack_pkt) <= rxd_ep_domain(ep)->max_mtu_sz -
+	    ep->tx_prefix_size)
+		rxd_ep_send_ack(ep, peer->addr);
+
+	list = peer->aggr_list;
+	slist_init(&peer->aggr_list);
+	peer->aggr_ack = NULL;
+	peer->aggr_size = 0;
+	dlist_remove_init(&peer->aggr_entry);
+
+	if (list.head == list.tail) {
+		pkt_entry = container_of(list.head, struct rxd_pkt_entry,
+					 s_entry);
+		if (!rxd_ep_post_send(ep, pkt_entry, 0))
+			return;
+		goto complete;
+	}
+
+	aggr_entry = rxd_get_tx_pkt(ep);
+	if (!aggr_entry) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"Unable to allocate aggregate packet\n");
+		goto complete;
+	}
+
+	base_hdr = aggr_entry->pkt;
+	base_hdr->version = RXD_PROTOCOL_VERSION;
+	base_hdr->type = RXD_AGGR;
+	base_hdr->flags = 0;
+	base_hdr->peer = peer->peer_addr;
+	base_hdr->seq_no = 0;
+
+	ptr = (char *) (base_hdr + 1);
+	for (item = list.head; item; item = item->next) {
+		pkt_entry = container_of(item, struct rxd_pkt_entry, s_entry);
+		len = pkt_entry->pkt_size - ep->tx_prefix_size;
+		aggr_hdr = (struct rxd_aggr_hdr *) ptr;
+		aggr_hdr->len = (uint16_t) len;
+		memset(aggr_hdr->resv, 0, sizeof(aggr_hdr->resv));
+		memcpy(aggr_hdr + 1, pkt_entry->pkt, len);
+		ptr += rxd_aggr_len(ep, pkt_entry);
+		cnt++;
+	}
+	aggr_entry->pkt_size = (ptr - (char *) base_hdr) + ep->tx_prefix_size;
+	aggr_entry->peer = peer->addr;
+
+	if (rxd_ep_post_send(ep, aggr_entry, 0)) {
+		ofi_buf_free(aggr_entry);
+	} else {
+		ep->aggr_cnt++;
+		ep->aggr_pkt_cnt += cnt;
+	}
+
+complete:
+	while (!slist_empty(&list)) {
+		item = slist_remove_head(&list);
+		pkt_entry = container_of(item, struct rxd_pkt_entry, s_entry);
+		opened |= rxd_tx_pkt_done(ep, pkt_entry);
+	}
+	if (!opened)
+		return;
+
+	if (progress)
+		rxd_progress_tx_list(ep, peer);
+	else
+		rxd_peer_defer_tx(ep, peer);
+}
+
+static void rxd_peer_aggr_add(struct rxd_ep *ep, struct rxd_peer *peer,
+			      struct rxd_pkt_entry *pkt_entry)
+{
+	size_t len = rxd_aggr_len(ep, pkt_entry);
+
+	if (peer->aggr_size + len > rxd_ep_domain(ep)->max_mtu_sz -
+				    ep->tx_prefix_size)
+		rxd_peer_aggr_flush(ep, peer, 0);
+
+	if (slist_empty(&peer->aggr_list)) {
+		peer->aggr_size = sizeof(struct rxd_base_hdr);
+		dlist_insert_tail(&peer->aggr_entry, &ep->aggr_peers);
+	}
+	slist_insert_tail(&pkt_entry->s_entry, &peer->aggr_list);
+	peer->aggr_size += len;
+	if (rxd_pkt_type(pkt_entry) == RXD_ACK)
+		peer->aggr_ack = pkt_entry;
+	pkt_entry->flags |= RXD_PKT_IN_USE;
+}
+
+static void rxd_peer_aggr_discard(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct slist_entry *item;
+
+	while (!slist_empty(&peer->aggr_list)) {
+		item = slist_remove_head(&peer->aggr_list);
+		pkt_entry = container_of(item, struct rxd_pkt_entry, s_entry);
+		pkt_entry->flags &= ~RXD_PKT_IN_USE;
+		if (rxd_pkt_type(pkt_entry) == RXD_CTS ||
+		    rxd_pkt_type(pkt_entry) == RXD_ACK) {
+			dlist_remove(&pkt_entry->d_entry);
+			ofi_buf_free(pkt_entry);
+		}
+	}
+	peer->aggr_ack = NULL;
+	peer->aggr_size = 0;
+	dlist_remove_init(&peer->aggr_entry);
+}
+
+/*
+ * Packets sent between rxd_ep_aggr_begin and the matching rxd_ep_aggr_end
+ * that are small enough are held back per peer, and packed together when
+ * the outermost batch ends.  Progress opens a batch around the completions
+ * it handles, as do the transmit calls.  A transmit flagged FI_MORE keeps
+ * the batch open until the next transmit without it, or the next progress.
+ */
+void rxd_ep_aggr_begin(struct rxd_ep *ep)
+{
+	ep->aggr_depth++;
+}
+
+void rxd_ep_aggr_end(struct rxd_ep *ep, int more)
+{
+	if (more && !ep->aggr_held) {
+		ep->aggr_held = 1;
+		return;
+	}
+	if (!more && ep->aggr_held) {
+		ep->aggr_held = 0;
+		ep->aggr_depth--;
+	}
+	if (--ep->aggr_depth)
+		return;
+
+	ep->aggr_depth++;
+	while (!dlist_empty(&ep->aggr_peers))
+		rxd_peer_aggr_flush(ep, container_of(ep->aggr_peers.next,
+				    struct rxd_peer, aggr_entry), 1);
+	ep->aggr_depth--;
+}
+
+int rxd_ep_send_pkt_flags(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			  uint64_t flags)
+{
+	struct rxd_peer *peer = rxd_peer(ep, pkt_entry->peer);
+
+	pkt_entry->timestamp = fi_gettime_us();
+	peer->busy = 1;
+
+	if (ep->aggr_depth &&
+	    pkt_entry->pkt_size - ep->tx_prefix_size <= RXD_AGGR_PKT_SIZE) {
+		rxd_peer_aggr_add(ep, peer, pkt_entry);
+		return 0;
+	}
+
+	/* keep the packets to a peer in order */
+	if (!slist_empty(&peer->aggr_list))
+		rxd_peer_aggr_flush(ep, peer, 0);
+
+	return rxd_ep_post_send(ep, pkt_entry, flags);
+}
+
 static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 {
 	struct rxd_pkt_entry *pkt_entry;
@@ -487,15 +734,20 @@ static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 
 	rxd_ep_send_pkt(rxd_ep, pkt_entry);
 	rxd_insert_unacked(rxd_ep, rxd_addr, pkt_entry);
-	dlist_insert_tail(&rxd_ep->peers[rxd_addr].entry, &rxd_ep->rts_sent_list);
+	dlist_insert_tail(&rxd_peer(rxd_ep, rxd_addr)->entry, &rxd_ep->rts_sent_list);
 
 	return 0;
 }
 
 ssize_t rxd_send_rts_if_needed(struct rxd_ep *ep, fi_addr_t addr)
 {
-	if (ep->peers[addr].peer_addr == FI_ADDR_UNSPEC &&
-	    dlist_empty(&ep->peers[addr].unacked))
+	struct rxd_peer *peer;
+
+	peer = rxd_peer_get(ep, addr);
+	if (!peer)
+		return -FI_ENOMEM;
+
+	if (peer->peer_addr == FI_ADDR_UNSPEC && dlist_empty(&peer->unacked))
 		return rxd_ep_send_rts(ep, addr);
 	return 0;
 }
@@ -508,7 +760,7 @@ void rxd_init_base_hdr(struct rxd_ep *rxd_ep, void **ptr,
 	hdr->version = RXD_PROTOCOL_VERSION;
 	hdr->type = tx_entry->op;
 	hdr->seq_no = 0;
-	hdr->peer = rxd_ep->peers[tx_entry->peer].peer_addr;
+	hdr->peer = rxd_peer(rxd_ep, tx_entry->peer)->peer_addr;
 	hdr->flags = tx_entry->flags;
 
 	*ptr = (char *) (*ptr) + sizeof(*hdr);
@@ -578,27 +830,66 @@ size_t rxd_init_msg(void **ptr, const struct iovec *iov, size_t iov_count,
 	return done;
 }
 
-void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
+/*
+ * Report the packets buffered ahead of the next expected one, coalesced
+ * into ranges.  buf_pkts is kept in sequence order.
+ */
+static void rxd_ep_fill_sack(struct rxd_peer *peer, struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_sack_blk *blk = NULL;
+	uint64_t seq_no;
+
+	ack->sack_cnt = 0;
+	ack->resv = 0;
+	dlist_foreach_container(&peer->buf_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (!ofi_before(peer->rx_seq_no, seq_no))
+			continue;
+		if (blk && seq_no == blk->end) {
+			blk->end++;
+			continue;
+		}
+		if (ack->sack_cnt == RXD_MAX_SACK_BLKS)
+			break;
+		blk = &ack->sack[ack->sack_cnt++];
+		blk->start = seq_no;
+		blk->end = seq_no + 1;
+	}
+}
+
+void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t addr)
 {
+	struct rxd_peer *peer = rxd_peer(rxd_ep, addr);
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_ack_pkt *ack;
 
-	pkt_entry = rxd_get_tx_pkt(rxd_ep);
+	/* an ack still waiting to be packed is brought up to date instead */
+	pkt_entry = peer->aggr_ack;
+	if (!pkt_entry)
+		pkt_entry = rxd_get_tx_pkt(rxd_ep);
 	if (!pkt_entry) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "Unable to send ack\n");
+		ofi_timer_start(&rxd_ep->timers, &peer->ack_timer,
+				rxd_tick(fi_gettime_us()) + 1);
 		return;
 	}
+	ofi_timer_stop(&rxd_ep->timers, &peer->ack_timer);
 
 	ack = (struct rxd_ack_pkt *) (pkt_entry->pkt);
 	pkt_entry->pkt_size = sizeof(*ack) + rxd_ep->tx_prefix_size;
-	pkt_entry->peer = peer;
+	pkt_entry->peer = addr;
 
 	ack->base_hdr.version = RXD_PROTOCOL_VERSION;
 	ack->base_hdr.type = RXD_ACK;
-	ack->base_hdr.peer = rxd_ep->peers[peer].peer_addr;
-	ack->base_hdr.seq_no = rxd_ep->peers[peer].rx_seq_no;
-	ack->ext_hdr.rx_id = rxd_ep->peers[peer].rx_window;
-	rxd_ep->peers[peer].last_tx_ack = ack->base_hdr.seq_no;
+	ack->base_hdr.peer = peer->peer_addr;
+	ack->base_hdr.seq_no = peer->rx_seq_no;
+	ack->ext_hdr.rx_id = peer->rx_window;
+	rxd_ep_fill_sack(peer, ack);
+	peer->last_tx_ack = ack->base_hdr.seq_no;
+	if (pkt_entry == peer->aggr_ack)
+		return;
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
 	if (rxd_ep_send_pkt(rxd_ep, pkt_entry)) {
@@ -609,10 +900,24 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 
 static void rxd_ep_free_res(struct rxd_ep *ep)
 {
+	size_t i;
+
 	ofi_bufpool_destroy(ep->tx_pkt_pool);
 	ofi_bufpool_destroy(ep->rx_pkt_pool);
 	ofi_bufpool_destroy(ep->tx_entry_pool);
 	ofi_bufpool_destroy(ep->rx_entry_pool);
+	ofi_bufpool_destroy(ep->peer_pool);
+
+	for (i = 0; i < ep->peer_chunk_cnt; i++)
+		free(ep->peer_table[i]);
+	free(ep->peer_table);
+}
+
+static void rxd_peer_stop_timers(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	ofi_timer_stop(&ep->timers, &peer->retry_timer);
+	ofi_timer_stop(&ep->timers, &peer->tx_timer);
+	ofi_timer_stop(&ep->timers, &peer->ack_timer);
 }
 
 static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -620,6 +925,13 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_x_entry *x_entry;
 
+	FI_INFO(&rxd_prov, FI_LOG_EP_CTRL, "peer %" PRIu64 ": cwnd %u, "
+		"ssthresh %u, srtt %" PRIu64 " us, rto %" PRIu64 " us\n",
+		peer->peer_addr, peer->cwnd, peer->ssthresh, peer->srtt,
+		peer->rto);
+
+	rxd_peer_stop_timers(ep, peer);
+	rxd_peer_aggr_discard(ep, peer);
 	while (!dlist_empty(&peer->unacked)) {
 		dlist_pop_front(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry);
@@ -627,6 +939,12 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		peer->unacked_cnt--;
 	}
 
+	while (!dlist_empty(&peer->buf_pkts)) {
+		dlist_pop_front(&peer->buf_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		ofi_buf_free(pkt_entry);
+	}
+
 	while(!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry,
 				x_entry, entry);
@@ -676,6 +994,16 @@ static int rxd_ep_close(struct fid *fid)
 	struct rxd_peer *peer;
 
 	ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
+	if (ofi_atomic_get32(&ep->util_ep.ref))
+		return -FI_EBUSY;
+
+	FI_INFO(&rxd_prov, FI_LOG_EP_CTRL, "transfer stats: retransmits %zu "
+		"(fast %zu), timeouts %zu (spurious %zu), dropped rx packets "
+		"%zu, %zu packets packed into %zu datagrams, peer state "
+		"allocated %zu times, freed idle %zu times\n",
+		ep->retrans_cnt, ep->fast_retrans_cnt, ep->timeout_cnt,
+		ep->spurious_cnt, ep->drop_cnt, ep->aggr_pkt_cnt,
+		ep->aggr_cnt, ep->peer_alloc_cnt, ep->peer_idle_cnt);
 
 	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry)
 		rxd_close_peer(ep, peer);
@@ -851,6 +1179,10 @@ static int rxd_ep_control(struct fid *fid, int command, void *arg)
 		ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
 		ret = rxd_ep_enable(ep);
 		break;
+	case FI_ALIAS:
+		ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
+		ret = ofi_ep_alias(&ep->util_ep, arg);
+		break;
 	default:
 		ret = -FI_ENOSYS;
 		break;
@@ -902,6 +1234,7 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	struct rxd_pkt_entry *pkt_entry;
 	int ret;
 
+	rxd_peer_aggr_discard(rxd_ep, peer);
 	while (!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry, tx_entry, entry);
 		memset(&err_entry, 0, sizeof(struct fi_cq_err_entry));
@@ -922,91 +1255,149 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	     	peer->unacked_cnt--;
 	}
 
-	dlist_remove(&peer->entry);
+	rxd_peer_stop_timers(rxd_ep, peer);
+	dlist_remove_init(&peer->entry);
 }
 
+/*
+ * Resend the oldest packet whose timeout has expired.  The other expired
+ * packets are marked lost and resent as acks reopen the window, so that a
+ * timeout caused by a late ack costs one packet, not the whole window.
+ * Packets the peer has selectively acked are skipped, unless a timeout
+ * has already passed without progress, in which case the sack information
+ * is not trusted.
+ */
 static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
-	uint64_t current;
-	int ret, retry = 0;
+	uint64_t current, rto, next = UINT64_MAX;
+	int ret, retry = 0, resent = 0;
 
-	current = fi_gettime_ms();
 	if (peer->retry_cnt > RXD_MAX_PKT_RETRY) {
 		rxd_peer_timeout(ep, peer);
 		return;
 	}
 
+	current = fi_gettime_us();
+	rto = peer->rto;
 	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry) {
+		if (pkt_entry->flags & RXD_PKT_SACKED && !peer->retry_cnt) {
+			if (current >= pkt_entry->timestamp + rto)
+				retry = 1;
+			else
+				next = MIN(next, pkt_entry->timestamp + rto);
+			continue;
+		}
 		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED) ||
-		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
+		    current < pkt_entry->timestamp + rto) {
+			next = MIN(next, pkt_entry->timestamp + rto);
 			break;
+		}
 		retry = 1;
+		if (resent) {
+			pkt_entry->flags |= RXD_PKT_LOST;
+			peer->lost = 1;
+			continue;
+		}
+		pkt_entry->flags = (pkt_entry->flags & ~RXD_PKT_LOST) |
+				   RXD_PKT_RETX;
 		ret = rxd_ep_send_pkt(ep, pkt_entry);
-		if (ret)
+		if (ret) {
+			next = current;
 			break;
+		}
+		ep->retrans_cnt++;
+		resent = 1;
 	}
-	if (retry)
+	if (retry) {
+		/* a timeout collapses the window, halving the threshold
+		 * only once per loss.  Until the RTT is measured, the
+		 * timeout is only a guess and just backs off. */
+		if (!peer->retry_cnt && peer->srtt) {
+			peer->prior_cwnd = peer->cwnd;
+			peer->prior_ssthresh = peer->ssthresh;
+			peer->ssthresh = MAX(peer->unacked_cnt / 2,
+					     RXD_MIN_SSTHRESH);
+		}
+		if (peer->srtt) {
+			peer->cwnd = 1;
+			peer->cwnd_cnt = 0;
+			peer->rto_time = current;
+		}
 		peer->retry_cnt++;
+		peer->rto = rto = MIN(rto << 1, RXD_MAX_RTO);
+		ep->timeout_cnt++;
+	}
 
 	if (!dlist_empty(&peer->unacked))
-		ep->next_retry = ep->next_retry == -1 ? peer->retry_cnt :
-				 MIN(ep->next_retry, peer->retry_cnt);
+		ofi_timer_start(&ep->timers, &peer->retry_timer,
+				rxd_tick(MIN(next, current + rto)));
+}
+
+static void rxd_peer_retry_timer(struct ofi_timer_wheel *wheel,
+				 struct ofi_timer *timer)
+{
+	rxd_progress_pkt_list(container_of(wheel, struct rxd_ep, timers),
+			      container_of(timer, struct rxd_peer,
+					   retry_timer));
+}
+
+static void rxd_peer_tx_timer(struct ofi_timer_wheel *wheel,
+			      struct ofi_timer *timer)
+{
+	rxd_progress_tx_list(container_of(wheel, struct rxd_ep, timers),
+			     container_of(timer, struct rxd_peer, tx_timer));
+}
+
+static void rxd_peer_ack_timer(struct ofi_timer_wheel *wheel,
+			       struct ofi_timer *timer)
+{
+	struct rxd_ep *ep = container_of(wheel, struct rxd_ep, timers);
+
+	rxd_ep_send_ack(ep, container_of(timer, struct rxd_peer,
+					 ack_timer)->addr);
 }
 
 void rxd_ep_progress(struct util_ep *util_ep)
 {
-	struct rxd_peer *peer;
-	struct fi_cq_msg_entry cq_entry;
-	struct dlist_entry *tmp;
+	struct fi_cq_msg_entry cq_entry[RXD_CQ_READ_BATCH];
 	struct rxd_ep *ep;
-	ssize_t ret;
+	uint64_t now, next;
+	ssize_t ret, j;
 	int i;
 
 	ep = container_of(util_ep, struct rxd_ep, util_ep);
 
 	fastlock_acquire(&ep->util_ep.lock);
-	for(ret = 1, i = 0;
-	    ret > 0 && (!rxd_env.spin_count || i < rxd_env.spin_count);
-	    i++) {
-		ret = fi_cq_read(ep->dg_cq, &cq_entry, 1);
-		if (ret == -FI_EAGAIN)
+	rxd_ep_aggr_begin(ep);
+	for (i = 0; !rxd_env.spin_count || i < rxd_env.spin_count; i += ret) {
+		ret = fi_cq_read(ep->dg_cq, cq_entry, RXD_CQ_READ_BATCH);
+		if (ret == -FI_EAVAIL)
+			rxd_handle_error(ep);
+		if (ret <= 0)
 			break;
 
-		if (ret == -FI_EAVAIL) {
-			rxd_handle_error(ep);
-			continue;
+		for (j = 0; j < ret; j++) {
+			if (cq_entry[j].flags & FI_RECV)
+				rxd_handle_recv_comp(ep, &cq_entry[j]);
+			else
+				rxd_handle_send_comp(ep, &cq_entry[j]);
 		}
-
-		if (cq_entry.flags & FI_RECV)
-			rxd_handle_recv_comp(ep, &cq_entry);
-		else
-			rxd_handle_send_comp(ep, &cq_entry);
-	}
-
-	if (!rxd_env.retry)
-		goto out;
-
-	ep->next_retry = -1;
-	dlist_foreach_container_safe(&ep->rts_sent_list, struct rxd_peer,
-				     peer, entry, tmp)
-		rxd_progress_pkt_list(ep, peer);
-
-	dlist_foreach_container_safe(&ep->active_peers, struct rxd_peer,
-				     peer, entry, tmp) {
-		rxd_progress_pkt_list(ep, peer);
-		if (dlist_empty(&peer->unacked))
-			rxd_progress_tx_list(ep, peer);
-	}
-
-out:
-	while (ep->posted_bufs < ep->rx_size) {
-		ret = rxd_ep_post_buf(ep);
-		if (ret)
-			break;
+		rxd_ep_post_bufs(ep);
 	}
 
+	now = rxd_tick(fi_gettime_us());
+	ofi_timer_wheel_run(&ep->timers, now);
+	rxd_ep_aggr_end(ep, 0);
+	next = ofi_timer_wheel_next(&ep->timers);
+	if (next == OFI_TIMER_NONE)
+		ep->next_retry = -1;
+	else
+		ep->next_retry = next > now ? (int) ((((next - now) <<
+				 RXD_TICK_SHIFT) + 999) / 1000) : 0;
+
+	rxd_ep_post_bufs(ep);
 	fastlock_release(&ep->util_ep.lock);
 }
 
@@ -1068,6 +1459,12 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	if (ret)
 		goto err;
 
+	ret = ofi_bufpool_create(&ep->peer_pool, sizeof(struct rxd_peer),
+				 RXD_BUF_POOL_ALIGNMENT, 0, RXD_PEER_POOL_CHUNK_CNT,
+				 OFI_BUFPOOL_NO_TRACK);
+	if (ret)
+		goto err;
+
 	dlist_init(&ep->rx_list);
 	dlist_init(&ep->rx_tag_list);
 	dlist_init(&ep->active_peers);
@@ -1075,6 +1472,7 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	dlist_init(&ep->unexp_list);
 	dlist_init(&ep->unexp_tag_list);
 	dlist_init(&ep->ctrl_pkts);
+	dlist_init(&ep->aggr_peers);
 	slist_init(&ep->rx_pkt_list);
 
 	return 0;
@@ -1091,26 +1489,170 @@ err:
 	if (ep->rx_entry_pool)
 		ofi_bufpool_destroy(ep->rx_entry_pool);
 
+	if (ep->peer_pool)
+		ofi_bufpool_destroy(ep->peer_pool);
+
 	return ret;
 }
 
-static void rxd_init_peer(struct rxd_ep *ep, uint64_t rxd_addr)
+/* Nothing in flight to or from the peer, and nothing owed to it */
+static int rxd_peer_idle(struct rxd_peer *peer)
+{
+	return !peer->unacked_cnt && dlist_empty(&peer->tx_list) &&
+	       dlist_empty(&peer->rx_list) && dlist_empty(&peer->rma_rx_list) &&
+	       dlist_empty(&peer->buf_pkts) && !peer->curr_unexp &&
+	       !peer->unexp_cnt && slist_empty(&peer->aggr_list) &&
+	       peer->rx_window == rxd_env.max_unacked &&
+	       !ofi_timer_pending(&peer->retry_timer) &&
+	       !ofi_timer_pending(&peer->tx_timer) &&
+	       !ofi_timer_pending(&peer->ack_timer);
+}
+
+static void rxd_free_peer(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_peer_slot *slot = rxd_peer_slot(ep, peer->addr);
+
+	slot->peer_addr = peer->peer_addr;
+	slot->tx_seq_no = peer->tx_seq_no;
+	slot->rx_seq_no = peer->rx_seq_no;
+	slot->peer = NULL;
+
+	dlist_remove(&peer->entry);
+	ofi_buf_free(peer);
+	ep->peer_idle_cnt++;
+}
+
+/*
+ * Free the state of a peer that has not been sent to for a whole period,
+ * once all traffic with it has been acked.  It is allocated again from
+ * the slot on the next contact, see rxd_peer_get().
+ */
+static void rxd_peer_idle_timer(struct ofi_timer_wheel *wheel,
+				struct ofi_timer *timer)
+{
+	struct rxd_peer *peer = container_of(timer, struct rxd_peer,
+					     idle_timer);
+
+	if (peer->busy || !rxd_peer_idle(peer)) {
+		peer->busy = 0;
+		ofi_timer_start(wheel, timer,
+				rxd_tick(fi_gettime_us() + RXD_PEER_IDLE_TIME));
+		return;
+	}
+
+	rxd_free_peer(container_of(wheel, struct rxd_ep, timers), peer);
+}
+
+static void rxd_init_peer(struct rxd_ep *ep, struct rxd_peer *peer,
+			  fi_addr_t rxd_addr, struct rxd_peer_slot *slot)
 {
-	ep->peers[rxd_addr].peer_addr = FI_ADDR_UNSPEC;
-	ep->peers[rxd_addr].tx_seq_no = 0;
-	ep->peers[rxd_addr].rx_seq_no = 0;
-	ep->peers[rxd_addr].last_rx_ack = 0;
-	ep->peers[rxd_addr].last_tx_ack = 0;
-	ep->peers[rxd_addr].rx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].tx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].unacked_cnt = 0;
-	ep->peers[rxd_addr].retry_cnt = 0;
-	ep->peers[rxd_addr].active = 0;
-	dlist_init(&ep->peers[rxd_addr].unacked);
-	dlist_init(&ep->peers[rxd_addr].tx_list);
-	dlist_init(&ep->peers[rxd_addr].rx_list);
-	dlist_init(&ep->peers[rxd_addr].rma_rx_list);
-	dlist_init(&ep->peers[rxd_addr].buf_pkts);
+	peer->addr = rxd_addr;
+	peer->peer_addr = slot->peer_addr;
+	peer->tx_seq_no = slot->tx_seq_no;
+	peer->rx_seq_no = slot->rx_seq_no;
+	peer->last_rx_ack = slot->tx_seq_no;
+	peer->last_tx_ack = slot->rx_seq_no;
+	peer->rx_window = rxd_env.max_unacked;
+	peer->tx_window = rxd_env.max_unacked;
+	peer->unacked_cnt = 0;
+	peer->retry_cnt = 0;
+	peer->dup_acks = 0;
+	peer->srtt = 0;
+	peer->rttvar = 0;
+	peer->rto = RXD_INIT_RTO;
+	peer->cwnd = MIN(RXD_INIT_CWND, rxd_env.max_unacked);
+	peer->ssthresh = rxd_env.max_unacked;
+	peer->cwnd_cnt = 0;
+	peer->pace_time = 0;
+	peer->rto_time = 0;
+	peer->lost = 0;
+	ofi_timer_init(&peer->retry_timer, rxd_peer_retry_timer);
+	ofi_timer_init(&peer->tx_timer, rxd_peer_tx_timer);
+	ofi_timer_init(&peer->ack_timer, rxd_peer_ack_timer);
+	ofi_timer_init(&peer->idle_timer, rxd_peer_idle_timer);
+	slist_init(&peer->aggr_list);
+	dlist_init(&peer->aggr_entry);
+	peer->aggr_ack = NULL;
+	peer->aggr_size = 0;
+	peer->busy = 0;
+	peer->curr_unexp = NULL;
+	peer->unexp_cnt = 0;
+	dlist_init(&peer->unacked);
+	dlist_init(&peer->tx_list);
+	dlist_init(&peer->rx_list);
+	dlist_init(&peer->rma_rx_list);
+	dlist_init(&peer->buf_pkts);
+
+	peer->active = peer->peer_addr != FI_ADDR_UNSPEC;
+	if (peer->active)
+		dlist_insert_tail(&peer->entry, &ep->active_peers);
+	else
+		dlist_init(&peer->entry);
+
+	ofi_timer_start(&ep->timers, &peer->idle_timer,
+			rxd_tick(fi_gettime_us() + RXD_PEER_IDLE_TIME));
+}
+
+static struct rxd_peer_slot *rxd_alloc_peer_slot(struct rxd_ep *ep,
+						 fi_addr_t rxd_addr)
+{
+	struct rxd_peer_slot **table, *chunk;
+	size_t idx = rxd_addr >> RXD_PEER_CHUNK_BITS;
+	size_t cnt, i;
+
+	if (idx >= ep->peer_chunk_cnt) {
+		cnt = MAX(idx + 1, ep->peer_chunk_cnt * 2);
+		table = realloc(ep->peer_table, cnt * sizeof(*table));
+		if (!table)
+			return NULL;
+
+		memset(&table[ep->peer_chunk_cnt], 0,
+		       (cnt - ep->peer_chunk_cnt) * sizeof(*table));
+		ep->peer_table = table;
+		ep->peer_chunk_cnt = cnt;
+	}
+
+	chunk = calloc(RXD_PEER_CHUNK_SIZE, sizeof(*chunk));
+	if (!chunk)
+		return NULL;
+
+	for (i = 0; i < RXD_PEER_CHUNK_SIZE; i++)
+		chunk[i].peer_addr = FI_ADDR_UNSPEC;
+	ep->peer_table[idx] = chunk;
+
+	return &chunk[rxd_addr & (RXD_PEER_CHUNK_SIZE - 1)];
+}
+
+/*
+ * Return the state of a peer, allocating it on first contact, or after it
+ * was freed while idle.  Fails for addresses the AV has not assigned.
+ */
+struct rxd_peer *rxd_peer_get(struct rxd_ep *ep, fi_addr_t rxd_addr)
+{
+	struct rxd_peer_slot *slot;
+	struct rxd_peer *peer;
+
+	slot = rxd_peer_slot(ep, rxd_addr);
+	if (slot && slot->peer)
+		return slot->peer;
+
+	if (rxd_addr >= rxd_ep_av(ep)->rxd_addr_cnt)
+		return NULL;
+
+	if (!slot) {
+		slot = rxd_alloc_peer_slot(ep, rxd_addr);
+		if (!slot)
+			return NULL;
+	}
+
+	peer = ofi_buf_alloc(ep->peer_pool);
+	if (!peer)
+		return NULL;
+
+	rxd_init_peer(ep, peer, rxd_addr, slot);
+	slot->peer = peer;
+	ep->peer_alloc_cnt++;
+	return peer;
 }
 
 int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
@@ -1119,10 +1661,9 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	struct fi_info *dg_info;
 	struct rxd_domain *rxd_domain;
 	struct rxd_ep *rxd_ep;
-	int ret, i;
+	int ret;
 
-	rxd_ep = calloc(1, sizeof(*rxd_ep) + sizeof(struct rxd_peer) *
-			rxd_env.max_peers);
+	rxd_ep = calloc(1, sizeof(*rxd_ep));
 	if (!rxd_ep)
 		return -FI_ENOMEM;
 
@@ -1160,13 +1701,11 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	fi_freeinfo(dg_info);
 
 	rxd_ep->next_retry = -1;
+	ofi_timer_wheel_init(&rxd_ep->timers, rxd_tick(fi_gettime_us()));
 	ret = rxd_ep_init_res(rxd_ep, info);
 	if (ret)
 		goto err3;
 
-	for (i = 0; i < rxd_env.max_peers; rxd_init_peer(rxd_ep, i++))
-		;
-
 	rxd_ep->util_ep.ep_fid.fid.ops = &rxd_ep_fi_ops;
 	rxd_ep->util_ep.ep_fid.cm = &rxd_ep_cm;
 	rxd_ep->util_ep.ep_fid.ops = &rxd_ops_ep;
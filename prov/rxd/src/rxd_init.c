@@ -136,7 +136,8 @@ struct fi_provider rxd_prov = {
 RXD_INI
 {
 	fi_param_define(&rxd_prov, "spin_count", FI_PARAM_INT,
-			"Number of iterations to receive packets (0 - infinite)");
+			"Number of packet completions to process per progress "
+			"call (0 - infinite)");
 	fi_param_define(&rxd_prov, "retry", FI_PARAM_BOOL,
 			"Toggle packet retrying (default: yes)");
 	fi_param_define(&rxd_prov, "max_peers", FI_PARAM_INT,
@@ -75,9 +75,10 @@ static struct rxd_unexp_msg *rxd_ep_check_unexp_list(struct dlist_entry *list,
 static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 				   struct rxd_unexp_msg *unexp_msg)
 {
+	struct rxd_peer *peer = rxd_peer(ep, unexp_msg->base_hdr->peer);
 	struct rxd_pkt_entry *pkt_entry;
 	uint64_t num_segs = 0;
-	uint16_t curr_id = ep->peers[unexp_msg->base_hdr->peer].curr_rx_id;
+	uint16_t curr_id = peer->curr_rx_id;
 
 	rxd_progress_op(ep, rx_entry, unexp_msg->pkt_entry, unexp_msg->base_hdr,
 			unexp_msg->sar_hdr, unexp_msg->tag_hdr,
@@ -93,13 +94,14 @@ static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_ent
 		num_segs++;
 	}
 
-	if (ep->peers[unexp_msg->base_hdr->peer].curr_unexp) {
+	if (peer->curr_unexp) {
 		if (!unexp_msg->sar_hdr || num_segs == unexp_msg->sar_hdr->num_segs - 1)
-			ep->peers[unexp_msg->base_hdr->peer].curr_rx_id = curr_id;
+			peer->curr_rx_id = curr_id;
 		else
-			ep->peers[unexp_msg->base_hdr->peer].curr_unexp = NULL;
+			peer->curr_unexp = NULL;
 	}
 
+	peer->unexp_cnt--;
 	ofi_buf_free(unexp_msg->pkt_entry);
 	dlist_remove(&unexp_msg->entry);
 	free(unexp_msg);
@@ -139,6 +141,7 @@ static int rxd_progress_unexp_list(struct rxd_ep *ep,
 static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 			       struct rxd_unexp_msg *unexp_msg)
 {
+	struct rxd_peer *peer = rxd_peer(rxd_ep, unexp_msg->base_hdr->peer);
 	struct rxd_pkt_entry *pkt_entry;
 	uint64_t seq = unexp_msg->base_hdr->seq_no;
 	int ret;
@@ -146,8 +149,7 @@ static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 	assert(unexp_msg->tag_hdr);
 	seq += unexp_msg->sar_hdr ? unexp_msg->sar_hdr->num_segs : 1;
 
-	rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no =
-			MAX(seq, rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no);
+	peer->rx_seq_no = MAX(seq, peer->rx_seq_no);
 	rxd_ep_send_ack(rxd_ep, unexp_msg->base_hdr->peer);
 
 	ret = ofi_cq_write(rxd_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
@@ -161,6 +163,7 @@ static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 		ofi_buf_free(pkt_entry);
 	}
 
+	peer->unexp_cnt--;
 	ofi_buf_free(unexp_msg->pkt_entry);
 	dlist_remove(&unexp_msg->entry);
 	free(unexp_msg);
@@ -276,6 +279,9 @@ static ssize_t rxd_ep_recvmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_RECV);
+
 	return rxd_ep_generic_recvmsg(ep, msg->msg_iov, msg->iov_count,
 				      msg->addr, 0, ~0, msg->context, RXD_MSG,
 				      rxd_rx_flags(flags | ep->util_ep.rx_msg_flags),
@@ -371,6 +377,7 @@ ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 	       rxd_ep_domain(rxd_ep)->max_inline_msg);
 
 	fastlock_acquire(&rxd_ep->util_ep.lock);
+	rxd_ep_aggr_begin(rxd_ep);
 
 	if (ofi_cirque_isfull(rxd_ep->util_ep.tx_cq->cirq))
 		goto out;
@@ -387,10 +394,11 @@ ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 		goto out;
 	}
 
-	if (rxd_ep->peers[rxd_addr].peer_addr != FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr != FI_ADDR_UNSPEC)
 		(void) rxd_start_xfer(rxd_ep, tx_entry);
 
 out:
+	rxd_ep_aggr_end(rxd_ep, rxd_flags & RXD_MORE);
 	fastlock_release(&rxd_ep->util_ep.lock);
 	return ret;
 }
@@ -411,6 +419,7 @@ ssize_t rxd_ep_generic_sendmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 					     op, rxd_flags);
 
 	fastlock_acquire(&rxd_ep->util_ep.lock);
+	rxd_ep_aggr_begin(rxd_ep);
 
 	if (ofi_cirque_isfull(rxd_ep->util_ep.tx_cq->cirq))
 		goto out;
@@ -425,7 +434,7 @@ ssize_t rxd_ep_generic_sendmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 	if (!tx_entry)
 		goto out;
 
-	if (rxd_ep->peers[rxd_addr].peer_addr == FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr == FI_ADDR_UNSPEC)
 		goto out;
 
 	ret = rxd_start_xfer(rxd_ep, tx_entry);
@@ -434,6 +443,7 @@ ssize_t rxd_ep_generic_sendmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 
 	ret = 0;
 out:
+	rxd_ep_aggr_end(rxd_ep, rxd_flags & RXD_MORE);
 	fastlock_release(&rxd_ep->util_ep.lock);
 	return ret;
 }
@@ -445,6 +455,9 @@ static ssize_t rxd_ep_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_SEND);
+
 	return rxd_ep_generic_sendmsg(ep, msg->msg_iov, msg->iov_count,
 				   msg->addr, 0, msg->data, msg->context,
 				   RXD_MSG, rxd_tx_flags(flags |
@@ -60,6 +60,7 @@
 	FUNC(RXD_ACK),			\
 	FUNC(RXD_DATA),			\
 	FUNC(RXD_DATA_READ),		\
+	FUNC(RXD_AGGR),			\
 	FUNC(RXD_NO_OP)
 
 enum rxd_pkt_type {
@@ -120,11 +121,24 @@ struct rxd_cts_pkt {
 
 /*
  * ACK: to signal received packets and send tx/rx id info
+ *
+ * base_hdr.seq_no is the cumulative ack (the next sequence number the
+ * receiver expects).  The sack blocks list ranges [start, end) of later
+ * packets that the receiver has buffered out of order, lowest first.
  */
+#define RXD_MAX_SACK_BLKS	4
+
+struct rxd_sack_blk {
+	uint64_t	start;
+	uint64_t	end;
+};
+
 struct rxd_ack_pkt {
 	struct rxd_base_hdr	base_hdr;
 	struct rxd_ext_hdr	ext_hdr;
-	//TODO fill in more fields? Selective ack?
+	uint32_t		sack_cnt;
+	uint32_t		resv;
+	struct rxd_sack_blk	sack[RXD_MAX_SACK_BLKS];
 };
 
 /*
@@ -137,6 +151,20 @@ struct rxd_data_pkt {
 	char			msg[];
 };
 
+/*
+ * Aggregate: several small packets to the same peer packed into one
+ * datagram.  The base_hdr (type RXD_AGGR) is followed by the packets, each
+ * preceded by an aggr_hdr giving its length and padded to 8 bytes.  The
+ * packets keep their own headers and sequence numbers, and are processed
+ * by the receiver as if they had arrived one by one.
+ */
+#define RXD_AGGR_ALIGN		8
+
+struct rxd_aggr_hdr {
+	uint16_t	len;
+	uint8_t		resv[6];
+};
+
 /*
  * The below five headers are used for op pkts and can be used in combination.
  * The presence of each header is determined by either op type or flags (in base_hr).
@@ -72,6 +72,9 @@ ssize_t rxd_ep_trecvmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TRECV);
+
 	return rxd_ep_generic_recvmsg(ep, msg->msg_iov, msg->iov_count, msg->addr,
 				      msg->tag, msg->ignore, msg->context,
 				      RXD_TAGGED, rxd_rx_flags(flags |
@@ -114,6 +117,9 @@ ssize_t rxd_ep_tsendmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 
 	ep = container_of(ep_fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TSEND);
+
 	return rxd_ep_generic_sendmsg(ep, msg->msg_iov, msg->iov_count,
 				      msg->addr, msg->tag, msg->data, msg->context,
 				      RXD_TAGGED, rxd_tx_flags(flags |
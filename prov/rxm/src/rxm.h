@@ -64,7 +64,7 @@
 
 #define RXM_CM_DATA_VERSION	1
 #define RXM_OP_VERSION		3
-#define RXM_CTRL_VERSION	4
+#define RXM_CTRL_VERSION	5
 
 #define RXM_BUF_SIZE	16384
 extern size_t rxm_eager_limit;
@@ -223,6 +223,9 @@ enum rxm_cmap_reject_reason {
 	RXM_CMAP_REJECT_SIMULT_CONN,
 };
 
+/* The sender of the CM data wants to be told of RMA to its memory */
+#define RXM_CM_FLAG_RMA_EVENT	(1 << 0)
+
 union rxm_cm_data {
 	struct _connect {
 		uint8_t version;
@@ -230,7 +233,8 @@ union rxm_cm_data {
 		uint8_t ctrl_version;
 		uint8_t op_version;
 		uint16_t port;
-		uint8_t padding[2];
+		uint8_t flags;
+		uint8_t padding;
 		uint32_t eager_size;
 		uint32_t rx_size;
 		uint64_t client_conn_id;
@@ -239,6 +243,7 @@ union rxm_cm_data {
 	struct _accept {
 		uint64_t server_conn_id;
 		uint32_t rx_size;
+		uint32_t flags;
 	} accept;
 
 	struct _reject {
@@ -282,6 +287,8 @@ struct rxm_domain {
 	struct fid_domain *msg_domain;
 	size_t max_atomic_size;
 	uint8_t mr_local;
+	/* serializes execution of atomics targeting the domain */
+	fastlock_t atomic_lock;
 };
 
 int rxm_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
@@ -359,6 +366,7 @@ enum {
 	rxm_ctrl_rndv_ack,
 	rxm_ctrl_atomic,
 	rxm_ctrl_atomic_resp,
+	rxm_ctrl_rma_event,
 };
 
 struct rxm_pkt {
@@ -508,6 +516,7 @@ struct rxm_rma_buf {
 
 	void *app_context;
 	uint64_t flags;
+	struct rxm_conn *conn;
 
 	struct {
 		struct fid_mr *mr[RXM_IOV_LIMIT];
@@ -696,6 +705,9 @@ struct rxm_conn {
 	 * handling of CONN_RECV in RXM_CMAP_CONNREQ_SENT for passive side */
 	struct fid_ep *saved_msg_ep;
 	uint32_t rndv_tx_credits;
+	/* the peer has FI_RMA_EVENT, send it an rxm_ctrl_rma_event for each
+	 * RMA operation that completes */
+	int rma_event;
 };
 
 extern struct fi_provider rxm_prov;
@@ -765,7 +777,7 @@ rxm_atomic_send_respmsg(struct rxm_ep *rxm_ep, struct rxm_conn *conn,
 
 static inline int rxm_needs_atomic_progress(const struct fi_info *info)
 {
-	return (info->caps & FI_ATOMIC) && info->domain_attr &&
+	return (info->caps & (FI_ATOMIC | FI_RMA_EVENT)) && info->domain_attr &&
 			info->domain_attr->data_progress == FI_PROGRESS_AUTO;
 }
 
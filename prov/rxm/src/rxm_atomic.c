@@ -195,6 +195,9 @@ rxm_ep_atomic_writemsg(struct fid_ep *ep_fid, const struct fi_msg_atomic *msg,
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_atomic(ep_fid, msg, flags);
+
 	return rxm_ep_generic_atomic_writemsg(rxm_ep, msg,
 				flags | rxm_ep->util_ep.tx_msg_flags);
 }
@@ -309,6 +312,11 @@ rxm_ep_atomic_readwritemsg(struct fid_ep *ep_fid,
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_fetch_atomic(ep_fid, msg, resultv,
+						result_desc, result_count,
+						flags);
+
 	return rxm_ep_generic_atomic_readwritemsg(rxm_ep, msg,
 			resultv, result_desc, result_count,
 			flags | rxm_ep->util_ep.tx_msg_flags);
@@ -405,6 +413,12 @@ rxm_ep_atomic_compwritemsg(struct fid_ep *ep_fid,
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_compare_atomic(ep_fid, msg, comparev,
+						  compare_desc, compare_count,
+						  resultv, result_desc,
+						  result_count, flags);
+
 	return rxm_ep_generic_atomic_compwritemsg(rxm_ep, msg, comparev,
 				    compare_desc, compare_count, resultv,
 				    result_desc, result_count,
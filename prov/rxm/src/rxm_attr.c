@@ -34,7 +34,8 @@
 
 #define RXM_EP_CAPS (FI_MSG | FI_RMA | FI_TAGGED | FI_ATOMIC |		\
 		     FI_DIRECTED_RECV |	FI_READ | FI_WRITE | FI_RECV |	\
-		     FI_SEND | FI_REMOTE_READ | FI_REMOTE_WRITE | FI_SOURCE)
+		     FI_SEND | FI_REMOTE_READ | FI_REMOTE_WRITE | FI_SOURCE |	\
+		     FI_RMA_EVENT | FI_TRIGGER)
 
 #define RXM_DOMAIN_CAPS (FI_LOCAL_COMM | FI_REMOTE_COMM)
 
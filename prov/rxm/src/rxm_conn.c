@@ -475,6 +475,8 @@ void rxm_cmap_process_connect(struct rxm_cmap *cmap,
 		assert(handle->state == RXM_CMAP_CONNREQ_SENT);
 		handle->remote_key = cm_data->accept.server_conn_id;
 		rxm_conn->rndv_tx_credits = cm_data->accept.rx_size;
+		rxm_conn->rma_event = !!(cm_data->accept.flags &
+					 RXM_CM_FLAG_RMA_EVENT);
 	} else {
 		assert(handle->state == RXM_CMAP_CONNREQ_RECV);
 	}
@@ -783,7 +785,7 @@ int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr)
 
 	if (ep->domain->data_progress == FI_PROGRESS_AUTO) {
 		if (pthread_create(&cmap->cm_thread, 0,
-				   rxm_ep->rxm_info->caps & FI_ATOMIC ?
+				   rxm_needs_atomic_progress(rxm_ep->rxm_info) ?
 				   rxm_conn_atomic_progress :
 				   rxm_conn_progress, ep)) {
 			FI_WARN(ep->av->prov, FI_LOG_EP_CTRL,
@@ -1138,6 +1140,8 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 	rxm_conn->handle.remote_key = remote_cm_data->connect.client_conn_id;
 	rxm_conn->rndv_tx_credits = remote_cm_data->connect.rx_size;
 	assert(rxm_conn->rndv_tx_credits);
+	rxm_conn->rma_event = !!(remote_cm_data->connect.flags &
+				 RXM_CM_FLAG_RMA_EVENT);
 
 	ret = rxm_msg_ep_open(rxm_ep, msg_info, rxm_conn, handle);
 	if (ret)
@@ -1145,6 +1149,8 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 
 	cm_data.accept.server_conn_id = rxm_conn->handle.key;
 	cm_data.accept.rx_size = rxm_conn_get_rx_size(rxm_ep, msg_info);
+	cm_data.accept.flags = (rxm_ep->util_ep.caps & FI_RMA_EVENT) ?
+			       RXM_CM_FLAG_RMA_EVENT : 0;
 
 	ret = fi_accept(rxm_conn->msg_ep, &cm_data.accept.server_conn_id,
 			sizeof(cm_data.accept));
@@ -1551,6 +1557,8 @@ rxm_conn_connect(struct util_ep *util_ep, struct rxm_cmap_handle *handle,
 		goto err;
 
 	cm_data.connect.rx_size = rxm_conn_get_rx_size(rxm_ep, rxm_ep->msg_info);
+	cm_data.connect.flags = (rxm_ep->util_ep.caps & FI_RMA_EVENT) ?
+				RXM_CM_FLAG_RMA_EVENT : 0;
 
 	ret = fi_connect(rxm_conn->msg_ep, rxm_ep->msg_info->dest_addr,
 			 &cm_data, sizeof(cm_data));
@@ -262,6 +262,48 @@ rxm_cq_tx_comp_write(struct rxm_ep *rxm_ep, uint64_t comp_flags,
 	return 0;
 }
 
+/* The MSG provider does not report RMA operations to the target, so the
+ * target's remote write and read counters are updated by a ctrl message
+ * sent once the operation has completed. */
+static ssize_t rxm_rma_send_event(struct rxm_ep *rxm_ep,
+				  struct rxm_conn *rxm_conn, uint8_t op)
+{
+	struct rxm_deferred_tx_entry *def_tx_entry;
+	struct rxm_tx_atomic_buf *tx_buf;
+	ssize_t ret;
+
+	tx_buf = (struct rxm_tx_atomic_buf *)
+		 rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_ATOMIC);
+	if (OFI_UNLIKELY(!tx_buf)) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Ran out of buffers from RMA event buffer pool\n");
+		return -FI_ENOMEM;
+	}
+
+	tx_buf->hdr.state = RXM_ATOMIC_RESP_SENT;
+	rxm_ep_format_tx_buf_pkt(rxm_conn, 0, op, 0, 0, 0, &tx_buf->pkt);
+	tx_buf->pkt.ctrl_hdr.type = rxm_ctrl_rma_event;
+
+	ret = rxm_atomic_send_respmsg(rxm_ep, rxm_conn, tx_buf,
+				      sizeof(tx_buf->pkt));
+	if (OFI_LIKELY(ret != -FI_EAGAIN))
+		return ret;
+
+	def_tx_entry = rxm_ep_alloc_deferred_tx_entry(rxm_ep, rxm_conn,
+						      RXM_DEFERRED_TX_ATOMIC_RESP);
+	if (OFI_UNLIKELY(!def_tx_entry)) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Unable to allocate deferred RMA event\n");
+		ofi_buf_free(tx_buf);
+		return -FI_ENOMEM;
+	}
+
+	def_tx_entry->atomic_resp.tx_buf = tx_buf;
+	def_tx_entry->atomic_resp.len = sizeof(tx_buf->pkt);
+	rxm_ep_enqueue_deferred_tx_queue(def_tx_entry);
+	return 0;
+}
+
 static inline int rxm_finish_rma(struct rxm_ep *rxm_ep, struct rxm_rma_buf *rma_buf,
 				 uint64_t comp_flags)
 {
@@ -276,6 +318,16 @@ static inline int rxm_finish_rma(struct rxm_ep *rxm_ep, struct rxm_rma_buf *rma_
 	else
 		ofi_ep_rd_cntr_inc(&rxm_ep->util_ep);
 
+	if (rma_buf->conn->rma_event) {
+		ssize_t event_ret;
+
+		event_ret = rxm_rma_send_event(rxm_ep, rma_buf->conn,
+					       (comp_flags & FI_WRITE) ?
+					       ofi_op_write : ofi_op_read_req);
+		if (!ret)
+			ret = (int) event_ret;
+	}
+
 	if (!(rma_buf->flags & FI_INJECT) && !rxm_ep->rxm_mr_local && rxm_ep->msg_mr_local) {
 		rxm_ep_msg_mr_closev(rma_buf->mr.mr, rma_buf->mr.count);
 	}
@@ -844,6 +896,18 @@ static int rxm_handle_remote_write(struct rxm_ep *rxm_ep,
 	return 0;
 }
 
+static int rxm_handle_rma_event(struct rxm_ep *rxm_ep,
+				struct rxm_rx_buf *rx_buf)
+{
+	if (rx_buf->pkt.hdr.op == ofi_op_write)
+		ofi_ep_rem_wr_cntr_inc(&rxm_ep->util_ep);
+	else
+		ofi_ep_rem_rd_cntr_inc(&rxm_ep->util_ep);
+
+	rxm_rx_buf_finish(rx_buf);
+	return 0;
+}
+
 static inline void rxm_ep_format_atomic_resp_pkt_hdr(struct rxm_conn *rxm_conn,
 				struct rxm_tx_atomic_buf *tx_buf,
 				size_t data_len, uint32_t pkt_op,
@@ -923,7 +987,7 @@ static inline void rxm_do_atomic(struct rxm_pkt *pkt, void *dst, void *src,
 {
 	switch (pkt->hdr.op) {
 	case ofi_op_atomic:
-		ofi_atomic_write_handlers[op][datatype](dst, src, count);
+		ofi_atomic_write_locked(op, datatype, dst, src, count);
 		break;
 	case ofi_op_atomic_fetch:
 		ofi_atomic_readwrite_handlers[op][datatype](dst, src, res,
@@ -998,6 +1062,7 @@ static inline ssize_t rxm_handle_atomic_req(struct rxm_ep *rxm_ep,
 			rx_buf->pkt.hdr.atomic.ioc_count) * datatype_sz;
 	resp_hdr = (struct rxm_atomic_resp_hdr *) resp_buf->pkt.data;
 
+	fastlock_acquire(&domain->atomic_lock);
 	for (i = 0, offset = 0; i < rx_buf->pkt.hdr.atomic.ioc_count; i++) {
 		rxm_do_atomic(&rx_buf->pkt,
 			      (uintptr_t *) req_hdr->rma_ioc[i].addr,
@@ -1007,6 +1072,7 @@ static inline ssize_t rxm_handle_atomic_req(struct rxm_ep *rxm_ep,
 			      req_hdr->rma_ioc[i].count, datatype, atomic_op);
 		offset += req_hdr->rma_ioc[i].count * datatype_sz;
 	}
+	fastlock_release(&domain->atomic_lock);
 	result_len = rx_buf->pkt.hdr.op == ofi_op_atomic ? 0 : offset;
 
 	if (rx_buf->pkt.hdr.op == ofi_op_atomic)
@@ -1138,6 +1204,8 @@ static ssize_t rxm_cq_handle_comp(struct rxm_ep *rxm_ep,
 			return rxm_handle_atomic_req(rxm_ep, rx_buf);
 		case rxm_ctrl_atomic_resp:
 			return rxm_handle_atomic_resp(rxm_ep, rx_buf);
+		case rxm_ctrl_rma_event:
+			return rxm_handle_rma_event(rxm_ep, rx_buf);
 		default:
 			FI_WARN(&rxm_prov, FI_LOG_CQ, "Unknown message type\n");
 			assert(0);
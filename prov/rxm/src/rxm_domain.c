@@ -119,6 +119,7 @@ static int rxm_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	fastlock_destroy(&rxm_domain->atomic_lock);
 	free(rxm_domain);
 	return 0;
 }
@@ -127,7 +128,7 @@ static struct fi_ops rxm_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = rxm_domain_close,
 	.bind = fi_no_bind,
-	.control = fi_no_control,
+	.control = ofi_domain_control,
 	.ops_open = fi_no_ops_open,
 };
 
@@ -346,6 +347,7 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	(*domain)->ops = &rxm_domain_ops;
 
 	rxm_domain->mr_local = ofi_mr_local(msg_info) && !ofi_mr_local(info);
+	fastlock_init(&rxm_domain->atomic_lock);
 
 	fi_freeinfo(msg_info);
 	return 0;
@@ -845,6 +845,9 @@ static ssize_t rxm_ep_recvmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_RECV);
+
 	return rxm_ep_recv_common_flags(rxm_ep, msg->msg_iov, msg->desc, msg->iov_count,
 					msg->addr, 0, 0, msg->context,
 					flags | rxm_ep->util_ep.rx_msg_flags,
@@ -1189,7 +1192,7 @@ rxm_ep_emulate_inject(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	tx_buf->app_context = NULL;
 
 	rxm_ep_format_tx_buf_pkt(rxm_conn, len, op, data, tag, flags, &tx_buf->pkt);
-	memcpy(tx_buf->pkt.data, buf, len);
+	ofi_memcpy(tx_buf->pkt.data, buf, len);
 	tx_buf->flags = flags;
 
 	ret = rxm_ep_msg_normal_send(rxm_conn, &tx_buf->pkt, pkt_size,
@@ -1213,7 +1216,7 @@ rxm_ep_inject_send_fast(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 
 	if (pkt_size <= rxm_ep->inject_limit) {
 		inject_pkt->hdr.size = len;
-		memcpy(inject_pkt->data, buf, len);
+		ofi_memcpy(inject_pkt->data, buf, len);
 		ret = rxm_ep_msg_inject_send(rxm_ep, rxm_conn, inject_pkt,
 					      pkt_size, rxm_ep->util_ep.tx_cntr_inc);
 	} else {
@@ -1245,7 +1248,7 @@ rxm_ep_inject_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		}
 		rxm_ep_format_tx_buf_pkt(rxm_conn, len, op, data, tag,
 					 flags, &tx_buf->pkt);
-		memcpy(tx_buf->pkt.data, buf, len);
+		ofi_memcpy(tx_buf->pkt.data, buf, len);
 
 		ret = rxm_ep_msg_inject_send(rxm_ep, rxm_conn, &tx_buf->pkt,
 					     pkt_size, rxm_ep->util_ep.tx_cntr_inc);
@@ -1486,6 +1489,9 @@ static ssize_t rxm_ep_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_SEND);
+
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
 	ret = rxm_ep_prepare_tx(rxm_ep, msg->addr, &rxm_conn);
 	if (OFI_UNLIKELY(ret))
@@ -1682,6 +1688,9 @@ static ssize_t rxm_ep_trecvmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TRECV);
+
 	return rxm_ep_recv_common_flags(rxm_ep, msg->msg_iov, msg->desc, msg->iov_count,
 					msg->addr, msg->tag, msg->ignore, msg->context,
 					flags | rxm_ep->util_ep.rx_msg_flags,
@@ -1724,6 +1733,9 @@ static ssize_t rxm_ep_tsendmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged
 	struct rxm_ep *rxm_ep = container_of(ep_fid, struct rxm_ep,
 					     util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TSEND);
+
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
 	ret = rxm_ep_prepare_tx(rxm_ep, msg->addr, &rxm_conn);
 	if (OFI_UNLIKELY(ret))
@@ -1964,6 +1976,9 @@ static int rxm_ep_close(struct fid *fid)
 	struct rxm_ep *rxm_ep =
 		container_of(fid, struct rxm_ep, util_ep.ep_fid.fid);
 
+	if (ofi_atomic_get32(&rxm_ep->util_ep.ref))
+		return -FI_EBUSY;
+
 	if (rxm_ep->cmap)
 		rxm_cmap_free(rxm_ep->cmap);
 
@@ -2035,7 +2050,7 @@ static int rxm_ep_wait_fd_add(struct rxm_ep *rxm_ep, struct util_wait *wait)
 		return ret;
 
 	if (rxm_ep->util_ep.domain->data_progress == FI_PROGRESS_AUTO &&
-	    !(rxm_ep->util_ep.caps & FI_ATOMIC))
+	    !(rxm_ep->util_ep.caps & (FI_ATOMIC | FI_RMA_EVENT)))
 		return 0;
 
 	ret = fi_control(&rxm_ep->msg_eq->fid, FI_GETWAIT, &msg_eq_fd);
@@ -2218,7 +2233,7 @@ err:
 
 #define RXM_NEED_RX_CQ_PROGRESS(info) 				\
 	((info->rx_attr->caps & (FI_MSG | FI_TAGGED)) ||	\
-	 (info->rx_attr->caps & FI_ATOMIC))
+	 (info->rx_attr->caps & (FI_ATOMIC | FI_RMA_EVENT)))
 
 static int rxm_ep_enable_check(struct rxm_ep *rxm_ep)
 {
@@ -2261,7 +2276,7 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 		 * opened to keep it simple (avoids progressing only MSG EQ first
 		 * and then progressing both MSG EQ and MSG CQ once the latter
 		 * is opened) */
-		assert(!(rxm_ep->rxm_info->caps & FI_ATOMIC) ||
+		assert(!rxm_needs_atomic_progress(rxm_ep->rxm_info) ||
 		       !rxm_ep->cmap || !rxm_ep->cmap->cm_thread);
 
 		ret = rxm_ep_msg_cq_open(rxm_ep);
@@ -2300,6 +2315,8 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 			}
 		}
 		break;
+	case FI_ALIAS:
+		return ofi_ep_alias(&rxm_ep->util_ep, arg);
 	default:
 		return -FI_ENOSYS;
 	}
@@ -217,7 +217,8 @@ static void rxm_alter_info(const struct fi_info *hints, struct fi_info *info)
 		 * may affect performance in fast-path */
 		if (!hints) {
 			cur->caps &= ~(FI_DIRECTED_RECV | FI_SOURCE |
-				       FI_ATOMIC);
+				       FI_RMA_EVENT | FI_ATOMIC);
+			cur->rx_attr->caps &= ~FI_RMA_EVENT;
 			cur->tx_attr->caps &= ~FI_ATOMIC;
 			cur->rx_attr->caps &= ~FI_ATOMIC;
 			cur->domain_attr->data_progress = FI_PROGRESS_MANUAL;
@@ -226,6 +227,10 @@ static void rxm_alter_info(const struct fi_info *hints, struct fi_info *info)
 				cur->caps &= ~FI_DIRECTED_RECV;
 			if (!(hints->caps & FI_SOURCE))
 				cur->caps &= ~FI_SOURCE;
+			if (!(hints->caps & FI_RMA_EVENT)) {
+				cur->caps &= ~FI_RMA_EVENT;
+				cur->rx_attr->caps &= ~FI_RMA_EVENT;
+			}
 
 			if (hints->mode & FI_BUFFERED_RECV)
 				cur->mode |= FI_BUFFERED_RECV;
@@ -89,6 +89,7 @@ rxm_ep_rma_common(struct rxm_ep *rxm_ep, const struct fi_msg_rma *msg, uint64_t
 
 	rma_buf->app_context = msg->context;
 	rma_buf->flags = flags;
+	rma_buf->conn = rxm_conn;
 
 	ret = rxm_ep_rma_reg_iov(rxm_ep, msg_rma.msg_iov, msg_rma.desc, mr_desc,
 				 msg_rma.iov_count, comp_flags & (FI_WRITE | FI_READ),
@@ -118,6 +119,9 @@ rxm_ep_readmsg(struct fid_ep *ep_fid, const struct fi_msg_rma *msg, uint64_t fla
 	struct rxm_ep *rxm_ep =
 		container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_rma(ep_fid, msg, flags, FI_OP_READ);
+
 	return rxm_ep_rma_common(rxm_ep, msg, flags | rxm_ep->util_ep.tx_msg_flags,
 				 fi_readmsg, FI_READ);
 }
@@ -214,6 +218,7 @@ rxm_ep_rma_emulate_inject_msg(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	rma_buf->pkt.hdr.size = total_size;
 	rma_buf->app_context = msg->context;
 	rma_buf->flags = flags;
+	rma_buf->conn = rxm_conn;
 	rxm_ep_format_rma_msg(rma_buf, msg, &rxm_msg_iov, &rxm_rma_msg);
 
 	flags = (flags & ~FI_INJECT) | FI_COMPLETION;
@@ -271,9 +276,11 @@ rxm_ep_rma_inject_common(struct rxm_ep *rxm_ep, const struct fi_msg_rma *msg, ui
 	if (OFI_UNLIKELY(ret))
 		goto unlock;
 
+	/* the target is told of the write once it completes */
 	if ((total_size > rxm_ep->msg_info->tx_attr->inject_size) ||
 	    (flags & FI_COMPLETION) || (msg->iov_count > 1) ||
-	    (msg->rma_iov_count > 1)) {
+	    (msg->rma_iov_count > 1) ||
+	    rxm_conn->rma_event) {
 		ret = rxm_ep_rma_emulate_inject_msg(rxm_ep, rxm_conn, total_size,
 						    msg, flags);
 		goto unlock;
@@ -326,6 +333,9 @@ rxm_ep_writemsg(struct fid_ep *ep_fid, const struct fi_msg_rma *msg, uint64_t fl
 	struct rxm_ep *rxm_ep =
 		container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_rma(ep_fid, msg, flags, FI_OP_WRITE);
+
 	return rxm_ep_generic_writemsg(ep_fid, msg, flags | rxm_ep->util_ep.tx_msg_flags);
 }
 
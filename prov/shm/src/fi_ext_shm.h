@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _FI_EXT_SHM_H_
+#define _FI_EXT_SHM_H_
+
+/*
+ * See the fi_shm.7 man page for information about the shm provider
+ * extensions provided in this header.
+ */
+
+#include <stddef.h>
+#include <rdma/fabric.h>
+
+#define FI_SHM_DOMAIN_OPS_1 "shm domain ops 1"
+
+/*
+ * Domain extension, opened with fi_open_ops() on the domain fid.
+ *
+ * mem_alloc() returns page-aligned memory from a shared memory segment
+ * that peers can map directly, so that large transfers out of or into it
+ * are single memcpys rather than process_vm_readv/writev calls.  Memory
+ * still allocated when the domain is closed is released with it.
+ */
+struct fi_shm_ops_domain {
+	size_t	size;
+	void	*(*mem_alloc)(struct fid *fid, size_t len);
+	int	(*mem_free)(struct fid *fid, void *buf);
+};
+
+#endif /* _FI_EXT_SHM_H_ */
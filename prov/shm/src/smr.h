@@ -135,9 +135,21 @@ struct smr_unexp_msg {
 	struct smr_cmd cmd;
 };
 
+/* target side of a transfer staged through a SAR buffer */
+struct smr_sar_entry {
+	struct dlist_entry	entry;
+	struct smr_cmd		cmd;
+	struct smr_ep_entry	*rx_entry; /* NULL for RMA */
+	struct iovec		iov[SMR_IOV_LIMIT];
+	size_t			iov_count;
+	struct smr_sar_buf	*sar_buf; /* NULL until one is free */
+	uint64_t		sar_start;
+};
+
 DECLARE_FREESTACK(struct smr_ep_entry, smr_recv_fs);
 DECLARE_FREESTACK(struct smr_unexp_msg, smr_unexp_fs);
 DECLARE_FREESTACK(struct smr_cmd, smr_pend_fs);
+DECLARE_FREESTACK(struct smr_sar_entry, smr_sar_fs);
 
 struct smr_queue {
 	struct dlist_entry list;
@@ -149,11 +161,45 @@ struct smr_fabric {
 	int			dom_idx;
 };
 
+/* Segment of shared memory handed out by the fi_ext_shm.h allocator */
+struct smr_heap_seg {
+	struct dlist_entry	entry;
+	uint64_t		id;	/* unique within the process */
+	int			fd;	/* memfd, opened by peers through /proc */
+	void			*base;
+	size_t			len;
+};
+
 struct smr_domain {
 	struct util_domain	util_domain;
 	int			dom_idx;
 	int			ep_idx;
 	int			fast_rma;
+	fastlock_t		heap_lock;
+	struct dlist_entry	heap_list;	/* struct smr_heap_seg */
+	/* registrations that peers may target with in-place atomics, kept
+	 * in sync with the regions of the endpoints on ep_list; protected
+	 * by heap_lock */
+	struct smr_mr_export	mr_export[SMR_MR_EXPORT_COUNT];
+	int			mr_export_cnt;
+	struct dlist_entry	ep_list;	/* struct smr_ep export_entry */
+};
+
+/* A peer's heap segment mapped into this process */
+struct smr_heap_map {
+	int			pid;
+	uint64_t		id;
+	void			*addr;
+	size_t			len;
+	uint64_t		last_use;
+};
+
+#define SMR_HEAP_MAP_COUNT	16
+
+/* LRU cache of peer heap segments */
+struct smr_heap_cache {
+	struct smr_heap_map	map[SMR_HEAP_MAP_COUNT];
+	uint64_t		use;
 };
 
 #define SMR_PREFIX	"fi_shm://"
@@ -187,6 +233,21 @@ struct smr_ep {
 	struct smr_unexp_fs	*unexp_fs;
 	struct smr_pend_fs	*pend_fs;
 	struct smr_queue	unexp_queue;
+	struct smr_sar_fs	*sar_fs; /* SAR state protected by rx_cq lock */
+	struct dlist_entry	sar_list;
+	uint64_t		sar_buf_free; /* bitmap of free SAR buffers */
+	uint32_t		fbox_active; /* fastboxes announced to us;
+						protected by region lock */
+	int			*fbox;	/* per peer, see smr_tx_queue_next():
+					   0 not set up, -1 no fastbox, i + 1
+					   on fastbox i, -i - 2 detached from
+					   fastbox i; protected by tx CQ lock */
+	struct smr_heap_cache	heap_rx; /* for transfers carried out by
+					    us as the target; protected by
+					    region lock */
+	struct smr_heap_cache	heap_tx; /* for in-place atomics; protected
+					    by tx CQ lock */
+	struct dlist_entry	export_entry; /* on the domain's ep_list */
 };
 
 #define smr_ep_rx_flags(smr_ep) ((smr_ep)->util_ep.rx_op_flags)
@@ -200,7 +261,91 @@ int smr_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 int smr_cntr_open(struct fid_domain *domain, struct fi_cntr_attr *attr,
 		  struct fid_cntr **cntr_fid, void *context);
 
+/*
+ * Doorbell for blocking CQ and counter waits.  A thread about to sleep
+ * counts itself in its region's waiters, samples the signal word and polls
+ * once more before sleeping on it.  Whoever makes new work visible in a
+ * region (a cmd, a resp status, SAR progress) rings its doorbell after
+ * publishing the work, which only costs a syscall while someone is asleep.
+ * Both sides touch the waiters count with an atomic RMW, so either the
+ * ringer sees the sleeper or the sleeper's last poll sees the work.
+ */
+#define SMR_WAIT_QUANTUM_MS	1
+
+static inline void smr_signal(struct smr_region *smr)
+{
+	if (!ofi_atomic_add32(&smr->waiters, 0))
+		return;
+
+	__atomic_add_fetch(&smr->signal, 1, __ATOMIC_SEQ_CST);
+	ofi_futex_wake(&smr->signal, INT_MAX);
+}
+
+static inline int32_t smr_wait_begin(struct smr_region *smr)
+{
+	ofi_atomic_inc32(&smr->waiters);
+	return __atomic_load_n(&smr->signal, __ATOMIC_SEQ_CST);
+}
+
+static inline int smr_wait_sleep(struct smr_region *smr, int32_t seq,
+				 int timeout)
+{
+	return ofi_futex_wait(&smr->signal, seq, timeout);
+}
+
+static inline void smr_wait_end(struct smr_region *smr)
+{
+	ofi_atomic_dec32(&smr->waiters);
+}
+
+struct smr_region *smr_wait_region(struct dlist_entry *ep_list, int *timeout);
+void smr_signal_ep_list(struct dlist_entry *ep_list);
+
 int smr_verify_peer(struct smr_ep *ep, int peer_id);
+int smr_tx_queue_next(struct smr_ep *ep, int peer_id, int cnt,
+		      struct smr_cmd_queue **queue, int64_t *pos);
+void smr_fbox_release(struct smr_ep *ep, int peer_id);
+
+/* A target can only reach back into our region (resp entries) once it
+ * knows us, i.e. has inserted our address and paired with us. */
+static inline bool smr_peer_paired(struct smr_ep *ep, int peer_id)
+{
+	return smr_peer_addr(ep->region)[peer_id].addr != FI_ADDR_UNSPEC;
+}
+
+extern int smr_cma_enabled;
+extern int smr_hugepages;
+
+static inline bool smr_cma_usable(struct smr_ep *ep, int peer_id)
+{
+	struct smr_peer *peer = smr_map_peer(ep->region->map, peer_id);
+
+	return smr_cma_enabled && peer && !peer->no_cma;
+}
+
+/* Errors indicating that CMA is not permitted between the two processes,
+ * rather than a problem with the transfer itself. */
+static inline bool smr_cma_denied(int err)
+{
+	return err == EPERM || err == ENOSYS;
+}
+
+void smr_heap_init(void);
+void smr_heap_format(struct smr_domain *domain, struct smr_cmd *cmd,
+		     struct smr_resp *resp);
+int smr_heap_copy(struct smr_ep *ep, struct smr_cmd *cmd,
+		  struct smr_resp *resp, struct iovec *iov, size_t iov_count,
+		  size_t *total_len);
+void smr_heap_unmap_all(struct smr_ep *ep);
+void smr_ep_mr_export_start(struct smr_ep *ep);
+void smr_ep_mr_export_stop(struct smr_ep *ep);
+void *smr_mr_export_map(struct smr_ep *ep, int peer_id, uint64_t key,
+			uint64_t addr, size_t len, uint64_t access);
+int smr_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
+		   uint64_t flags, struct fid_mr **mr_fid);
+int smr_domain_ops_open(struct fid *fid, const char *name, uint64_t flags,
+			void **ops, void *context);
+void smr_domain_heap_close(struct smr_domain *domain);
 
 void smr_post_pend_resp(struct smr_cmd *cmd, struct smr_cmd *pend,
 			struct smr_resp *resp);
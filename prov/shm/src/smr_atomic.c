@@ -35,6 +35,7 @@
 #include <sys/uio.h>
 
 #include "ofi_iov.h"
+#include "ofi_atomic.h"
 #include "smr.h"
 
 
@@ -150,24 +151,88 @@ static int smr_fetch_result(struct smr_ep *ep, struct smr_region *peer_smr,
 }
 
 static void smr_post_fetch_resp(struct smr_ep *ep, struct smr_cmd *cmd,
-				const struct iovec *result_iov, size_t count)
+				int peer_id, const struct iovec *result_iov,
+				size_t count)
 {
 	struct smr_cmd *pend;
 	struct smr_resp *resp;
+	int64_t pos;
 
-	assert(!ofi_cirque_isfull(smr_resp_queue(ep->region)));
-	resp = ofi_cirque_tail(smr_resp_queue(ep->region));
+	assert(!smr_resp_queue_isfull(smr_resp_queue(ep->region)));
+	smr_resp_queue_next(smr_resp_queue(ep->region), 1, &pos);
+	resp = smr_resp_queue_buf(smr_resp_queue(ep->region), pos);
 
 	cmd->msg.hdr.data = (uint64_t) ((char **) resp -
 			    (char **) ep->region);
 
 	pend = freestack_pop(ep->pend_fs);
 	smr_post_pend_resp(cmd, pend, resp);
+	/* the result is read back through our own map */
+	pend->msg.hdr.addr = peer_id;
 	memcpy(pend->msg.data.iov, result_iov,
 	       sizeof(*result_iov) * count);
 	pend->msg.data.iov_count = count;
 
-	ofi_cirque_commit(smr_resp_queue(ep->region));
+	smr_resp_queue_commit(smr_resp_queue(ep->region), pos, 1);
+}
+
+/*
+ * Apply the atomic directly to the target memory if the peer has exported
+ * it from one of its heap segments.  The util handlers use hardware
+ * atomics, so this is atomic with respect to atomics applied by the
+ * peer's progress.  Returns -FI_ENOENT if any of the target ranges is not
+ * accessible this way.
+ */
+static int smr_atomic_inplace(struct smr_ep *ep, int peer_id,
+			const struct iovec *iov, size_t count,
+			const struct iovec *compare_iov, size_t compare_count,
+			const struct iovec *result_iov, size_t result_count,
+			const struct fi_rma_ioc *rma_ioc, size_t rma_count,
+			enum fi_datatype datatype, enum fi_op atomic_op,
+			uint32_t op, size_t msg_len)
+{
+	uint8_t src[SMR_INJECT_SIZE], cmp[SMR_INJECT_SIZE];
+	uint8_t res[SMR_INJECT_SIZE];
+	void *dst[SMR_IOV_LIMIT];
+	size_t dt_size, len, i;
+	uint64_t access;
+
+	dt_size = ofi_datatype_size(datatype);
+	access = ofi_rx_mr_reg_flags(op, atomic_op);
+	for (i = len = 0; i < rma_count; i++) {
+		len += rma_ioc[i].count * dt_size;
+		dst[i] = smr_mr_export_map(ep, peer_id, rma_ioc[i].key,
+					   rma_ioc[i].addr,
+					   rma_ioc[i].count * dt_size, access);
+		if (!dst[i])
+			return -FI_ENOENT;
+	}
+	/* let the target report the size mismatch */
+	if (len != msg_len)
+		return -FI_ENOENT;
+
+	if (atomic_op != FI_ATOMIC_READ)
+		ofi_copy_from_iov(src, msg_len, iov, count, 0);
+	if (op == ofi_op_atomic_compare)
+		ofi_copy_from_iov(cmp, msg_len, compare_iov, compare_count, 0);
+
+	for (i = len = 0; i < rma_count; i++) {
+		if (atomic_op >= OFI_SWAP_OP_START)
+			ofi_atomic_swap_handlers[atomic_op - OFI_SWAP_OP_START]
+				[datatype](dst[i], &src[len], &cmp[len],
+					   &res[len], rma_ioc[i].count);
+		else if (op == ofi_op_atomic_fetch)
+			ofi_atomic_readwrite_handlers[atomic_op][datatype](
+				dst[i], &src[len], &res[len], rma_ioc[i].count);
+		else
+			ofi_atomic_write_handlers[atomic_op][datatype](
+				dst[i], &src[len], rma_ioc[i].count);
+		len += rma_ioc[i].count * dt_size;
+	}
+
+	if (op != ofi_op_atomic)
+		ofi_copy_to_iov(result_iov, result_count, 0, res, len);
+	return 0;
 }
 
 static ssize_t smr_generic_atomic(struct smr_ep *ep,
@@ -182,11 +247,13 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 {
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
 	struct smr_cmd *cmd;
 	struct iovec iov[SMR_IOV_LIMIT];
 	struct iovec compare_iov[SMR_IOV_LIMIT];
 	struct iovec result_iov[SMR_IOV_LIMIT];
+	int64_t pos;
 	int peer_id, err = 0;
 	uint16_t flags = 0;
 	ssize_t ret = 0;
@@ -204,20 +271,6 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	if(ret)
 		return ret;
 
-	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
-	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
-		ret = -FI_EAGAIN;
-		goto unlock_cq;
-	}
-
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
 	msg_len = total_len = ofi_datatype_size(datatype) *
 			      ofi_total_ioc_cnt(ioc, count);
 	
@@ -247,30 +300,73 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 		break;
 	}
 
-	if (total_len <= SMR_MSG_DATA_LEN && !(flags & SMR_RMA_REQ)) {
+	if (total_len > SMR_INJECT_SIZE) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"message too large\n");
+		return -FI_EINVAL;
+	}
+
+	peer_smr = smr_peer_region(ep->region, peer_id);
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	if (domain->fast_rma &&
+	    !smr_atomic_inplace(ep, peer_id, iov, count, compare_iov,
+				compare_count, result_iov, result_count,
+				rma_ioc, rma_count, datatype, atomic_op, op,
+				msg_len)) {
+		ret = smr_complete_tx(ep, context, op, op_flags & FI_COMPLETION ?
+				      SMR_TX_COMPLETION : 0, 0);
+		if (ret)
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"unable to process tx completion\n");
+		goto unlock_cq;
+	}
+
+	if (((flags & SMR_RMA_REQ) &&
+	     (smr_resp_queue_isfull(smr_resp_queue(ep->region)) ||
+	      !smr_peer_paired(ep, peer_id)))) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	if (!smr_get_cmd_credit(peer_smr, 2)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	tx_buf = NULL;
+	if (total_len > SMR_MSG_DATA_LEN || (flags & SMR_RMA_REQ)) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, 2, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
+
+	if (!tx_buf) {
 		smr_format_inline_atomic(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 					 iov, count, compare_iov, compare_count,
 					 op, datatype, atomic_op, op_flags);
-	} else if (total_len <= SMR_INJECT_SIZE) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+	} else {
 		smr_format_inject_atomic(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 					 iov, count, result_iov, result_count,
 					 compare_iov, compare_count, op, datatype,
 					 atomic_op, peer_smr, tx_buf, op_flags);
-	} else {
-		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
-			"message too large\n");
-		ret = -FI_EINVAL;
-		goto unlock_cq;
 	}
 	cmd->msg.hdr.op_flags |= flags;
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-
 	if (op != ofi_op_atomic) {
 		if (flags & SMR_RMA_REQ) {
-			smr_post_fetch_resp(ep, cmd,
+			smr_post_fetch_resp(ep, cmd, peer_id,
 				(const struct iovec *) result_iov,
 				result_count);
 			goto format_rma;
@@ -289,14 +385,19 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	}
 
 format_rma:
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	cmd = smr_cmd_queue_buf(queue, pos + 1);
 	smr_format_rma_ioc(cmd, rma_ioc, rma_count);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(queue, pos, 2);
+	smr_signal(peer_smr);
+	goto unlock_cq;
+
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, 2);
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
 	return ret;
 }
 
@@ -307,6 +408,9 @@ static ssize_t smr_atomic_writemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_atomic(ep_fid, msg, flags);
+
 	return smr_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  NULL, NULL, 0, NULL, NULL, 0, msg->addr,
 				  msg->rma_iov, msg->rma_iov_count,
@@ -360,12 +464,15 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 			size_t count, fi_addr_t dest_addr, uint64_t addr,
 			uint64_t key, enum fi_datatype datatype, enum fi_op op)
 {
+	struct smr_domain *domain;
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
 	struct smr_cmd *cmd;
 	struct iovec iov;
 	struct fi_rma_ioc rma_ioc;
+	int64_t pos;
 	int peer_id;
 	ssize_t ret = 0;
 	size_t total_len;
@@ -373,20 +480,14 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	assert(count <= SMR_INJECT_SIZE);
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
 
 	peer_id = (int) dest_addr;
 	ret = smr_verify_peer(ep, peer_id);
 	if(ret)
 		return ret;
 
-	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < 2) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
 	total_len = count * ofi_datatype_size(datatype);
 	
 	iov.iov_base = (void *) buf;
@@ -396,27 +497,60 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 	rma_ioc.count = count;
 	rma_ioc.key = key;
 
-	if (total_len <= SMR_MSG_DATA_LEN) {
+	peer_smr = smr_peer_region(ep->region, peer_id);
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (domain->fast_rma &&
+	    !smr_atomic_inplace(ep, peer_id, &iov, 1, NULL, 0, NULL, 0,
+				&rma_ioc, 1, datatype, op, ofi_op_atomic,
+				total_len)) {
+		ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_atomic);
+		goto unlock_cq;
+	}
+
+	if (!smr_get_cmd_credit(peer_smr, 2)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	tx_buf = NULL;
+	if (total_len > SMR_MSG_DATA_LEN) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, 2, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
+
+	if (!tx_buf) {
 		smr_format_inline_atomic(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 					 &iov, 1, NULL, 0, ofi_op_atomic,
 					 datatype, op, 0);
-	} else if (total_len <= SMR_INJECT_SIZE) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+	} else {
 		smr_format_inject_atomic(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 					 &iov, 1, NULL, 0, NULL, 0, ofi_op_atomic,
 					 datatype, op, peer_smr, tx_buf, 0);
 	}
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	cmd = smr_cmd_queue_buf(queue, pos + 1);
 	smr_format_rma_ioc(cmd, &rma_ioc, 1);
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(queue, pos, 2);
+	smr_signal(peer_smr);
 
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_atomic);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
+	goto unlock_cq;
+
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, 2);
+unlock_cq:
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
 	return ret;
 }
 
@@ -428,6 +562,11 @@ static ssize_t smr_atomic_readwritemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_fetch_atomic(ep_fid, msg, resultv,
+						result_desc, result_count,
+						flags);
+
 	return smr_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  NULL, NULL, 0, resultv, result_desc,
 				  result_count, msg->addr,
@@ -497,6 +636,12 @@ static ssize_t smr_atomic_compwritemsg(struct fid_ep *ep_fid,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_compare_atomic(ep_fid, msg, comparev,
+						  compare_desc, compare_count,
+						  resultv, result_desc,
+						  result_count, flags);
+
 	return smr_generic_atomic(ep, msg->msg_iov, msg->desc, msg->iov_count,
 				  comparev, compare_desc, compare_count,
 				  resultv, result_desc,
@@ -32,9 +32,10 @@
 
 #include "smr.h"
 
-#define SMR_TX_CAPS (OFI_TX_MSG_CAPS | FI_TAGGED | OFI_TX_RMA_CAPS | FI_ATOMICS)
+#define SMR_TX_CAPS (OFI_TX_MSG_CAPS | FI_TAGGED | OFI_TX_RMA_CAPS | FI_ATOMICS | \
+		     FI_TRIGGER)
 #define SMR_RX_CAPS (FI_SOURCE | FI_RMA_EVENT | OFI_RX_MSG_CAPS | FI_TAGGED | \
-		     OFI_RX_RMA_CAPS | FI_ATOMICS)
+		     OFI_RX_RMA_CAPS | FI_ATOMICS | FI_TRIGGER)
 #define SMR_TX_OP_FLAGS (FI_REMOTE_CQ_DATA | FI_COMPLETION | \
 			 FI_INJECT_COMPLETE | FI_TRANSMIT_COMPLETE | \
 			 /* TODO: support for delivery complete */ \
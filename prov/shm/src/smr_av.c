@@ -81,6 +81,9 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 			ret = smr_map_add(&smr_prov, smr_av->smr_map,
 					  ep_name, index);
 			if (ret) {
+				fastlock_acquire(&util_av->lock);
+				ofi_av_remove_addr(util_av, index);
+				fastlock_release(&util_av->lock);
 				if (util_av->eq)
 					ofi_av_write_event(util_av, i, -ret, context);
 			} else {
@@ -90,11 +93,15 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 
 		if (fi_addr)
 			fi_addr[i] = (ret == 0) ? index : FI_ADDR_NOTAVAIL;
+		if (ret)
+			continue;
 
+		/* The peer's region is mapped on first use */
 		dlist_foreach(&util_av->ep_list, av_entry) {
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
-			smr_map_to_endpoint(smr_ep->region, index);
+			if (smr_ep->region)
+				smr_map_to_endpoint(smr_ep->region, index);
 		}
 	}
 
@@ -127,12 +134,18 @@ static int smr_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 			break;
 		}
 
-		smr_map_del(smr_av->smr_map, fi_addr[i]);
 		dlist_foreach(&util_av->ep_list, av_entry) {
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
-			smr_unmap_from_endpoint(smr_ep->region, fi_addr[i]);
+			if (smr_ep->region) {
+				fastlock_acquire(&util_ep->tx_cq->cq_lock);
+				smr_fbox_release(smr_ep, (int) fi_addr[i]);
+				fastlock_release(&util_ep->tx_cq->cq_lock);
+				smr_unmap_from_endpoint(smr_ep->region,
+							fi_addr[i]);
+			}
 		}
+		smr_map_del(smr_av->smr_map, fi_addr[i]);
 	}
 
 	fastlock_release(&util_av->lock);
@@ -144,17 +157,17 @@ static int smr_av_lookup(struct fid_av *av, fi_addr_t fi_addr, void *addr,
 {
 	struct util_av *util_av;
 	struct smr_av *smr_av;
-	struct smr_region *peer_smr;
+	struct smr_peer *peer;
 	int peer_id = (int)fi_addr;
 
 	util_av = container_of(av, struct util_av, av_fid);
 	smr_av = container_of(util_av, struct smr_av, util_av);
-	peer_smr = smr_map_get(smr_av->smr_map, peer_id);
+	peer = smr_map_peer(smr_av->smr_map, peer_id);
 
-	if (!peer_smr)
+	if (!peer)
 		return -FI_ADDR_NOTAVAIL;
 
-	strncpy((char *)addr, smr_name(peer_smr), *addrlen);
+	strncpy((char *)addr, peer->peer.name, *addrlen);
 	((char *) addr)[*addrlen] = '\0';
 	*addrlen = sizeof(struct smr_addr);
 	return 0;
@@ -227,7 +240,9 @@ int smr_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	(*av)->fid.ops = &smr_av_fi_ops;
 	(*av)->ops = &smr_av_ops;
 
-	ret = smr_map_create(&smr_prov, SMR_MAX_PEERS, &smr_av->smr_map);
+	/* endpoint regions size their peer address tables to the AV */
+	ret = smr_map_create(&smr_prov, MIN(smr_av->util_av.count, SMR_MAX_PEERS),
+			     &smr_av->smr_map);
 	if (ret)
 		goto close;
 
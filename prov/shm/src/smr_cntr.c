@@ -32,14 +32,120 @@
 
 #include "smr.h"
 
+static int smr_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold,
+			 int timeout)
+{
+	struct smr_region *region;
+	struct util_cntr *cntr;
+	uint64_t endtime, errcnt;
+	int32_t seq;
+	int ret, wait_timeout;
+
+	cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
+	errcnt = ofi_atomic_get64(&cntr->err);
+	endtime = ofi_timeout_time(timeout);
+
+	for (;;) {
+		cntr->progress(cntr);
+		ofi_progress_work(cntr->domain);
+		if (threshold <= ofi_cntr_value(cntr))
+			return FI_SUCCESS;
+
+		if (errcnt != ofi_atomic_get64(&cntr->err))
+			return -FI_EAVAIL;
+
+		if (ofi_adjust_timeout(endtime, &timeout))
+			return -FI_ETIMEDOUT;
+
+		wait_timeout = timeout;
+		fastlock_acquire(&cntr->ep_list_lock);
+		region = smr_wait_region(&cntr->ep_list, &wait_timeout);
+		fastlock_release(&cntr->ep_list_lock);
+		if (!region)
+			continue;
+
+		seq = smr_wait_begin(region);
+		cntr->progress(cntr);
+		ret = 0;
+		if (threshold > ofi_cntr_value(cntr) &&
+		    errcnt == ofi_atomic_get64(&cntr->err))
+			ret = smr_wait_sleep(region, seq, wait_timeout);
+		smr_wait_end(region);
+
+		if (ret && ret != -FI_ETIMEDOUT)
+			return ret;
+	}
+}
+
+/* updates from the application may satisfy a waiter */
+static void smr_cntr_signal(struct util_cntr *cntr)
+{
+	fastlock_acquire(&cntr->ep_list_lock);
+	smr_signal_ep_list(&cntr->ep_list);
+	fastlock_release(&cntr->ep_list_lock);
+}
+
+static int smr_cntr_add(struct fid_cntr *cntr_fid, uint64_t value)
+{
+	int ret;
+
+	ret = ofi_cntr_add(cntr_fid, value);
+	smr_cntr_signal(container_of(cntr_fid, struct util_cntr, cntr_fid));
+	return ret;
+}
+
+static int smr_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value)
+{
+	int ret;
+
+	ret = ofi_cntr_adderr(cntr_fid, value);
+	smr_cntr_signal(container_of(cntr_fid, struct util_cntr, cntr_fid));
+	return ret;
+}
+
+static int smr_cntr_set(struct fid_cntr *cntr_fid, uint64_t value)
+{
+	int ret;
+
+	ret = ofi_cntr_set(cntr_fid, value);
+	smr_cntr_signal(container_of(cntr_fid, struct util_cntr, cntr_fid));
+	return ret;
+}
+
+static int smr_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value)
+{
+	int ret;
+
+	ret = ofi_cntr_seterr(cntr_fid, value);
+	smr_cntr_signal(container_of(cntr_fid, struct util_cntr, cntr_fid));
+	return ret;
+}
+
+static struct fi_ops_cntr smr_cntr_ops = {
+	.size = sizeof(struct fi_ops_cntr),
+	.read = ofi_cntr_read,
+	.readerr = ofi_cntr_readerr,
+	.add = smr_cntr_add,
+	.adderr = smr_cntr_adderr,
+	.set = smr_cntr_set,
+	.seterr = smr_cntr_seterr,
+	.wait = smr_cntr_wait,
+};
+
 int smr_cntr_open(struct fid_domain *domain, struct fi_cntr_attr *attr,
 		  struct fid_cntr **cntr_fid, void *context)
 {
-	int ret;
+	struct fi_cntr_attr cntr_attr;
 	struct util_cntr *cntr;
+	int ret;
 
-	if (attr->wait_obj != FI_WAIT_NONE) {
-		FI_INFO(&smr_prov, FI_LOG_CNTR, "cntr wait not yet supported\n");
+	switch (attr->wait_obj) {
+	case FI_WAIT_NONE:
+	case FI_WAIT_UNSPEC:
+		break;
+	default:
+		FI_INFO(&smr_prov, FI_LOG_CNTR,
+			"cntr wait object not supported\n");
 		return -FI_ENOSYS;
 	}
 
@@ -47,11 +153,17 @@ int smr_cntr_open(struct fid_domain *domain, struct fi_cntr_attr *attr,
 	if (!cntr)
 		return -FI_ENOMEM;
 
-	ret = ofi_cntr_init(&smr_prov, domain, attr, cntr,
+	/* waits sleep on the endpoints' doorbells, see smr_cntr_wait */
+	cntr_attr = *attr;
+	cntr_attr.wait_obj = FI_WAIT_NONE;
+	ret = ofi_cntr_init(&smr_prov, domain, &cntr_attr, cntr,
 			    &ofi_cntr_progress, context);
 	if (ret)
 		goto free;
 
+	if (attr->wait_obj == FI_WAIT_UNSPEC)
+		cntr->cntr_fid.ops = &smr_cntr_ops;
+
 	*cntr_fid = &cntr->cntr_fid;
 	return FI_SUCCESS;
 
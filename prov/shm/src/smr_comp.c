@@ -54,6 +54,9 @@ int smr_tx_comp(struct smr_ep *ep, void *context, uint32_t op,
 	struct fi_cq_tagged_entry *comp;
 	struct util_cq_oflow_err_entry *entry;
 
+	if (ofi_cq_complete_work(ep->util_ep.tx_cq, &context, err != 0))
+		return 0;
+
 	comp = ofi_cirque_tail(ep->util_ep.tx_cq->cirq);
 	if (err) {
 		if (!(entry = calloc(1, sizeof(*entry))))
@@ -108,6 +111,9 @@ int smr_rx_comp(struct smr_ep *ep, void *context, uint32_t op,
 	struct fi_cq_tagged_entry *comp;
 	struct util_cq_oflow_err_entry *entry;
 
+	if (ofi_cq_complete_work(ep->util_ep.rx_cq, &context, err != 0))
+		return 0;
+
 	comp = ofi_cirque_tail(ep->util_ep.rx_cq->cirq);
 	if (err) {
 		if (!(entry = calloc(1, sizeof(*entry))))
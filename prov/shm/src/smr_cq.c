@@ -35,14 +35,98 @@
 
 #include "smr.h"
 
+static ssize_t smr_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
+				fi_addr_t *src_addr, const void *cond,
+				int timeout)
+{
+	struct smr_region *region;
+	struct util_cq *cq;
+	uint64_t endtime;
+	int32_t seq;
+	int wait_timeout;
+	ssize_t ret;
+
+	cq = container_of(cq_fid, struct util_cq, cq_fid);
+	endtime = ofi_timeout_time(timeout);
+
+	for (;;) {
+		ret = ofi_cq_readfrom(cq_fid, buf, count, src_addr);
+		if (ret != -FI_EAGAIN)
+			return ret;
+
+		if (ofi_adjust_timeout(endtime, &timeout))
+			return -FI_EAGAIN;
+
+		if (ofi_atomic_get32(&cq->signaled)) {
+			ofi_atomic_set32(&cq->signaled, 0);
+			return -FI_ECANCELED;
+		}
+
+		wait_timeout = timeout;
+		cq->cq_fastlock_acquire(&cq->ep_list_lock);
+		region = smr_wait_region(&cq->ep_list, &wait_timeout);
+		cq->cq_fastlock_release(&cq->ep_list_lock);
+		if (!region)
+			continue;
+
+		seq = smr_wait_begin(region);
+		ret = ofi_cq_readfrom(cq_fid, buf, count, src_addr);
+		if (ret == -FI_EAGAIN && !ofi_atomic_get32(&cq->signaled))
+			ret = smr_wait_sleep(region, seq, wait_timeout);
+		smr_wait_end(region);
+
+		if (ret && ret != -FI_ETIMEDOUT)
+			return ret;
+	}
+}
+
+static ssize_t smr_cq_sread(struct fid_cq *cq_fid, void *buf, size_t count,
+			    const void *cond, int timeout)
+{
+	return smr_cq_sreadfrom(cq_fid, buf, count, NULL, cond, timeout);
+}
+
+static int smr_cq_signal(struct fid_cq *cq_fid)
+{
+	struct util_cq *cq = container_of(cq_fid, struct util_cq, cq_fid);
+
+	ofi_atomic_set32(&cq->signaled, 1);
+	cq->cq_fastlock_acquire(&cq->ep_list_lock);
+	smr_signal_ep_list(&cq->ep_list);
+	cq->cq_fastlock_release(&cq->ep_list_lock);
+	return 0;
+}
+
+static const char *smr_cq_strerror(struct fid_cq *cq_fid, int prov_errno,
+				   const void *err_data, char *buf, size_t len)
+{
+	return fi_strerror(prov_errno);
+}
+
+static struct fi_ops_cq smr_cq_ops = {
+	.size = sizeof(struct fi_ops_cq),
+	.read = ofi_cq_read,
+	.readfrom = ofi_cq_readfrom,
+	.readerr = ofi_cq_readerr,
+	.sread = smr_cq_sread,
+	.sreadfrom = smr_cq_sreadfrom,
+	.signal = smr_cq_signal,
+	.strerror = smr_cq_strerror,
+};
+
 int smr_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		struct fid_cq **cq_fid, void *context)
 {
+	struct fi_cq_attr cq_attr;
 	struct util_cq *util_cq;
 	int ret;
 
-	if (attr->wait_obj != FI_WAIT_NONE) {
-		FI_INFO(&smr_prov, FI_LOG_CQ, "CQ wait not yet supported\n");
+	switch (attr->wait_obj) {
+	case FI_WAIT_NONE:
+	case FI_WAIT_UNSPEC:
+		break;
+	default:
+		FI_INFO(&smr_prov, FI_LOG_CQ, "CQ wait object not supported\n");
 		return -FI_ENOSYS;
 	}
 
@@ -50,10 +134,18 @@ int smr_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (!util_cq)
 		return -FI_ENOMEM;
 
-	ret = ofi_cq_init(&smr_prov, domain, attr, util_cq, ofi_cq_progress, context);
+	/* blocking reads sleep on the endpoints' doorbells rather than on
+	 * a util wait object */
+	cq_attr = *attr;
+	cq_attr.wait_obj = FI_WAIT_NONE;
+	ret = ofi_cq_init(&smr_prov, domain, &cq_attr, util_cq,
+			  ofi_cq_progress, context);
 	if (ret)
 		goto free;
 
+	if (attr->wait_obj == FI_WAIT_UNSPEC)
+		util_cq->cq_fid.ops = &smr_cq_ops;
+
 	(*cq_fid) = &util_cq->cq_fid;
 	return 0;
 
@@ -58,6 +58,7 @@ static int smr_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	smr_domain_heap_close(domain);
 	free(domain);
 	return 0;
 }
@@ -66,15 +67,43 @@ static struct fi_ops smr_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = smr_domain_close,
 	.bind = fi_no_bind,
-	.control = fi_no_control,
-	.ops_open = fi_no_ops_open,
+	.control = ofi_domain_control,
+	.ops_open = smr_domain_ops_open,
 };
 
+static int smr_mr_regv(struct fid *fid, const struct iovec *iov,
+		       size_t count, uint64_t access, uint64_t offset,
+		       uint64_t requested_key, uint64_t flags,
+		       struct fid_mr **mr_fid, void *context)
+{
+	struct fi_mr_attr attr;
+
+	attr.mr_iov = iov;
+	attr.iov_count = count;
+	attr.access = access;
+	attr.offset = offset;
+	attr.requested_key = requested_key;
+	attr.context = context;
+	return smr_mr_regattr(fid, &attr, flags, mr_fid);
+}
+
+static int smr_mr_reg(struct fid *fid, const void *buf, size_t len,
+		      uint64_t access, uint64_t offset, uint64_t requested_key,
+		      uint64_t flags, struct fid_mr **mr_fid, void *context)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return smr_mr_regv(fid, &iov, 1, access, offset, requested_key, flags,
+			   mr_fid, context);
+}
+
 static struct fi_ops_mr smr_mr_ops = {
 	.size = sizeof(struct fi_ops_mr),
-	.reg = ofi_mr_reg,
-	.regv = ofi_mr_regv,
-	.regattr = ofi_mr_regattr,
+	.reg = smr_mr_reg,
+	.regv = smr_mr_regv,
+	.regattr = smr_mr_regattr,
 };
 
 int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
@@ -105,6 +134,10 @@ int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 						    info->tx_attr->msg_order);
 	fastlock_release(&smr_fabric->util_fabric.lock);
 
+	fastlock_init(&smr_domain->heap_lock);
+	dlist_init(&smr_domain->heap_list);
+	dlist_init(&smr_domain->ep_list);
+
 	*domain = &smr_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &smr_domain_fi_ops;
 	(*domain)->ops = &smr_domain_ops;
@@ -178,12 +178,177 @@ int smr_verify_peer(struct smr_ep *ep, int peer_id)
 {
 	int ret;
 
-	if (ep->region->map->peers[peer_id].peer.addr != FI_ADDR_UNSPEC)
+	if (smr_peer_region(ep->region, peer_id) &&
+	    smr_peer_addr(ep->region)[peer_id].addr != FI_ADDR_UNSPEC)
 		return 0;
 
-	ret = smr_map_to_region(&smr_prov, &ep->region->map->peers[peer_id]);
+	ret = smr_map_to_region(&smr_prov, ep->region->map, peer_id);
+	if (ret)
+		return (ret == -ENOENT) ? -FI_EAGAIN : ret;
+
+	/* pairs up once the peer has inserted our address */
+	smr_map_to_endpoint(ep->region, peer_id);
+	return 0;
+}
+
+/* Post a fastbox control cmd to the peer's shared queue. */
+static int smr_fbox_ctrl(struct smr_ep *ep, struct smr_region *peer_smr,
+			 int peer_id, uint32_t op, int index)
+{
+	struct smr_cmd *cmd;
+	int64_t pos;
+
+	if (!smr_get_cmd_credit(peer_smr, 1))
+		return -FI_EAGAIN;
+
+	if (smr_cmd_queue_next(smr_cmd_queue(peer_smr), 1, &pos)) {
+		smr_put_cmd_credit(peer_smr, 1);
+		return -FI_EAGAIN;
+	}
+
+	cmd = smr_cmd_queue_buf(smr_cmd_queue(peer_smr), pos);
+	cmd->msg.hdr.op = op;
+	cmd->msg.hdr.op_src = smr_src_inline;
+	cmd->msg.hdr.op_flags = 0;
+	cmd->msg.hdr.addr = smr_peer_addr(ep->region)[peer_id].addr;
+	cmd->msg.hdr.data = index;
+	smr_cmd_queue_commit(smr_cmd_queue(peer_smr), pos, 1);
+	smr_signal(peer_smr);
+	return 0;
+}
+
+/*
+ * A sender that left and came back finds its fastbox still claimed, and
+ * keeps using it, so that its old and new cmds stay in one queue.
+ */
+static int smr_fbox_claim(struct smr_region *peer_smr, int32_t owner)
+{
+	int i;
+
+	for (i = 0; i < SMR_FBOX_COUNT; i++) {
+		if (ofi_atomic_get32(&peer_smr->fbox_owner[i]) == owner)
+			return i;
+	}
+
+	for (i = 0; i < SMR_FBOX_COUNT; i++) {
+		if (ofi_atomic_cas_bool32(&peer_smr->fbox_owner[i], 0, owner))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Give our fastbox in the peer's region back, on removing the peer or
+ * closing.  The peer frees it once it has drained it; until then no sender
+ * can claim it.  If the release cannot be posted, the fastbox stays ours.
+ */
+void smr_fbox_release(struct smr_ep *ep, int peer_id)
+{
+	struct smr_region *peer_smr = smr_peer_region(ep->region, peer_id);
+	int *fbox = &ep->fbox[peer_id];
+	int32_t owner;
+	int index;
+
+	if (peer_smr && (*fbox > 0 || *fbox < -1)) {
+		index = *fbox > 0 ? *fbox - 1 : -*fbox - 2;
+		owner = ofi_atomic_get32(&peer_smr->fbox_owner[index]);
+		ofi_atomic_set32(&peer_smr->fbox_owner[index],
+				 SMR_FBOX_RELEASING);
+		if (smr_fbox_ctrl(ep, peer_smr, peer_id, smr_op_fbox_release,
+				  index))
+			ofi_atomic_set32(&peer_smr->fbox_owner[index], owner);
+	}
+	*fbox = 0;
+}
+
+/*
+ * Claim cnt cmd entries for a send to a peer, in our fastbox in the peer's
+ * region if we have one and it has room, else in the peer's shared queue.
+ * A full fastbox is detached from, which makes the peer drain it before
+ * the cmds we send next on the shared queue, and is reattached to once
+ * the peer has done so.  Must be called, and the cmds committed, under the
+ * tx CQ lock, which orders the queue switches with our other sends.
+ */
+int smr_tx_queue_next(struct smr_ep *ep, int peer_id, int cnt,
+		      struct smr_cmd_queue **queue, int64_t *pos)
+{
+	struct smr_region *peer_smr = smr_peer_region(ep->region, peer_id);
+	int *fbox = &ep->fbox[peer_id];
+	int index;
+
+	if (!*fbox && smr_peer_paired(ep, peer_id)) {
+		index = smr_fbox_claim(peer_smr, (int32_t)
+				smr_peer_addr(ep->region)[peer_id].addr + 1);
+		*fbox = index < 0 ? -1 : -index - 2;
+	}
 
-	return (ret == -ENOENT) ? -FI_EAGAIN : ret;
+	if (*fbox < -1) {
+		index = -*fbox - 2;
+		if (!(ofi_atomic_get32(&peer_smr->fbox_detached) &
+		      (1U << index)) &&
+		    !smr_fbox_ctrl(ep, peer_smr, peer_id, smr_op_fbox, index))
+			*fbox = index + 1;
+	}
+
+	if (*fbox > 0) {
+		index = *fbox - 1;
+		*queue = smr_fbox(peer_smr, index);
+		if (!smr_cmd_queue_next(*queue, cnt, pos))
+			return 0;
+
+		/* the peer clears the bit once it has drained the fastbox */
+		ofi_atomic_add32(&peer_smr->fbox_detached, 1U << index);
+		if (smr_fbox_ctrl(ep, peer_smr, peer_id, smr_op_fbox_detach,
+				  index)) {
+			ofi_atomic_sub32(&peer_smr->fbox_detached, 1U << index);
+			return -FI_EAGAIN;
+		}
+		*fbox = -index - 2;
+	}
+
+	*queue = smr_cmd_queue(peer_smr);
+	return smr_cmd_queue_next(*queue, cnt, pos);
+}
+
+/* Region for a CQ or counter wait to sleep on, with ep_list locked by the
+ * caller.  Only one doorbell can be slept on at a time, so when several
+ * endpoints are bound the sleep is cut to SMR_WAIT_QUANTUM_MS and the rest
+ * are picked up by polling. */
+struct smr_region *smr_wait_region(struct dlist_entry *ep_list, int *timeout)
+{
+	struct fid_list_entry *fid_entry;
+	struct smr_region *region = NULL;
+	struct smr_ep *ep;
+
+	dlist_foreach_container(ep_list, struct fid_list_entry,
+				fid_entry, entry) {
+		ep = container_of(fid_entry->fid, struct smr_ep,
+				  util_ep.ep_fid.fid);
+		if (!ep->region)
+			continue;
+
+		if (region) {
+			*timeout = *timeout < 0 ? SMR_WAIT_QUANTUM_MS :
+				   MIN(*timeout, SMR_WAIT_QUANTUM_MS);
+			break;
+		}
+		region = ep->region;
+	}
+	return region;
+}
+
+void smr_signal_ep_list(struct dlist_entry *ep_list)
+{
+	struct fid_list_entry *fid_entry;
+	struct smr_ep *ep;
+
+	dlist_foreach_container(ep_list, struct fid_list_entry,
+				fid_entry, entry) {
+		ep = container_of(fid_entry->fid, struct smr_ep,
+				  util_ep.ep_fid.fid);
+		if (ep->region)
+			smr_signal(ep->region);
+	}
 }
 
 static int smr_match_msg(struct dlist_entry *item, const void *args)
@@ -300,17 +465,29 @@ void smr_format_iov(struct smr_cmd *cmd, fi_addr_t peer_id,
 static int smr_ep_close(struct fid *fid)
 {
 	struct smr_ep *ep;
+	int i;
 
 	ep = container_of(fid, struct smr_ep, util_ep.ep_fid.fid);
+	if (ofi_atomic_get32(&ep->util_ep.ref))
+		return -FI_EBUSY;
 
+	smr_ep_mr_export_stop(ep);
+	if (ep->region) {
+		for (i = 0; i < ep->region->max_peers; i++)
+			smr_fbox_release(ep, i);
+	}
 	ofi_endpoint_close(&ep->util_ep);
 
 	if (ep->region)
 		smr_free(ep->region);
 
+	smr_heap_unmap_all(ep);
+
 	smr_recv_fs_free(ep->recv_fs);
 	smr_unexp_fs_free(ep->unexp_fs);
 	smr_pend_fs_free(ep->pend_fs);
+	smr_sar_fs_free(ep->sar_fs);
+	free(ep->fbox);
 	free(ep);
 	return 0;
 }
@@ -345,6 +522,38 @@ static int smr_ep_bind_cq(struct smr_ep *ep, struct util_cq *cq, uint64_t flags)
 	return ret;
 }
 
+/* Completions are counted by whoever is progressing the endpoint, so there
+ * is nobody to wake; skip the signaling done by fi_cntr_add(). */
+static void smr_cntr_inc(struct util_cntr *cntr)
+{
+	ofi_cntr_add_value(cntr, 1);
+}
+
+static int smr_ep_bind_cntr(struct smr_ep *ep, struct util_cntr *cntr,
+			    uint64_t flags)
+{
+	int ret;
+
+	ret = ofi_ep_bind_cntr(&ep->util_ep, cntr, flags);
+	if (ret)
+		return ret;
+
+	if (flags & FI_TRANSMIT)
+		ep->util_ep.tx_cntr_inc = smr_cntr_inc;
+	if (flags & FI_RECV)
+		ep->util_ep.rx_cntr_inc = smr_cntr_inc;
+	if (flags & FI_READ)
+		ep->util_ep.rd_cntr_inc = smr_cntr_inc;
+	if (flags & FI_WRITE)
+		ep->util_ep.wr_cntr_inc = smr_cntr_inc;
+	if (flags & FI_REMOTE_READ)
+		ep->util_ep.rem_rd_cntr_inc = smr_cntr_inc;
+	if (flags & FI_REMOTE_WRITE)
+		ep->util_ep.rem_wr_cntr_inc = smr_cntr_inc;
+
+	return 0;
+}
+
 static int smr_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 {
 	struct smr_ep *ep;
@@ -369,7 +578,7 @@ static int smr_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 	case FI_CLASS_EQ:
 		break;
 	case FI_CLASS_CNTR:
-		ret = ofi_ep_bind_cntr(&ep->util_ep, container_of(bfid,
+		ret = smr_ep_bind_cntr(ep, container_of(bfid,
 				struct util_cntr, cntr_fid.fid), flags);
 		break;
 	default:
@@ -401,11 +610,21 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		attr.name = ep->name;
 		attr.rx_count = ep->rx_size;
 		attr.tx_count = ep->tx_size;
+		attr.flags = smr_hugepages ? SMR_ATTR_HUGEPAGES : 0;
+		ep->fbox = calloc(av->smr_map->max_peers, sizeof(*ep->fbox));
+		if (!ep->fbox)
+			return -FI_ENOMEM;
 		ret = smr_create(&smr_prov, av->smr_map, &attr, &ep->region);
-		if (ret)
+		if (ret) {
+			free(ep->fbox);
+			ep->fbox = NULL;
 			return ret;
+		}
 		smr_exchange_all_peers(ep->region);
+		smr_ep_mr_export_start(ep);
 		break;
+	case FI_ALIAS:
+		return ofi_ep_alias(&ep->util_ep, arg);
 	default:
 		return -FI_ENOSYS;
 	}
@@ -474,6 +693,10 @@ int smr_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ep->recv_fs = smr_recv_fs_create(info->rx_attr->size, NULL, NULL);
 	ep->unexp_fs = smr_unexp_fs_create(info->rx_attr->size, NULL, NULL);
 	ep->pend_fs = smr_pend_fs_create(info->tx_attr->size, NULL, NULL);
+	ep->sar_fs = smr_sar_fs_create(info->rx_attr->size, NULL, NULL);
+	dlist_init(&ep->sar_list);
+	dlist_init(&ep->export_entry);
+	ep->sar_buf_free = (1ULL << SMR_SAR_COUNT) - 1;
 	smr_init_queue(&ep->recv_queue, smr_match_msg);
 	smr_init_queue(&ep->trecv_queue, smr_match_tagged);
 	smr_init_queue(&ep->unexp_queue, smr_match_unexp);
@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ofi_iov.h"
+#include "ofi_mr.h"
+#include "smr.h"
+#include "fi_ext_shm.h"
+
+/*
+ * Heap of memfd backed segments for single-copy transfers without CMA.
+ * Senders tag iov cmds whose buffers all lie in one segment with
+ * SMR_HEAP_IOV and describe the segment in the resp entry.  The target
+ * opens the segment through /proc/<pid>/fd, keeps the mapping in a small
+ * LRU cache, and copies with memcpy.  Segment ids are never reused, so a
+ * cached mapping of a freed segment is never hit again and simply ages
+ * out of the cache.
+ */
+
+static ofi_atomic64_t smr_heap_id;
+
+static void smr_mr_export_drop_seg(struct smr_domain *domain, uint64_t id);
+
+void smr_heap_init(void)
+{
+	ofi_atomic_initialize64(&smr_heap_id, 0);
+}
+
+static void *smr_heap_alloc(struct fid *fid, size_t len)
+{
+	struct smr_domain *domain;
+	struct smr_heap_seg *seg;
+	int ret;
+
+	domain = container_of(fid, struct smr_domain,
+			      util_domain.domain_fid.fid);
+
+	seg = calloc(1, sizeof(*seg));
+	if (!seg)
+		return NULL;
+
+	seg->len = ofi_get_aligned_size(len ? len : 1, ofi_get_page_size());
+	seg->fd = ofi_memfd_create("fi_shm_heap");
+	if (seg->fd < 0) {
+		FI_WARN(&smr_prov, FI_LOG_DOMAIN,
+			"memfd_create failed: %s\n", strerror(-seg->fd));
+		goto err1;
+	}
+
+	ret = ftruncate(seg->fd, seg->len);
+	if (ret) {
+		FI_WARN(&smr_prov, FI_LOG_DOMAIN, "ftruncate failed: %s\n",
+			strerror(errno));
+		goto err2;
+	}
+
+	seg->base = mmap(NULL, seg->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 seg->fd, 0);
+	if (seg->base == MAP_FAILED) {
+		FI_WARN(&smr_prov, FI_LOG_DOMAIN, "mmap failed: %s\n",
+			strerror(errno));
+		goto err2;
+	}
+
+	seg->id = ofi_atomic_inc64(&smr_heap_id);
+
+	fastlock_acquire(&domain->heap_lock);
+	dlist_insert_tail(&seg->entry, &domain->heap_list);
+	fastlock_release(&domain->heap_lock);
+	return seg->base;
+
+err2:
+	close(seg->fd);
+err1:
+	free(seg);
+	return NULL;
+}
+
+static void smr_heap_release(struct smr_heap_seg *seg)
+{
+	munmap(seg->base, seg->len);
+	close(seg->fd);
+	free(seg);
+}
+
+static int smr_heap_match_base(struct dlist_entry *item, const void *arg)
+{
+	return container_of(item, struct smr_heap_seg, entry)->base == arg;
+}
+
+static int smr_heap_free(struct fid *fid, void *buf)
+{
+	struct smr_domain *domain;
+	struct dlist_entry *entry;
+
+	domain = container_of(fid, struct smr_domain,
+			      util_domain.domain_fid.fid);
+
+	fastlock_acquire(&domain->heap_lock);
+	entry = dlist_remove_first_match(&domain->heap_list,
+					 smr_heap_match_base, buf);
+	if (entry)
+		smr_mr_export_drop_seg(domain, container_of(entry,
+				       struct smr_heap_seg, entry)->id);
+	fastlock_release(&domain->heap_lock);
+	if (!entry)
+		return -FI_EINVAL;
+
+	smr_heap_release(container_of(entry, struct smr_heap_seg, entry));
+	return 0;
+}
+
+static struct fi_shm_ops_domain smr_heap_ops = {
+	.size = sizeof(struct fi_shm_ops_domain),
+	.mem_alloc = smr_heap_alloc,
+	.mem_free = smr_heap_free,
+};
+
+int smr_domain_ops_open(struct fid *fid, const char *name, uint64_t flags,
+			void **ops, void *context)
+{
+	if (strcmp(name, FI_SHM_DOMAIN_OPS_1))
+		return -FI_ENOSYS;
+
+	*ops = &smr_heap_ops;
+	return 0;
+}
+
+void smr_domain_heap_close(struct smr_domain *domain)
+{
+	struct smr_heap_seg *seg;
+
+	while (!dlist_empty(&domain->heap_list)) {
+		dlist_pop_front(&domain->heap_list, struct smr_heap_seg,
+				seg, entry);
+		FI_WARN(&smr_prov, FI_LOG_DOMAIN,
+			"releasing heap memory still allocated at close\n");
+		smr_heap_release(seg);
+	}
+	fastlock_destroy(&domain->heap_lock);
+}
+
+static bool smr_heap_contains(struct smr_heap_seg *seg,
+			      const struct iovec *iov)
+{
+	return (char *) iov->iov_base >= (char *) seg->base &&
+	       iov->iov_len <= seg->len -
+			       ((char *) iov->iov_base - (char *) seg->base);
+}
+
+void smr_heap_format(struct smr_domain *domain, struct smr_cmd *cmd,
+		     struct smr_resp *resp)
+{
+	struct smr_heap_seg *seg;
+	struct dlist_entry *entry;
+	size_t i;
+
+	fastlock_acquire(&domain->heap_lock);
+	dlist_foreach(&domain->heap_list, entry) {
+		seg = container_of(entry, struct smr_heap_seg, entry);
+		if (!smr_heap_contains(seg, &cmd->msg.data.iov[0]))
+			continue;
+
+		for (i = 1; i < cmd->msg.data.iov_count; i++) {
+			if (!smr_heap_contains(seg, &cmd->msg.data.iov[i]))
+				goto unlock;
+		}
+
+		cmd->msg.hdr.op_flags |= SMR_HEAP_IOV;
+		resp->heap_id = seg->id;
+		resp->heap_base = (uintptr_t) seg->base;
+		resp->heap_len = seg->len;
+		resp->heap_fd = seg->fd;
+		break;
+	}
+unlock:
+	fastlock_release(&domain->heap_lock);
+}
+
+static struct smr_heap_map *smr_heap_map(struct smr_heap_cache *cache,
+					 int pid, uint64_t id, int heap_fd,
+					 size_t len)
+{
+	struct smr_heap_map *map, *victim = &cache->map[0];
+	char path[64];
+	struct stat st;
+	void *addr;
+	int fd, i;
+
+	for (i = 0; i < SMR_HEAP_MAP_COUNT; i++) {
+		map = &cache->map[i];
+		if (map->addr && map->pid == pid && map->id == id) {
+			map->last_use = ++cache->use;
+			return map;
+		}
+		if (map->last_use < victim->last_use)
+			victim = map;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, heap_fd);
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+			"unable to open peer heap segment: %s\n",
+			strerror(errno));
+		return NULL;
+	}
+
+	/* guard against a segment replaced under a reused fd */
+	if (fstat(fd, &st) || st.st_size != len) {
+		close(fd);
+		return NULL;
+	}
+
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		FI_INFO(&smr_prov, FI_LOG_EP_DATA,
+			"unable to map peer heap segment: %s\n",
+			strerror(errno));
+		return NULL;
+	}
+
+	if (victim->addr)
+		munmap(victim->addr, victim->len);
+	victim->pid = pid;
+	victim->id = id;
+	victim->addr = addr;
+	victim->len = len;
+	victim->last_use = ++cache->use;
+	return victim;
+}
+
+/*
+ * Move the data of an SMR_HEAP_IOV cmd through a mapping of the
+ * initiator's heap segment.  Returns -FI_ENOENT if the segment cannot be
+ * mapped, in which case the caller falls back to CMA or SAR.
+ */
+int smr_heap_copy(struct smr_ep *ep, struct smr_cmd *cmd,
+		  struct smr_resp *resp, struct iovec *iov, size_t iov_count,
+		  size_t *total_len)
+{
+	struct smr_peer *peer;
+	struct smr_heap_map *map;
+	struct iovec *src;
+	uint64_t offset, done = 0, len;
+	size_t i;
+
+	peer = smr_map_peer(ep->region->map, cmd->msg.hdr.addr);
+	if (peer->no_heap)
+		return -FI_ENOENT;
+
+	map = smr_heap_map(&ep->heap_rx, peer->region->pid, resp->heap_id,
+			   resp->heap_fd, resp->heap_len);
+	if (!map) {
+		peer->no_heap = true;
+		return -FI_ENOENT;
+	}
+
+	for (i = 0; i < cmd->msg.data.iov_count; i++) {
+		src = &cmd->msg.data.iov[i];
+		offset = (uintptr_t) src->iov_base - resp->heap_base;
+		if (offset > map->len || src->iov_len > map->len - offset)
+			return -FI_EINVAL;
+
+		if (cmd->msg.hdr.op == ofi_op_read_req)
+			len = ofi_copy_from_iov((char *) map->addr + offset,
+						src->iov_len, iov, iov_count,
+						done);
+		else
+			len = ofi_copy_to_iov(iov, iov_count, done,
+					      (char *) map->addr + offset,
+					      src->iov_len);
+		done += len;
+		if (len != src->iov_len)
+			return -FI_EIO;
+	}
+
+	*total_len = done;
+	return 0;
+}
+
+static void smr_heap_cache_clear(struct smr_heap_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < SMR_HEAP_MAP_COUNT; i++) {
+		if (cache->map[i].addr)
+			munmap(cache->map[i].addr, cache->map[i].len);
+	}
+}
+
+void smr_heap_unmap_all(struct smr_ep *ep)
+{
+	smr_heap_cache_clear(&ep->heap_rx);
+	smr_heap_cache_clear(&ep->heap_tx);
+}
+
+/*
+ * Registrations of heap memory are exported through the MR export table
+ * of each endpoint's region, so that peers can apply atomics to the
+ * memory directly (see smr_atomic.c).  Endpoints with remote counters
+ * bound do not export, as such atomics would bypass the counters.  This
+ * relies on the util atomic handlers using hardware atomics, so that
+ * in-place atomics and those applied by the target's progress are atomic
+ * with respect to each other.
+ */
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+
+#define SMR_MR_EXPORT_DATA offsetof(struct smr_mr_export, heap_fd)
+
+static void smr_mr_export_write(struct smr_mr_export *dst,
+				const struct smr_mr_export *src)
+{
+	ofi_atomic_inc32(&dst->seq);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((char *) dst + SMR_MR_EXPORT_DATA,
+	       (const char *) src + SMR_MR_EXPORT_DATA,
+	       sizeof(*dst) - SMR_MR_EXPORT_DATA);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	ofi_atomic_inc32(&dst->seq);
+}
+
+/* Rather than waiting for an update in progress, report no entry and let
+ * the caller fall back to the target's progress. */
+static bool smr_mr_export_read(struct smr_mr_export *src,
+			       struct smr_mr_export *dst)
+{
+	int32_t seq;
+
+	seq = ofi_atomic_get32(&src->seq);
+	if (seq & 1)
+		return false;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	memcpy((char *) dst + SMR_MR_EXPORT_DATA,
+	       (const char *) src + SMR_MR_EXPORT_DATA,
+	       sizeof(*dst) - SMR_MR_EXPORT_DATA);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return dst->len && seq == ofi_atomic_get32(&src->seq);
+}
+
+static void smr_mr_export_publish(struct smr_domain *domain, int index)
+{
+	struct dlist_entry *entry;
+	struct smr_region *smr;
+
+	dlist_foreach(&domain->ep_list, entry) {
+		smr = container_of(entry, struct smr_ep, export_entry)->region;
+		smr_mr_export_write(&smr_mr_export(smr)[index],
+				    &domain->mr_export[index]);
+		ofi_atomic_set32(&smr->mr_export_cnt, domain->mr_export_cnt);
+	}
+}
+
+static void smr_mr_export_drop_seg(struct smr_domain *domain, uint64_t id)
+{
+	int i;
+
+	for (i = 0; i < domain->mr_export_cnt; i++) {
+		if (domain->mr_export[i].len &&
+		    domain->mr_export[i].heap_id == id) {
+			domain->mr_export[i].len = 0;
+			smr_mr_export_publish(domain, i);
+		}
+	}
+}
+
+static void smr_mr_export_add(struct smr_domain *domain, struct ofi_mr *mr,
+			      const struct fi_mr_attr *attr)
+{
+	struct smr_mr_export *export;
+	struct smr_heap_seg *seg;
+	struct dlist_entry *entry;
+	int i;
+
+	fastlock_acquire(&domain->heap_lock);
+	dlist_foreach(&domain->heap_list, entry) {
+		seg = container_of(entry, struct smr_heap_seg, entry);
+		if (smr_heap_contains(seg, &attr->mr_iov[0]))
+			goto found;
+	}
+	goto unlock;
+
+found:
+	for (i = 0; i < SMR_MR_EXPORT_COUNT; i++) {
+		if (!domain->mr_export[i].len)
+			break;
+	}
+	if (i == SMR_MR_EXPORT_COUNT) {
+		FI_INFO(&smr_prov, FI_LOG_MR, "MR export table full, "
+			"atomics on key %" PRIu64 " need target progress\n",
+			mr->key);
+		goto unlock;
+	}
+
+	export = &domain->mr_export[i];
+	export->key = mr->key;
+	export->base = (uintptr_t) attr->mr_iov[0].iov_base;
+	export->len = attr->mr_iov[0].iov_len;
+	export->offset = domain->util_domain.mr_mode & FI_MR_VIRT_ADDR ?
+			 attr->offset : export->base;
+	export->access = attr->access;
+	export->heap_id = seg->id;
+	export->heap_fd = seg->fd;
+	export->heap_base = (uintptr_t) seg->base;
+	export->heap_len = seg->len;
+	if (i >= domain->mr_export_cnt)
+		domain->mr_export_cnt = i + 1;
+	smr_mr_export_publish(domain, i);
+unlock:
+	fastlock_release(&domain->heap_lock);
+}
+
+static int smr_mr_close(struct fid *fid)
+{
+	struct smr_domain *domain;
+	struct ofi_mr *mr;
+	int i;
+
+	mr = container_of(fid, struct ofi_mr, mr_fid.fid);
+	domain = container_of(mr->domain, struct smr_domain, util_domain);
+
+	fastlock_acquire(&domain->heap_lock);
+	for (i = 0; i < domain->mr_export_cnt; i++) {
+		if (domain->mr_export[i].len &&
+		    domain->mr_export[i].key == mr->key) {
+			domain->mr_export[i].len = 0;
+			smr_mr_export_publish(domain, i);
+		}
+	}
+	fastlock_release(&domain->heap_lock);
+
+	return ofi_mr_close(fid);
+}
+
+static struct fi_ops smr_mr_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = smr_mr_close,
+	.bind = fi_no_bind,
+	.control = fi_no_control,
+	.ops_open = fi_no_ops_open,
+};
+
+int smr_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
+		   uint64_t flags, struct fid_mr **mr_fid)
+{
+	struct smr_domain *domain;
+	int ret;
+
+	ret = ofi_mr_regattr(fid, attr, flags, mr_fid);
+	if (ret || attr->iov_count != 1 || !attr->mr_iov[0].iov_len ||
+	    !(attr->access & (FI_REMOTE_READ | FI_REMOTE_WRITE)))
+		return ret;
+
+	domain = container_of(fid, struct smr_domain,
+			      util_domain.domain_fid.fid);
+	(*mr_fid)->fid.ops = &smr_mr_fi_ops;
+	smr_mr_export_add(domain, container_of(*mr_fid, struct ofi_mr, mr_fid),
+			  attr);
+	return 0;
+}
+
+void smr_ep_mr_export_start(struct smr_ep *ep)
+{
+	struct smr_domain *domain;
+	int i;
+
+	if (ep->util_ep.rem_wr_cntr || ep->util_ep.rem_rd_cntr)
+		return;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+
+	fastlock_acquire(&domain->heap_lock);
+	for (i = 0; i < domain->mr_export_cnt; i++)
+		smr_mr_export_write(&smr_mr_export(ep->region)[i],
+				    &domain->mr_export[i]);
+	ofi_atomic_set32(&ep->region->mr_export_cnt, domain->mr_export_cnt);
+	dlist_insert_tail(&ep->export_entry, &domain->ep_list);
+	fastlock_release(&domain->heap_lock);
+}
+
+void smr_ep_mr_export_stop(struct smr_ep *ep)
+{
+	struct smr_domain *domain;
+
+	if (dlist_empty(&ep->export_entry))
+		return;
+
+	domain = container_of(ep->util_ep.domain, struct smr_domain,
+			      util_domain);
+
+	fastlock_acquire(&domain->heap_lock);
+	dlist_remove_init(&ep->export_entry);
+	fastlock_release(&domain->heap_lock);
+}
+
+/*
+ * Translate a target range of a peer into a local pointer, through a
+ * mapping of the peer's heap segment holding it.  Returns NULL if the peer
+ * has not exported the key, does not allow the access, or its segment
+ * cannot be mapped; the op then goes through the peer's progress instead,
+ * which also reports any error.
+ */
+void *smr_mr_export_map(struct smr_ep *ep, int peer_id, uint64_t key,
+			uint64_t addr, size_t len, uint64_t access)
+{
+	struct smr_mr_export export;
+	struct smr_heap_map *map;
+	struct smr_region *peer_smr;
+	struct smr_peer *peer;
+	uint64_t start;
+	int i, cnt;
+
+	peer = smr_map_peer(ep->region->map, peer_id);
+	if (!peer || !peer->region || peer->no_heap)
+		return NULL;
+
+	peer_smr = peer->region;
+	cnt = ofi_atomic_get32(&peer_smr->mr_export_cnt);
+	for (i = 0; i < cnt; i++) {
+		if (!smr_mr_export_read(&smr_mr_export(peer_smr)[i], &export) ||
+		    export.key != key)
+			continue;
+
+		start = addr + export.offset - export.base;
+		if ((access & export.access) != access ||
+		    start > export.len || len > export.len - start)
+			return NULL;
+
+		map = smr_heap_map(&ep->heap_tx, peer_smr->pid, export.heap_id,
+				   export.heap_fd, export.heap_len);
+		if (!map) {
+			peer->no_heap = true;
+			return NULL;
+		}
+		return (char *) map->addr + (export.base - export.heap_base) +
+		       start;
+	}
+	return NULL;
+}
+
+#else /* HAVE_BUILTIN_MM_ATOMICS */
+
+static void smr_mr_export_drop_seg(struct smr_domain *domain, uint64_t id)
+{
+}
+
+int smr_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
+		   uint64_t flags, struct fid_mr **mr_fid)
+{
+	return ofi_mr_regattr(fid, attr, flags, mr_fid);
+}
+
+void smr_ep_mr_export_start(struct smr_ep *ep)
+{
+}
+
+void smr_ep_mr_export_stop(struct smr_ep *ep)
+{
+}
+
+void *smr_mr_export_map(struct smr_ep *ep, int peer_id, uint64_t key,
+			uint64_t addr, size_t len, uint64_t access)
+{
+	return NULL;
+}
+
+#endif /* HAVE_BUILTIN_MM_ATOMICS */
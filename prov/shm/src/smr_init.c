@@ -31,10 +31,30 @@
  */
 
 #include <rdma/fi_errno.h>
+#include <sys/uio.h>
 
 #include <ofi_prov.h>
 #include "smr.h"
 
+int smr_cma_enabled;
+int smr_hugepages;
+
+/* CMA can be compiled out or blocked by a seccomp filter; in that case
+ * even a read of our own memory fails.  Restrictions that only apply
+ * between processes are detected on the first failed transfer instead. */
+static int smr_check_cma(void)
+{
+	struct iovec local, remote;
+	uint64_t src = 1, dst = 0;
+
+	local.iov_base = &dst;
+	local.iov_len = sizeof(dst);
+	remote.iov_base = &src;
+	remote.iov_len = sizeof(src);
+
+	return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) ==
+	       sizeof(dst) && dst == src;
+}
 
 static void smr_resolve_addr(const char *node, const char *service,
 			     char **addr, size_t *addrlen)
@@ -126,5 +146,24 @@ struct util_prov smr_util_prov = {
 
 SHM_INI
 {
+	int disable_cma = 0;
+
+	fi_param_define(&smr_prov, "disable_cma", FI_PARAM_BOOL,
+			"stage large transfers through shared memory instead "
+			"of using process_vm_readv/writev (default: no)");
+	fi_param_get_bool(&smr_prov, "disable_cma", &disable_cma);
+	fi_param_define(&smr_prov, "hugepages", FI_PARAM_BOOL,
+			"back shared memory regions with transparent huge "
+			"pages where the system allows it (default: no)");
+	fi_param_get_bool(&smr_prov, "hugepages", &smr_hugepages);
+
+	smr_heap_init();
+
+	smr_cma_enabled = !disable_cma && smr_check_cma();
+	if (!smr_cma_enabled)
+		FI_INFO(&smr_prov, FI_LOG_CORE,
+			"CMA not in use, large transfers will be staged "
+			"through shared memory\n");
+
 	return &smr_prov;
 }
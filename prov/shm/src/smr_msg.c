@@ -78,6 +78,10 @@ ssize_t smr_recvmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	assert(!(flags & FI_MULTI_RECV) || msg->iov_count == 1);
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
+
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_RECV);
+
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
 	entry = smr_get_recv_entry(ep, flags | ep->util_ep.rx_msg_flags);
 	if (!entry) {
@@ -161,9 +165,12 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 				   uint64_t op_flags)
 {
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
 	struct smr_resp *resp;
 	struct smr_cmd *cmd, *pend;
+	int64_t pos, resp_pos;
+	uint16_t comp_flags;
 	int peer_id;
 	ssize_t ret = 0;
 	size_t total_len;
@@ -177,12 +184,6 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 		return ret;
 
 	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
 		ret = -FI_EAGAIN;
@@ -190,44 +191,74 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	}
 
 	total_len = ofi_total_iov_len(iov, iov_count);
+	if (total_len > SMR_INJECT_SIZE &&
+	    (smr_resp_queue_isfull(smr_resp_queue(ep->region)) ||
+	     !smr_peer_paired(ep, peer_id))) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	if (!smr_get_cmd_credit(peer_smr, 1)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
 
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	tx_buf = NULL;
+	if (total_len > SMR_MSG_DATA_LEN && total_len <= SMR_INJECT_SIZE) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, 1, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
 
 	if (total_len <= SMR_MSG_DATA_LEN) {
 		smr_format_inline(cmd, smr_peer_addr(ep->region)[peer_id].addr, iov,
 				  iov_count, op, tag, data, op_flags);
 	} else if (total_len <= SMR_INJECT_SIZE) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 		smr_format_inject(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  iov, iov_count, op, tag, data, op_flags,
 				  peer_smr, tx_buf);
 	} else {
-		if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
-			ret = -FI_EAGAIN;
-			goto unlock_cq;
-		}
-		resp = ofi_cirque_tail(smr_resp_queue(ep->region));
+		smr_resp_queue_next(smr_resp_queue(ep->region), 1, &resp_pos);
+		resp = smr_resp_queue_buf(smr_resp_queue(ep->region), resp_pos);
 		pend = freestack_pop(ep->pend_fs);
 		smr_format_iov(cmd, smr_peer_addr(ep->region)[peer_id].addr, iov,
 			       iov_count, total_len, op, tag, data, op_flags,
 			       context, ep->region, resp, pend);
-		ofi_cirque_commit(smr_resp_queue(ep->region));
-		goto commit;
+		smr_heap_format(container_of(ep->util_ep.domain,
+					     struct smr_domain, util_domain),
+				cmd, resp);
+		/* the resp is driven locally if the peer falls back to SAR */
+		pend->msg.hdr.addr = peer_id;
+		smr_resp_queue_commit(smr_resp_queue(ep->region), resp_pos, 1);
+		smr_cmd_queue_commit(queue, pos, 1);
+		smr_signal(peer_smr);
+		goto unlock_cq;
 	}
-	ret = smr_complete_tx(ep, context, op, cmd->msg.hdr.op_flags, 0);
+	comp_flags = cmd->msg.hdr.op_flags;
+	smr_cmd_queue_commit(queue, pos, 1);
+	smr_signal(peer_smr);
+
+	ret = smr_complete_tx(ep, context, op, comp_flags, 0);
 	if (ret) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"unable to process tx completion\n");
-		goto unlock_cq;
 	}
+	goto unlock_cq;
 
-commit:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, 1);
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
 	return ret;
 }
 
@@ -265,6 +296,9 @@ ssize_t smr_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_msg(ep_fid, msg, flags, FI_OP_SEND);
+
 	return smr_generic_sendmsg(ep, msg->msg_iov, msg->iov_count,
 				   msg->addr, 0, msg->data, msg->context,
 				   ofi_op_msg, flags | ep->util_ep.tx_msg_flags);
@@ -276,8 +310,10 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 {
 	struct smr_ep *ep;
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
 	struct smr_cmd *cmd;
+	int64_t pos;
 	int peer_id;
 	ssize_t ret = 0;
 	struct iovec msg_iov;
@@ -295,29 +331,46 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 		return ret;
 
 	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (!peer_smr->cmd_cnt) {
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (!smr_get_cmd_credit(peer_smr, 1)) {
 		ret = -FI_EAGAIN;
-		goto unlock;
+		goto unlock_cq;
 	}
 
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	tx_buf = NULL;
+	if (len > SMR_MSG_DATA_LEN) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, 1, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
 
 	if (len <= SMR_MSG_DATA_LEN) {
 		smr_format_inline(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  &msg_iov, 1, op, tag, data, op_flags);
 	} else {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 		smr_format_inject(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  &msg_iov, 1, op, tag, data, op_flags,
 				  peer_smr, tx_buf);
 	}
+	smr_cmd_queue_commit(queue, pos, 1);
+	smr_signal(peer_smr);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, op);
-	peer_smr->cmd_cnt--;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-unlock:
-	fastlock_release(&peer_smr->lock);
+	goto unlock_cq;
 
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, 1);
+unlock_cq:
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
 	return ret;
 }
 
@@ -466,6 +519,10 @@ ssize_t smr_trecvmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 	assert(!(flags & FI_MULTI_RECV) || msg->iov_count == 1);
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
+
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TRECV);
+
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
 	entry = smr_get_trecv_entry(ep, flags | ep->util_ep.rx_msg_flags);
 	if (!entry) {
@@ -523,6 +580,9 @@ ssize_t smr_tsendmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_tagged(ep_fid, msg, flags, FI_OP_TSEND);
+
 	return smr_generic_sendmsg(ep, msg->msg_iov, msg->iov_count,
 				   msg->addr, msg->tag, msg->data, msg->context,
 				   ofi_op_tagged, flags | ep->util_ep.tx_msg_flags);
@@ -37,8 +37,8 @@
 #include "ofi_iov.h"
 #include "smr.h"
 
-static int smr_progress_fetch(struct smr_ep *ep, struct smr_cmd *pending,
-			      uint64_t *ret)
+static void smr_progress_fetch(struct smr_ep *ep, struct smr_cmd *pending,
+			       uint64_t *ret)
 {
 	struct smr_region *peer_smr;
 	size_t inj_offset, size;
@@ -46,8 +46,6 @@ static int smr_progress_fetch(struct smr_ep *ep, struct smr_cmd *pending,
 	uint8_t *src;
 
 	peer_smr = smr_peer_region(ep->region, pending->msg.hdr.addr);
-	if (fastlock_tryacquire(&peer_smr->lock))
-		return -FI_EAGAIN;
 
 	inj_offset = (size_t) pending->msg.hdr.src_data;
 	tx_buf = (struct smr_inject_buf *) ((char **) peer_smr +
@@ -69,41 +67,117 @@ static int smr_progress_fetch(struct smr_ep *ep, struct smr_cmd *pending,
 	}
 
 out:
-	smr_freestack_push(smr_inject_pool(peer_smr), tx_buf);
-	peer_smr->cmd_cnt++;
-	fastlock_release(&peer_smr->lock);
-	return 0;
+	smr_put_inject_buf(peer_smr, tx_buf);
+	smr_put_cmd_credit(peer_smr, 1);
+}
+
+/*
+ * Move as much of a SAR transfer through the buffer as there is room or
+ * data for, publishing each chunk as it is copied.  A caller acting on a
+ * transfer that has already finished finds its position at or past the
+ * end and copies nothing, even if the buffer has been handed to another
+ * transfer since.
+ */
+static size_t smr_copy_sar(struct smr_sar_buf *sar_buf, uint64_t start,
+			   struct iovec *iov, size_t iov_count, size_t size,
+			   int dir)
+{
+	ofi_atomic64_t *pos_cntr;
+	uint64_t pos, end, avail;
+	size_t off, len, copied;
+
+	pos_cntr = (dir == OFI_COPY_IOV_TO_BUF) ?
+		   &sar_buf->produced : &sar_buf->consumed;
+	end = start + size;
+
+	for (copied = 0; copied < SMR_SAR_SIZE; copied += len) {
+		pos = ofi_atomic_get64(pos_cntr);
+		if (pos >= end)
+			break;
+
+		if (dir == OFI_COPY_IOV_TO_BUF)
+			avail = SMR_SAR_SIZE -
+				(pos - ofi_atomic_get64(&sar_buf->consumed));
+		else
+			avail = ofi_atomic_get64(&sar_buf->produced) - pos;
+
+		off = pos & (SMR_SAR_SIZE - 1);
+		len = MIN(MIN(avail, end - pos),
+			  MIN(SMR_SAR_CHUNK_SIZE, SMR_SAR_SIZE - off));
+		if (!len)
+			break;
+
+		ofi_copy_iov_buf(iov, iov_count, pos - start,
+				 sar_buf->buf + off, len, dir);
+		ofi_atomic_set64(pos_cntr, pos + len);
+	}
+	return copied;
+}
+
+/* initiator side of a SAR transfer: fill the target's buffer for sends
+ * and writes, drain it for reads */
+static void smr_progress_sar_resp(struct smr_ep *ep, struct smr_resp *resp)
+{
+	struct smr_region *peer_smr;
+	struct smr_sar_buf *sar_buf;
+	struct smr_cmd *pending;
+
+	pending = (struct smr_cmd *) resp->msg_id;
+	peer_smr = smr_peer_region(ep->region, pending->msg.hdr.addr);
+	sar_buf = (struct smr_sar_buf *) ((char *) peer_smr +
+					  resp->sar_offset);
+
+	if (smr_copy_sar(sar_buf, resp->sar_start, pending->msg.data.iov,
+			 pending->msg.data.iov_count, pending->msg.hdr.size,
+			 pending->msg.hdr.op == ofi_op_read_req ?
+			 OFI_COPY_BUF_TO_IOV : OFI_COPY_IOV_TO_BUF))
+		smr_signal(peer_smr);
 }
 
 static void smr_progress_resp(struct smr_ep *ep)
 {
+	struct smr_resp_queue *resp_queue = smr_resp_queue(ep->region);
 	struct smr_resp *resp;
 	struct smr_cmd *pending;
+	uint64_t status;
+	int64_t pos;
 	int ret;
 
 	fastlock_acquire(&ep->region->lock);
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	while (!ofi_cirque_isempty(smr_resp_queue(ep->region)) &&
-	       !ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
-		resp = ofi_cirque_head(smr_resp_queue(ep->region));
-		if (resp->status == FI_EBUSY)
+
+	/* SAR transfers need our help to finish and can be queued behind
+	 * other outstanding responses */
+	for (pos = ofi_atomic_get64(&resp_queue->read_pos);
+	     pos < ofi_atomic_get64(&resp_queue->write_pos); pos++) {
+		resp = smr_resp_queue_buf(resp_queue, pos);
+		if (smr_resp_status(resp) == SMR_STATUS_SAR)
+			smr_progress_sar_resp(ep, resp);
+	}
+
+	while (!ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+		resp = smr_resp_queue_head(resp_queue);
+		if (!resp)
+			break;
+
+		status = smr_resp_status(resp);
+		if (status == FI_EBUSY || status == SMR_STATUS_SAR)
 			break;
 
 		pending = (struct smr_cmd *) resp->msg_id;
-		if (pending->msg.hdr.op_flags & SMR_RMA_REQ &&
-			smr_progress_fetch(ep, pending, &resp->status))
-				break;
+		if (pending->msg.hdr.op_flags & SMR_RMA_REQ)
+			smr_progress_fetch(ep, pending, &status);
 
 		ret = smr_complete_tx(ep, (void *) (uintptr_t) pending->msg.hdr.msg_id,
 				  pending->msg.hdr.op, pending->msg.hdr.op_flags,
-				  -(resp->status));
+				  -status);
 		if (ret) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"unable to process tx completion\n");
 			break;
 		}
 		freestack_push(ep->pend_fs, pending);
-		ofi_cirque_discard(smr_resp_queue(ep->region));
+		smr_resp_queue_release(resp_queue);
 	}
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
 	fastlock_release(&ep->region->lock);
@@ -144,7 +218,7 @@ static int smr_progress_inject(struct smr_cmd *cmd, struct iovec *iov,
 	}
 
 out:
-	smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+	smr_put_inject_buf(ep->region, tx_buf);
 	return err;
 }
 
@@ -158,6 +232,10 @@ static int smr_progress_iov(struct smr_cmd *cmd, struct iovec *iov,
 
 	peer_id = (int) cmd->msg.hdr.addr;
 	peer_smr = smr_peer_region(ep->region, peer_id);
+	/* the sender's region could not be mapped, nobody waits for a resp */
+	if (!peer_smr)
+		return err ? err : -FI_EIO;
+
 	resp = (struct smr_resp *) ((char **) peer_smr +
 				    (size_t) cmd->msg.hdr.src_data);
 
@@ -166,6 +244,17 @@ static int smr_progress_iov(struct smr_cmd *cmd, struct iovec *iov,
 		goto out;
 	}
 
+	if (cmd->msg.hdr.op_flags & SMR_HEAP_IOV) {
+		ret = smr_heap_copy(ep, cmd, resp, iov, iov_count, total_len);
+		if (ret != -FI_ENOENT) {
+			ret = -ret;
+			goto out;
+		}
+	}
+
+	if (!smr_cma_usable(ep, peer_id))
+		goto sar;
+
 	if (cmd->msg.hdr.op == ofi_op_read_req) {
 		ret = process_vm_writev(peer_smr->pid, iov, iov_count,
 					cmd->msg.data.iov,
@@ -178,6 +267,14 @@ static int smr_progress_iov(struct smr_cmd *cmd, struct iovec *iov,
 
 	if (ret != cmd->msg.hdr.size) {
 		if (ret < 0) {
+			if (smr_cma_denied(errno)) {
+				FI_INFO(&smr_prov, FI_LOG_EP_CTRL,
+					"CMA not permitted, falling back "
+					"to SAR\n");
+				smr_map_peer(ep->region->map,
+					     peer_id)->no_cma = true;
+				goto sar;
+			}
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"CMA write error\n");
 			ret = errno;
@@ -193,9 +290,20 @@ static int smr_progress_iov(struct smr_cmd *cmd, struct iovec *iov,
 
 out:
 	//Status must be set last (signals peer: op done, valid resp entry)
-	resp->status = ret;
+	smr_resp_set_status(resp, ret);
+	smr_signal(peer_smr);
 
 	return -ret;
+
+sar:
+	/* nothing has been copied yet, so the whole transfer is staged */
+	if (ofi_total_iov_len(iov, iov_count) < cmd->msg.hdr.size) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"recv truncated");
+		ret = FI_EIO;
+		goto out;
+	}
+	return -FI_EINPROGRESS;
 }
 
 static int smr_progress_multi_recv(struct smr_ep *ep, struct smr_queue *queue,
@@ -223,6 +331,122 @@ static int smr_progress_multi_recv(struct smr_ep *ep, struct smr_queue *queue,
 	return 0;
 }
 
+static int smr_progress_sar(struct smr_ep *ep, struct smr_sar_entry *sar)
+{
+	struct smr_region *peer_smr;
+	struct smr_resp *resp;
+	bool signal = false;
+	int index;
+
+	peer_smr = smr_peer_region(ep->region, sar->cmd.msg.hdr.addr);
+	if (!sar->sar_buf) {
+		if (!ep->sar_buf_free)
+			return -FI_EAGAIN;
+
+		index = ofi_lsb(ep->sar_buf_free) - 1;
+		ep->sar_buf_free &= ~(1ULL << index);
+		sar->sar_buf = &smr_sar_pool(ep->region)[index];
+		sar->sar_start = ofi_atomic_get64(&sar->sar_buf->consumed);
+
+		resp = (struct smr_resp *) ((char **) peer_smr +
+				(size_t) sar->cmd.msg.hdr.src_data);
+		resp->sar_offset = (char *) sar->sar_buf - (char *) ep->region;
+		resp->sar_start = sar->sar_start;
+		smr_resp_set_status(resp, SMR_STATUS_SAR);
+		signal = true;
+	}
+
+	if (smr_copy_sar(sar->sar_buf, sar->sar_start, sar->iov,
+			 sar->iov_count, sar->cmd.msg.hdr.size,
+			 sar->cmd.msg.hdr.op == ofi_op_read_req ?
+			 OFI_COPY_IOV_TO_BUF : OFI_COPY_BUF_TO_IOV))
+		signal = true;
+	if (signal)
+		smr_signal(peer_smr);
+
+	return (uint64_t) ofi_atomic_get64(&sar->sar_buf->consumed) ==
+	       sar->sar_start + sar->cmd.msg.hdr.size ? 0 : -FI_EAGAIN;
+}
+
+static void smr_start_sar(struct smr_ep *ep, struct smr_cmd *cmd,
+			  struct iovec *iov, size_t iov_count,
+			  struct smr_ep_entry *rx_entry)
+{
+	struct smr_sar_entry *sar;
+
+	sar = freestack_pop(ep->sar_fs);
+	sar->cmd = *cmd;
+	memcpy(sar->iov, iov, sizeof(*iov) * iov_count);
+	sar->iov_count = iov_count;
+	sar->rx_entry = rx_entry;
+	sar->sar_buf = NULL;
+	dlist_insert_tail(&sar->entry, &ep->sar_list);
+
+	(void) smr_progress_sar(ep, sar);
+}
+
+static int smr_complete_sar(struct smr_ep *ep, struct smr_sar_entry *sar)
+{
+	struct smr_cmd *cmd = &sar->cmd;
+	struct smr_ep_entry *entry = sar->rx_entry;
+	struct smr_region *peer_smr;
+	struct smr_resp *resp;
+	int ret;
+
+	ep->sar_buf_free |= 1ULL << (sar->sar_buf - smr_sar_pool(ep->region));
+
+	if (entry) {
+		ret = smr_complete_rx(ep, entry->context, cmd->msg.hdr.op,
+				cmd->msg.hdr.op_flags |
+				(entry->flags & ~SMR_MULTI_RECV),
+				cmd->msg.hdr.size, entry->iov[0].iov_base,
+				&cmd->msg.hdr.addr, cmd->msg.hdr.tag,
+				cmd->msg.hdr.data, 0);
+	} else {
+		ret = smr_complete_rx(ep, (void *) cmd->msg.hdr.msg_id,
+				cmd->msg.hdr.op, cmd->msg.hdr.op_flags,
+				cmd->msg.hdr.size, sar->iov[0].iov_base,
+				&cmd->msg.hdr.addr, 0, cmd->msg.hdr.data, 0);
+	}
+	if (ret) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"unable to process rx completion\n");
+	}
+
+	peer_smr = smr_peer_region(ep->region, cmd->msg.hdr.addr);
+	resp = (struct smr_resp *) ((char **) peer_smr +
+				    (size_t) cmd->msg.hdr.src_data);
+	smr_resp_set_status(resp, 0);
+	smr_signal(peer_smr);
+
+	if (entry && entry->flags & SMR_MULTI_RECV) {
+		ret = smr_progress_multi_recv(ep,
+				cmd->msg.hdr.op == ofi_op_tagged ?
+				&ep->trecv_queue : &ep->recv_queue,
+				entry, cmd->msg.hdr.size);
+	} else if (entry) {
+		freestack_push(ep->recv_fs, entry);
+	}
+
+	dlist_remove(&sar->entry);
+	freestack_push(ep->sar_fs, sar);
+	return ret;
+}
+
+static void smr_progress_sar_list(struct smr_ep *ep)
+{
+	struct smr_sar_entry *sar;
+	struct dlist_entry *tmp;
+
+	dlist_foreach_container_safe(&ep->sar_list, struct smr_sar_entry,
+				     sar, entry, tmp) {
+		if (smr_progress_sar(ep, sar) ||
+		    ofi_cirque_isfull(ep->util_ep.rx_cq->cirq))
+			continue;
+		(void) smr_complete_sar(ep, sar);
+	}
+}
+
 static void smr_do_atomic(void *src, void *dst, void *cmp, enum fi_datatype datatype,
 			  enum fi_op op, size_t cnt, uint16_t flags)
 {
@@ -316,12 +540,14 @@ static int smr_progress_inject_atomic(struct smr_cmd *cmd, struct fi_ioc *ioc,
 
 out:
 	if (!(cmd->msg.hdr.op_flags & SMR_RMA_REQ))
-		smr_freestack_push(smr_inject_pool(ep->region), tx_buf);
+		smr_put_inject_buf(ep->region, tx_buf);
 
 	return err;
 }
 
-static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
+static int smr_progress_cmd_msg(struct smr_ep *ep,
+				struct smr_cmd_queue *queue,
+				struct smr_cmd *cmd)
 {
 	struct smr_queue *recv_queue;
 	struct smr_match_attr match_attr;
@@ -347,6 +573,9 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 		return -FI_ENOMSG;
 	}
 
+	if (cmd->msg.hdr.op_src == smr_src_iov && freestack_isempty(ep->sar_fs))
+		return -FI_EAGAIN;
+
 	match_attr.addr = cmd->msg.hdr.addr;
 	match_attr.tag = cmd->msg.hdr.tag;
 
@@ -358,7 +587,7 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 			return -FI_EAGAIN;
 		unexp = freestack_pop(ep->unexp_fs);
 		memcpy(&unexp->cmd, cmd, sizeof(*cmd));
-		ofi_cirque_discard(smr_cmd_queue(ep->region));
+		smr_cmd_queue_release(queue);
 		dlist_insert_tail(&unexp->entry, &ep->unexp_queue.list);
 		return ret;
 	}
@@ -376,6 +605,13 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	case smr_src_iov:
 		err = smr_progress_iov(cmd, entry->iov, entry->iov_count,
 				       &total_len, ep, 0);
+		if (err == -FI_EINPROGRESS) {
+			smr_start_sar(ep, cmd, entry->iov, entry->iov_count,
+				      entry);
+			smr_cmd_queue_release(queue);
+			smr_put_cmd_credit(ep->region, 1);
+			return 0;
+		}
 		break;
 	default:
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -390,8 +626,8 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"unable to process rx completion\n");
 	}
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
+	smr_cmd_queue_release(queue);
+	smr_put_cmd_credit(ep->region, 1);
 
 	if (entry->flags & SMR_MULTI_RECV) {
 		ret = smr_progress_multi_recv(ep, recv_queue, entry, total_len);
@@ -403,10 +639,12 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	return ret;
 }
 
-static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
+static int smr_progress_cmd_rma(struct smr_ep *ep,
+				struct smr_cmd_queue *queue,
+				struct smr_cmd *cmd)
 {
 	struct smr_domain *domain;
-	struct smr_cmd *rma_cmd;
+	struct smr_cmd *rma_cmd, local_cmd;
 	struct iovec iov[SMR_IOV_LIMIT];
 	size_t iov_count;
 	size_t total_len = 0;
@@ -422,9 +660,16 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 		return -FI_ENOSPC;
 	}
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	if (cmd->msg.hdr.op_src == smr_src_iov && freestack_isempty(ep->sar_fs))
+		return -FI_EAGAIN;
+
+	/* a released entry may be reused by a sender right away */
+	local_cmd = *cmd;
+	cmd = &local_cmd;
+	smr_cmd_queue_release(queue);
+	smr_put_cmd_credit(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(queue);
+	assert(rma_cmd);
 
 	for (iov_count = 0; iov_count < rma_cmd->rma.rma_count; iov_count++) {
 		ret = ofi_mr_verify(&domain->util_domain.mr_map,
@@ -438,8 +683,8 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 		iov[iov_count].iov_base = (void *) rma_cmd->rma.rma_iov[iov_count].addr;
 		iov[iov_count].iov_len = rma_cmd->rma.rma_iov[iov_count].len;
 	}
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
+	smr_cmd_queue_release(queue);
+	smr_put_cmd_credit(ep->region, 1);
 	if (ret)
 		return ret;
 
@@ -452,6 +697,10 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 		break;
 	case smr_src_iov:
 		err = smr_progress_iov(cmd, iov, iov_count, &total_len, ep, ret);
+		if (err == -FI_EINPROGRESS) {
+			smr_start_sar(ep, cmd, iov, iov_count, NULL);
+			return 0;
+		}
 		break;
 	default:
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -471,11 +720,13 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd)
 	return ret;
 }
 
-static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
+static int smr_progress_cmd_atomic(struct smr_ep *ep,
+				struct smr_cmd_queue *queue,
+				struct smr_cmd *cmd)
 {
 	struct smr_region *peer_smr;
 	struct smr_domain *domain;
-	struct smr_cmd *rma_cmd;
+	struct smr_cmd *rma_cmd, local_cmd;
 	struct smr_resp *resp;
 	struct fi_ioc ioc[SMR_IOV_LIMIT];
 	size_t ioc_count;
@@ -485,9 +736,12 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 	domain = container_of(ep->util_ep.domain, struct smr_domain,
 			      util_domain);
 
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
-	ep->region->cmd_cnt++;
-	rma_cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
+	local_cmd = *cmd;
+	cmd = &local_cmd;
+	smr_cmd_queue_release(queue);
+	smr_put_cmd_credit(ep->region, 1);
+	rma_cmd = smr_cmd_queue_head(queue);
+	assert(rma_cmd);
 
 	for (ioc_count = 0; ioc_count < rma_cmd->rma.rma_count; ioc_count++) {
 		ret = ofi_mr_verify(&domain->util_domain.mr_map,
@@ -503,9 +757,9 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		ioc[ioc_count].addr = (void *) rma_cmd->rma.rma_ioc[ioc_count].addr;
 		ioc[ioc_count].count = rma_cmd->rma.rma_ioc[ioc_count].count;
 	}
-	ofi_cirque_discard(smr_cmd_queue(ep->region));
+	smr_cmd_queue_release(queue);
 	if (ret) {
-		ep->region->cmd_cnt++;
+		smr_put_cmd_credit(ep->region, 1);
 		return ret;
 	}
 
@@ -522,12 +776,21 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 		err = -FI_EINVAL;
 	}
 	if (!(cmd->msg.hdr.op_flags & SMR_RMA_REQ)) {
-		ep->region->cmd_cnt++;
-	} else {
-		peer_smr = smr_peer_region(ep->region, cmd->msg.hdr.addr);
+		smr_put_cmd_credit(ep->region, 1);
+	} else if ((peer_smr = smr_peer_region(ep->region,
+					       cmd->msg.hdr.addr))) {
 		resp = (struct smr_resp *) ((char **) peer_smr +
 			    (size_t) cmd->msg.hdr.data);
-		resp->status = -err;
+		smr_resp_set_status(resp, -err);
+		smr_signal(peer_smr);
+	} else {
+		/* the sender has gone and will not collect the result */
+		smr_put_inject_buf(ep->region, (struct smr_inject_buf *)
+				   ((char **) ep->region +
+				    (size_t) cmd->msg.hdr.src_data));
+		smr_put_cmd_credit(ep->region, 1);
+		if (!err)
+			err = -FI_EIO;
 	}
 	if (err)
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -543,36 +806,107 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd)
 	return err; 
 }
 
-static void smr_progress_cmd(struct smr_ep *ep)
+static int smr_progress_cmd_queue(struct smr_ep *ep,
+				  struct smr_cmd_queue *queue);
+
+/* The sender goes on in the shared queue behind the detach cmd, so what it
+ * left in the fastbox must be consumed first. */
+static int smr_progress_fbox_detach(struct smr_ep *ep, struct smr_cmd *cmd)
+{
+	int index = (int) cmd->msg.hdr.data;
+	int ret;
+
+	ret = smr_progress_cmd_queue(ep, smr_fbox(ep->region, index));
+	if (ret)
+		return ret;
+
+	ep->fbox_active &= ~(1U << index);
+	ofi_atomic_sub32(&ep->region->fbox_detached, 1U << index);
+	return 0;
+}
+
+/* What the sender left in the fastbox comes before the release */
+static int smr_progress_fbox_release(struct smr_ep *ep, struct smr_cmd *cmd)
+{
+	int index = (int) cmd->msg.hdr.data;
+	int ret;
+
+	ret = smr_progress_cmd_queue(ep, smr_fbox(ep->region, index));
+	if (ret)
+		return ret;
+
+	ep->fbox_active &= ~(1U << index);
+	ofi_atomic_set32(&ep->region->fbox_owner[index], 0);
+	return 0;
+}
+
+static int smr_progress_cmd_queue(struct smr_ep *ep,
+				  struct smr_cmd_queue *queue)
 {
 	struct smr_cmd *cmd;
 	int ret = 0;
 
-	fastlock_acquire(&ep->region->lock);
-	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+	while ((cmd = smr_cmd_queue_head(queue))) {
+		/* map the sender's region the first time it is needed; inline
+		 * and inject data can be consumed after the sender has gone.
+		 * Only a sender that is still setting up is waited for, a cmd
+		 * from one that has gone fails without a resp. */
+		if ((cmd->msg.hdr.op_src == smr_src_iov ||
+		     cmd->msg.hdr.op_flags & SMR_RMA_REQ) &&
+		    !smr_peer_region(ep->region, cmd->msg.hdr.addr)) {
+			ret = smr_map_to_region(&smr_prov, ep->region->map,
+						cmd->msg.hdr.addr);
+			if (ret == -FI_EAGAIN) {
+				FI_DBG(&smr_prov, FI_LOG_EP_CTRL,
+				       "peer region not ready\n");
+				break;
+			}
+			if (ret) {
+				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+					"unable to map peer region: %s\n",
+					fi_strerror(-ret));
+			}
+		}
 
-	while (!ofi_cirque_isempty(smr_cmd_queue(ep->region))) {
-		cmd = ofi_cirque_head(smr_cmd_queue(ep->region));
 
 		switch (cmd->msg.hdr.op) {
 		case ofi_op_msg:
 		case ofi_op_tagged:
-			ret = smr_progress_cmd_msg(ep, cmd);
+			ret = smr_progress_cmd_msg(ep, queue, cmd);
 			break;
 		case ofi_op_write:
 		case ofi_op_read_req:
-			ret = smr_progress_cmd_rma(ep, cmd);
+			ret = smr_progress_cmd_rma(ep, queue, cmd);
 			break;
 		case ofi_op_write_async:
 		case ofi_op_read_async:
 			ofi_ep_rx_cntr_inc_func(&ep->util_ep, cmd->msg.hdr.op);
-			ofi_cirque_discard(smr_cmd_queue(ep->region));
-			ep->region->cmd_cnt++;
+			smr_cmd_queue_release(queue);
+			smr_put_cmd_credit(ep->region, 1);
 			break;
 		case ofi_op_atomic:
 		case ofi_op_atomic_fetch:
 		case ofi_op_atomic_compare:
-			ret = smr_progress_cmd_atomic(ep, cmd);
+			ret = smr_progress_cmd_atomic(ep, queue, cmd);
+			break;
+		case smr_op_fbox:
+			ep->fbox_active |= 1U << cmd->msg.hdr.data;
+			smr_cmd_queue_release(queue);
+			smr_put_cmd_credit(ep->region, 1);
+			break;
+		case smr_op_fbox_detach:
+			ret = smr_progress_fbox_detach(ep, cmd);
+			if (!ret) {
+				smr_cmd_queue_release(queue);
+				smr_put_cmd_credit(ep->region, 1);
+			}
+			break;
+		case smr_op_fbox_release:
+			ret = smr_progress_fbox_release(ep, cmd);
+			if (!ret) {
+				smr_cmd_queue_release(queue);
+				smr_put_cmd_credit(ep->region, 1);
+			}
 			break;
 		default:
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -588,6 +922,27 @@ static void smr_progress_cmd(struct smr_ep *ep)
 			break;
 		}
 	}
+	return ret;
+}
+
+/* Drain the announced fastboxes before the shared queue, which carries
+ * fastbox control cmds, overflow, and senders without a fastbox. */
+static void smr_progress_cmd(struct smr_ep *ep)
+{
+	int i, ret = 0;
+
+	fastlock_acquire(&ep->region->lock);
+	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+
+	smr_progress_sar_list(ep);
+
+	for (i = 0; !ret && i < SMR_FBOX_COUNT && ep->fbox_active >> i; i++) {
+		if (ep->fbox_active & (1U << i))
+			ret = smr_progress_cmd_queue(ep, smr_fbox(ep->region, i));
+	}
+	if (!ret)
+		(void) smr_progress_cmd_queue(ep, smr_cmd_queue(ep->region));
+
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
 	fastlock_release(&ep->region->lock);
 }
@@ -628,6 +983,13 @@ int smr_progress_unexp(struct smr_ep *ep, struct smr_ep_entry *entry)
 
 	unexp_msg = container_of(dlist_entry, struct smr_unexp_msg, entry);
 
+	if (unexp_msg->cmd.msg.hdr.op_src == smr_src_iov &&
+	    freestack_isempty(ep->sar_fs)) {
+		dlist_insert_head(&unexp_msg->entry, &ep->unexp_queue.list);
+		ret = -FI_EAGAIN;
+		goto push_entry;
+	}
+
 	switch (unexp_msg->cmd.msg.hdr.op_src) {
 	case smr_src_inline:
 		entry->err = smr_progress_inline(&unexp_msg->cmd, entry->iov,
@@ -642,6 +1004,14 @@ int smr_progress_unexp(struct smr_ep *ep, struct smr_ep_entry *entry)
 		entry->err = smr_progress_iov(&unexp_msg->cmd, entry->iov,
 					      entry->iov_count, &total_len,
 					      ep, 0);
+		if (entry->err == -FI_EINPROGRESS) {
+			entry->err = 0;
+			smr_start_sar(ep, &unexp_msg->cmd, entry->iov,
+				      entry->iov_count, entry);
+			smr_put_cmd_credit(ep->region, 1);
+			freestack_push(ep->unexp_fs, unexp_msg);
+			return 0;
+		}
 		break;
 	default:
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -658,7 +1028,7 @@ int smr_progress_unexp(struct smr_ep *ep, struct smr_ep_entry *entry)
 			"unable to process rx completion\n");
 	}
 
-	ep->region->cmd_cnt++;
+	smr_put_cmd_credit(ep->region, 1);
 	freestack_push(ep->unexp_fs, unexp_msg);
 
 	if (entry->flags & SMR_MULTI_RECV) {
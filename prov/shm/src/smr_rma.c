@@ -105,13 +105,16 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 {
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
 	struct smr_resp *resp;
-	struct smr_cmd *cmd, *pend;
+	struct smr_cmd *cmd, *pend, fast_cmd;
+	int64_t pos, resp_pos;
 	int peer_id, cmds, err = 0, comp = 1;
 	uint16_t comp_flags;
 	ssize_t ret = 0;
 	size_t total_len;
+	bool use_resp;
 
 	assert(iov_count <= SMR_IOV_LIMIT);
 	assert(rma_count <= SMR_IOV_LIMIT);
@@ -124,77 +127,116 @@ ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		return ret;
 
 	cmds = 1 + !(domain->fast_rma && !(op_flags & FI_REMOTE_CQ_DATA) &&
-		     rma_count == 1);
+		     rma_count == 1 && smr_cma_usable(ep, peer_id));
 
 	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds) {
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
 		ret = -FI_EAGAIN;
-		goto unlock_region;
+		goto unlock_cq;
 	}
 
-	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	total_len = ofi_total_iov_len(iov, iov_count);
+	use_resp = cmds > 1 && (op != ofi_op_write ||
+				total_len > SMR_INJECT_SIZE);
+	if (use_resp && (smr_resp_queue_isfull(smr_resp_queue(ep->region)) ||
+			 !smr_peer_paired(ep, peer_id))) {
 		ret = -FI_EAGAIN;
 		goto unlock_cq;
 	}
 
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	if (!smr_get_cmd_credit(peer_smr, cmds)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
+
+	/* The data moves before a queue entry is claimed so that a failed
+	 * transfer never has to publish a command.
+	 */
+	if (cmds == 1) {
+		err = smr_rma_fast(peer_smr, &fast_cmd, iov, iov_count, rma_iov,
+				   rma_count, desc, peer_id, context, op,
+				   op_flags);
+		if (err) {
+			smr_put_cmd_credit(peer_smr, cmds);
+			if (smr_cma_denied(-err)) {
+				/* retried through the target, which can
+				 * stage the data without CMA */
+				smr_map_peer(ep->region->map, peer_id)->no_cma = true;
+				ret = -FI_EAGAIN;
+				goto unlock_cq;
+			}
+			comp_flags = op_flags & FI_COMPLETION ?
+				     SMR_TX_COMPLETION : 0;
+			goto comp;
+		}
+	}
+
+	tx_buf = NULL;
+	if (cmds > 1 && !use_resp && total_len > SMR_MSG_DATA_LEN) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, cmds, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
 
 	if (cmds == 1) {
-		err = smr_rma_fast(peer_smr, cmd, iov, iov_count, rma_iov,
-				   rma_count, desc, peer_id, context, op, op_flags);
+		*cmd = fast_cmd;
 		comp_flags = cmd->msg.hdr.op_flags;
 		goto commit_comp;
 	}
 
-	total_len = ofi_total_iov_len(iov, iov_count);
-
 	if (total_len <= SMR_MSG_DATA_LEN && op == ofi_op_write) {
 		smr_format_inline(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  iov, iov_count, op, 0, data, op_flags);
-	} else if (total_len <= SMR_INJECT_SIZE && op == ofi_op_write) {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
+	} else if (!use_resp) {
 		smr_format_inject(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  iov, iov_count, op, 0, data, op_flags,
 				  peer_smr, tx_buf);
 	} else {
-		if (ofi_cirque_isfull(smr_resp_queue(ep->region))) {
-			ret = -FI_EAGAIN;
-			goto unlock_cq;
-		}
-		resp = ofi_cirque_tail(smr_resp_queue(ep->region));
+		smr_resp_queue_next(smr_resp_queue(ep->region), 1, &resp_pos);
+		resp = smr_resp_queue_buf(smr_resp_queue(ep->region), resp_pos);
 		pend = freestack_pop(ep->pend_fs);
 		smr_format_iov(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 			       iov, iov_count, total_len, op, 0, data,
 			       op_flags, context, ep->region, resp, pend);
-		ofi_cirque_commit(smr_resp_queue(ep->region));
+		smr_heap_format(domain, cmd, resp);
+		pend->msg.hdr.addr = peer_id;
+		smr_resp_queue_commit(smr_resp_queue(ep->region), resp_pos, 1);
 		comp = 0;
 	}
 
 	comp_flags = cmd->msg.hdr.op_flags;
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	cmd = smr_cmd_queue_buf(queue, pos + 1);
 	smr_format_rma_iov(cmd, rma_iov, rma_count);
 
 commit_comp:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(queue, pos, cmds);
+	smr_signal(peer_smr);
 
 	if (!comp)
 		goto unlock_cq;
-
+comp:
 	ret = smr_complete_tx(ep, context, op, comp_flags, err);
 	if (ret) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"unable to process tx completion\n");
 	}
+	goto unlock_cq;
 
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, cmds);
 unlock_cq:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
 	return ret;
 }
 
@@ -243,6 +285,9 @@ ssize_t smr_readmsg(struct fid_ep *ep_fid, const struct fi_msg_rma *msg,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_rma(ep_fid, msg, flags, FI_OP_READ);
+
 	return smr_generic_rma(ep, msg->msg_iov, msg->iov_count,
 			       msg->rma_iov, msg->rma_iov_count,
 			       msg->desc, msg->addr, msg->context,
@@ -296,6 +341,9 @@ ssize_t smr_writemsg(struct fid_ep *ep_fid, const struct fi_msg_rma *msg,
 
 	ep = container_of(ep_fid, struct smr_ep, util_ep.ep_fid.fid);
 
+	if (flags & FI_TRIGGER)
+		return ofi_trigger_rma(ep_fid, msg, flags, FI_OP_WRITE);
+
 	return smr_generic_rma(ep, msg->msg_iov, msg->iov_count,
 			       msg->rma_iov, msg->rma_iov_count,
 			       msg->desc, msg->addr, msg->context,
@@ -310,10 +358,12 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 	struct smr_ep *ep;
 	struct smr_domain *domain;
 	struct smr_region *peer_smr;
+	struct smr_cmd_queue *queue;
 	struct smr_inject_buf *tx_buf;
-	struct smr_cmd *cmd;
+	struct smr_cmd *cmd, fast_cmd;
 	struct iovec iov;
 	struct fi_rma_iov rma_iov;
+	int64_t pos;
 	int peer_id, cmds;
 	ssize_t ret = 0;
 
@@ -328,26 +378,42 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 
 	cmds = 1 + !(domain->fast_rma && !(flags & FI_REMOTE_CQ_DATA));
 
-	peer_smr = smr_peer_region(ep->region, peer_id);
-	fastlock_acquire(&peer_smr->lock);
-	if (peer_smr->cmd_cnt < cmds) {
-		ret = -FI_EAGAIN;
-		goto unlock_region;
-	}
-
 	iov.iov_base = (void *) buf;
 	iov.iov_len = len;
 	rma_iov.addr = addr;
 	rma_iov.len = len;
 	rma_iov.key = key;
 
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	peer_smr = smr_peer_region(ep->region, peer_id);
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (!smr_get_cmd_credit(peer_smr, cmds)) {
+		ret = -FI_EAGAIN;
+		goto unlock_cq;
+	}
 
 	if (cmds == 1) {
-		ret = smr_rma_fast(peer_smr, cmd, &iov, 1, &rma_iov, 1, NULL,
-				   peer_id, NULL, ofi_op_write, flags);
+		ret = smr_rma_fast(peer_smr, &fast_cmd, &iov, 1, &rma_iov, 1,
+				   NULL, peer_id, NULL, ofi_op_write, flags);
 		if (ret)
-			goto unlock_region;
+			goto put_credit;
+	}
+
+	tx_buf = NULL;
+	if (cmds > 1 && len > SMR_MSG_DATA_LEN) {
+		tx_buf = smr_get_inject_buf(peer_smr);
+		if (!tx_buf) {
+			ret = -FI_EAGAIN;
+			goto put_credit;
+		}
+	}
+
+	ret = smr_tx_queue_next(ep, peer_id, cmds, &queue, &pos);
+	if (ret)
+		goto put_buf;
+	cmd = smr_cmd_queue_buf(queue, pos);
+
+	if (cmds == 1) {
+		*cmd = fast_cmd;
 		goto commit;
 	}
 
@@ -355,23 +421,27 @@ ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 		smr_format_inline(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  &iov, 1, ofi_op_write, 0, data, flags);
 	} else {
-		tx_buf = smr_freestack_pop(smr_inject_pool(peer_smr));
 		smr_format_inject(cmd, smr_peer_addr(ep->region)[peer_id].addr,
 				  &iov, 1, ofi_op_write, 0, data,
 				  flags, peer_smr, tx_buf);
 	}
 
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
-	cmd = ofi_cirque_tail(smr_cmd_queue(peer_smr));
+	cmd = smr_cmd_queue_buf(queue, pos + 1);
 	smr_format_rma_iov(cmd, &rma_iov, 1);
 
 commit:
-	ofi_cirque_commit(smr_cmd_queue(peer_smr));
-	peer_smr->cmd_cnt--;
+	smr_cmd_queue_commit(queue, pos, cmds);
+	smr_signal(peer_smr);
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, ofi_op_write);
-unlock_region:
-	fastlock_release(&peer_smr->lock);
+	goto unlock_cq;
+
+put_buf:
+	if (tx_buf)
+		smr_put_inject_buf(peer_smr, tx_buf);
+put_credit:
+	smr_put_cmd_credit(peer_smr, cmds);
+unlock_cq:
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
 	return ret;
 }
 
@@ -87,7 +87,11 @@
 #define SOCK_DOMAIN_MR_CNT (65535)
 
 #define SOCK_PE_POLL_TIMEOUT (100000)
-#define SOCK_PE_MAX_ENTRIES (128)
+/* entry ids are 16 bits on the wire */
+#define SOCK_PE_MAX_ENTRIES (1 << 16)
+#define SOCK_PE_ENTRY_CHUNK_CNT (128)
+/* engine ids are 8 bits on the wire */
+#define SOCK_PE_MAX_CNT (1 << 8)
 #define SOCK_PE_WAITTIME (10)
 
 #define SOCK_EQ_DEF_SZ (1<<8)
@@ -161,7 +165,7 @@ extern uint64_t SOCK_EP_MSG_CAP;
 #define SOCK_USE_OP_FLAGS (1ULL << 61)
 #define SOCK_TRIGGERED_OP (1ULL << 62)
 #define SOCK_PE_COMM_BUFF_SZ (1024)
-#define SOCK_PE_OVERFLOW_COMM_BUFF_SZ (128)
+#define SOCK_PE_MIN_COMM_BUFF_SZ (128)
 
 /* it must be adjusted if error data size in CQ/EQ
  * will be larger than SOCK_EP_MAX_CM_DATA_SZ */
@@ -180,7 +184,7 @@ enum {
 #define SOCK_MAJOR_VERSION 2
 #define SOCK_MINOR_VERSION 0
 
-#define SOCK_WIRE_PROTO_VERSION (2)
+#define SOCK_WIRE_PROTO_VERSION (3)
 
 struct sock_service_entry {
 	int service;
@@ -249,7 +253,10 @@ struct sock_domain {
 
 	enum fi_progress	progress_mode;
 	struct ofi_mr_map	mr_map;
-	struct sock_pe		*pe;
+	struct sock_pe		**pe;
+	int			pe_cnt;
+	ofi_atomic32_t		pe_next;
+	fastlock_t		atomic_lock;
 	struct dlist_entry	dom_list_entry;
 	struct fi_domain_attr	attr;
 	struct sock_conn_listener conn_listener;
@@ -559,6 +566,7 @@ struct sock_ep_attr {
 	struct sock_eq *eq;
 	struct sock_av *av;
 	struct sock_domain *domain;
+	struct sock_pe *pe;
 
 	struct sock_rx_ctx *rx_ctx;
 	struct sock_tx_ctx *tx_ctx;
@@ -659,6 +667,7 @@ struct sock_rx_ctx {
 	struct sock_av *av;
 	struct sock_eq *eq;
  	struct sock_domain *domain;
+	struct sock_pe *pe;
 
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
@@ -698,6 +707,7 @@ struct sock_tx_ctx {
 	struct sock_av *av;
 	struct sock_eq *eq;
  	struct sock_domain *domain;
+	struct sock_pe *pe;
 
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
@@ -715,7 +725,9 @@ struct sock_msg_hdr {
 	uint8_t rx_id;
 	uint8_t dest_iov_len;
 	uint16_t pe_entry_id;
-	uint8_t reserved[2];
+	/* engine of the request, and of the entry a response is for */
+	uint8_t pe_id;
+	uint8_t reserved;
 
 	uint64_t flags;
 	uint64_t msg_len;
@@ -835,9 +847,8 @@ struct sock_pe_entry {
 	uint8_t is_complete;
 	uint8_t is_error;
 	uint8_t mr_checked;
-	uint8_t is_pool_entry;
 	uint8_t completion_reported;
-	uint8_t reserved[3];
+	uint8_t reserved[4];
 
 	uint64_t done_len;
 	uint64_t total_len;
@@ -848,7 +859,6 @@ struct sock_pe_entry {
 	struct sock_conn *conn;
 	struct sock_comp *comp;
 
-	struct dlist_entry entry;
 	struct dlist_entry ctx_entry;
 	struct ofi_ringbuf comm_buf;
 	size_t cache_sz;
@@ -856,8 +866,8 @@ struct sock_pe_entry {
 
 struct sock_pe {
 	struct sock_domain *domain;
-	int num_free_entries;
-	struct sock_pe_entry pe_table[SOCK_PE_MAX_ENTRIES];
+	int index;
+	struct ofi_bufpool *pe_pool;
 	fastlock_t lock;
 	fastlock_t signal_lock;
 	pthread_mutex_t list_lock;
@@ -865,11 +875,7 @@ struct sock_pe {
 	int signal_fds[2];
 	uint64_t waittime;
 
-	struct ofi_bufpool *pe_rx_pool;
 	struct ofi_bufpool *atomic_rx_pool;
-	struct dlist_entry free_list;
-	struct dlist_entry busy_list;
-	struct dlist_entry pool_list;
 
 	struct dlist_entry tx_list;
 	struct dlist_entry rx_list;
@@ -1039,6 +1045,9 @@ void sock_dom_add_to_list(struct sock_domain *domain);
 int sock_dom_check_list(struct sock_domain *domain);
 void sock_dom_remove_from_list(struct sock_domain *domain);
 struct sock_domain *sock_dom_list_head(void);
+struct sock_pe *sock_dom_assign_pe(struct sock_domain *dom, int shared);
+struct sock_pe *sock_ep_ctx_pe(struct sock_ep_attr *attr, int index);
+int sock_ep_pe_cnt(struct sock_ep_attr *attr);
 int sock_dom_check_manual_progress(struct sock_fabric *fabric);
 int sock_query_atomic(struct fid_domain *domain,
 		      enum fi_datatype datatype, enum fi_op op,
@@ -1168,16 +1177,18 @@ void sock_conn_release_entry(struct sock_conn_map *map, struct sock_conn *conn);
 void sock_set_sockopts(int sock, int sock_opts);
 int fd_set_nonblock(int fd);
 int sock_conn_map_init(struct sock_ep *ep, int init_size);
+void sock_conn_poll_add(struct sock_ep_attr *ep_attr, int fd);
+void sock_conn_poll_del(struct sock_ep_attr *ep_attr, int fd);
 
-struct sock_pe *sock_pe_init(struct sock_domain *domain);
+struct sock_pe *sock_pe_init(struct sock_domain *domain, int index);
 void sock_pe_add_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *ctx);
 void sock_pe_add_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *ctx);
 void sock_pe_signal(struct sock_pe *pe);
 void sock_pe_poll_add(struct sock_pe *pe, int fd);
 void sock_pe_poll_del(struct sock_pe *pe, int fd);
 
-int sock_pe_progress_ep_rx(struct sock_pe *pe, struct sock_ep_attr *ep_attr);
-int sock_pe_progress_ep_tx(struct sock_pe *pe, struct sock_ep_attr *ep_attr);
+int sock_pe_progress_ep_rx(struct sock_ep_attr *ep_attr);
+int sock_pe_progress_ep_tx(struct sock_ep_attr *ep_attr);
 int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx);
 int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx);
 void sock_pe_remove_tx_ctx(struct sock_tx_ctx *tx_ctx);
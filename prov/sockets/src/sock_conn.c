@@ -141,13 +141,38 @@ static int sock_conn_map_increase(struct sock_conn_map *map, int new_size)
 	return 0;
 }
 
+/* Every engine running a context of the endpoint waits on its connections */
+void sock_conn_poll_add(struct sock_ep_attr *ep_attr, int fd)
+{
+	int i;
+
+	for (i = 0; i < sock_ep_pe_cnt(ep_attr); i++)
+		sock_pe_poll_add(sock_ep_ctx_pe(ep_attr, i), fd);
+}
+
+void sock_conn_poll_del(struct sock_ep_attr *ep_attr, int fd)
+{
+	int i;
+
+	for (i = 0; i < sock_ep_pe_cnt(ep_attr); i++)
+		sock_pe_poll_del(sock_ep_ctx_pe(ep_attr, i), fd);
+}
+
+static void sock_conn_signal(struct sock_ep_attr *ep_attr)
+{
+	int i;
+
+	for (i = 0; i < sock_ep_pe_cnt(ep_attr); i++)
+		sock_pe_signal(sock_ep_ctx_pe(ep_attr, i));
+}
+
 void sock_conn_map_destroy(struct sock_ep_attr *ep_attr)
 {
 	int i;
 	struct sock_conn_map *cmap = &ep_attr->cmap;
 	for (i = 0; i < cmap->used; i++) {
 		if (cmap->table[i].sock_fd != -1) {
-			sock_pe_poll_del(ep_attr->domain->pe, cmap->table[i].sock_fd);
+			sock_conn_poll_del(ep_attr, cmap->table[i].sock_fd);
 			sock_conn_release_entry(cmap, &cmap->table[i]);
 		}
 	}
@@ -214,7 +239,7 @@ static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
 		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", conn_fd);
 
 	map->table[index].address_published = addr_published;
-	sock_pe_poll_add(ep_attr->domain->pe, conn_fd);
+	sock_conn_poll_add(ep_attr, conn_fd);
 	return &map->table[index];
 }
 
@@ -357,7 +382,7 @@ static void *sock_conn_listener_thread(void *arg)
 			fastlock_acquire(&ep_attr->cmap.lock);
 			sock_conn_map_insert(ep_attr, &remote, conn_fd, 1);
 			fastlock_release(&ep_attr->cmap.lock);
-			sock_pe_signal(ep_attr->domain->pe);
+			sock_conn_signal(ep_attr);
 		}
 		fastlock_release(&conn_listener->signal_lock);
 	}
@@ -168,7 +168,7 @@ void sock_tx_ctx_write(struct sock_tx_ctx *tx_ctx, const void *buf, size_t len)
 void sock_tx_ctx_commit(struct sock_tx_ctx *tx_ctx)
 {
 	ofi_rbcommit(&tx_ctx->rb);
-	sock_pe_signal(tx_ctx->domain->pe);
+	sock_pe_signal(tx_ctx->pe);
 	fastlock_release(&tx_ctx->rb_lock);
 }
 
@@ -174,6 +174,75 @@ int sock_verify_domain_attr(uint32_t version, const struct fi_info *info)
 	return 0;
 }
 
+static void sock_dom_free_pe(struct sock_domain *dom)
+{
+	int i;
+
+	for (i = 0; i < dom->pe_cnt; i++)
+		sock_pe_finalize(dom->pe[i]);
+	free(dom->pe);
+}
+
+static int sock_dom_init_pe(struct sock_domain *dom)
+{
+	int cnt;
+
+	cnt = MIN(MAX(sock_pe_cnt, 1), SOCK_PE_MAX_CNT);
+	dom->pe = calloc(cnt, sizeof(*dom->pe));
+	if (!dom->pe)
+		return -FI_ENOMEM;
+
+	for (dom->pe_cnt = 0; dom->pe_cnt < cnt; dom->pe_cnt++) {
+		dom->pe[dom->pe_cnt] = sock_pe_init(dom, dom->pe_cnt);
+		if (!dom->pe[dom->pe_cnt]) {
+			sock_dom_free_pe(dom);
+			return -FI_ENOMEM;
+		}
+	}
+	ofi_atomic_initialize32(&dom->pe_next, 0);
+	return 0;
+}
+
+/*
+ * Endpoints are spread round-robin over the progress engines.  Shared
+ * contexts, along with the endpoints using them, stay on the first engine.
+ */
+struct sock_pe *sock_dom_assign_pe(struct sock_domain *dom, int shared)
+{
+	if (shared || dom->pe_cnt == 1)
+		return dom->pe[0];
+
+	return dom->pe[(uint32_t) ofi_atomic_inc32(&dom->pe_next) %
+		       dom->pe_cnt];
+}
+
+/*
+ * The contexts of a scalable endpoint are spread over the engines in
+ * turn, starting from the engine of the endpoint.  They share its
+ * connections: a connection is taken for sending or receiving under the
+ * connection map lock, and responses carry the id of the engine that
+ * sent the request.
+ */
+struct sock_pe *sock_ep_ctx_pe(struct sock_ep_attr *attr, int index)
+{
+	struct sock_domain *dom = attr->domain;
+
+	if (attr->fclass != FI_CLASS_SEP || attr->tx_shared || attr->rx_shared)
+		return attr->pe;
+
+	return dom->pe[(attr->pe->index + index) % dom->pe_cnt];
+}
+
+/* Number of engines, from the endpoint's one, its contexts run on */
+int sock_ep_pe_cnt(struct sock_ep_attr *attr)
+{
+	if (attr->fclass != FI_CLASS_SEP || attr->tx_shared || attr->rx_shared)
+		return 1;
+
+	return MIN(attr->domain->pe_cnt,
+		   (int) MAX(attr->ep_attr.tx_ctx_cnt, attr->ep_attr.rx_ctx_cnt));
+}
+
 static int sock_dom_close(struct fid *fid)
 {
 	struct sock_domain *dom;
@@ -184,7 +253,8 @@ static int sock_dom_close(struct fid *fid)
 	sock_conn_stop_listener_thread(&dom->conn_listener);
 	sock_ep_cm_stop_thread(&dom->cm_head);
 
-	sock_pe_finalize(dom->pe);
+	sock_dom_free_pe(dom);
+	fastlock_destroy(&dom->atomic_lock);
 	fastlock_destroy(&dom->lock);
 	ofi_mr_map_close(&dom->mr_map);
 	sock_dom_remove_from_list(dom);
@@ -293,6 +363,7 @@ int sock_domain(struct fid_fabric *fabric, struct fi_info *info,
 		return -FI_ENOMEM;
 
 	fastlock_init(&sock_domain->lock);
+	fastlock_init(&sock_domain->atomic_lock);
 	ofi_atomic_initialize32(&sock_domain->ref, 0);
 
 	if (info) {
@@ -314,8 +385,7 @@ int sock_domain(struct fid_fabric *fabric, struct fi_info *info,
 	else
 		sock_domain->progress_mode = info->domain_attr->data_progress;
 
-	sock_domain->pe = sock_pe_init(sock_domain);
-	if (!sock_domain->pe) {
+	if (sock_dom_init_pe(sock_domain)) {
 		SOCK_LOG_ERROR("Failed to init PE\n");
 		goto err1;
 	}
@@ -347,8 +417,9 @@ int sock_domain(struct fid_fabric *fabric, struct fi_info *info,
 err3:
 	sock_conn_stop_listener_thread(&sock_domain->conn_listener);
 err2:
-	sock_pe_finalize(sock_domain->pe);
+	sock_dom_free_pe(sock_domain);
 err1:
+	fastlock_destroy(&sock_domain->atomic_lock);
 	fastlock_destroy(&sock_domain->lock);
 	free(sock_domain);
 	return -FI_EINVAL;
@@ -288,7 +288,7 @@ static int sock_ctx_enable(struct fid_ep *ep)
 	switch (ep->fid.fclass) {
 	case FI_CLASS_RX_CTX:
 		rx_ctx = container_of(ep, struct sock_rx_ctx, ctx.fid);
-		sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx);
+		sock_pe_add_rx_ctx(rx_ctx->pe, rx_ctx);
 
 		if (!rx_ctx->ep_attr->conn_handle.do_listen &&
 		    sock_conn_listen(rx_ctx->ep_attr)) {
@@ -299,7 +299,7 @@ static int sock_ctx_enable(struct fid_ep *ep)
 
 	case FI_CLASS_TX_CTX:
 		tx_ctx = container_of(ep, struct sock_tx_ctx, fid.ctx.fid);
-		sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx);
+		sock_pe_add_tx_ctx(tx_ctx->pe, tx_ctx);
 
 		if (!tx_ctx->ep_attr->conn_handle.do_listen &&
 		    sock_conn_listen(tx_ctx->ep_attr)) {
@@ -689,7 +689,7 @@ static int sock_ep_close(struct fid *fid)
 		fastlock_release(&sock_ep->attr->av->list_lock);
 	}
 
-	pthread_mutex_lock(&sock_ep->attr->domain->pe->list_lock);
+	pthread_mutex_lock(&sock_ep->attr->pe->list_lock);
 	if (sock_ep->attr->tx_shared) {
 		fastlock_acquire(&sock_ep->attr->tx_ctx->lock);
 		dlist_remove(&sock_ep->attr->tx_ctx_entry);
@@ -701,7 +701,7 @@ static int sock_ep_close(struct fid *fid)
 		dlist_remove(&sock_ep->attr->rx_ctx_entry);
 		fastlock_release(&sock_ep->attr->rx_ctx->lock);
 	}
-	pthread_mutex_unlock(&sock_ep->attr->domain->pe->list_lock);
+	pthread_mutex_unlock(&sock_ep->attr->pe->list_lock);
 
 	if (sock_ep->attr->conn_handle.do_listen) {
 		fastlock_acquire(&sock_ep->attr->domain->conn_listener.signal_lock);
@@ -749,10 +749,10 @@ static int sock_ep_close(struct fid *fid)
 	if (sock_ep->attr->dest_addr)
 		free(sock_ep->attr->dest_addr);
 
-	fastlock_acquire(&sock_ep->attr->domain->pe->lock);
+	fastlock_acquire(&sock_ep->attr->pe->lock);
 	ofi_idm_reset(&sock_ep->attr->av_idm);
 	sock_conn_map_destroy(sock_ep->attr);
-	fastlock_release(&sock_ep->attr->domain->pe->lock);
+	fastlock_release(&sock_ep->attr->pe->lock);
 
 	ofi_atomic_dec32(&sock_ep->attr->domain->ref);
 	fastlock_destroy(&sock_ep->attr->lock);
@@ -761,6 +761,22 @@ static int sock_ep_close(struct fid *fid)
 	return 0;
 }
 
+/* An endpoint moves to the progress engine of the shared context it uses */
+static void sock_ep_set_pe(struct sock_ep_attr *attr, struct sock_pe *pe)
+{
+	struct sock_tx_ctx *tx_ctx = attr->tx_ctx;
+	struct sock_rx_ctx *rx_ctx = attr->rx_ctx;
+
+	attr->pe = pe;
+	if (tx_ctx) {
+		tx_ctx->pe = pe;
+		if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx)
+			tx_ctx->rx_ctrl_ctx->pe = pe;
+	}
+	if (rx_ctx)
+		rx_ctx->pe = pe;
+}
+
 static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 {
 	int ret;
@@ -908,6 +924,7 @@ static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 
 		ep->attr->tx_ctx->use_shared = 1;
 		ep->attr->tx_ctx->stx_ctx = tx_ctx;
+		sock_ep_set_pe(ep->attr, tx_ctx->pe);
 		break;
 
 	case FI_CLASS_SRX_CTX:
@@ -918,6 +935,7 @@ static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 
 		ep->attr->rx_ctx->use_shared = 1;
 		ep->attr->rx_ctx->srx_ctx = rx_ctx;
+		sock_ep_set_pe(ep->attr, rx_ctx->pe);
 		break;
 
 	default:
@@ -1012,11 +1030,11 @@ int sock_ep_enable(struct fid_ep *ep)
 			tx_ctx->enabled = 1;
 			if (tx_ctx->use_shared) {
 				if (tx_ctx->stx_ctx) {
-					sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx->stx_ctx);
+					sock_pe_add_tx_ctx(tx_ctx->stx_ctx->pe, tx_ctx->stx_ctx);
 					tx_ctx->stx_ctx->enabled = 1;
 				}
 			} else {
-				sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx);
+				sock_pe_add_tx_ctx(tx_ctx->pe, tx_ctx);
 			}
 		}
 	}
@@ -1027,11 +1045,11 @@ int sock_ep_enable(struct fid_ep *ep)
 			rx_ctx->enabled = 1;
 			if (rx_ctx->use_shared) {
 				if (rx_ctx->srx_ctx) {
-					sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx->srx_ctx);
+					sock_pe_add_rx_ctx(rx_ctx->srx_ctx->pe, rx_ctx->srx_ctx);
 					rx_ctx->srx_ctx->enabled = 1;
 				}
 			} else {
-				sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx);
+				sock_pe_add_rx_ctx(rx_ctx->pe, rx_ctx);
 			}
 		}
 	}
@@ -1159,8 +1177,11 @@ static int sock_ep_tx_ctx(struct fid_ep *ep, int index, struct fi_tx_attr *attr,
 	tx_ctx->tx_id = index;
 	tx_ctx->ep_attr = sock_ep->attr;
 	tx_ctx->domain = sock_ep->attr->domain;
-	if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx)
+	tx_ctx->pe = sock_ep_ctx_pe(sock_ep->attr, index);
+	if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx) {
 		tx_ctx->rx_ctrl_ctx->domain = sock_ep->attr->domain;
+		tx_ctx->rx_ctrl_ctx->pe = tx_ctx->pe;
+	}
 	tx_ctx->av = sock_ep->attr->av;
 	dlist_insert_tail(&sock_ep->attr->tx_ctx_entry, &tx_ctx->ep_list);
 
@@ -1204,6 +1225,7 @@ static int sock_ep_rx_ctx(struct fid_ep *ep, int index, struct fi_rx_attr *attr,
 	rx_ctx->rx_id = index;
 	rx_ctx->ep_attr = sock_ep->attr;
 	rx_ctx->domain = sock_ep->attr->domain;
+	rx_ctx->pe = sock_ep_ctx_pe(sock_ep->attr, index);
 	rx_ctx->av = sock_ep->attr->av;
 	dlist_insert_tail(&sock_ep->attr->rx_ctx_entry, &rx_ctx->ep_list);
 
@@ -1267,8 +1289,11 @@ int sock_stx_ctx(struct fid_domain *domain,
 		return -FI_ENOMEM;
 
 	tx_ctx->domain = dom;
-	if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx)
+	tx_ctx->pe = sock_dom_assign_pe(dom, 1);
+	if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx) {
 		tx_ctx->rx_ctrl_ctx->domain = dom;
+		tx_ctx->rx_ctrl_ctx->pe = tx_ctx->pe;
+	}
 
 	tx_ctx->fid.stx.fid.ops = &sock_ctx_ops;
 	tx_ctx->fid.stx.ops = &sock_ep_ops;
@@ -1316,6 +1341,7 @@ int sock_srx_ctx(struct fid_domain *domain,
 		return -FI_ENOMEM;
 
 	rx_ctx->domain = dom;
+	rx_ctx->pe = sock_dom_assign_pe(dom, 1);
 	rx_ctx->ctx.fid.fclass = FI_CLASS_SRX_CTX;
 
 	rx_ctx->ctx.fid.ops = &sock_ctx_ops;
@@ -1733,6 +1759,8 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		sock_ep->attr->tx_shared = 1;
 	if (sock_ep->attr->ep_attr.rx_ctx_cnt == FI_SHARED_CONTEXT)
 		sock_ep->attr->rx_shared = 1;
+	sock_ep->attr->pe = sock_dom_assign_pe(sock_dom, sock_ep->attr->tx_shared ||
+					       sock_ep->attr->rx_shared);
 
 	if (sock_ep->attr->fclass != FI_CLASS_SEP) {
 		sock_ep->attr->ep_attr.tx_ctx_cnt = 1;
@@ -1763,8 +1791,11 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		}
 		tx_ctx->ep_attr = sock_ep->attr;
 		tx_ctx->domain = sock_dom;
-		if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx)
+		tx_ctx->pe = sock_ep->attr->pe;
+		if (tx_ctx->rx_ctrl_ctx && tx_ctx->rx_ctrl_ctx->is_ctrl_ctx) {
 			tx_ctx->rx_ctrl_ctx->domain = sock_dom;
+			tx_ctx->rx_ctrl_ctx->pe = sock_ep->attr->pe;
+		}
 		tx_ctx->tx_id = 0;
 		dlist_insert_tail(&sock_ep->attr->tx_ctx_entry, &tx_ctx->ep_list);
 		sock_ep->attr->tx_array[0] = tx_ctx;
@@ -1779,6 +1810,7 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		}
 		rx_ctx->ep_attr = sock_ep->attr;
 		rx_ctx->domain = sock_dom;
+		rx_ctx->pe = sock_ep->attr->pe;
 		rx_ctx->rx_id = 0;
 		dlist_insert_tail(&sock_ep->attr->rx_ctx_entry, &rx_ctx->ep_list);
 		sock_ep->attr->rx_array[0] = rx_ctx;
@@ -1816,7 +1848,7 @@ err1:
 
 void sock_ep_remove_conn(struct sock_ep_attr *attr, struct sock_conn *conn)
 {
-	sock_pe_poll_del(attr->domain->pe, conn->sock_fd);
+	sock_conn_poll_del(attr, conn->sock_fd);
 	sock_conn_release_entry(&attr->cmap, conn);
 }
 
@@ -63,7 +63,7 @@
 #define SOCK_LOG_DBG(...) _SOCK_LOG_DBG(FI_LOG_EP_DATA, __VA_ARGS__)
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_EP_DATA, __VA_ARGS__)
 
-#define PE_INDEX(_pe, _e) (_e - &_pe->pe_table[0])
+#define PE_INDEX(_pe, _e) ofi_buf_index(_e)
 #define SOCK_GET_RX_ID(_addr, _bits) (((_bits) == 0) ? 0 : \
 		(((uint64_t)_addr) >> (64 - _bits)))
 
@@ -85,6 +85,46 @@ static inline int sock_pe_is_data_msg(int msg_id)
 	}
 }
 
+static inline int sock_pe_is_response(int msg_id)
+{
+	switch (msg_id) {
+	case SOCK_OP_SEND_COMPLETE:
+	case SOCK_OP_WRITE_COMPLETE:
+	case SOCK_OP_READ_COMPLETE:
+	case SOCK_OP_ATOMIC_COMPLETE:
+	case SOCK_OP_WRITE_ERROR:
+	case SOCK_OP_READ_ERROR:
+	case SOCK_OP_ATOMIC_ERROR:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Take the connection's send or receive slot for the entry.  The contexts
+ * of a scalable endpoint may run on different engines, so a free slot is
+ * taken under the connection map lock.
+ */
+static int sock_pe_claim_conn(struct sock_pe_entry *pe_entry,
+			      struct sock_pe_entry **slot)
+{
+	struct sock_conn *conn = pe_entry->conn;
+	int ret;
+
+	if (*slot == pe_entry)
+		return 1;
+	if (*slot != NULL)
+		return 0;
+
+	fastlock_acquire(&conn->ep_attr->cmap.lock);
+	ret = (*slot == NULL);
+	if (ret)
+		*slot = pe_entry;
+	fastlock_release(&conn->ep_attr->cmap.lock);
+	return ret;
+}
+
 static inline ssize_t sock_pe_send_field(struct sock_pe_entry *pe_entry,
 					 void *field, size_t field_len,
 					 size_t start_offset)
@@ -164,17 +204,9 @@ static void sock_pe_release_entry(struct sock_pe *pe,
 		ofi_buf_free(pe_entry->pe.rx.atomic_src);
 	}
 
-	if (pe_entry->is_pool_entry) {
-		ofi_rbfree(&pe_entry->comm_buf);
-		dlist_remove(&pe_entry->entry);
-		ofi_buf_free(pe_entry);
-		return;
-	}
-
 	if (pe_entry->type == SOCK_PE_TX)
 		ofi_rbreset(&pe_entry->comm_buf);
 
-	pe->num_free_entries++;
 	pe_entry->conn = NULL;
 
 	memset(&pe_entry->pe.rx, 0, sizeof(pe_entry->pe.rx));
@@ -194,41 +226,64 @@ static void sock_pe_release_entry(struct sock_pe *pe,
 	pe_entry->mr_checked = 0;
 	pe_entry->completion_reported = 0;
 
-	dlist_remove(&pe_entry->entry);
-	dlist_insert_head(&pe_entry->entry, &pe->free_list);
+	ofi_ibuf_free(pe_entry);
 	SOCK_LOG_DBG("progress entry %p released\n", pe_entry);
 }
 
+/*
+ * Entries keep their comm buffer when released.  It is allocated at the
+ * minimum size on first use, and grown to fit the message being handled,
+ * up to SOCK_PE_COMM_BUFF_SZ, while it holds no data.  Larger fields are
+ * sent and received directly on the socket.
+ */
+static void sock_pe_size_comm_buf(struct sock_pe_entry *pe_entry, size_t len)
+{
+	struct ofi_ringbuf rb;
+
+	len = MIN(roundup_power_of_two(len), SOCK_PE_COMM_BUFF_SZ);
+	if (len <= pe_entry->cache_sz || !ofi_rbempty(&pe_entry->comm_buf))
+		return;
+
+	if (ofi_rbinit(&rb, len)) {
+		SOCK_LOG_DBG("failed to grow comm-cache\n");
+		return;
+	}
+
+	ofi_rbfree(&pe_entry->comm_buf);
+	pe_entry->comm_buf = rb;
+	pe_entry->cache_sz = len;
+}
+
 static struct sock_pe_entry *sock_pe_acquire_entry(struct sock_pe *pe)
 {
-	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
 
-	if (dlist_empty(&pe->free_list)) {
-		pe_entry = ofi_buf_alloc(pe->pe_rx_pool);
-		SOCK_LOG_DBG("Getting rx pool entry\n");
-		if (pe_entry) {
-			memset(pe_entry, 0, sizeof(*pe_entry));
-			pe_entry->is_pool_entry = 1;
-			if (ofi_rbinit(&pe_entry->comm_buf, SOCK_PE_OVERFLOW_COMM_BUFF_SZ))
-				SOCK_LOG_ERROR("failed to init comm-cache\n");
-			pe_entry->cache_sz = SOCK_PE_OVERFLOW_COMM_BUFF_SZ;
-			dlist_insert_tail(&pe_entry->entry, &pe->pool_list);
-		}
-	} else {
-		pe->num_free_entries--;
-		entry = pe->free_list.next;
-		pe_entry = container_of(entry, struct sock_pe_entry, entry);
+	pe_entry = ofi_ibuf_alloc(pe->pe_pool);
+	if (!pe_entry)
+		return NULL;
 
-		assert(ofi_rbempty(&pe_entry->comm_buf));
-		dlist_remove(&pe_entry->entry);
-		dlist_insert_tail(&pe_entry->entry, &pe->busy_list);
-		SOCK_LOG_DBG("progress entry %p acquired : %lu\n", pe_entry,
-			     PE_INDEX(pe, pe_entry));
+	if (!pe_entry->cache_sz) {
+		if (ofi_rbinit(&pe_entry->comm_buf, SOCK_PE_MIN_COMM_BUFF_SZ)) {
+			SOCK_LOG_ERROR("failed to init comm-cache\n");
+			ofi_ibuf_free(pe_entry);
+			return NULL;
+		}
+		pe_entry->cache_sz = SOCK_PE_MIN_COMM_BUFF_SZ;
 	}
+
+	assert(ofi_rbempty(&pe_entry->comm_buf));
+	SOCK_LOG_DBG("progress entry %p acquired : %lu\n", pe_entry,
+		     PE_INDEX(pe, pe_entry));
 	return pe_entry;
 }
 
+static struct sock_pe_entry *
+sock_pe_lookup_entry(struct sock_pe *pe, uint16_t pe_entry_id)
+{
+	assert(pe_entry_id < pe->pe_pool->entry_cnt);
+	return ofi_bufpool_get_ibuf(pe->pe_pool, pe_entry_id);
+}
+
 static void sock_pe_report_send_cq_completion(struct sock_pe_entry *pe_entry)
 {
 	int ret = 0;
@@ -468,17 +523,12 @@ static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 	if (!conn || pe_entry->rem)
 		return;
 
-	if (conn->tx_pe_entry != NULL && conn->tx_pe_entry != pe_entry) {
+	if (!sock_pe_claim_conn(pe_entry, &conn->tx_pe_entry)) {
 		SOCK_LOG_DBG("Cannot progress %p as conn %p is being used by %p\n",
 			      pe_entry, conn, conn->tx_pe_entry);
 		return;
 	}
 
-	if (conn->tx_pe_entry == NULL) {
-		SOCK_LOG_DBG("Connection %p grabbed by %p\n", conn, pe_entry);
-		conn->tx_pe_entry = pe_entry;
-	}
-
 	if (sock_pe_send_field(pe_entry, &pe_entry->response,
 			       sizeof(pe_entry->response), 0))
 		return;
@@ -538,6 +588,7 @@ static void sock_pe_send_response(struct sock_pe *pe,
 	response->msg_hdr.op_type = op_type;
 	response->msg_hdr.msg_len = htonll(response->msg_hdr.msg_len);
 	response->msg_hdr.rx_id = pe_entry->msg_hdr.rx_id;
+	response->msg_hdr.pe_id = pe_entry->msg_hdr.pe_id;
 
 	pe->pe_atomic = NULL;
 	pe_entry->done_len = 0;
@@ -545,6 +596,7 @@ static void sock_pe_send_response(struct sock_pe *pe,
 	if (pe_entry->rem == 0)
 		pe_entry->conn->rx_pe_entry = NULL;
 	pe_entry->total_len = sizeof(*response) + data_len;
+	sock_pe_size_comm_buf(pe_entry, pe_entry->total_len);
 
 	sock_pe_progress_pending_ack(pe, pe_entry);
 }
@@ -577,8 +629,7 @@ static int sock_pe_handle_ack(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = sock_pe_lookup_entry(pe, response->pe_entry_id);
 	SOCK_LOG_DBG("Received ack for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
@@ -599,8 +650,7 @@ static int sock_pe_handle_error(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = sock_pe_lookup_entry(pe, response->pe_entry_id);
 	SOCK_LOG_ERROR("Received error for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
@@ -635,12 +685,10 @@ static int sock_pe_handle_read_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = sock_pe_lookup_entry(pe, response->pe_entry_id);
 	SOCK_LOG_DBG("Received read complete for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
 	assert(waiting_entry->type == SOCK_PE_TX);
 
 	len = sizeof(struct sock_msg_response);
@@ -669,8 +717,7 @@ static int sock_pe_handle_write_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = sock_pe_lookup_entry(pe, response->pe_entry_id);
 	SOCK_LOG_DBG("Received ack for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
@@ -693,12 +740,10 @@ static int sock_pe_handle_atomic_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = sock_pe_lookup_entry(pe, response->pe_entry_id);
 	SOCK_LOG_DBG("Received atomic complete for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
 	assert(waiting_entry->type == SOCK_PE_TX);
 
 	len = sizeof(struct sock_msg_response);
@@ -873,7 +918,7 @@ static void sock_pe_do_atomic(void *cmp, void *dst, void *src,
 		ofi_atomic_readwrite_handlers[op][datatype](dst, src,
 			cmp /*results*/, cnt);
 	} else {
-		ofi_atomic_write_handlers[op][datatype](dst, src, cnt);
+		ofi_atomic_write_locked(op, datatype, dst, src, cnt);
 	}
 }
 
@@ -978,6 +1023,8 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 		pe->pe_atomic = pe_entry;
 	}
 
+	/* targets may be updated by the other progress engines as well */
+	fastlock_acquire(&pe->domain->atomic_lock);
 	offset = 0;
 	for (i = 0; i < pe_entry->pe.rx.rx_op.dest_iov_len; i++) {
 		sock_pe_do_atomic(pe_entry->pe.rx.atomic_cmp + offset,
@@ -989,6 +1036,7 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 			pe_entry->pe.rx.rx_op.atomic.res_iov_len);
 		offset += datatype_sz * pe_entry->pe.rx.rx_iov[i].ioc.count;
 	}
+	fastlock_release(&pe->domain->atomic_lock);
 
 	pe_entry->buf = pe_entry->pe.rx.rx_iov[0].iov.addr;
 	pe_entry->data_len = offset;
@@ -1559,13 +1607,9 @@ static int sock_pe_peek_hdr(struct sock_pe *pe,
 	struct sock_msg_hdr *msg_hdr;
 	struct sock_conn *conn = pe_entry->conn;
 
-	if (conn->rx_pe_entry != NULL && conn->rx_pe_entry != pe_entry)
+	if (!sock_pe_claim_conn(pe_entry, &conn->rx_pe_entry))
 		return -1;
 
-	if (conn->rx_pe_entry == NULL) {
-		conn->rx_pe_entry = pe_entry;
-	}
-
 	len = sizeof(struct sock_msg_hdr);
 	msg_hdr = &pe_entry->msg_hdr;
 	if (sock_comm_peek(pe_entry->conn, (void *) msg_hdr, len) != len)
@@ -1587,12 +1631,9 @@ static int sock_pe_read_hdr(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	struct sock_msg_hdr *msg_hdr;
 	struct sock_conn *conn = pe_entry->conn;
 
-	if (conn->rx_pe_entry != NULL && conn->rx_pe_entry != pe_entry)
+	if (!sock_pe_claim_conn(pe_entry, &conn->rx_pe_entry))
 		return 0;
 
-	if (conn->rx_pe_entry == NULL)
-		conn->rx_pe_entry = pe_entry;
-
 	msg_hdr = &pe_entry->msg_hdr;
 	if (sock_pe_peek_hdr(pe, pe_entry))
 		return -1;
@@ -1604,6 +1645,12 @@ static int sock_pe_read_hdr(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	    msg_hdr->rx_id != rx_ctx->rx_id)
 		return -1;
 
+	/* the engine that sent the request owns the entry waiting for it */
+	if (sock_pe_is_response(msg_hdr->op_type) &&
+	    msg_hdr->pe_id != pe->index)
+		return -1;
+
+	sock_pe_size_comm_buf(pe_entry, pe_entry->total_len);
 	if (sock_pe_recv_field(pe_entry, (void *) msg_hdr,
 			       sizeof(struct sock_msg_hdr), 0)) {
 		SOCK_LOG_ERROR("Failed to recv header\n");
@@ -1940,17 +1987,12 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 	if (pe_entry->pe.tx.send_done)
 		goto out;
 
-	if (conn->tx_pe_entry != NULL && conn->tx_pe_entry != pe_entry) {
+	if (!sock_pe_claim_conn(pe_entry, &conn->tx_pe_entry)) {
 		SOCK_LOG_DBG("Cannot progress %p as conn %p is being used by %p\n",
 			      pe_entry, conn, conn->tx_pe_entry);
 		goto out;
 	}
 
-	if (conn->tx_pe_entry == NULL) {
-		SOCK_LOG_DBG("Connection %p grabbed by %p\n", conn, pe_entry);
-		conn->tx_pe_entry = pe_entry;
-	}
-
 	if ((pe_entry->flags & FI_FENCE) &&
 	    (tx_ctx->pe_entry_list.next != &pe_entry->ctx_entry)) {
 		SOCK_LOG_DBG("Waiting for FI_FENCE\n");
@@ -2093,6 +2135,8 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	struct sock_ep_attr *ep_attr;
 
 	pe_entry = sock_pe_acquire_entry(pe);
+	if (!pe_entry)
+		return 0;
 	memset(&pe_entry->pe.tx, 0, sizeof(pe_entry->pe.tx));
 	memset(&pe_entry->msg_hdr, 0, sizeof(pe_entry->msg_hdr));
 
@@ -2111,6 +2155,7 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	msg_hdr->msg_len = sizeof(*msg_hdr);
 
 	msg_hdr->pe_entry_id = PE_INDEX(pe, pe_entry);
+	msg_hdr->pe_id = pe->index;
 	SOCK_LOG_DBG("New TX on PE entry %p (%d)\n",
 		      pe_entry, msg_hdr->pe_entry_id);
 
@@ -2252,6 +2297,7 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 
 	msg_hdr->flags = htonll(pe_entry->flags);
 	pe_entry->total_len = msg_hdr->msg_len;
+	sock_pe_size_comm_buf(pe_entry, pe_entry->total_len);
 	msg_hdr->msg_len = htonll(msg_hdr->msg_len);
 	msg_hdr->pe_entry_id = htons(msg_hdr->pe_entry_id);
 
@@ -2329,16 +2375,16 @@ out:
 
 void sock_pe_remove_tx_ctx(struct sock_tx_ctx *tx_ctx)
 {
-	pthread_mutex_lock(&tx_ctx->domain->pe->list_lock);
-	dlist_remove(&tx_ctx->pe_entry);
-	pthread_mutex_unlock(&tx_ctx->domain->pe->list_lock);
+	pthread_mutex_lock(&tx_ctx->pe->list_lock);
+	dlist_remove_init(&tx_ctx->pe_entry);
+	pthread_mutex_unlock(&tx_ctx->pe->list_lock);
 }
 
 void sock_pe_remove_rx_ctx(struct sock_rx_ctx *rx_ctx)
 {
-	pthread_mutex_lock(&rx_ctx->domain->pe->list_lock);
-	dlist_remove(&rx_ctx->pe_entry);
-	pthread_mutex_unlock(&rx_ctx->domain->pe->list_lock);
+	pthread_mutex_lock(&rx_ctx->pe->list_lock);
+	dlist_remove_init(&rx_ctx->pe_entry);
+	pthread_mutex_unlock(&rx_ctx->pe->list_lock);
 }
 
 static int sock_pe_progress_rx_ep(struct sock_pe *pe,
@@ -2354,6 +2400,8 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe,
 	if (!map->used)
 		return 0;
 
+	/* the engines of a scalable endpoint's contexts share the buffer */
+	fastlock_acquire(&map->lock);
 	if (map->epoll_ctxs_sz < map->used) {
 		uint64_t new_size = map->used * 2;
 		void *ctxs;
@@ -2369,12 +2417,12 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe,
 	num_fds = fi_epoll_wait(map->epoll_set, map->epoll_ctxs,
 	                        MIN(map->used, map->epoll_ctxs_sz), 0);
 	if (num_fds < 0 || num_fds == 0) {
+		fastlock_release(&map->lock);
 		if (num_fds < 0)
 			SOCK_LOG_ERROR("epoll failed: %d\n", num_fds);
 		return num_fds;
 	}
 
-	fastlock_acquire(&map->lock);
 	for (i = 0; i < num_fds; i++) {
 		conn = map->epoll_ctxs[i];
 		if (!conn)
@@ -2435,7 +2483,7 @@ out:
 	return ret;
 }
 
-int sock_pe_progress_ep_rx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
+int sock_pe_progress_ep_rx(struct sock_ep_attr *ep_attr)
 {
 	struct sock_rx_ctx *rx_ctx;
 	int ret, i;
@@ -2445,14 +2493,14 @@ int sock_pe_progress_ep_rx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
 		if (!rx_ctx)
 			continue;
 
-		ret = sock_pe_progress_rx_ctx(pe, rx_ctx);
+		ret = sock_pe_progress_rx_ctx(rx_ctx->pe, rx_ctx);
 		if (ret < 0)
 			return ret;
 	}
 	return 0;
 }
 
-int sock_pe_progress_ep_tx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
+int sock_pe_progress_ep_tx(struct sock_ep_attr *ep_attr)
 {
 	struct sock_tx_ctx *tx_ctx;
 	int ret, i;
@@ -2462,7 +2510,7 @@ int sock_pe_progress_ep_tx(struct sock_pe *pe, struct sock_ep_attr *ep_attr)
 		if (!tx_ctx)
 			continue;
 
-		ret = sock_pe_progress_tx_ctx(pe, tx_ctx);
+		ret = sock_pe_progress_tx_ctx(tx_ctx->pe, tx_ctx);
 		if (ret < 0)
 			return ret;
 	}
@@ -2517,7 +2565,7 @@ int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	}
 
 	fastlock_acquire(&tx_ctx->rb_lock);
-	if (!ofi_rbempty(&tx_ctx->rb) && !dlist_empty(&pe->free_list)) {
+	if (!ofi_rbempty(&tx_ctx->rb)) {
 		ret = sock_pe_new_tx_entry(pe, tx_ctx);
 	}
 	fastlock_release(&tx_ctx->rb_lock);
@@ -2592,17 +2640,35 @@ static void sock_pe_wait(struct sock_pe *pe)
 	pe->waittime = fi_gettime_ms();
 }
 
-static void sock_pe_set_affinity(void)
+/*
+ * The affinity string holds one set of processors per progress engine,
+ * separated by ';'.  Engines beyond the last set wrap around to the first.
+ */
+static void sock_pe_set_affinity(struct sock_pe *pe)
 {
-	char *sock_pe_affinity_str;
+	char *sock_pe_affinity_str, *str, *set, *saveptr;
+	int i, cnt;
+
 	if (fi_param_get_str(&sock_prov, "pe_affinity", &sock_pe_affinity_str) != FI_SUCCESS)
 		return;
 
 	if (sock_pe_affinity_str == NULL)
 		return;
 
-	if (ofi_set_thread_affinity(sock_pe_affinity_str) == -FI_ENOSYS)
+	str = strdup(sock_pe_affinity_str);
+	if (!str)
+		return;
+
+	for (cnt = 0, set = str; (set = strchr(set, ';')); set++)
+		cnt++;
+
+	set = strtok_r(str, ";", &saveptr);
+	for (i = 0; set && i < pe->index % (cnt + 1); i++)
+		set = strtok_r(NULL, ";", &saveptr);
+
+	if (set && ofi_set_thread_affinity(set) == -FI_ENOSYS)
 		SOCK_LOG_ERROR("FI_SOCKETS_PE_AFFINITY is not supported on OS X and Windows\n");
+	free(str);
 }
 
 static void *sock_pe_progress_thread(void *data)
@@ -2613,8 +2679,8 @@ static void *sock_pe_progress_thread(void *data)
 	struct sock_rx_ctx *rx_ctx;
 	struct sock_pe *pe = (struct sock_pe *)data;
 
-	SOCK_LOG_DBG("Progress thread started\n");
-	sock_pe_set_affinity();
+	SOCK_LOG_DBG("Progress thread %d started\n", pe->index);
+	sock_pe_set_affinity(pe);
 	while (*((volatile int *)&pe->do_progress)) {
 		pthread_mutex_lock(&pe->list_lock);
 		if (pe->domain->progress_mode == FI_PROGRESS_AUTO &&
@@ -2658,29 +2724,42 @@ static void *sock_pe_progress_thread(void *data)
 	return NULL;
 }
 
-static void sock_pe_init_table(struct sock_pe *pe)
+static void sock_pe_free_region(struct ofi_bufpool_region *region)
 {
-	int i;
+	struct sock_pe_entry *pe_entry;
+	size_t i;
 
-	memset(&pe->pe_table, 0,
-	       sizeof(struct sock_pe_entry) * SOCK_PE_MAX_ENTRIES);
+	for (i = 0; i < region->pool->attr.chunk_cnt; i++) {
+		pe_entry = (struct sock_pe_entry *)
+			(region->mem_region + i * region->pool->entry_size);
+		if (pe_entry->cache_sz)
+			ofi_rbfree(&pe_entry->comm_buf);
+	}
+}
 
-	dlist_init(&pe->free_list);
-	dlist_init(&pe->busy_list);
-	dlist_init(&pe->pool_list);
+static int sock_pe_init_table(struct sock_pe *pe)
+{
+	struct ofi_bufpool_attr attr = {
+		.size		= sizeof(struct sock_pe_entry),
+		.alignment	= 16,
+		.max_cnt	= SOCK_PE_MAX_ENTRIES,
+		.chunk_cnt	= SOCK_PE_ENTRY_CHUNK_CNT,
+		.free_fn	= sock_pe_free_region,
+		.flags		= OFI_BUFPOOL_INDEXED | OFI_BUFPOOL_NO_TRACK,
+	};
+	int ret;
 
-	for (i = 0; i < SOCK_PE_MAX_ENTRIES; i++) {
-		dlist_insert_head(&pe->pe_table[i].entry, &pe->free_list);
-		pe->pe_table[i].cache_sz = SOCK_PE_COMM_BUFF_SZ;
-		if (ofi_rbinit(&pe->pe_table[i].comm_buf, SOCK_PE_COMM_BUFF_SZ))
-			SOCK_LOG_ERROR("failed to init comm-cache\n");
+	ret = ofi_bufpool_create_attr(&attr, &pe->pe_pool);
+	if (ret) {
+		SOCK_LOG_ERROR("failed to create PE entry pool\n");
+		return ret;
 	}
 
-	pe->num_free_entries = SOCK_PE_MAX_ENTRIES;
 	SOCK_LOG_DBG("PE table init: OK\n");
+	return 0;
 }
 
-struct sock_pe *sock_pe_init(struct sock_domain *domain)
+struct sock_pe *sock_pe_init(struct sock_domain *domain, int index)
 {
 	struct sock_pe *pe;
 	int ret;
@@ -2689,21 +2768,17 @@ struct sock_pe *sock_pe_init(struct sock_domain *domain)
 	if (!pe)
 		return NULL;
 
-	sock_pe_init_table(pe);
 	dlist_init(&pe->tx_list);
 	dlist_init(&pe->rx_list);
 	fastlock_init(&pe->lock);
 	fastlock_init(&pe->signal_lock);
 	pthread_mutex_init(&pe->list_lock, NULL);
 	pe->domain = domain;
+	pe->index = index;
 
-	
-	ret = ofi_bufpool_create(&pe->pe_rx_pool,
-				 sizeof(struct sock_pe_entry), 16, 0, 1024, 0);
-	if (ret) {
-		SOCK_LOG_ERROR("failed to create buffer pool\n");
+	ret = sock_pe_init_table(pe);
+	if (ret)
 		goto err1;
-	}
 
 	ret = ofi_bufpool_create(&pe->atomic_rx_pool,
 				 SOCK_EP_MAX_ATOMIC_SZ, 16, 0, 32, 0);
@@ -2745,33 +2820,15 @@ err4:
 err3:
 	ofi_bufpool_destroy(pe->atomic_rx_pool);
 err2:
-	ofi_bufpool_destroy(pe->pe_rx_pool);
+	ofi_bufpool_destroy(pe->pe_pool);
 err1:
 	fastlock_destroy(&pe->lock);
 	free(pe);
 	return NULL;
 }
 
-static void sock_pe_free_util_pool(struct sock_pe *pe)
-{
-	struct dlist_entry *entry;
-	struct sock_pe_entry *pe_entry;
-
-	while (!dlist_empty(&pe->pool_list)) {
-		entry = pe->pool_list.next;
-		pe_entry = container_of(entry, struct sock_pe_entry, entry);
-		ofi_rbfree(&pe_entry->comm_buf);
-		dlist_remove(&pe_entry->entry);
-		ofi_buf_free(pe_entry);
-	}
-
-	ofi_bufpool_destroy(pe->pe_rx_pool);
-	ofi_bufpool_destroy(pe->atomic_rx_pool);
-}
-
 void sock_pe_finalize(struct sock_pe *pe)
 {
-	int i;
 	if (pe->domain->progress_mode == FI_PROGRESS_AUTO) {
 		pe->do_progress = 0;
 		sock_pe_signal(pe);
@@ -2780,11 +2837,8 @@ void sock_pe_finalize(struct sock_pe *pe)
 		ofi_close_socket(pe->signal_fds[1]);
 	}
 
-	for (i = 0; i < SOCK_PE_MAX_ENTRIES; i++) {
-		ofi_rbfree(&pe->pe_table[i].comm_buf);
-	}
-
-	sock_pe_free_util_pool(pe);
+	ofi_bufpool_destroy(pe->pe_pool);
+	ofi_bufpool_destroy(pe->atomic_rx_pool);
 	fastlock_destroy(&pe->lock);
 	fastlock_destroy(&pe->signal_lock);
 	pthread_mutex_destroy(&pe->list_lock);
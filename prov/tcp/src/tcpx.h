@@ -79,10 +79,20 @@
 
 #define TCPX_PORT_MAX_RANGE	(USHRT_MAX)
 
+#define TCPX_MAX_STREAMS	(16)
+#define TCPX_DEF_STRIPE_THRESHOLD	(1 << 18)
+
+/* ofi_ctrl_hdr::type used to attach a sub-stream to a connected ep */
+#define TCPX_CTRL_STREAM_JOIN	(0x80)
+
+/* tcpx_base_hdr::flags, payload carried on the sub-streams */
+#define TCPX_STRIPED		(1 << 15)
+
 extern struct fi_provider	tcpx_prov;
 extern struct util_prov		tcpx_util_prov;
 extern struct fi_info		tcpx_info;
 extern struct tcpx_port_range	port_range;
+extern struct tcpx_stripe_attr	stripe_attr;
 struct tcpx_xfer_entry;
 struct tcpx_ep;
 
@@ -118,11 +128,17 @@ struct tcpx_port_range {
 	int low;
 };
 
+struct tcpx_stripe_attr {
+	int	streams;
+	size_t	threshold;
+};
+
 struct tcpx_conn_handle {
 	struct fid		handle;
 	struct tcpx_pep		*pep;
 	SOCKET			conn_fd;
 	bool			endian_match;
+	uint32_t		stream_cnt;
 };
 
 struct tcpx_pep {
@@ -178,6 +194,38 @@ struct tcpx_rx_ctx {
 	fastlock_t		lock;
 };
 
+/*
+ * Large payloads are split into one chunk per sub-stream.  Each chunk is
+ * preceded by a tcpx_stripe_hdr (network byte order) that identifies the
+ * striped message by sequence number and places the data by offset.
+ */
+struct tcpx_stripe_hdr {
+	uint64_t		seq;
+	uint64_t		offset;
+	uint64_t		len;
+};
+
+struct tcpx_stripe {
+	struct slist_entry	entry;
+	struct tcpx_stripe_hdr	hdr;
+	struct iovec		iov[TCPX_IOV_LIMIT + 1];
+	size_t			iov_cnt;
+	uint64_t		rem_len;
+	struct tcpx_xfer_entry	*tx_entry;
+};
+
+struct tcpx_stream {
+	struct tcpx_ep		*ep;
+	SOCKET			fd;
+	struct slist		tx_queue;
+	bool			send_ready_monitor;
+	struct tcpx_stripe_hdr	rx_hdr;
+	size_t			rx_hdr_done;
+	struct iovec		rx_iov[TCPX_IOV_LIMIT + 1];
+	size_t			rx_iov_cnt;
+	uint64_t		rx_rem;
+};
+
 typedef int (*tcpx_rx_process_fn_t)(struct tcpx_xfer_entry *rx_entry);
 typedef void (*tcpx_ep_progress_func_t)(struct tcpx_ep *ep);
 typedef int (*tcpx_get_rx_func_t)(struct tcpx_ep *ep);
@@ -210,10 +258,26 @@ struct tcpx_ep {
 	struct stage_buf	stage_buf;
 	size_t			min_multi_recv_size;
 	bool			send_ready_monitor;
+
+	/* parallel sub-connections used to stripe large transfers */
+	struct tcpx_stream	*streams;
+	uint32_t		stream_cnt;
+	uint32_t		stream_ready;
+	uint64_t		stream_key;
+	struct dlist_entry	stream_entry;
+	/* EQ of the listening ep, through which the sub-streams join */
+	struct util_eq		*stream_eq;
+	uint64_t		tx_stripe_seq;
+	uint64_t		rx_stripe_seq;
+	struct ofi_bufpool	*stripe_pool;
 };
 
 struct tcpx_fabric {
 	struct util_fabric	util_fabric;
+	/* accepted eps waiting for their sub-streams, protected by
+	 * util_fabric.lock
+	 */
+	struct dlist_entry	stream_ep_list;
 };
 
 typedef void (*release_func_t)(struct tcpx_xfer_entry *xfer_entry);
@@ -233,6 +297,9 @@ struct tcpx_xfer_entry {
 	uint64_t		rem_len;
 	void			*mrecv_msg_start;
 	release_func_t		rx_msg_release_fn;
+	/* striped transfers: chunks in flight (tx), bytes missing (rx) */
+	uint64_t		stripe_rem;
+	int			stripe_err;
 };
 
 struct tcpx_domain {
@@ -326,4 +393,19 @@ int tcpx_get_rx_entry_op_read_req(struct tcpx_ep *tcpx_ep);
 int tcpx_get_rx_entry_op_write(struct tcpx_ep *tcpx_ep);
 int tcpx_get_rx_entry_op_read_rsp(struct tcpx_ep *tcpx_ep);
 
+int tcpx_stream_init(struct tcpx_ep *ep, uint32_t stream_cnt);
+void tcpx_stream_cleanup(struct tcpx_ep *ep);
+int tcpx_stream_accept(struct tcpx_ep *ep, uint32_t stream_cnt,
+		       struct util_eq *eq);
+void tcpx_stream_join_progress(struct tcpx_ep *ep);
+int tcpx_stream_connect(struct tcpx_ep *ep, uint64_t key);
+int tcpx_stream_join(struct tcpx_fabric *fabric, SOCKET sock,
+		     struct ofi_ctrl_hdr *hdr);
+int tcpx_stream_wait_add(struct tcpx_ep *ep);
+void tcpx_stream_progress(struct tcpx_ep *ep);
+void tcpx_stream_shutdown(struct tcpx_ep *ep);
+bool tcpx_stripe_tx(struct tcpx_ep *ep, struct tcpx_xfer_entry *tx_entry);
+void tcpx_stripe_cancel(struct tcpx_ep *ep, struct tcpx_xfer_entry *tx_entry);
+int tcpx_recv_stripe_data(struct tcpx_xfer_entry *rx_entry);
+
 #endif //_TCP_H_
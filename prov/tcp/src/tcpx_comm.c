@@ -68,7 +68,7 @@ static ssize_t tcpx_read_from_buffer(struct stage_buf *sbuf,
 	rem_size = sbuf->len - sbuf->off;
 	assert(rem_size);
 	ret = (rem_size >= len)? len : rem_size;
-	memcpy(buf, &sbuf->buf[sbuf->off], ret);
+	ofi_memcpy(buf, &sbuf->buf[sbuf->off], ret);
 	sbuf->off += ret;
 	return ret;
 }
@@ -154,6 +154,9 @@ int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
 {
 	ssize_t bytes_recvd;
 
+	if (rx_entry->hdr.base_hdr.flags & TCPX_STRIPED)
+		return tcpx_recv_stripe_data(rx_entry);
+
 	if (rx_entry->ep->stage_buf.len != rx_entry->ep->stage_buf.off) {
 		bytes_recvd = tcpx_readv_from_buffer(&rx_entry->ep->stage_buf,
 						     rx_entry->iov,
@@ -62,7 +62,7 @@ static int read_cm_data(SOCKET fd, struct tcpx_cm_context *cm_ctx,
 }
 
 static int rx_cm_data(SOCKET fd, struct ofi_ctrl_hdr *hdr,
-		      int type, struct tcpx_cm_context *cm_ctx)
+		      struct tcpx_cm_context *cm_ctx)
 {
 	ssize_t ret;
 
@@ -74,14 +74,15 @@ static int rx_cm_data(SOCKET fd, struct ofi_ctrl_hdr *hdr,
 	if (hdr->version != TCPX_CTRL_HDR_VERSION)
 		return -FI_ENOPROTOOPT;
 
-	ret = read_cm_data(fd, cm_ctx, hdr);
-	if (hdr->type != type) {
-		ret = -FI_ECONNREFUSED;
-	}
-	return ret;
+	return read_cm_data(fd, cm_ctx, hdr);
 }
 
-static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
+/* seg_no carries the number of sub-streams requested (connreq) or
+ * granted (connresp), conn_id the key used by the sub-streams to find
+ * the accepted ep.  Peers that do not stripe leave both zero.
+ */
+static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx,
+		      uint32_t stream_cnt, uint64_t stream_key)
 {
 	struct ofi_ctrl_hdr hdr;
 	ssize_t ret;
@@ -90,6 +91,8 @@ static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 	hdr.version = TCPX_CTRL_HDR_VERSION;
 	hdr.type = type;
 	hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
+	hdr.seg_no = htonl(stream_cnt);
+	hdr.conn_id = htonll(stream_key);
 	hdr.conn_data = 1; /* For testing endianess mismatch at peer */
 
 	ret = ofi_send_socket(fd, &hdr, sizeof(hdr), MSG_NOSIGNAL);
@@ -132,12 +135,16 @@ static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
 	struct ofi_ctrl_hdr conn_resp;
 	struct fi_eq_cm_entry *cm_entry;
 	ssize_t len;
+	uint32_t stream_cnt;
 	int ret = FI_SUCCESS;
 
-	ret = rx_cm_data(ep->conn_fd, &conn_resp, ofi_ctrl_connresp, cm_ctx);
+	ret = rx_cm_data(ep->conn_fd, &conn_resp, cm_ctx);
 	if (ret)
 		return ret;
 
+	if (conn_resp.type != ofi_ctrl_connresp)
+		return -FI_ECONNREFUSED;
+
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
 		return -FI_ENOMEM;
@@ -148,6 +155,22 @@ static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
 	ep->hdr_bswap = (conn_resp.conn_data == 1)?
 		tcpx_hdr_none:tcpx_hdr_bswap;
 
+	stream_cnt = ntohl(conn_resp.seg_no);
+	if (stream_cnt) {
+		if (stream_cnt > (uint32_t) stripe_attr.streams) {
+			ret = -FI_ENOPROTOOPT;
+			goto err;
+		}
+
+		ret = tcpx_stream_init(ep, stream_cnt);
+		if (ret)
+			goto err;
+
+		ret = tcpx_stream_connect(ep, ntohll(conn_resp.conn_id));
+		if (ret)
+			goto err;
+	}
+
 	ret = tcpx_ep_msg_xfer_enable(ep);
 	if (ret)
 		goto err;
@@ -226,7 +249,8 @@ static void server_send_cm_accept(struct util_wait *wait,
 	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
 	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
 
-	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connresp, cm_ctx);
+	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connresp, cm_ctx,
+			 ep->stream_cnt, ep->stream_key);
 	if (ret)
 		goto err;
 
@@ -262,6 +286,29 @@ err:
 		    &err_entry, sizeof(err_entry), UTIL_FLAG_ERROR);
 }
 
+static void server_recv_stream_join(struct util_wait *wait,
+				    struct tcpx_cm_context *cm_ctx,
+				    struct tcpx_conn_handle *handle,
+				    struct ofi_ctrl_hdr *hdr)
+{
+	struct tcpx_fabric *fabric;
+	int ret;
+
+	ret = ofi_wait_fd_del(wait, handle->conn_fd);
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"fd deletion from ofi_wait failed\n");
+
+	fabric = container_of(handle->pep->util_pep.fabric,
+			      struct tcpx_fabric, util_fabric);
+	ret = tcpx_stream_join(fabric, handle->conn_fd, hdr);
+	if (ret)
+		ofi_close_socket(handle->conn_fd);
+
+	free(cm_ctx);
+	free(handle);
+}
+
 static void server_recv_connreq(struct util_wait *wait,
 				struct tcpx_cm_context *cm_ctx)
 {
@@ -277,10 +324,18 @@ static void server_recv_connreq(struct util_wait *wait,
 			       struct tcpx_conn_handle,
 			       handle);
 
-	ret = rx_cm_data(handle->conn_fd, &conn_req, ofi_ctrl_connreq, cm_ctx);
+	ret = rx_cm_data(handle->conn_fd, &conn_req, cm_ctx);
 	if (ret)
 		goto err1;
 
+	if (conn_req.type == TCPX_CTRL_STREAM_JOIN) {
+		server_recv_stream_join(wait, cm_ctx, handle, &conn_req);
+		return;
+	}
+
+	if (conn_req.type != ofi_ctrl_connreq)
+		goto err1;
+
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
 		goto err1;
@@ -300,6 +355,8 @@ static void server_recv_connreq(struct util_wait *wait,
 		goto err3;
 
 	handle->endian_match = (conn_req.conn_data == 1);
+	handle->stream_cnt = MIN(ntohl(conn_req.seg_no),
+				 (uint32_t) stripe_attr.streams);
 	cm_entry->info->handle = &handle->handle;
 	memcpy(cm_entry->data, cm_ctx->cm_data, cm_ctx->cm_data_sz);
 
@@ -348,7 +405,8 @@ static void client_send_connreq(struct util_wait *wait,
 		goto err;
 	}
 
-	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connreq, cm_ctx);
+	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connreq, cm_ctx,
+			 (uint32_t) stripe_attr.streams, 0);
 	if (ret)
 		goto err;
 
@@ -191,6 +191,7 @@ static int tcpx_ep_shutdown(struct fid_ep *ep, uint64_t flags)
 	}
 
 	fastlock_acquire(&tcpx_ep->lock);
+	tcpx_stream_shutdown(tcpx_ep);
 	ret = tcpx_ep_shutdown_report(tcpx_ep, &ep->fid);
 	fastlock_release(&tcpx_ep->lock);
 	if (ret) {
@@ -413,6 +414,8 @@ static int tcpx_ep_close(struct fid *fid)
 
 	if (ep->util_ep.eq->wait)
 		ofi_wait_fd_del(ep->util_ep.eq->wait, ep->conn_fd);
+
+	tcpx_stream_cleanup(ep);
 	fastlock_release(&eq->close_lock);
 	ofi_eq_remove_fid_events(ep->util_ep.eq,
 				  &ep->util_ep.ep_fid.fid);
@@ -537,12 +540,16 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	struct tcpx_ep *ep;
 	struct tcpx_pep *pep;
 	struct tcpx_conn_handle *handle;
+	struct util_eq *stream_eq = NULL;
+	uint32_t stream_cnt = 0;
 	int ret;
 
 	ep = calloc(1, sizeof(*ep));
 	if (!ep)
 		return -FI_ENOMEM;
 
+	dlist_init(&ep->stream_entry);
+
 	ret = ofi_endpoint_init(domain, &tcpx_util_prov, info, &ep->util_ep,
 				context, tcpx_progress);
 	if (ret)
@@ -561,6 +568,8 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 			ep->conn_fd = handle->conn_fd;
 			ep->hdr_bswap = handle->endian_match ?
 					tcpx_hdr_none : tcpx_hdr_bswap;
+			stream_cnt = handle->stream_cnt;
+			stream_eq = handle->pep->util_pep.eq;
 			free(handle);
 
 			ret = tcpx_setup_socket(ep->conn_fd);
@@ -585,6 +594,12 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (ret)
 		goto err3;
 
+	if (stream_cnt) {
+		ret = tcpx_stream_accept(ep, stream_cnt, stream_eq);
+		if (ret)
+			goto err4;
+	}
+
 	ep->stage_buf.size = STAGE_BUF_SIZE;
 	ep->stage_buf.len = 0;
 	ep->stage_buf.off = 0;
@@ -611,6 +626,8 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ep->get_rx_entry[ofi_op_read_rsp] = tcpx_get_rx_entry_op_read_rsp;
 	ep->get_rx_entry[ofi_op_write] =tcpx_get_rx_entry_op_write;
 	return 0;
+err4:
+	fastlock_destroy(&ep->lock);
 err3:
 	ofi_close_socket(ep->conn_fd);
 err2:
@@ -91,6 +91,7 @@ int tcpx_create_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 		return ret;
 	}
 
+	dlist_init(&tcpx_fabric->stream_ep_list);
 	*fabric = &tcpx_fabric->util_fabric.fabric_fid;
 	(*fabric)->fid.ops = &tcpx_fabric_fi_ops;
 	(*fabric)->ops = &tcpx_fabric_ops;
@@ -139,6 +139,21 @@ static int tcpx_init_env(void)
 		port_range.low  = 0;
 		port_range.high = 0;
 	}
+
+	fi_param_get_int(&tcpx_prov, "streams", &stripe_attr.streams);
+	fi_param_get_size_t(&tcpx_prov, "stripe_threshold",
+			    &stripe_attr.threshold);
+
+	if (stripe_attr.streams < 0 ||
+	    stripe_attr.streams > TCPX_MAX_STREAMS) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "User provided "
+			"stream count invalid. Limiting to %d\n",
+			TCPX_MAX_STREAMS);
+		stripe_attr.streams = stripe_attr.streams < 0 ?
+				      0 : TCPX_MAX_STREAMS;
+	}
+	if (!stripe_attr.threshold)
+		stripe_attr.threshold = TCPX_DEF_STRIPE_THRESHOLD;
 	return 0;
 }
 
@@ -170,6 +185,14 @@ TCP_INI
 	fi_param_define(&tcpx_prov,"port_high_range", FI_PARAM_INT,
 			"define port high range");
 
+	fi_param_define(&tcpx_prov, "streams", FI_PARAM_INT,
+			"number of additional connections opened to each "
+			"peer and used to stripe large transfers (default: 0)");
+
+	fi_param_define(&tcpx_prov, "stripe_threshold", FI_PARAM_SIZE_T,
+			"transfers of at least this many bytes are striped "
+			"across the additional connections (default: 256k)");
+
 	if (tcpx_init_env()) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,"Invalid info\n");
 		return NULL;
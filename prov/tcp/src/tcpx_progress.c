@@ -96,10 +96,21 @@ static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
 	struct tcpx_cq *tcpx_cq;
 	int ret;
 
-	ret = tcpx_send_msg(tx_entry);
+	ret = tx_entry->rem_len ? tcpx_send_msg(tx_entry) : FI_SUCCESS;
 	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
 		return;
 
+	/* A striped transfer holds the head of the queue until all of its
+	 * chunks are out, which keeps completions in order.
+	 */
+	if (tx_entry->stripe_rem) {
+		if (!ret)
+			return;
+		tcpx_stripe_cancel(tx_entry->ep, tx_entry);
+	}
+	if (!ret)
+		ret = tx_entry->stripe_err;
+
 	/* Keep this path below as a single pass path.*/
 	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	slist_remove_head(&tx_entry->ep->tx_queue);
@@ -437,6 +448,10 @@ int tcpx_get_rx_entry_op_msg(struct tcpx_ep *tcpx_ep)
 	msg_len = (tcpx_ep->rx_detect.hdr.base_hdr.size -
 		   tcpx_ep->rx_detect.hdr.base_hdr.payload_off);
 
+	if ((rx_detect->hdr.base_hdr.flags & TCPX_STRIPED) &&
+	    !tcpx_ep->stream_cnt)
+		return -FI_EIO;
+
 	if (tcpx_ep->srx_ctx){
 		rx_entry = tcpx_srx_next_xfer_entry(tcpx_ep->srx_ctx,
 						    tcpx_ep, msg_len);
@@ -486,6 +501,11 @@ int tcpx_get_rx_entry_op_msg(struct tcpx_ep *tcpx_ep)
 	if (rx_detect->hdr.base_hdr.flags & OFI_REMOTE_CQ_DATA)
 		rx_entry->flags |= FI_REMOTE_CQ_DATA;
 
+	if (rx_detect->hdr.base_hdr.flags & TCPX_STRIPED) {
+		rx_entry->stripe_rem = msg_len;
+		tcpx_ep->rx_stripe_seq++;
+	}
+
 	tcpx_rx_detect_init(rx_detect);
 	tcpx_ep->cur_rx_entry = rx_entry;
 	return FI_SUCCESS;
@@ -562,6 +582,15 @@ int tcpx_get_rx_entry_op_write(struct tcpx_ep *tcpx_ep)
 		return ret;
 	}
 
+	if (rx_entry->hdr.base_hdr.flags & TCPX_STRIPED) {
+		if (!tcpx_ep->stream_cnt) {
+			tcpx_xfer_entry_release(tcpx_cq, rx_entry);
+			return -FI_EIO;
+		}
+		rx_entry->stripe_rem = rx_entry->rem_len;
+		tcpx_ep->rx_stripe_seq++;
+	}
+
 	tcpx_copy_rma_iov_to_msg_iov(rx_entry);
 	tcpx_rx_detect_init(&tcpx_ep->rx_detect);
 	tcpx_ep->cur_rx_entry = rx_entry;
@@ -635,7 +664,9 @@ static void tcpx_process_rx_msg(struct tcpx_ep *ep)
 				goto err;
 		}
 		assert(ep->cur_rx_proc_fn != NULL);
-		ep->cur_rx_proc_fn(ep->cur_rx_entry);
+		ret = ep->cur_rx_proc_fn(ep->cur_rx_entry);
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			break;
 
 	} while (ep->stage_buf.len != ep->stage_buf.off);
 
@@ -665,6 +696,13 @@ static void process_tx_queue(struct tcpx_ep *ep)
 
 void tcpx_ep_progress(struct tcpx_ep *ep)
 {
+	/* Retire a striped transfer whose last chunk just went out before
+	 * looking for the peer's delivery response.
+	 */
+	if (ep->stream_ready) {
+		tcpx_stream_progress(ep);
+		process_tx_queue(ep);
+	}
 	tcpx_process_rx_msg(ep);
 	process_tx_queue(ep);
 }
@@ -674,6 +712,14 @@ void tcpx_progress(struct util_ep *util_ep)
 	struct tcpx_ep *ep;
 
 	ep = container_of(util_ep, struct tcpx_ep, util_ep);
+
+	/* Sub-stream joins are delivered through the listening ep; keep
+	 * its connection manager moving until all have arrived so that the
+	 * application does not need to keep reading the listener's EQ.
+	 */
+	if (!dlist_empty(&ep->stream_entry))
+		tcpx_stream_join_progress(ep);
+
 	fastlock_acquire(&ep->lock);
 	ep->progress_func(ep);
 	fastlock_release(&ep->lock);
@@ -685,6 +731,7 @@ static int tcpx_try_func(void *util_ep)
 	uint32_t events;
 	struct util_wait_fd *wait_fd;
 	struct tcpx_ep *ep;
+	bool tx_pending;
 	int ret;
 
 	ep = container_of(util_ep, struct tcpx_ep, util_ep);
@@ -692,11 +739,14 @@ static int tcpx_try_func(void *util_ep)
 			       struct util_wait_fd, util_wait);
 
 	fastlock_acquire(&ep->lock);
-	if (!slist_empty(&ep->tx_queue) && !ep->send_ready_monitor) {
+	tx_pending = !slist_empty(&ep->tx_queue) &&
+		     container_of(ep->tx_queue.head, struct tcpx_xfer_entry,
+				  entry)->rem_len;
+	if (tx_pending && !ep->send_ready_monitor) {
 		ep->send_ready_monitor = true;
 		events = FI_EPOLL_IN | FI_EPOLL_OUT;
 		goto epoll_mod;
-	} else if (slist_empty(&ep->tx_queue) && ep->send_ready_monitor) {
+	} else if (!tx_pending && ep->send_ready_monitor) {
 		ep->send_ready_monitor = false;
 		events = FI_EPOLL_IN;
 		goto epoll_mod;
@@ -715,13 +765,19 @@ epoll_mod:
 
 int tcpx_cq_wait_ep_add(struct tcpx_ep *ep)
 {
+	int ret;
+
 	if (!ep->util_ep.rx_cq->wait)
 		return FI_SUCCESS;
 
-	return ofi_wait_fd_add(ep->util_ep.rx_cq->wait,
-			       ep->conn_fd, FI_EPOLL_IN,
-			       tcpx_try_func, (void *)&ep->util_ep,
-			       NULL);
+	ret = ofi_wait_fd_add(ep->util_ep.rx_cq->wait,
+			      ep->conn_fd, FI_EPOLL_IN,
+			      tcpx_try_func, (void *)&ep->util_ep,
+			      NULL);
+	if (ret)
+		return ret;
+
+	return tcpx_stream_wait_add(ep);
 }
 
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
@@ -730,6 +786,11 @@ void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 	int empty;
 	struct util_wait *wait = tcpx_ep->util_ep.tx_cq->wait;
 
+	tx_entry->stripe_rem = 0;
+	tx_entry->stripe_err = 0;
+	if (tcpx_stripe_tx(tcpx_ep, tx_entry))
+		tcpx_stream_progress(tcpx_ep);
+
 	empty = slist_empty(&tcpx_ep->tx_queue);
 	slist_insert_tail(&tx_entry->entry, &tcpx_ep->tx_queue);
 
@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2019 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <rdma/fi_errno.h>
+#include <ofi_prov.h>
+#include <sys/types.h>
+#include <netinet/tcp.h>
+#include <ofi_util.h>
+#include <ofi_iov.h>
+#include "tcpx.h"
+
+struct tcpx_stripe_attr stripe_attr = {
+	.streams = 0,
+	.threshold = TCPX_DEF_STRIPE_THRESHOLD,
+};
+
+static void tcpx_stripe_iov(struct iovec *dst, size_t *dst_cnt,
+			    const struct iovec *src, size_t src_cnt,
+			    size_t offset, size_t len)
+{
+	memcpy(dst, src, src_cnt * sizeof(*src));
+	*dst_cnt = src_cnt;
+	if (offset)
+		ofi_consume_iov(dst, dst_cnt, offset);
+	(void) ofi_truncate_iov(dst, dst_cnt, len);
+}
+
+static int tcpx_stream_setup(SOCKET sock)
+{
+	int ret, optval = 1;
+
+	ret = setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *) &optval,
+			 sizeof(optval));
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"setsockopt nodelay failed\n");
+		return -ofi_sockerr();
+	}
+
+	return fi_fd_nonblock(sock);
+}
+
+int tcpx_stream_init(struct tcpx_ep *ep, uint32_t stream_cnt)
+{
+	uint32_t i;
+	int ret;
+
+	ep->streams = calloc(stream_cnt, sizeof(*ep->streams));
+	if (!ep->streams)
+		return -FI_ENOMEM;
+
+	ret = ofi_bufpool_create(&ep->stripe_pool, sizeof(struct tcpx_stripe),
+				 16, 0, 64, 0);
+	if (ret) {
+		free(ep->streams);
+		ep->streams = NULL;
+		return ret;
+	}
+
+	for (i = 0; i < stream_cnt; i++) {
+		ep->streams[i].ep = ep;
+		ep->streams[i].fd = INVALID_SOCKET;
+		slist_init(&ep->streams[i].tx_queue);
+	}
+	ep->stream_cnt = stream_cnt;
+	ep->stream_ready = 0;
+	return FI_SUCCESS;
+}
+
+static void tcpx_stream_close(struct tcpx_stream *stream)
+{
+	struct util_cq *cq = stream->ep->util_ep.rx_cq;
+
+	if (cq && cq->wait)
+		ofi_wait_fd_del(cq->wait, stream->fd);
+	ofi_close_socket(stream->fd);
+	stream->fd = INVALID_SOCKET;
+	stream->ep->stream_ready--;
+}
+
+/* Caller holds the fabric lock */
+static void tcpx_stream_put_eq(struct tcpx_ep *ep)
+{
+	if (ep->stream_eq) {
+		ofi_atomic_dec32(&ep->stream_eq->ref);
+		ep->stream_eq = NULL;
+	}
+}
+
+void tcpx_stream_cleanup(struct tcpx_ep *ep)
+{
+	struct tcpx_fabric *fabric;
+	struct tcpx_stream *stream;
+	struct tcpx_stripe *stripe;
+	uint32_t i;
+
+	if (!ep->streams)
+		return;
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	dlist_remove_init(&ep->stream_entry);
+	tcpx_stream_put_eq(ep);
+	fastlock_release(&fabric->util_fabric.lock);
+
+	for (i = 0; i < ep->stream_cnt; i++) {
+		stream = &ep->streams[i];
+		while (!slist_empty(&stream->tx_queue)) {
+			stripe = container_of(slist_remove_head(&stream->tx_queue),
+					      struct tcpx_stripe, entry);
+			ofi_buf_free(stripe);
+		}
+
+		if (stream->fd != INVALID_SOCKET)
+			tcpx_stream_close(stream);
+	}
+
+	ofi_bufpool_destroy(ep->stripe_pool);
+	free(ep->streams);
+	ep->streams = NULL;
+	ep->stream_cnt = 0;
+	ep->stream_ready = 0;
+}
+
+/* Passive side: publish the ep so that the peer's sub-streams can find
+ * it through the key returned in the connection response.  The key is
+ * random, so that it cannot be guessed from the keys of other eps.  The
+ * listener's EQ is held until all sub-streams have joined through it.
+ */
+int tcpx_stream_accept(struct tcpx_ep *ep, uint32_t stream_cnt,
+		       struct util_eq *eq)
+{
+	struct tcpx_fabric *fabric;
+	uint64_t key;
+	int ret;
+
+	ret = ofi_getrandom(&key, sizeof(key));
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to generate sub-stream key\n");
+		return ret;
+	}
+
+	ret = tcpx_stream_init(ep, stream_cnt);
+	if (ret)
+		return ret;
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	ep->stream_key = key;
+	ep->stream_eq = eq;
+	ofi_atomic_inc32(&eq->ref);
+	dlist_insert_tail(&ep->stream_entry, &fabric->stream_ep_list);
+	fastlock_release(&fabric->util_fabric.lock);
+	return FI_SUCCESS;
+}
+
+/* Runs the listener's connection manager while sub-streams are missing */
+void tcpx_stream_join_progress(struct tcpx_ep *ep)
+{
+	struct tcpx_fabric *fabric;
+	struct util_eq *eq;
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct tcpx_fabric,
+			      util_fabric);
+	fastlock_acquire(&fabric->util_fabric.lock);
+	eq = ep->stream_eq;
+	if (eq)
+		ofi_atomic_inc32(&eq->ref);
+	fastlock_release(&fabric->util_fabric.lock);
+	if (!eq)
+		return;
+
+	tcpx_conn_mgr_run(eq);
+	ofi_atomic_dec32(&eq->ref);
+}
+
+void tcpx_stream_shutdown(struct tcpx_ep *ep)
+{
+	uint32_t i;
+
+	for (i = 0; i < ep->stream_cnt; i++) {
+		if (ep->streams[i].fd != INVALID_SOCKET)
+			ofi_shutdown(ep->streams[i].fd, SHUT_RDWR);
+	}
+}
+
+/* Called by the active side once the peer has granted sub-streams.  The
+ * peer's listening socket completes the TCP handshake without help from
+ * its progress engine, so connecting synchronously here is safe.
+ */
+int tcpx_stream_connect(struct tcpx_ep *ep, uint64_t key)
+{
+	struct ofi_ctrl_hdr hdr;
+	union ofi_sock_ip addr;
+	socklen_t len = sizeof(addr);
+	SOCKET sock;
+	uint32_t i;
+	ssize_t ret;
+
+	ret = ofi_getpeername(ep->conn_fd, &addr.sa, &len);
+	if (ret)
+		return -ofi_sockerr();
+
+	for (i = 0; i < ep->stream_cnt; i++) {
+		sock = ofi_socket(addr.sa.sa_family, SOCK_STREAM, 0);
+		if (sock == INVALID_SOCKET)
+			return -ofi_sockerr();
+
+		ret = connect(sock, &addr.sa, len);
+		if (ret) {
+			ret = -ofi_sockerr();
+			goto err;
+		}
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.version = TCPX_CTRL_HDR_VERSION;
+		hdr.type = TCPX_CTRL_STREAM_JOIN;
+		hdr.seg_no = htonl(i);
+		hdr.conn_id = htonll(key);
+		hdr.conn_data = 1;
+
+		ret = ofi_send_socket(sock, &hdr, sizeof(hdr), MSG_NOSIGNAL);
+		if (ret != sizeof(hdr)) {
+			ret = -FI_EIO;
+			goto err;
+		}
+
+		ret = tcpx_stream_setup(sock);
+		if (ret)
+			goto err;
+
+		ep->streams[i].fd = sock;
+		ep->stream_ready++;
+	}
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "connected %u sub-streams\n",
+	       ep->stream_cnt);
+	return FI_SUCCESS;
+err:
+	FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+		"sub-stream %u connect failed\n", i);
+	ofi_close_socket(sock);
+	return (int) ret;
+}
+
+static int tcpx_stream_try_func(void *arg)
+{
+	struct tcpx_stream *stream = arg;
+	struct util_wait_fd *wait_fd;
+	uint32_t events;
+	int ret;
+
+	wait_fd = container_of(stream->ep->util_ep.rx_cq->wait,
+			       struct util_wait_fd, util_wait);
+
+	fastlock_acquire(&stream->ep->lock);
+	if (!slist_empty(&stream->tx_queue) && !stream->send_ready_monitor) {
+		stream->send_ready_monitor = true;
+		events = FI_EPOLL_IN | FI_EPOLL_OUT;
+	} else if (slist_empty(&stream->tx_queue) &&
+		   stream->send_ready_monitor) {
+		stream->send_ready_monitor = false;
+		events = FI_EPOLL_IN;
+	} else {
+		fastlock_release(&stream->ep->lock);
+		return FI_SUCCESS;
+	}
+
+	ret = fi_epoll_mod(wait_fd->epoll_fd, stream->fd, events, NULL);
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"failed to update sub-stream events\n");
+	fastlock_release(&stream->ep->lock);
+	return ret;
+}
+
+static int tcpx_stream_wait_add_one(struct tcpx_stream *stream)
+{
+	struct util_cq *cq = stream->ep->util_ep.rx_cq;
+
+	if (!cq || !cq->wait)
+		return FI_SUCCESS;
+
+	return ofi_wait_fd_add(cq->wait, stream->fd, FI_EPOLL_IN,
+			       tcpx_stream_try_func, stream, NULL);
+}
+
+int tcpx_stream_wait_add(struct tcpx_ep *ep)
+{
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < ep->stream_cnt; i++) {
+		if (ep->streams[i].fd == INVALID_SOCKET)
+			continue;
+
+		ret = tcpx_stream_wait_add_one(&ep->streams[i]);
+		if (ret)
+			return ret;
+	}
+	return FI_SUCCESS;
+}
+
+/* The sub-streams must come from the host at the other end of the
+ * primary connection.
+ */
+static bool tcpx_stream_peer_match(struct tcpx_ep *ep, SOCKET sock)
+{
+	union ofi_sock_ip peer, addr;
+	socklen_t len;
+
+	len = sizeof(peer);
+	if (ofi_getpeername(ep->conn_fd, &peer.sa, &len))
+		return false;
+
+	len = sizeof(addr);
+	if (ofi_getpeername(sock, &addr.sa, &len))
+		return false;
+
+	return ofi_equals_ipaddr(&peer.sa, &addr.sa);
+}
+
+/* Passive side: attach an incoming sub-stream to the accepted ep that
+ * advertised the key carried in the join header.
+ */
+int tcpx_stream_join(struct tcpx_fabric *fabric, SOCKET sock,
+		     struct ofi_ctrl_hdr *hdr)
+{
+	struct tcpx_ep *ep;
+	uint64_t key = ntohll(hdr->conn_id);
+	uint32_t idx = ntohl(hdr->seg_no);
+	int ret = -FI_ENOENT;
+
+	fastlock_acquire(&fabric->util_fabric.lock);
+	dlist_foreach_container(&fabric->stream_ep_list, struct tcpx_ep,
+				ep, stream_entry) {
+		if (ep->stream_key != key)
+			continue;
+
+		fastlock_acquire(&ep->lock);
+		if (idx >= ep->stream_cnt ||
+		    ep->streams[idx].fd != INVALID_SOCKET ||
+		    !tcpx_stream_peer_match(ep, sock)) {
+			ret = -FI_EINVAL;
+			goto unlock;
+		}
+
+		ret = tcpx_stream_setup(sock);
+		if (ret)
+			goto unlock;
+
+		ep->streams[idx].fd = sock;
+		ret = tcpx_stream_wait_add_one(&ep->streams[idx]);
+		if (ret) {
+			ep->streams[idx].fd = INVALID_SOCKET;
+			goto unlock;
+		}
+
+		if (++ep->stream_ready == ep->stream_cnt) {
+			dlist_remove_init(&ep->stream_entry);
+			tcpx_stream_put_eq(ep);
+			FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL,
+			       "all %u sub-streams joined\n", ep->stream_cnt);
+		}
+unlock:
+		fastlock_release(&ep->lock);
+		break;
+	}
+	fastlock_release(&fabric->util_fabric.lock);
+
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to join sub-stream %u: %d\n", idx, ret);
+	return ret;
+}
+
+static void tcpx_stripe_free(struct tcpx_stripe *stripe, int err)
+{
+	struct tcpx_xfer_entry *tx_entry = stripe->tx_entry;
+
+	if (err && !tx_entry->stripe_err)
+		tx_entry->stripe_err = err;
+	tx_entry->stripe_rem--;
+	ofi_buf_free(stripe);
+}
+
+/* Caller holds ep->lock.  Returns true if the payload of tx_entry was
+ * queued on the sub-streams, in which case only the header remains to be
+ * sent on the primary connection.  Transfers are never split unless all
+ * sub-streams are up, so the peer always has somewhere to receive them.
+ */
+bool tcpx_stripe_tx(struct tcpx_ep *ep, struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_stripe *stripe[TCPX_MAX_STREAMS];
+	struct tcpx_base_hdr *hdr = &tx_entry->hdr.base_hdr;
+	uint64_t payload, chunk, offset;
+	uint32_t i, cnt;
+
+	if (!ep->stream_cnt || ep->stream_ready != ep->stream_cnt ||
+	    !(tx_entry->flags & (FI_SEND | FI_WRITE)) ||
+	    tx_entry->iov_cnt < 2)
+		return false;
+
+	payload = tx_entry->rem_len - tx_entry->iov[0].iov_len;
+	if (payload < stripe_attr.threshold)
+		return false;
+
+	chunk = (payload + ep->stream_cnt - 1) / ep->stream_cnt;
+	cnt = (uint32_t) ((payload + chunk - 1) / chunk);
+	for (i = 0; i < cnt; i++) {
+		stripe[i] = ofi_buf_alloc(ep->stripe_pool);
+		if (!stripe[i]) {
+			while (i--)
+				ofi_buf_free(stripe[i]);
+			return false;
+		}
+	}
+
+	ep->tx_stripe_seq++;
+	for (i = 0, offset = 0; i < cnt; i++, offset += chunk) {
+		stripe[i]->tx_entry = tx_entry;
+		stripe[i]->hdr.seq = htonll(ep->tx_stripe_seq);
+		stripe[i]->hdr.offset = htonll(offset);
+		stripe[i]->hdr.len = htonll(MIN(chunk, payload - offset));
+		stripe[i]->iov[0].iov_base = &stripe[i]->hdr;
+		stripe[i]->iov[0].iov_len = sizeof(stripe[i]->hdr);
+		tcpx_stripe_iov(&stripe[i]->iov[1], &stripe[i]->iov_cnt,
+				&tx_entry->iov[1], tx_entry->iov_cnt - 1,
+				offset, MIN(chunk, payload - offset));
+		stripe[i]->iov_cnt++;
+		stripe[i]->rem_len = sizeof(stripe[i]->hdr) +
+				     MIN(chunk, payload - offset);
+		slist_insert_tail(&stripe[i]->entry,
+				  &ep->streams[i].tx_queue);
+	}
+
+	/* the header was already converted to wire order by the caller */
+	ep->hdr_bswap(hdr);
+	hdr->flags |= TCPX_STRIPED;
+	ep->hdr_bswap(hdr);
+
+	tx_entry->stripe_rem = cnt;
+	tx_entry->iov_cnt = 1;
+	tx_entry->rem_len = tx_entry->iov[0].iov_len;
+	return true;
+}
+
+void tcpx_stripe_cancel(struct tcpx_ep *ep, struct tcpx_xfer_entry *tx_entry)
+{
+	struct slist_entry *entry, *prev;
+	struct tcpx_stripe *stripe;
+	uint32_t i;
+
+	for (i = 0; i < ep->stream_cnt && tx_entry->stripe_rem; i++) {
+		slist_foreach(&ep->streams[i].tx_queue, entry, prev) {
+			stripe = container_of(entry, struct tcpx_stripe, entry);
+			if (stripe->tx_entry != tx_entry)
+				continue;
+
+			slist_remove(&ep->streams[i].tx_queue, entry, prev);
+			tcpx_stripe_free(stripe, -FI_ECANCELED);
+			break;
+		}
+	}
+}
+
+static int tcpx_stream_send(struct tcpx_stream *stream)
+{
+	struct tcpx_stripe *stripe;
+	struct msghdr msg = {0};
+	ssize_t bytes_sent;
+
+	while (!slist_empty(&stream->tx_queue)) {
+		stripe = container_of(stream->tx_queue.head,
+				      struct tcpx_stripe, entry);
+
+		msg.msg_iov = stripe->iov;
+		msg.msg_iovlen = stripe->iov_cnt;
+		bytes_sent = ofi_sendmsg_tcp(stream->fd, &msg, MSG_NOSIGNAL);
+		if (bytes_sent < 0)
+			return ofi_sockerr() == EPIPE ?
+			       -FI_ENOTCONN : -ofi_sockerr();
+
+		stripe->rem_len -= bytes_sent;
+		if (stripe->rem_len) {
+			ofi_consume_iov(stripe->iov, &stripe->iov_cnt,
+					bytes_sent);
+			return -FI_EAGAIN;
+		}
+
+		slist_remove_head(&stream->tx_queue);
+		tcpx_stripe_free(stripe, 0);
+	}
+	return FI_SUCCESS;
+}
+
+static int tcpx_stream_recv(struct tcpx_stream *stream)
+{
+	struct tcpx_ep *ep = stream->ep;
+	struct tcpx_xfer_entry *rx_entry;
+	uint64_t payload;
+	ssize_t ret;
+
+	for (;;) {
+		if (stream->rx_hdr_done < sizeof(stream->rx_hdr)) {
+			ret = ofi_recv_socket(stream->fd,
+					      (uint8_t *) &stream->rx_hdr +
+					      stream->rx_hdr_done,
+					      sizeof(stream->rx_hdr) -
+					      stream->rx_hdr_done, 0);
+			if (ret <= 0)
+				return ret ? -ofi_sockerr() : -FI_ENOTCONN;
+
+			stream->rx_hdr_done += ret;
+			if (stream->rx_hdr_done < sizeof(stream->rx_hdr))
+				return -FI_EAGAIN;
+
+			stream->rx_hdr.seq = ntohll(stream->rx_hdr.seq);
+			stream->rx_hdr.offset = ntohll(stream->rx_hdr.offset);
+			stream->rx_hdr.len = ntohll(stream->rx_hdr.len);
+			stream->rx_iov_cnt = 0;
+		}
+
+		/* Data for a later message stays in the socket until the
+		 * primary connection has matched that message's header.
+		 */
+		rx_entry = ep->cur_rx_entry;
+		if (!stream->rx_iov_cnt) {
+			if (!rx_entry ||
+			    !(rx_entry->hdr.base_hdr.flags & TCPX_STRIPED) ||
+			    stream->rx_hdr.seq != ep->rx_stripe_seq)
+				return -FI_EAGAIN;
+
+			payload = rx_entry->hdr.base_hdr.size -
+				  rx_entry->hdr.base_hdr.payload_off;
+			if (!stream->rx_hdr.len ||
+			    stream->rx_hdr.offset + stream->rx_hdr.len > payload ||
+			    stream->rx_hdr.len > rx_entry->stripe_rem) {
+				FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+					"invalid sub-stream chunk\n");
+				return -FI_EIO;
+			}
+
+			tcpx_stripe_iov(stream->rx_iov, &stream->rx_iov_cnt,
+					rx_entry->iov, rx_entry->iov_cnt,
+					stream->rx_hdr.offset,
+					stream->rx_hdr.len);
+			stream->rx_rem = stream->rx_hdr.len;
+		}
+
+		ret = ofi_readv_socket(stream->fd, stream->rx_iov,
+				       (int) stream->rx_iov_cnt);
+		if (ret <= 0)
+			return ret ? -ofi_sockerr() : -FI_ENOTCONN;
+
+		stream->rx_rem -= ret;
+		if (stream->rx_rem) {
+			ofi_consume_iov(stream->rx_iov, &stream->rx_iov_cnt,
+					ret);
+			return -FI_EAGAIN;
+		}
+
+		rx_entry->stripe_rem -= stream->rx_hdr.len;
+		stream->rx_hdr_done = 0;
+		stream->rx_iov_cnt = 0;
+	}
+}
+
+/* Caller holds ep->lock */
+void tcpx_stream_progress(struct tcpx_ep *ep)
+{
+	struct tcpx_stream *stream;
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < ep->stream_cnt; i++) {
+		stream = &ep->streams[i];
+		if (stream->fd == INVALID_SOCKET)
+			continue;
+
+		ret = tcpx_stream_recv(stream);
+		if (!ret || OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			ret = tcpx_stream_send(stream);
+
+		if (!ret || OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			continue;
+
+		/* The peer closes its sub-streams independently of the
+		 * primary connection; an idle stream going away is left for
+		 * the primary connection to report.
+		 */
+		if (ret == -FI_ENOTCONN && slist_empty(&stream->tx_queue) &&
+		    !stream->rx_hdr_done) {
+			FI_DBG(&tcpx_prov, FI_LOG_EP_DATA,
+			       "sub-stream %u closed by peer\n", i);
+			tcpx_stream_close(stream);
+			continue;
+		}
+
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"sub-stream %u failed: %d\n", i, ret);
+		while (!slist_empty(&stream->tx_queue)) {
+			tcpx_stripe_free(container_of(
+				slist_remove_head(&stream->tx_queue),
+				struct tcpx_stripe, entry), ret);
+		}
+		tcpx_stream_close(stream);
+		tcpx_ep_shutdown_report(ep, &ep->util_ep.ep_fid.fid);
+	}
+}
+
+int tcpx_recv_stripe_data(struct tcpx_xfer_entry *rx_entry)
+{
+	if (rx_entry->stripe_rem)
+		return -FI_EAGAIN;
+
+	ofi_consume_iov(rx_entry->iov, &rx_entry->iov_cnt,
+			ofi_total_iov_len(rx_entry->iov, rx_entry->iov_cnt));
+	return FI_SUCCESS;
+}
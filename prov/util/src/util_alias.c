@@ -0,0 +1,844 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <ofi_enosys.h>
+#include <ofi_iov.h>
+#include <ofi_util.h>
+
+/*
+ * Endpoint alias: a second handle on an endpoint, with its own operation
+ * flags.  Its data transfer calls are passed to the endpoint's *msg calls
+ * along with the alias' flags, so that providers need not handle aliases
+ * in each call.
+ */
+struct util_ep_alias {
+	struct fid_ep		ep_fid;
+	struct fid_ep		*ep;
+	uint64_t		tx_flags;
+	uint64_t		rx_flags;
+};
+
+static inline struct util_ep_alias *util_alias(struct fid_ep *ep_fid)
+{
+	return container_of(ep_fid, struct util_ep_alias, ep_fid);
+}
+
+/* Inject calls generate no completion, whatever the alias' flags say. */
+static inline uint64_t util_alias_tx_flags(struct fid_ep *ep_fid,
+					   uint64_t flags)
+{
+	if (flags & FI_INJECT)
+		return (util_alias(ep_fid)->tx_flags & ~FI_COMPLETION) | flags;
+	return util_alias(ep_fid)->tx_flags | flags;
+}
+
+static int util_alias_close(struct fid *fid)
+{
+	struct util_ep_alias *ep_alias;
+
+	ep_alias = container_of(fid, struct util_ep_alias, ep_fid.fid);
+	ofi_atomic_dec32(&container_of(ep_alias->ep, struct util_ep,
+				       ep_fid)->ref);
+	free(ep_alias);
+	return 0;
+}
+
+static struct fi_ops util_alias_fid_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = util_alias_close,
+	.bind = fi_no_bind,
+	.control = fi_no_control,
+	.ops_open = fi_no_ops_open,
+};
+
+static ssize_t util_alias_cancel(fid_t fid, void *context)
+{
+	return fi_cancel(&util_alias(container_of(fid, struct fid_ep,
+						  fid))->ep->fid, context);
+}
+
+static struct fi_ops_ep util_alias_ep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = util_alias_cancel,
+	.getopt = fi_no_getopt,
+	.setopt = fi_no_setopt,
+	.tx_ctx = fi_no_tx_ctx,
+	.rx_ctx = fi_no_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
+
+static ssize_t util_alias_recvmsg(struct fid_ep *ep_fid,
+				  const struct fi_msg *msg, uint64_t flags)
+{
+	return fi_recvmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_recvv(struct fid_ep *ep_fid, const struct iovec *iov,
+				void **desc, size_t count, fi_addr_t src_addr,
+				void *context)
+{
+	struct fi_msg msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = src_addr,
+		.context = context,
+	};
+
+	return fi_recvmsg(util_alias(ep_fid)->ep, &msg,
+			  util_alias(ep_fid)->rx_flags);
+}
+
+static ssize_t util_alias_recv(struct fid_ep *ep_fid, void *buf, size_t len,
+			       void *desc, fi_addr_t src_addr, void *context)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+
+	return util_alias_recvv(ep_fid, &iov, &desc, 1, src_addr, context);
+}
+
+static ssize_t util_alias_sendmsg(struct fid_ep *ep_fid,
+				  const struct fi_msg *msg, uint64_t flags)
+{
+	return fi_sendmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_send_common(struct fid_ep *ep_fid,
+				      const struct iovec *iov, void **desc,
+				      size_t count, fi_addr_t dest_addr,
+				      uint64_t data, void *context,
+				      uint64_t flags)
+{
+	struct fi_msg msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.context = context,
+		.data = data,
+	};
+
+	return fi_sendmsg(util_alias(ep_fid)->ep, &msg,
+			  util_alias_tx_flags(ep_fid, flags));
+}
+
+static ssize_t util_alias_sendv(struct fid_ep *ep_fid, const struct iovec *iov,
+				void **desc, size_t count, fi_addr_t dest_addr,
+				void *context)
+{
+	return util_alias_send_common(ep_fid, iov, desc, count, dest_addr, 0,
+				      context, 0);
+}
+
+static ssize_t util_alias_send(struct fid_ep *ep_fid, const void *buf,
+			       size_t len, void *desc, fi_addr_t dest_addr,
+			       void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_send_common(ep_fid, &iov, &desc, 1, dest_addr, 0,
+				      context, 0);
+}
+
+static ssize_t util_alias_inject(struct fid_ep *ep_fid, const void *buf,
+				 size_t len, fi_addr_t dest_addr)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_send_common(ep_fid, &iov, NULL, 1, dest_addr, 0,
+				      NULL, FI_INJECT);
+}
+
+static ssize_t util_alias_senddata(struct fid_ep *ep_fid, const void *buf,
+				   size_t len, void *desc, uint64_t data,
+				   fi_addr_t dest_addr, void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_send_common(ep_fid, &iov, &desc, 1, dest_addr, data,
+				      context, FI_REMOTE_CQ_DATA);
+}
+
+static ssize_t util_alias_injectdata(struct fid_ep *ep_fid, const void *buf,
+				     size_t len, uint64_t data,
+				     fi_addr_t dest_addr)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_send_common(ep_fid, &iov, NULL, 1, dest_addr, data,
+				      NULL, FI_INJECT | FI_REMOTE_CQ_DATA);
+}
+
+static struct fi_ops_msg util_alias_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = util_alias_recv,
+	.recvv = util_alias_recvv,
+	.recvmsg = util_alias_recvmsg,
+	.send = util_alias_send,
+	.sendv = util_alias_sendv,
+	.sendmsg = util_alias_sendmsg,
+	.inject = util_alias_inject,
+	.senddata = util_alias_senddata,
+	.injectdata = util_alias_injectdata,
+};
+
+static ssize_t util_alias_trecvmsg(struct fid_ep *ep_fid,
+				   const struct fi_msg_tagged *msg,
+				   uint64_t flags)
+{
+	return fi_trecvmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_trecvv(struct fid_ep *ep_fid,
+				 const struct iovec *iov, void **desc,
+				 size_t count, fi_addr_t src_addr, uint64_t tag,
+				 uint64_t ignore, void *context)
+{
+	struct fi_msg_tagged msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = src_addr,
+		.tag = tag,
+		.ignore = ignore,
+		.context = context,
+	};
+
+	return fi_trecvmsg(util_alias(ep_fid)->ep, &msg,
+			   util_alias(ep_fid)->rx_flags);
+}
+
+static ssize_t util_alias_trecv(struct fid_ep *ep_fid, void *buf, size_t len,
+				void *desc, fi_addr_t src_addr, uint64_t tag,
+				uint64_t ignore, void *context)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+
+	return util_alias_trecvv(ep_fid, &iov, &desc, 1, src_addr, tag, ignore,
+				 context);
+}
+
+static ssize_t util_alias_tsendmsg(struct fid_ep *ep_fid,
+				   const struct fi_msg_tagged *msg,
+				   uint64_t flags)
+{
+	return fi_tsendmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_tsend_common(struct fid_ep *ep_fid,
+				       const struct iovec *iov, void **desc,
+				       size_t count, fi_addr_t dest_addr,
+				       uint64_t tag, uint64_t data,
+				       void *context, uint64_t flags)
+{
+	struct fi_msg_tagged msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.tag = tag,
+		.context = context,
+		.data = data,
+	};
+
+	return fi_tsendmsg(util_alias(ep_fid)->ep, &msg,
+			   util_alias_tx_flags(ep_fid, flags));
+}
+
+static ssize_t util_alias_tsendv(struct fid_ep *ep_fid,
+				 const struct iovec *iov, void **desc,
+				 size_t count, fi_addr_t dest_addr,
+				 uint64_t tag, void *context)
+{
+	return util_alias_tsend_common(ep_fid, iov, desc, count, dest_addr,
+				       tag, 0, context, 0);
+}
+
+static ssize_t util_alias_tsend(struct fid_ep *ep_fid, const void *buf,
+				size_t len, void *desc, fi_addr_t dest_addr,
+				uint64_t tag, void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_tsend_common(ep_fid, &iov, &desc, 1, dest_addr, tag,
+				       0, context, 0);
+}
+
+static ssize_t util_alias_tinject(struct fid_ep *ep_fid, const void *buf,
+				  size_t len, fi_addr_t dest_addr, uint64_t tag)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_tsend_common(ep_fid, &iov, NULL, 1, dest_addr, tag,
+				       0, NULL, FI_INJECT);
+}
+
+static ssize_t util_alias_tsenddata(struct fid_ep *ep_fid, const void *buf,
+				    size_t len, void *desc, uint64_t data,
+				    fi_addr_t dest_addr, uint64_t tag,
+				    void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_tsend_common(ep_fid, &iov, &desc, 1, dest_addr, tag,
+				       data, context, FI_REMOTE_CQ_DATA);
+}
+
+static ssize_t util_alias_tinjectdata(struct fid_ep *ep_fid, const void *buf,
+				      size_t len, uint64_t data,
+				      fi_addr_t dest_addr, uint64_t tag)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_tsend_common(ep_fid, &iov, NULL, 1, dest_addr, tag,
+				       data, NULL,
+				       FI_INJECT | FI_REMOTE_CQ_DATA);
+}
+
+static struct fi_ops_tagged util_alias_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = util_alias_trecv,
+	.recvv = util_alias_trecvv,
+	.recvmsg = util_alias_trecvmsg,
+	.send = util_alias_tsend,
+	.sendv = util_alias_tsendv,
+	.sendmsg = util_alias_tsendmsg,
+	.inject = util_alias_tinject,
+	.senddata = util_alias_tsenddata,
+	.injectdata = util_alias_tinjectdata,
+};
+
+static ssize_t util_alias_readmsg(struct fid_ep *ep_fid,
+				  const struct fi_msg_rma *msg, uint64_t flags)
+{
+	return fi_readmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_readv(struct fid_ep *ep_fid, const struct iovec *iov,
+				void **desc, size_t count, fi_addr_t src_addr,
+				uint64_t addr, uint64_t key, void *context)
+{
+	struct fi_rma_iov rma_iov = {
+		.addr = addr,
+		.len = ofi_total_iov_len(iov, count),
+		.key = key,
+	};
+	struct fi_msg_rma msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = src_addr,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.context = context,
+	};
+
+	return fi_readmsg(util_alias(ep_fid)->ep, &msg,
+			  util_alias(ep_fid)->tx_flags);
+}
+
+static ssize_t util_alias_read(struct fid_ep *ep_fid, void *buf, size_t len,
+			       void *desc, fi_addr_t src_addr, uint64_t addr,
+			       uint64_t key, void *context)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+
+	return util_alias_readv(ep_fid, &iov, &desc, 1, src_addr, addr, key,
+				context);
+}
+
+static ssize_t util_alias_writemsg(struct fid_ep *ep_fid,
+				   const struct fi_msg_rma *msg, uint64_t flags)
+{
+	return fi_writemsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_write_common(struct fid_ep *ep_fid,
+				       const struct iovec *iov, void **desc,
+				       size_t count, fi_addr_t dest_addr,
+				       uint64_t addr, uint64_t key,
+				       uint64_t data, void *context,
+				       uint64_t flags)
+{
+	struct fi_rma_iov rma_iov = {
+		.addr = addr,
+		.len = ofi_total_iov_len(iov, count),
+		.key = key,
+	};
+	struct fi_msg_rma msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.context = context,
+		.data = data,
+	};
+
+	return fi_writemsg(util_alias(ep_fid)->ep, &msg,
+			   util_alias_tx_flags(ep_fid, flags));
+}
+
+static ssize_t util_alias_writev(struct fid_ep *ep_fid,
+				 const struct iovec *iov, void **desc,
+				 size_t count, fi_addr_t dest_addr,
+				 uint64_t addr, uint64_t key, void *context)
+{
+	return util_alias_write_common(ep_fid, iov, desc, count, dest_addr,
+				       addr, key, 0, context, 0);
+}
+
+static ssize_t util_alias_write(struct fid_ep *ep_fid, const void *buf,
+				size_t len, void *desc, fi_addr_t dest_addr,
+				uint64_t addr, uint64_t key, void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_write_common(ep_fid, &iov, &desc, 1, dest_addr,
+				       addr, key, 0, context, 0);
+}
+
+static ssize_t util_alias_inject_write(struct fid_ep *ep_fid, const void *buf,
+				       size_t len, fi_addr_t dest_addr,
+				       uint64_t addr, uint64_t key)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_write_common(ep_fid, &iov, NULL, 1, dest_addr, addr,
+				       key, 0, NULL, FI_INJECT);
+}
+
+static ssize_t util_alias_writedata(struct fid_ep *ep_fid, const void *buf,
+				    size_t len, void *desc, uint64_t data,
+				    fi_addr_t dest_addr, uint64_t addr,
+				    uint64_t key, void *context)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_write_common(ep_fid, &iov, &desc, 1, dest_addr,
+				       addr, key, data, context,
+				       FI_REMOTE_CQ_DATA);
+}
+
+static ssize_t util_alias_inject_writedata(struct fid_ep *ep_fid,
+					   const void *buf, size_t len,
+					   uint64_t data, fi_addr_t dest_addr,
+					   uint64_t addr, uint64_t key)
+{
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+
+	return util_alias_write_common(ep_fid, &iov, NULL, 1, dest_addr, addr,
+				       key, data, NULL,
+				       FI_INJECT | FI_REMOTE_CQ_DATA);
+}
+
+static struct fi_ops_rma util_alias_rma_ops = {
+	.size = sizeof(struct fi_ops_rma),
+	.read = util_alias_read,
+	.readv = util_alias_readv,
+	.readmsg = util_alias_readmsg,
+	.write = util_alias_write,
+	.writev = util_alias_writev,
+	.writemsg = util_alias_writemsg,
+	.inject = util_alias_inject_write,
+	.writedata = util_alias_writedata,
+	.injectdata = util_alias_inject_writedata,
+};
+
+static ssize_t util_alias_atomic_writemsg(struct fid_ep *ep_fid,
+					  const struct fi_msg_atomic *msg,
+					  uint64_t flags)
+{
+	return fi_atomicmsg(util_alias(ep_fid)->ep, msg, flags);
+}
+
+static ssize_t util_alias_atomic_common(struct fid_ep *ep_fid,
+					const struct fi_ioc *iov, void **desc,
+					size_t count, fi_addr_t dest_addr,
+					uint64_t addr, uint64_t key,
+					enum fi_datatype datatype,
+					enum fi_op op, void *context,
+					uint64_t flags)
+{
+	struct fi_rma_ioc rma_iov = {
+		.addr = addr,
+		.count = ofi_total_ioc_cnt(iov, count),
+		.key = key,
+	};
+	struct fi_msg_atomic msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.datatype = datatype,
+		.op = op,
+		.context = context,
+	};
+
+	return fi_atomicmsg(util_alias(ep_fid)->ep, &msg,
+			    util_alias_tx_flags(ep_fid, flags));
+}
+
+static ssize_t util_alias_atomic_writev(struct fid_ep *ep_fid,
+					const struct fi_ioc *iov, void **desc,
+					size_t count, fi_addr_t dest_addr,
+					uint64_t addr, uint64_t key,
+					enum fi_datatype datatype,
+					enum fi_op op, void *context)
+{
+	return util_alias_atomic_common(ep_fid, iov, desc, count, dest_addr,
+					addr, key, datatype, op, context, 0);
+}
+
+static ssize_t util_alias_atomic_write(struct fid_ep *ep_fid, const void *buf,
+				       size_t count, void *desc,
+				       fi_addr_t dest_addr, uint64_t addr,
+				       uint64_t key, enum fi_datatype datatype,
+				       enum fi_op op, void *context)
+{
+	struct fi_ioc iov = {
+		.addr = (void *) buf,
+		.count = count,
+	};
+
+	return util_alias_atomic_common(ep_fid, &iov, &desc, 1, dest_addr,
+					addr, key, datatype, op, context, 0);
+}
+
+static ssize_t util_alias_atomic_inject(struct fid_ep *ep_fid,
+					const void *buf, size_t count,
+					fi_addr_t dest_addr, uint64_t addr,
+					uint64_t key, enum fi_datatype datatype,
+					enum fi_op op)
+{
+	struct fi_ioc iov = {
+		.addr = (void *) buf,
+		.count = count,
+	};
+
+	return util_alias_atomic_common(ep_fid, &iov, NULL, 1, dest_addr,
+					addr, key, datatype, op, NULL,
+					FI_INJECT);
+}
+
+static ssize_t util_alias_atomic_readwritemsg(struct fid_ep *ep_fid,
+					      const struct fi_msg_atomic *msg,
+					      struct fi_ioc *resultv,
+					      void **result_desc,
+					      size_t result_count,
+					      uint64_t flags)
+{
+	return fi_fetch_atomicmsg(util_alias(ep_fid)->ep, msg, resultv,
+				  result_desc, result_count, flags);
+}
+
+static ssize_t util_alias_atomic_readwritev(struct fid_ep *ep_fid,
+					    const struct fi_ioc *iov,
+					    void **desc, size_t count,
+					    struct fi_ioc *resultv,
+					    void **result_desc,
+					    size_t result_count,
+					    fi_addr_t dest_addr, uint64_t addr,
+					    uint64_t key,
+					    enum fi_datatype datatype,
+					    enum fi_op op, void *context)
+{
+	struct fi_rma_ioc rma_iov = {
+		.addr = addr,
+		.count = ofi_total_ioc_cnt(resultv, result_count),
+		.key = key,
+	};
+	struct fi_msg_atomic msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.datatype = datatype,
+		.op = op,
+		.context = context,
+	};
+
+	return fi_fetch_atomicmsg(util_alias(ep_fid)->ep, &msg, resultv,
+				  result_desc, result_count,
+				  util_alias(ep_fid)->tx_flags);
+}
+
+static ssize_t util_alias_atomic_readwrite(struct fid_ep *ep_fid,
+					   const void *buf, size_t count,
+					   void *desc, void *result,
+					   void *result_desc,
+					   fi_addr_t dest_addr, uint64_t addr,
+					   uint64_t key,
+					   enum fi_datatype datatype,
+					   enum fi_op op, void *context)
+{
+	struct fi_ioc iov = {
+		.addr = (void *) buf,
+		.count = op == FI_ATOMIC_READ ? 0 : count,
+	};
+	struct fi_ioc result_iov = {
+		.addr = result,
+		.count = count,
+	};
+
+	return util_alias_atomic_readwritev(ep_fid, &iov, &desc, 1,
+					    &result_iov, &result_desc, 1,
+					    dest_addr, addr, key, datatype, op,
+					    context);
+}
+
+static ssize_t util_alias_atomic_compwritemsg(struct fid_ep *ep_fid,
+					      const struct fi_msg_atomic *msg,
+					      const struct fi_ioc *comparev,
+					      void **compare_desc,
+					      size_t compare_count,
+					      struct fi_ioc *resultv,
+					      void **result_desc,
+					      size_t result_count,
+					      uint64_t flags)
+{
+	return fi_compare_atomicmsg(util_alias(ep_fid)->ep, msg, comparev,
+				    compare_desc, compare_count, resultv,
+				    result_desc, result_count, flags);
+}
+
+static ssize_t util_alias_atomic_compwritev(struct fid_ep *ep_fid,
+					    const struct fi_ioc *iov,
+					    void **desc, size_t count,
+					    const struct fi_ioc *comparev,
+					    void **compare_desc,
+					    size_t compare_count,
+					    struct fi_ioc *resultv,
+					    void **result_desc,
+					    size_t result_count,
+					    fi_addr_t dest_addr, uint64_t addr,
+					    uint64_t key,
+					    enum fi_datatype datatype,
+					    enum fi_op op, void *context)
+{
+	struct fi_rma_ioc rma_iov = {
+		.addr = addr,
+		.count = ofi_total_ioc_cnt(iov, count),
+		.key = key,
+	};
+	struct fi_msg_atomic msg = {
+		.msg_iov = iov,
+		.desc = desc,
+		.iov_count = count,
+		.addr = dest_addr,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.datatype = datatype,
+		.op = op,
+		.context = context,
+	};
+
+	return fi_compare_atomicmsg(util_alias(ep_fid)->ep, &msg, comparev,
+				    compare_desc, compare_count, resultv,
+				    result_desc, result_count,
+				    util_alias(ep_fid)->tx_flags);
+}
+
+static ssize_t util_alias_atomic_compwrite(struct fid_ep *ep_fid,
+					   const void *buf, size_t count,
+					   void *desc, const void *compare,
+					   void *compare_desc, void *result,
+					   void *result_desc,
+					   fi_addr_t dest_addr, uint64_t addr,
+					   uint64_t key,
+					   enum fi_datatype datatype,
+					   enum fi_op op, void *context)
+{
+	struct fi_ioc iov = {
+		.addr = (void *) buf,
+		.count = count,
+	};
+	struct fi_ioc compare_iov = {
+		.addr = (void *) compare,
+		.count = count,
+	};
+	struct fi_ioc result_iov = {
+		.addr = result,
+		.count = count,
+	};
+
+	return util_alias_atomic_compwritev(ep_fid, &iov, &desc, 1,
+					    &compare_iov, &compare_desc, 1,
+					    &result_iov, &result_desc, 1,
+					    dest_addr, addr, key, datatype, op,
+					    context);
+}
+
+static int util_alias_atomic_writevalid(struct fid_ep *ep_fid,
+					enum fi_datatype datatype,
+					enum fi_op op, size_t *count)
+{
+	return fi_atomicvalid(util_alias(ep_fid)->ep, datatype, op, count);
+}
+
+static int util_alias_atomic_readwritevalid(struct fid_ep *ep_fid,
+					    enum fi_datatype datatype,
+					    enum fi_op op, size_t *count)
+{
+	return fi_fetch_atomicvalid(util_alias(ep_fid)->ep, datatype, op,
+				    count);
+}
+
+static int util_alias_atomic_compwritevalid(struct fid_ep *ep_fid,
+					    enum fi_datatype datatype,
+					    enum fi_op op, size_t *count)
+{
+	return fi_compare_atomicvalid(util_alias(ep_fid)->ep, datatype, op,
+				      count);
+}
+
+static struct fi_ops_atomic util_alias_atomic_ops = {
+	.size = sizeof(struct fi_ops_atomic),
+	.write = util_alias_atomic_write,
+	.writev = util_alias_atomic_writev,
+	.writemsg = util_alias_atomic_writemsg,
+	.inject = util_alias_atomic_inject,
+	.readwrite = util_alias_atomic_readwrite,
+	.readwritev = util_alias_atomic_readwritev,
+	.readwritemsg = util_alias_atomic_readwritemsg,
+	.compwrite = util_alias_atomic_compwrite,
+	.compwritev = util_alias_atomic_compwritev,
+	.compwritemsg = util_alias_atomic_compwritemsg,
+	.writevalid = util_alias_atomic_writevalid,
+	.readwritevalid = util_alias_atomic_readwritevalid,
+	.compwritevalid = util_alias_atomic_compwritevalid,
+};
+
+/* Returns the endpoint of an alias, or the endpoint itself */
+struct util_ep *ofi_ep_unalias(struct fid_ep *ep_fid)
+{
+	if (ep_fid->fid.ops == &util_alias_fid_ops)
+		ep_fid = util_alias(ep_fid)->ep;
+	return container_of(ep_fid, struct util_ep, ep_fid);
+}
+
+/*
+ * The flags replace the transmit or receive operation flags of the
+ * endpoint, as selected by FI_TRANSMIT or FI_RECV.  The alias holds a
+ * reference on the endpoint, which can't be closed until the alias is.
+ */
+int ofi_ep_alias(struct util_ep *ep, struct fi_alias *alias)
+{
+	struct util_ep_alias *ep_alias;
+
+	if (!alias || !alias->fid ||
+	    !(alias->flags & (FI_TRANSMIT | FI_RECV)) ||
+	    (alias->flags & FI_TRANSMIT && alias->flags & FI_RECV))
+		return -FI_EINVAL;
+
+	ep_alias = calloc(1, sizeof(*ep_alias));
+	if (!ep_alias)
+		return -FI_ENOMEM;
+
+	ep_alias->ep = &ep->ep_fid;
+	ep_alias->tx_flags = ep->tx_op_flags;
+	ep_alias->rx_flags = ep->rx_op_flags;
+	if (alias->flags & FI_TRANSMIT)
+		ep_alias->tx_flags = alias->flags & ~FI_TRANSMIT;
+	else
+		ep_alias->rx_flags = alias->flags & ~FI_RECV;
+
+	ep_alias->ep_fid.fid.fclass = FI_CLASS_EP;
+	ep_alias->ep_fid.fid.context = ep->ep_fid.fid.context;
+	ep_alias->ep_fid.fid.ops = &util_alias_fid_ops;
+	ep_alias->ep_fid.ops = &util_alias_ep_ops;
+	ep_alias->ep_fid.cm = ep->ep_fid.cm;
+	ep_alias->ep_fid.msg = &util_alias_msg_ops;
+	ep_alias->ep_fid.rma = &util_alias_rma_ops;
+	ep_alias->ep_fid.tagged = &util_alias_tagged_ops;
+	ep_alias->ep_fid.atomic = &util_alias_atomic_ops;
+
+	ofi_atomic_inc32(&ep->ref);
+	*alias->fid = &ep_alias->ep_fid.fid;
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <config.h>
+
+#include <string.h>
+
+#include "ofi_atomic.h"
+
+/*
+ * Reduce handlers:
+ * Non-atomic versions of the write handlers for the arithmetic and bitwise
+ * operations, for targets whose updates are serialized by the caller.
+ * They process a vector register width of elements per iteration, using
+ * the compiler's vector extensions, and finish the remainder one element
+ * at a time.  The generic versions use 16 byte vectors, which map to SSE2
+ * on x86-64 and NEON on aarch64.  On x86-64, AVX2 and AVX-512 versions are
+ * also built and the widest one the CPU supports is selected at init.
+ */
+void (*ofi_atomic_reduce_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST])
+	(void *dst, const void *src, size_t cnt);
+
+#if defined(__GNUC__)
+
+#define OFI_REDUCE_MIN(dst, src)	((dst) > (src) ? (src) : (dst))
+#define OFI_REDUCE_MAX(dst, src)	((dst) < (src) ? (src) : (dst))
+#define OFI_REDUCE_SUM(dst, src)	((dst) + (src))
+#define OFI_REDUCE_PROD(dst, src)	((dst) * (src))
+#define OFI_REDUCE_BOR(dst, src)	((dst) | (src))
+#define OFI_REDUCE_BAND(dst, src)	((dst) & (src))
+#define OFI_REDUCE_BXOR(dst, src)	((dst) ^ (src))
+
+/* Comparisons yield all-ones integer masks, used to blend dst and src */
+#define OFI_REDUCE_BLEND(vec, ivec, mask, x, y)			\
+	((vec) (((mask) & (ivec) (x)) | (~(mask) & (ivec) (y))))
+
+#define OFI_REDUCE_VEC_MIN(vec, ivec, dst, src)			\
+	OFI_REDUCE_BLEND(vec, ivec, (ivec) ((dst) > (src)), src, dst)
+#define OFI_REDUCE_VEC_MAX(vec, ivec, dst, src)			\
+	OFI_REDUCE_BLEND(vec, ivec, (ivec) ((dst) < (src)), src, dst)
+#define OFI_REDUCE_VEC_SUM(vec, ivec, dst, src)		((dst) + (src))
+#define OFI_REDUCE_VEC_PROD(vec, ivec, dst, src)	((dst) * (src))
+#define OFI_REDUCE_VEC_BOR(vec, ivec, dst, src)		((dst) | (src))
+#define OFI_REDUCE_VEC_BAND(vec, ivec, dst, src)	((dst) & (src))
+#define OFI_REDUCE_VEC_BXOR(vec, ivec, dst, src)	((dst) ^ (src))
+
+#define OFI_REDUCE_TARGET_vec
+#define OFI_REDUCE_TARGET_avx2	__attribute__((target("avx2")))
+#define OFI_REDUCE_TARGET_avx512					\
+	__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+
+#define OFI_REDUCE_NAME(isa, op, type)	ofi_reduce_##isa##_##op##_##type
+
+/*
+ * itype is a signed integer type of the same size as type, which holds
+ * the result of comparing vectors of type.
+ */
+#define OFI_DEF_REDUCE_FUNC(isa, width, op, type, itype)		\
+static OFI_REDUCE_TARGET_##isa void					\
+OFI_REDUCE_NAME(isa, op, type)(void *dst, const void *src, size_t cnt)	\
+{									\
+	typedef type vec __attribute__((vector_size(width)));		\
+	typedef itype ivec						\
+		__attribute__((vector_size(width), unused));		\
+	const size_t n = width / sizeof(type);				\
+	const type *s = src;						\
+	type *d = dst;							\
+	vec vd, vs;							\
+	size_t i;							\
+									\
+	for (i = 0; i + n <= cnt; i += n) {				\
+		memcpy(&vd, &d[i], sizeof(vd));				\
+		memcpy(&vs, &s[i], sizeof(vs));				\
+		vd = OFI_REDUCE_VEC_##op(vec, ivec, vd, vs);		\
+		memcpy(&d[i], &vd, sizeof(vd));				\
+	}								\
+	for (; i < cnt; i++)						\
+		d[i] = OFI_REDUCE_##op(d[i], s[i]);			\
+}
+
+#define OFI_DEF_REDUCE_INT(isa, width, op)				\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, int8_t, int8_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, uint8_t, int8_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, int16_t, int16_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, uint16_t, int16_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, int32_t, int32_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, uint32_t, int32_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, int64_t, int64_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, uint64_t, int64_t)
+
+#define OFI_DEF_REDUCE_REAL(isa, width, op)				\
+	OFI_DEF_REDUCE_INT(isa, width, op)				\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, float, int32_t)		\
+	OFI_DEF_REDUCE_FUNC(isa, width, op, double, int64_t)
+
+#define OFI_DEF_REDUCE_ALL(isa, width)					\
+	OFI_DEF_REDUCE_REAL(isa, width, MIN)				\
+	OFI_DEF_REDUCE_REAL(isa, width, MAX)				\
+	OFI_DEF_REDUCE_REAL(isa, width, SUM)				\
+	OFI_DEF_REDUCE_REAL(isa, width, PROD)				\
+	OFI_DEF_REDUCE_INT(isa, width, BOR)				\
+	OFI_DEF_REDUCE_INT(isa, width, BAND)				\
+	OFI_DEF_REDUCE_INT(isa, width, BXOR)
+
+#define OFI_REDUCE_INT_NAMES(isa, op)					\
+	[FI_INT8] = OFI_REDUCE_NAME(isa, op, int8_t),			\
+	[FI_UINT8] = OFI_REDUCE_NAME(isa, op, uint8_t),			\
+	[FI_INT16] = OFI_REDUCE_NAME(isa, op, int16_t),			\
+	[FI_UINT16] = OFI_REDUCE_NAME(isa, op, uint16_t),		\
+	[FI_INT32] = OFI_REDUCE_NAME(isa, op, int32_t),			\
+	[FI_UINT32] = OFI_REDUCE_NAME(isa, op, uint32_t),		\
+	[FI_INT64] = OFI_REDUCE_NAME(isa, op, int64_t),			\
+	[FI_UINT64] = OFI_REDUCE_NAME(isa, op, uint64_t)
+
+#define OFI_REDUCE_REAL_NAMES(isa, op)					\
+	OFI_REDUCE_INT_NAMES(isa, op),					\
+	[FI_FLOAT] = OFI_REDUCE_NAME(isa, op, float),			\
+	[FI_DOUBLE] = OFI_REDUCE_NAME(isa, op, double)
+
+#define OFI_DEF_REDUCE_TABLE(isa)					\
+static void (*ofi_reduce_##isa##_handlers[OFI_WRITE_OP_LAST]		\
+		[FI_DATATYPE_LAST])(void *dst, const void *src,		\
+				    size_t cnt) = {			\
+	[FI_MIN] = { OFI_REDUCE_REAL_NAMES(isa, MIN) },			\
+	[FI_MAX] = { OFI_REDUCE_REAL_NAMES(isa, MAX) },			\
+	[FI_SUM] = { OFI_REDUCE_REAL_NAMES(isa, SUM) },			\
+	[FI_PROD] = { OFI_REDUCE_REAL_NAMES(isa, PROD) },		\
+	[FI_BOR] = { OFI_REDUCE_INT_NAMES(isa, BOR) },			\
+	[FI_BAND] = { OFI_REDUCE_INT_NAMES(isa, BAND) },		\
+	[FI_BXOR] = { OFI_REDUCE_INT_NAMES(isa, BXOR) },		\
+};
+
+OFI_DEF_REDUCE_ALL(vec, 16)
+OFI_DEF_REDUCE_TABLE(vec)
+
+#if defined(__x86_64__)
+OFI_DEF_REDUCE_ALL(avx2, 32)
+OFI_DEF_REDUCE_TABLE(avx2)
+OFI_DEF_REDUCE_ALL(avx512, 64)
+OFI_DEF_REDUCE_TABLE(avx512)
+#endif
+
+void ofi_atomic_reduce_init(void)
+{
+	const char *isa = "generic";
+
+	memcpy(ofi_atomic_reduce_handlers, ofi_reduce_vec_handlers,
+	       sizeof(ofi_atomic_reduce_handlers));
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("avx512dq") &&
+	    __builtin_cpu_supports("avx512vl")) {
+		memcpy(ofi_atomic_reduce_handlers, ofi_reduce_avx512_handlers,
+		       sizeof(ofi_atomic_reduce_handlers));
+		isa = "AVX-512";
+	} else if (__builtin_cpu_supports("avx2")) {
+		memcpy(ofi_atomic_reduce_handlers, ofi_reduce_avx2_handlers,
+		       sizeof(ofi_atomic_reduce_handlers));
+		isa = "AVX2";
+	}
+#endif
+
+	FI_INFO(&core_prov, FI_LOG_CORE,
+		"Using %s vector kernels for serialized atomics\n", isa);
+}
+
+#else /* __GNUC__ */
+
+void ofi_atomic_reduce_init(void)
+{
+}
+
+#endif /* __GNUC__ */
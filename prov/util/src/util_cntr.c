@@ -36,6 +36,52 @@
 #include <ofi_enosys.h>
 #include <ofi_util.h>
 
+#define UTIL_CNTR_MAX_STRIPES	256
+
+size_t ofi_cntr_stripes;
+pthread_key_t ofi_cntr_key;
+static ofi_atomic64_t util_cntr_thread_id;
+
+void ofi_cntr_stripe_init(void)
+{
+	fi_param_define(NULL, "cntr_stripes", FI_PARAM_SIZE_T,
+			"Number of cache line sized cells that each counter "
+			"spreads its increments across, rounded up to a power "
+			"of two, to reduce contention between threads that "
+			"update the same counter.  Reads sum the cells. "
+			"(default: 0, a single value)");
+	fi_param_get_size_t(NULL, "cntr_stripes", &ofi_cntr_stripes);
+	if (!ofi_cntr_stripes)
+		return;
+
+	if (pthread_key_create(&ofi_cntr_key, NULL)) {
+		FI_WARN(&core_prov, FI_LOG_CORE,
+			"unable to create key, counters are not striped\n");
+		ofi_cntr_stripes = 0;
+		return;
+	}
+
+	ofi_cntr_stripes = roundup_power_of_two(MIN(ofi_cntr_stripes,
+						    UTIL_CNTR_MAX_STRIPES));
+	ofi_atomic_initialize64(&util_cntr_thread_id, 0);
+}
+
+void ofi_cntr_stripe_fini(void)
+{
+	if (ofi_cntr_stripes)
+		pthread_key_delete(ofi_cntr_key);
+}
+
+/* Assign cells to threads round robin, starting at 1 as 0 means unset */
+uintptr_t ofi_cntr_thread_init(void)
+{
+	uintptr_t id;
+
+	id = (uintptr_t) ofi_atomic_inc64(&util_cntr_thread_id);
+	pthread_setspecific(ofi_cntr_key, (void *) id);
+	return id;
+}
+
 static int ofi_check_cntr_attr(const struct fi_provider *prov,
 			       const struct fi_cntr_attr *attr)
 {
@@ -67,40 +113,42 @@ static int ofi_check_cntr_attr(const struct fi_provider *prov,
 	return 0;
 }
 
-static uint64_t ofi_cntr_read(struct fid_cntr *cntr_fid)
+uint64_t ofi_cntr_read(struct fid_cntr *cntr_fid)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 	cntr->progress(cntr);
+	ofi_progress_work(cntr->domain);
 
-	return ofi_atomic_get64(&cntr->cnt);
+	return ofi_cntr_value(cntr);
 }
 
-static uint64_t ofi_cntr_readerr(struct fid_cntr *cntr_fid)
+uint64_t ofi_cntr_readerr(struct fid_cntr *cntr_fid)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 	cntr->progress(cntr);
+	ofi_progress_work(cntr->domain);
 
 	return ofi_atomic_get64(&cntr->err);
 }
 
-static int ofi_cntr_add(struct fid_cntr *cntr_fid, uint64_t value)
+int ofi_cntr_add(struct fid_cntr *cntr_fid, uint64_t value)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
-	ofi_atomic_add64(&cntr->cnt, value);
+	ofi_cntr_add_value(cntr, value);
 	if (cntr->wait)
 		cntr->wait->signal(cntr->wait);
 
 	return FI_SUCCESS;
 }
 
-static int ofi_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value)
+int ofi_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 
@@ -113,12 +161,15 @@ static int ofi_cntr_adderr(struct fid_cntr *cntr_fid, uint64_t value)
 	return FI_SUCCESS;
 }
 
-static int ofi_cntr_set(struct fid_cntr *cntr_fid, uint64_t value)
+int ofi_cntr_set(struct fid_cntr *cntr_fid, uint64_t value)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
 
+	/* Striped counters offset the sum of the cells, which keep growing */
+	if (cntr->cells)
+		value -= ofi_cntr_value(cntr) - ofi_atomic_get64(&cntr->cnt);
 	ofi_atomic_set64(&cntr->cnt, value);
 	if (cntr->wait)
 		cntr->wait->signal(cntr->wait);
@@ -126,7 +177,7 @@ static int ofi_cntr_set(struct fid_cntr *cntr_fid, uint64_t value)
 	return FI_SUCCESS;
 }
 
-static int ofi_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value)
+int ofi_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value)
 {
 	struct util_cntr *cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
 	assert(cntr->cntr_fid.fid.fclass == FI_CLASS_CNTR);
@@ -153,7 +204,8 @@ static int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 
 	do {
 		cntr->progress(cntr);
-		if (threshold <= ofi_atomic_get64(&cntr->cnt))
+		ofi_progress_work(cntr->domain);
+		if (threshold <= ofi_cntr_value(cntr))
 			return FI_SUCCESS;
 
 		if (errcnt != ofi_atomic_get64(&cntr->err))
@@ -205,6 +257,10 @@ int ofi_cntr_cleanup(struct util_cntr *cntr)
 			fi_close(&cntr->wait->wait_fid.fid);
 	}
 
+	ofi_flush_work(cntr->domain, cntr);
+	free(cntr->work_heap);
+	ofi_freealign(cntr->cells);
+
 	ofi_atomic_dec32(&cntr->domain->ref);
 	fastlock_destroy(&cntr->ep_list_lock);
 	return 0;
@@ -228,14 +284,30 @@ static int fi_cntr_init(struct fid_domain *domain, struct fi_cntr_attr *attr,
 {
 	struct fi_wait_attr wait_attr;
 	struct fid_wait *wait;
+	size_t i;
 	int ret;
 
 	cntr->domain = container_of(domain, struct util_domain, domain_fid);
 	ofi_atomic_initialize32(&cntr->ref, 0);
 	ofi_atomic_initialize64(&cntr->cnt, 0);
 	ofi_atomic_initialize64(&cntr->err, 0);
+
+	cntr->cells = NULL;
+	if (ofi_cntr_stripes) {
+		ret = ofi_memalign((void **) &cntr->cells, OFI_CACHE_LINE_SIZE,
+				   ofi_cntr_stripes * sizeof(*cntr->cells));
+		if (ret)
+			return -FI_ENOMEM;
+		for (i = 0; i < ofi_cntr_stripes; i++)
+			ofi_atomic_initialize64(&cntr->cells[i].cnt, 0);
+		cntr->cell_mask = ofi_cntr_stripes - 1;
+	}
 	dlist_init(&cntr->ep_list);
 	fastlock_init(&cntr->ep_list_lock);
+	cntr->work_heap = NULL;
+	cntr->work_cnt = 0;
+	cntr->work_size = 0;
+	dlist_init(&cntr->work_entry);
 
 	cntr->cntr_fid.fid.fclass = FI_CLASS_CNTR;
 	cntr->cntr_fid.fid.context = context;
@@ -253,8 +325,10 @@ static int fi_cntr_init(struct fid_domain *domain, struct fi_cntr_attr *attr,
 		cntr->internal_wait = 1;
 		ret = fi_wait_open(&cntr->domain->fabric->fabric_fid,
 				   &wait_attr, &wait);
-		if (ret)
+		if (ret) {
+			ofi_freealign(cntr->cells);
 			return ret;
+		}
 		break;
 	case FI_WAIT_SET:
 		wait = attr->wait_set;
@@ -70,13 +70,18 @@ int ofi_cq_write_error(struct util_cq *cq,
 {
 	struct util_cq_oflow_err_entry *entry;
 	struct fi_cq_tagged_entry *comp;
+	void *context = err_entry->op_context;
 
 	assert(err_entry->err);
 
+	if (ofi_cq_complete_work(cq, &context, err_entry->err))
+		return 0;
+
 	if (!(entry = calloc(1, sizeof(*entry))))
 		return -FI_ENOMEM;
 
 	entry->comp = *err_entry;
+	entry->comp.op_context = context;
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
 
@@ -243,6 +248,7 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 	if (ofi_cirque_isempty(cq->cirq) || !count) {
 		cq->cq_fastlock_release(&cq->cq_lock);
 		cq->progress(cq);
+		ofi_progress_work(cq->domain);
 		cq->cq_fastlock_acquire(&cq->cq_lock);
 		if (ofi_cirque_isempty(cq->cirq)) {
 			i = -FI_EAGAIN;
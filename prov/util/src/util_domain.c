@@ -62,6 +62,8 @@ int ofi_domain_close(struct util_domain *domain)
 	dlist_remove(&domain->list_entry);
 	fastlock_release(&domain->fabric->lock);
 
+	ofi_rbmap_cleanup(&domain->work_map);
+	fastlock_destroy(&domain->work_lock);
 	free(domain->name);
 	fastlock_destroy(&domain->lock);
 	ofi_atomic_dec32(&domain->fabric->ref);
@@ -75,11 +77,24 @@ static struct fi_ops_mr util_domain_mr_ops = {
 	.regattr = fi_no_mr_regattr,
 };
 
+static int util_domain_work_compare(struct ofi_rbmap *map, void *key,
+				    void *data)
+{
+	OFI_UNUSED(map);
+	return ((uintptr_t) key < (uintptr_t) data) ? -1 :
+	       ((uintptr_t) key > (uintptr_t) data);
+}
+
 static int util_domain_init(struct util_domain *domain,
 			    const struct fi_info *info)
 {
 	ofi_atomic_initialize32(&domain->ref, 0);
 	fastlock_init(&domain->lock);
+	fastlock_init(&domain->work_lock);
+	dlist_init(&domain->work_cntr_list);
+	ofi_rbmap_init(&domain->work_map, util_domain_work_compare);
+	ofi_atomic_initialize32(&domain->work_active, 0);
+	domain->work_seq = 0;
 	domain->info_domain_caps = info->caps | info->domain_attr->caps;
 	domain->info_domain_mode = info->mode | info->domain_attr->mode;
 	domain->mr_mode = info->domain_attr->mr_mode;
@@ -91,6 +106,29 @@ static int util_domain_init(struct util_domain *domain,
 	return domain->name ? 0 : -FI_ENOMEM;
 }
 
+int ofi_domain_control(struct fid *fid, int command, void *arg)
+{
+	struct util_domain *domain;
+	struct fi_deferred_work *work = arg;
+
+	domain = container_of(fid, struct util_domain, domain_fid.fid);
+
+	switch (command) {
+	case FI_QUEUE_WORK:
+		return ofi_queue_work(domain, work);
+	case FI_CANCEL_WORK:
+		return ofi_cancel_work(domain, work);
+	case FI_FLUSH_WORK:
+		/* flush all work, or only that of the given triggering cntr */
+		return ofi_flush_work(domain, work && work->triggering_cntr ?
+				      container_of(work->triggering_cntr,
+						   struct util_cntr, cntr_fid) :
+				      NULL);
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
 int ofi_domain_init(struct fid_fabric *fabric_fid, const struct fi_info *info,
 		   struct util_domain *domain, void *context)
 {
@@ -229,6 +229,7 @@ int ofi_endpoint_init(struct fid_domain *domain, const struct util_prov *util_pr
 	ep->rem_rd_cntr_inc 	= ofi_cntr_inc_noop;
 	ep->rem_wr_cntr_inc 	= ofi_cntr_inc_noop;
 	ep->type = info->ep_attr->type;
+	ofi_atomic_initialize32(&ep->ref, 0);
 	ofi_atomic_inc32(&util_domain->ref);
 	if (util_domain->eq)
 		ofi_ep_bind_eq(ep, util_domain->eq);
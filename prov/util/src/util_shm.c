@@ -41,6 +41,7 @@
 #include <fcntl.h>
 
 #include <ofi_shm.h>
+#include <uthash.h>
 
 
 static void smr_peer_addr_init(struct smr_addr *peer)
@@ -54,18 +55,31 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	       const struct smr_attr *attr, struct smr_region **smr)
 {
 	size_t total_size, cmd_queue_offset, peer_addr_offset;
-	size_t resp_queue_offset, inject_pool_offset, name_offset;
-	int fd, ret, i;
+	size_t resp_queue_offset, inject_queue_offset, inject_pool_offset;
+	size_t sar_pool_offset, fbox_pool_offset, mr_export_offset;
+	size_t name_index_offset, name_offset;
+	int fd, ret, i, name_index_size, node;
 	void *mapped_addr;
 
 	cmd_queue_offset = sizeof(**smr);
 	resp_queue_offset = cmd_queue_offset + sizeof(struct smr_cmd_queue) +
-			sizeof(struct smr_cmd) * attr->rx_count;
-	inject_pool_offset = resp_queue_offset + sizeof(struct smr_resp_queue) +
-			sizeof(struct smr_resp) * attr->tx_count;
-	peer_addr_offset = inject_pool_offset + sizeof(struct smr_inject_pool) +
-			sizeof(struct smr_inject_pool_entry) * attr->rx_count;
-	name_offset = peer_addr_offset + sizeof(struct smr_addr) * SMR_MAX_PEERS;
+			sizeof(struct smr_cmd_queue_entry) * attr->rx_count;
+	inject_queue_offset = resp_queue_offset + sizeof(struct smr_resp_queue) +
+			sizeof(struct smr_resp_queue_entry) * attr->tx_count;
+	inject_pool_offset = inject_queue_offset +
+			sizeof(struct smr_inject_queue) +
+			sizeof(struct smr_inject_queue_entry) * attr->rx_count;
+	sar_pool_offset = inject_pool_offset +
+			sizeof(struct smr_inject_buf) * attr->rx_count;
+	fbox_pool_offset = sar_pool_offset +
+			sizeof(struct smr_sar_buf) * SMR_SAR_COUNT;
+	mr_export_offset = fbox_pool_offset + SMR_FBOX_BYTES * SMR_FBOX_COUNT;
+	peer_addr_offset = mr_export_offset +
+			sizeof(struct smr_mr_export) * SMR_MR_EXPORT_COUNT;
+	name_index_offset = peer_addr_offset +
+			sizeof(struct smr_addr) * map->max_peers;
+	name_index_size = roundup_power_of_two(map->max_peers * 2);
+	name_offset = name_index_offset + sizeof(int32_t) * name_index_size;
 	total_size = name_offset + strlen(attr->name) + 1;
 	total_size = roundup_power_of_two(total_size);
 
@@ -90,6 +104,28 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 
 	close(fd);
 
+	/*
+	 * The region is written by peers but polled by its owner, so keep its
+	 * pages on the owner's node, including those (e.g. inject buffers)
+	 * that a peer touches first.
+	 */
+	node = ofi_numa_node_self();
+	if (node >= 0) {
+		ret = ofi_mbind_node(mapped_addr, total_size, node);
+		if (ret)
+			FI_INFO(prov, FI_LOG_EP_CTRL,
+				"unable to bind region %s to NUMA node %d: %s\n",
+				attr->name, node, fi_strerror(-ret));
+	}
+
+	if (attr->flags & SMR_ATTR_HUGEPAGES) {
+		ret = ofi_madvise_hugepage(mapped_addr, total_size);
+		if (ret)
+			FI_INFO(prov, FI_LOG_EP_CTRL,
+				"huge pages unavailable for region %s: %s\n",
+				attr->name, fi_strerror(-ret));
+	}
+
 	*smr = mapped_addr;
 	fastlock_init(&(*smr)->lock);
 	fastlock_acquire(&(*smr)->lock);
@@ -97,25 +133,58 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->map = map;
 	(*smr)->version = SMR_VERSION;
 	(*smr)->flags = SMR_FLAG_ATOMIC | SMR_FLAG_DEBUG;
-	(*smr)->pid = getpid();
 
 	(*smr)->total_size = total_size;
+	(*smr)->max_peers = map->max_peers;
+	(*smr)->name_index_size = name_index_size;
 	(*smr)->cmd_queue_offset = cmd_queue_offset;
 	(*smr)->resp_queue_offset = resp_queue_offset;
+	(*smr)->inject_queue_offset = inject_queue_offset;
 	(*smr)->inject_pool_offset = inject_pool_offset;
+	(*smr)->sar_pool_offset = sar_pool_offset;
+	(*smr)->fbox_pool_offset = fbox_pool_offset;
+	(*smr)->mr_export_offset = mr_export_offset;
 	(*smr)->peer_addr_offset = peer_addr_offset;
+	(*smr)->name_index_offset = name_index_offset;
 	(*smr)->name_offset = name_offset;
-	(*smr)->cmd_cnt = attr->rx_count;
+	ofi_atomic_initialize64(&(*smr)->cmd_cnt, attr->rx_count);
+	(*smr)->signal = 0;
+	ofi_atomic_initialize32(&(*smr)->waiters, 0);
+	ofi_atomic_initialize32(&(*smr)->fbox_detached, 0);
+	ofi_atomic_initialize32(&(*smr)->mr_export_cnt, 0);
 
 	smr_cmd_queue_init(smr_cmd_queue(*smr), attr->rx_count);
 	smr_resp_queue_init(smr_resp_queue(*smr), attr->tx_count);
-	smr_inject_pool_init(smr_inject_pool(*smr), attr->rx_count);
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	smr_inject_queue_init(smr_inject_queue(*smr), attr->rx_count);
+	for (i = 0; i < attr->rx_count; i++)
+		smr_inject_queue_enqueue(smr_inject_queue(*smr), i);
+	for (i = 0; i < SMR_SAR_COUNT; i++) {
+		ofi_atomic_initialize64(&smr_sar_pool(*smr)[i].produced, 0);
+		ofi_atomic_initialize64(&smr_sar_pool(*smr)[i].consumed, 0);
+	}
+	for (i = 0; i < SMR_FBOX_COUNT; i++) {
+		ofi_atomic_initialize32(&(*smr)->fbox_owner[i], 0);
+		smr_cmd_queue_init(smr_fbox(*smr, i), SMR_FBOX_SIZE);
+	}
+	for (i = 0; i < SMR_MR_EXPORT_COUNT; i++) {
+		ofi_atomic_initialize32(&smr_mr_export(*smr)[i].seq, 0);
+		smr_mr_export(*smr)[i].len = 0;
+	}
+	for (i = 0; i < map->max_peers; i++)
 		smr_peer_addr_init(&smr_peer_addr(*smr)[i]);
+	memset(smr_name_index(*smr), 0, sizeof(int32_t) * name_index_size);
 
 	strncpy((char *) smr_name(*smr), attr->name, total_size - name_offset);
+
+	/* peers do not lock the region; pid marks it ready for use */
+	(*smr)->pid = getpid();
 	fastlock_release(&(*smr)->lock);
 
+	FI_INFO(prov, FI_LOG_EP_CTRL, "region %s: %zu bytes, cmd queue on "
+		"NUMA node %d, inject pool on node %d (owner on node %d)%s\n",
+		attr->name, total_size, ofi_mem_node(smr_cmd_queue(*smr)),
+		ofi_mem_node(smr_inject_pool(*smr)), node,
+		attr->flags & SMR_ATTR_HUGEPAGES ? ", huge pages advised" : "");
 	return 0;
 
 err2:
@@ -134,32 +203,44 @@ void smr_free(struct smr_region *smr)
 int smr_map_create(const struct fi_provider *prov, int peer_count,
 		   struct smr_map **map)
 {
-	int i;
-
 	(*map) = calloc(1, sizeof(struct smr_map));
 	if (!*map) {
 		FI_WARN(prov, FI_LOG_DOMAIN, "failed to create SHM region group\n");
 		return -FI_ENOMEM;
 	}
 
-	for (i = 0; i < peer_count; i++)
-		smr_peer_addr_init(&(*map)->peers[i].peer);
-
+	(*map)->max_peers = peer_count;
 	fastlock_init(&(*map)->lock);
 
 	return 0;
 }
 
-int smr_map_to_region(const struct fi_provider *prov, struct smr_peer *peer_buf)
+int smr_map_to_region(const struct fi_provider *prov, struct smr_map *map,
+		      int id)
 {
+	struct smr_peer *peer_buf;
 	struct smr_region *peer;
 	size_t size;
 	int fd, ret = 0;
 
+	fastlock_acquire(&map->lock);
+	peer_buf = smr_map_peer(map, id);
+	if (!peer_buf) {
+		ret = -FI_EINVAL;
+		goto unlock;
+	}
+	if (peer_buf->region)
+		goto unlock;
+
 	fd = shm_open(peer_buf->peer.name, O_RDWR, S_IRUSR | S_IWUSR);
 	if (fd < 0) {
-		FI_WARN(prov, FI_LOG_AV, "shm_open error\n");
-		return -errno;
+		ret = -errno;
+		/* a peer that has not created its region yet is retried */
+		if (ret == -FI_ENOENT)
+			FI_DBG(prov, FI_LOG_AV, "shm_open error\n");
+		else
+			FI_WARN(prov, FI_LOG_AV, "shm_open error\n");
+		goto unlock;
 	}
 
 	peer = mmap(NULL, sizeof(*peer), PROT_READ | PROT_WRITE,
@@ -171,49 +252,132 @@ int smr_map_to_region(const struct fi_provider *prov, struct smr_peer *peer_buf)
 	}
 
 	if (!peer->pid) {
-		FI_WARN(prov, FI_LOG_AV, "peer not initialized\n");
+		FI_DBG(prov, FI_LOG_AV, "peer not initialized\n");
 		munmap(peer, sizeof(*peer));
 		ret = -FI_EAGAIN;
 		goto out;
 	}
 
+	if (peer->version != SMR_VERSION) {
+		FI_WARN(prov, FI_LOG_AV, "peer region version %d, expected %d\n",
+			peer->version, SMR_VERSION);
+		munmap(peer, sizeof(*peer));
+		ret = -FI_EINVAL;
+		goto out;
+	}
+
 	size = peer->total_size;
 	munmap(peer, sizeof(*peer));
 
 	peer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (peer == MAP_FAILED) {
+		FI_WARN(prov, FI_LOG_AV, "mmap error\n");
+		ret = -errno;
+		goto out;
+	}
 	peer_buf->region = peer;
+	peer_buf->peer.addr = id;
 
 out:
 	close(fd);
+unlock:
+	fastlock_release(&map->lock);
 	return ret;
 }
 
+static uint32_t smr_name_hash(const char *name)
+{
+	uint32_t hashv;
+
+	HASH_FNV(name, strnlen(name, SMR_NAME_SIZE), hashv);
+	return hashv;
+}
+
+/* Returns the index of the peer address entry holding name, or -1 */
+static int smr_name_index_find(struct smr_region *smr, const char *name)
+{
+	int32_t *name_index = smr_name_index(smr);
+	int mask = smr->name_index_size - 1;
+	int i, n, slot;
+
+	slot = smr_name_hash(name) & mask;
+	for (n = 0; n < smr->name_index_size; n++, slot = (slot + 1) & mask) {
+		i = name_index[slot];
+		if (!i)
+			break;
+		if (i > 0 && !strncmp(smr_peer_addr(smr)[i - 1].name, name,
+				      SMR_NAME_SIZE))
+			return i - 1;
+	}
+	return -1;
+}
+
+static void smr_name_index_insert(struct smr_region *smr, int index)
+{
+	int32_t *name_index = smr_name_index(smr);
+	int mask = smr->name_index_size - 1;
+	int slot;
+
+	slot = smr_name_hash(smr_peer_addr(smr)[index].name) & mask;
+	while (name_index[slot] > 0)
+		slot = (slot + 1) & mask;
+	name_index[slot] = index + 1;
+}
+
+static void smr_name_index_remove(struct smr_region *smr, int index)
+{
+	int32_t *name_index = smr_name_index(smr);
+	int mask = smr->name_index_size - 1;
+	int n, slot;
+
+	slot = smr_name_hash(smr_peer_addr(smr)[index].name) & mask;
+	for (n = 0; n < smr->name_index_size; n++, slot = (slot + 1) & mask) {
+		if (!name_index[slot])
+			return;
+		if (name_index[slot] == index + 1) {
+			name_index[slot] = -1;
+			return;
+		}
+	}
+}
+
+/*
+ * Record the peer's name in the endpoint's address table and, once the
+ * peer's region has been mapped, exchange indices with the peer so that
+ * each side can identify the other's commands.
+ */
 void smr_map_to_endpoint(struct smr_region *region, int index)
 {
 	struct smr_region *peer_smr;
 	struct smr_addr *local_peers, *peer_peers;
+	struct smr_peer *peer;
 	int peer_index;
 
+	peer = smr_map_peer(region->map, index);
+	if (!peer || index >= region->max_peers)
+		return;
+
 	local_peers = smr_peer_addr(region);
+	if (strncmp(local_peers[index].name, peer->peer.name, SMR_NAME_SIZE)) {
+		if (local_peers[index].name[0])
+			smr_name_index_remove(region, index);
+		strncpy(local_peers[index].name, peer->peer.name,
+			SMR_NAME_SIZE);
+		local_peers[index].name[SMR_NAME_SIZE - 1] = '\0';
+		smr_name_index_insert(region, index);
+	}
 
-	strncpy(smr_peer_addr(region)[index].name,
-		region->map->peers[index].peer.name, SMR_NAME_SIZE);
-	smr_peer_addr(region)[index].name[SMR_NAME_SIZE - 1] = '\0';
-	if (region->map->peers[index].peer.addr == FI_ADDR_UNSPEC)
+	peer_smr = peer->region;
+	if (!peer_smr)
 		return;
 
-	peer_smr = smr_peer_region(region, index);
-	peer_peers = smr_peer_addr(peer_smr);
+	peer_index = smr_name_index_find(peer_smr, smr_name(region));
+	if (peer_index < 0)
+		return;
 
-	for (peer_index = 0; peer_index < SMR_MAX_PEERS; peer_index++) {
-		if (!strncmp(smr_name(region),
-		    peer_peers[peer_index].name, SMR_NAME_SIZE))
-			break;
-	}
-	if (peer_index != SMR_MAX_PEERS) {
-		peer_peers[peer_index].addr = index;
-		local_peers[index].addr = peer_index;
-	}
+	peer_peers = smr_peer_addr(peer_smr);
+	peer_peers[peer_index].addr = index;
+	local_peers[index].addr = peer_index;
 }
 
 void smr_unmap_from_endpoint(struct smr_region *region, int index)
@@ -222,66 +386,90 @@ void smr_unmap_from_endpoint(struct smr_region *region, int index)
 	struct smr_addr *local_peers, *peer_peers;
 	int peer_index;
 
-	local_peers = smr_peer_addr(region);
+	if (index < 0 || index >= region->max_peers)
+		return;
 
+	local_peers = smr_peer_addr(region);
+	if (local_peers[index].name[0])
+		smr_name_index_remove(region, index);
 	memset(local_peers[index].name, 0, SMR_NAME_SIZE);
-	peer_index = region->map->peers[index].peer.addr;
-	if (peer_index == FI_ADDR_UNSPEC)
-		return;
 
+	peer_index = (int) local_peers[index].addr;
+	local_peers[index].addr = FI_ADDR_UNSPEC;
 	peer_smr = smr_peer_region(region, index);
-	peer_peers = smr_peer_addr(peer_smr);
+	if (peer_index == (int) FI_ADDR_UNSPEC || !peer_smr)
+		return;
 
+	peer_peers = smr_peer_addr(peer_smr);
 	peer_peers[peer_index].addr = FI_ADDR_UNSPEC;
 }
 
 void smr_exchange_all_peers(struct smr_region *region)
 {
 	int i;
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+
+	for (i = 0; i < region->max_peers; i++)
 		smr_map_to_endpoint(region, i);
 }
 
 int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		const char *name, int id)
 {
+	struct smr_peer *peer;
 	int ret = 0;
 
+	if (id < 0 || id >= map->max_peers) {
+		FI_WARN(prov, FI_LOG_AV, "peer index %d exceeds AV size %d\n",
+			id, map->max_peers);
+		return -FI_ENOSPC;
+	}
+
 	fastlock_acquire(&map->lock);
-	strncpy(map->peers[id].peer.name, name, SMR_NAME_SIZE);
-	map->peers[id].peer.name[SMR_NAME_SIZE - 1] = '\0';
-	ret = smr_map_to_region(prov, &map->peers[id]);
-	if (!ret)
-		map->peers[id].peer.addr = id;
+	peer = ofi_idm_lookup(&map->peers, id);
+	if (!peer) {
+		peer = calloc(1, sizeof(*peer));
+		if (!peer) {
+			ret = -FI_ENOMEM;
+			goto unlock;
+		}
+		if (ofi_idm_set(&map->peers, id, peer) < 0) {
+			free(peer);
+			ret = -FI_ENOMEM;
+			goto unlock;
+		}
+		peer->peer.addr = FI_ADDR_UNSPEC;
+	}
+	strncpy(peer->peer.name, name, SMR_NAME_SIZE);
+	peer->peer.name[SMR_NAME_SIZE - 1] = '\0';
+unlock:
 	fastlock_release(&map->lock);
 
-	return ret == -ENOENT ? 0 : ret;
+	return ret;
 }
 
 void smr_map_del(struct smr_map *map, int id)
 {
-	if (id >= SMR_MAX_PEERS || id < 0 ||
-	    map->peers[id].peer.addr == FI_ADDR_UNSPEC)
-		return;
+	struct smr_peer *peer;
 
-	munmap(map->peers[id].region, map->peers[id].region->total_size);
-	map->peers[id].peer.addr = FI_ADDR_UNSPEC;
+	fastlock_acquire(&map->lock);
+	peer = smr_map_peer(map, id);
+	if (peer) {
+		if (peer->region)
+			munmap(peer->region, peer->region->total_size);
+		ofi_idm_clear(&map->peers, id);
+		free(peer);
+	}
+	fastlock_release(&map->lock);
 }
 
 void smr_map_free(struct smr_map *map)
 {
 	int i;
 
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	for (i = 0; i < map->max_peers; i++)
 		smr_map_del(map, i);
 
+	ofi_idm_reset(&map->peers);
+	fastlock_destroy(&map->lock);
 	free(map);
 }
-
-struct smr_region *smr_map_get(struct smr_map *map, int id)
-{
-	if (id < 0 || id >= SMR_MAX_PEERS)
-		return NULL;
-
-	return map->peers[id].region;
-}
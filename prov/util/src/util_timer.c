@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <ofi.h>
+#include <ofi_timer.h>
+
+#define UTIL_TIMER_MASK		(OFI_TIMER_SLOTS - 1)
+#define UTIL_TIMER_RANGE	(1ULL << (OFI_TIMER_BITS * OFI_TIMER_LEVELS))
+
+static inline uint64_t util_timer_level_span(int level)
+{
+	return 1ULL << (OFI_TIMER_BITS * (level + 1));
+}
+
+static void util_timer_add(struct ofi_timer_wheel *wheel,
+			   struct ofi_timer *timer)
+{
+	uint64_t expires, delta;
+	int level;
+
+	expires = MAX(timer->expires, wheel->now);
+	delta = expires - wheel->now;
+	if (delta >= UTIL_TIMER_RANGE) {
+		expires = wheel->now + UTIL_TIMER_RANGE - 1;
+		delta = UTIL_TIMER_RANGE - 1;
+	}
+
+	for (level = 0; delta >= util_timer_level_span(level); level++)
+		;
+
+	dlist_insert_tail(&timer->entry, &wheel->slots[level]
+			  [(expires >> (OFI_TIMER_BITS * level)) & UTIL_TIMER_MASK]);
+	timer->level = level;
+	wheel->level_cnt[level]++;
+	wheel->cnt++;
+}
+
+static void util_timer_del(struct ofi_timer_wheel *wheel,
+			   struct ofi_timer *timer)
+{
+	dlist_remove_init(&timer->entry);
+	wheel->level_cnt[timer->level]--;
+	wheel->cnt--;
+}
+
+/*
+ * Called when the wheel reaches a multiple of the level 0 size: move the
+ * timers of the level 1 slot that is now due down a level, and so on up
+ * the levels that wrapped around.
+ */
+static void util_timer_cascade(struct ofi_timer_wheel *wheel)
+{
+	struct dlist_entry *slot;
+	struct ofi_timer *timer;
+	int level, idx;
+
+	for (level = 1; level < OFI_TIMER_LEVELS; level++) {
+		idx = (wheel->now >> (OFI_TIMER_BITS * level)) & UTIL_TIMER_MASK;
+		slot = &wheel->slots[level][idx];
+		while (!dlist_empty(slot)) {
+			timer = container_of(slot->next, struct ofi_timer, entry);
+			util_timer_del(wheel, timer);
+			util_timer_add(wheel, timer);
+		}
+		if (idx)
+			break;
+	}
+}
+
+/*
+ * While the lowest levels hold no timers, nothing can expire before the
+ * next slot of the first non-empty level comes due.
+ */
+static void util_timer_skip(struct ofi_timer_wheel *wheel, uint64_t now)
+{
+	uint64_t span;
+	int level;
+
+	for (level = 0; level < OFI_TIMER_LEVELS - 1 &&
+	     !wheel->level_cnt[level]; level++)
+		;
+	if (!level)
+		return;
+
+	span = util_timer_level_span(level - 1);
+	wheel->now = MIN((wheel->now + span - 1) & ~(span - 1), now + 1);
+}
+
+void ofi_timer_wheel_init(struct ofi_timer_wheel *wheel, uint64_t now)
+{
+	int level, i;
+
+	wheel->now = now;
+	wheel->cnt = 0;
+	for (level = 0; level < OFI_TIMER_LEVELS; level++) {
+		wheel->level_cnt[level] = 0;
+		for (i = 0; i < OFI_TIMER_SLOTS; i++)
+			dlist_init(&wheel->slots[level][i]);
+	}
+}
+
+/*
+ * Expire the timers due up to and including tick 'now'.  Timers that are
+ * restarted from a callback to expire by then run again on a later tick.
+ */
+int ofi_timer_wheel_run(struct ofi_timer_wheel *wheel, uint64_t now)
+{
+	struct dlist_entry expired;
+	struct ofi_timer *timer;
+	int cnt = 0;
+
+	dlist_init(&expired);
+	while (wheel->now <= now) {
+		if (!wheel->cnt) {
+			wheel->now = now + 1;
+			break;
+		}
+
+		if (!(wheel->now & UTIL_TIMER_MASK))
+			util_timer_cascade(wheel);
+
+		dlist_splice_tail(&expired,
+				  &wheel->slots[0][wheel->now & UTIL_TIMER_MASK]);
+		wheel->now++;
+
+		while (!dlist_empty(&expired)) {
+			timer = container_of(expired.next, struct ofi_timer,
+					     entry);
+			util_timer_del(wheel, timer);
+			timer->cb(wheel, timer);
+			cnt++;
+		}
+
+		util_timer_skip(wheel, now);
+	}
+	return cnt;
+}
+
+/*
+ * Return the earliest tick at which a timer may expire, or OFI_TIMER_NONE.
+ * Timers on higher levels are accounted for by the next cascade of the
+ * lowest level holding any, so the result may be early, but never late.
+ */
+uint64_t ofi_timer_wheel_next(struct ofi_timer_wheel *wheel)
+{
+	uint64_t span, next = OFI_TIMER_NONE;
+	int level, i;
+
+	if (!wheel->cnt)
+		return OFI_TIMER_NONE;
+
+	for (level = 1; level < OFI_TIMER_LEVELS &&
+	     !wheel->level_cnt[level]; level++)
+		;
+	if (level < OFI_TIMER_LEVELS) {
+		span = util_timer_level_span(level - 1);
+		next = (wheel->now + span - 1) & ~(span - 1);
+	}
+
+	for (i = 0; wheel->level_cnt[0] && i < OFI_TIMER_SLOTS; i++) {
+		if (!dlist_empty(&wheel->slots[0]
+				 [(wheel->now + i) & UTIL_TIMER_MASK]))
+			return MIN(next, wheel->now + i);
+	}
+	return next;
+}
+
+void ofi_timer_start(struct ofi_timer_wheel *wheel, struct ofi_timer *timer,
+		     uint64_t expires)
+{
+	if (ofi_timer_pending(timer))
+		util_timer_del(wheel, timer);
+
+	timer->expires = expires;
+	util_timer_add(wheel, timer);
+}
+
+void ofi_timer_stop(struct ofi_timer_wheel *wheel, struct ofi_timer *timer)
+{
+	if (ofi_timer_pending(timer))
+		util_timer_del(wheel, timer);
+}
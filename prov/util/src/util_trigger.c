@@ -0,0 +1,898 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ofi_util.h>
+
+#define UTIL_WORK_HEAP_MIN	16
+
+/*
+ * Copy of a deferred work request, along with the arrays it references, so
+ * that the application's request need not remain valid.  The copy is used
+ * as the context of the issued operation.
+ */
+struct util_work {
+	struct fi_context2	context;
+	struct fi_deferred_work	*app_work;
+	void			*app_context;
+	struct fid_cntr		*triggering_cntr;
+	struct fid_cntr		*completion_cntr;
+	struct fid_cntr		*ep_cntr;
+	enum fi_op_type		op_type;
+	uint64_t		flags;
+	union {
+		struct fi_op_msg		msg;
+		struct fi_op_tagged		tagged;
+		struct fi_op_rma		rma;
+		struct fi_op_atomic		atomic;
+		struct fi_op_fetch_atomic	fetch_atomic;
+		struct fi_op_compare_atomic	compare_atomic;
+		struct fi_op_cntr		cntr;
+	} op;
+	uint64_t		data[];
+};
+
+static inline int util_trigger_before(const struct util_trigger *a,
+				      const struct util_trigger *b)
+{
+	return a->threshold < b->threshold ||
+	       (a->threshold == b->threshold && a->seq < b->seq);
+}
+
+static void util_heap_up(struct util_cntr *cntr, size_t i)
+{
+	struct util_trigger trigger = cntr->work_heap[i];
+	size_t parent;
+
+	for (; i; i = parent) {
+		parent = (i - 1) / 2;
+		if (!util_trigger_before(&trigger, &cntr->work_heap[parent]))
+			break;
+		cntr->work_heap[i] = cntr->work_heap[parent];
+	}
+	cntr->work_heap[i] = trigger;
+}
+
+static void util_heap_down(struct util_cntr *cntr, size_t i)
+{
+	struct util_trigger trigger = cntr->work_heap[i];
+	size_t child;
+
+	for (; (child = 2 * i + 1) < cntr->work_cnt; i = child) {
+		if (child + 1 < cntr->work_cnt &&
+		    util_trigger_before(&cntr->work_heap[child + 1],
+					&cntr->work_heap[child]))
+			child++;
+		if (!util_trigger_before(&cntr->work_heap[child], &trigger))
+			break;
+		cntr->work_heap[i] = cntr->work_heap[child];
+	}
+	cntr->work_heap[i] = trigger;
+}
+
+static int util_heap_push(struct util_domain *domain, struct util_cntr *cntr,
+			  const struct util_trigger *trigger)
+{
+	struct util_trigger *heap;
+	size_t size;
+
+	if (cntr->work_cnt == cntr->work_size) {
+		size = MAX(cntr->work_size * 2, UTIL_WORK_HEAP_MIN);
+		heap = realloc(cntr->work_heap, size * sizeof(*heap));
+		if (!heap)
+			return -FI_ENOMEM;
+		cntr->work_heap = heap;
+		cntr->work_size = size;
+	}
+
+	if (!cntr->work_cnt)
+		dlist_insert_tail(&cntr->work_entry, &domain->work_cntr_list);
+	cntr->work_heap[cntr->work_cnt] = *trigger;
+	util_heap_up(cntr, cntr->work_cnt++);
+	return 0;
+}
+
+static void util_heap_remove(struct util_cntr *cntr, size_t i)
+{
+	cntr->work_heap[i] = cntr->work_heap[--cntr->work_cnt];
+	if (i < cntr->work_cnt) {
+		util_heap_up(cntr, i);
+		util_heap_down(cntr, i);
+	}
+
+	if (!cntr->work_cnt)
+		dlist_remove_init(&cntr->work_entry);
+}
+
+/* The threshold applies to the sum of the success and error counts */
+static inline int util_cntr_reached(struct util_cntr *cntr, uint64_t threshold)
+{
+	return ofi_cntr_value(cntr) + ofi_atomic_get64(&cntr->err) >=
+	       threshold;
+}
+
+static size_t util_iov_size(size_t count)
+{
+	return count * (sizeof(struct iovec) + sizeof(void *));
+}
+
+static size_t util_ioc_size(size_t count)
+{
+	return count * (sizeof(struct fi_ioc) + sizeof(void *));
+}
+
+/* Returns the size of the arrays to copy, or -FI_ENOSYS for unknown ops */
+static ssize_t util_work_data_size(const struct fi_deferred_work *work)
+{
+	const struct fi_msg_atomic *atomic;
+
+	switch (work->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_SEND:
+		return util_iov_size(work->op.msg->msg.iov_count);
+	case FI_OP_TRECV:
+	case FI_OP_TSEND:
+		return util_iov_size(work->op.tagged->msg.iov_count);
+	case FI_OP_READ:
+	case FI_OP_WRITE:
+		return util_iov_size(work->op.rma->msg.iov_count) +
+		       work->op.rma->msg.rma_iov_count *
+		       sizeof(struct fi_rma_iov);
+	case FI_OP_ATOMIC:
+		atomic = &work->op.atomic->msg;
+		break;
+	case FI_OP_FETCH_ATOMIC:
+		atomic = &work->op.fetch_atomic->msg;
+		return util_ioc_size(atomic->iov_count) +
+		       atomic->rma_iov_count * sizeof(struct fi_rma_ioc) +
+		       util_ioc_size(work->op.fetch_atomic->fetch.iov_count);
+	case FI_OP_COMPARE_ATOMIC:
+		atomic = &work->op.compare_atomic->msg;
+		return util_ioc_size(atomic->iov_count) +
+		       atomic->rma_iov_count * sizeof(struct fi_rma_ioc) +
+		       util_ioc_size(work->op.compare_atomic->fetch.iov_count) +
+		       util_ioc_size(work->op.compare_atomic->compare.iov_count);
+	case FI_OP_CNTR_SET:
+	case FI_OP_CNTR_ADD:
+		return 0;
+	default:
+		return -FI_ENOSYS;
+	}
+	return util_ioc_size(atomic->iov_count) +
+	       atomic->rma_iov_count * sizeof(struct fi_rma_ioc);
+}
+
+static void *util_work_copy(char **pos, const void *src, size_t size)
+{
+	void *dst;
+
+	if (!src)
+		return NULL;
+
+	dst = *pos;
+	memcpy(dst, src, size);
+	*pos += size;
+	return dst;
+}
+
+static void util_work_copy_iov(char **pos, const struct iovec **iov,
+			       void ***desc, size_t count)
+{
+	*iov = util_work_copy(pos, *iov, count * sizeof(**iov));
+	*desc = util_work_copy(pos, *desc, count * sizeof(**desc));
+}
+
+static void util_work_copy_ioc(char **pos, const struct fi_ioc **ioc,
+			       void ***desc, size_t count)
+{
+	*ioc = util_work_copy(pos, *ioc, count * sizeof(**ioc));
+	*desc = util_work_copy(pos, *desc, count * sizeof(**desc));
+}
+
+static void util_work_copy_atomic(char **pos, struct fi_msg_atomic *msg)
+{
+	util_work_copy_ioc(pos, &msg->msg_iov, &msg->desc, msg->iov_count);
+	msg->rma_iov = util_work_copy(pos, msg->rma_iov, msg->rma_iov_count *
+				      sizeof(*msg->rma_iov));
+}
+
+static struct util_work *util_work_alloc(const struct fi_deferred_work *work)
+{
+	struct util_work *uwork;
+	struct fi_msg_fetch *fetch;
+	ssize_t size;
+	char *pos;
+
+	size = util_work_data_size(work);
+	if (size < 0)
+		return NULL;
+
+	uwork = calloc(1, sizeof(*uwork) + size);
+	if (!uwork)
+		return NULL;
+
+	uwork->app_work = (struct fi_deferred_work *) work;
+	uwork->triggering_cntr = work->triggering_cntr;
+	uwork->completion_cntr = work->completion_cntr;
+	uwork->op_type = work->op_type;
+	pos = (char *) uwork->data;
+
+	switch (work->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_SEND:
+		uwork->op.msg = *work->op.msg;
+		uwork->app_context = uwork->op.msg.msg.context;
+		uwork->op.msg.msg.context = uwork;
+		uwork->flags = uwork->op.msg.flags;
+		util_work_copy_iov(&pos, &uwork->op.msg.msg.msg_iov,
+				   &uwork->op.msg.msg.desc,
+				   uwork->op.msg.msg.iov_count);
+		break;
+	case FI_OP_TRECV:
+	case FI_OP_TSEND:
+		uwork->op.tagged = *work->op.tagged;
+		uwork->app_context = uwork->op.tagged.msg.context;
+		uwork->op.tagged.msg.context = uwork;
+		uwork->flags = uwork->op.tagged.flags;
+		util_work_copy_iov(&pos, &uwork->op.tagged.msg.msg_iov,
+				   &uwork->op.tagged.msg.desc,
+				   uwork->op.tagged.msg.iov_count);
+		break;
+	case FI_OP_READ:
+	case FI_OP_WRITE:
+		uwork->op.rma = *work->op.rma;
+		uwork->app_context = uwork->op.rma.msg.context;
+		uwork->op.rma.msg.context = uwork;
+		uwork->flags = uwork->op.rma.flags;
+		util_work_copy_iov(&pos, &uwork->op.rma.msg.msg_iov,
+				   &uwork->op.rma.msg.desc,
+				   uwork->op.rma.msg.iov_count);
+		uwork->op.rma.msg.rma_iov =
+			util_work_copy(&pos, uwork->op.rma.msg.rma_iov,
+				       uwork->op.rma.msg.rma_iov_count *
+				       sizeof(struct fi_rma_iov));
+		break;
+	case FI_OP_ATOMIC:
+		uwork->op.atomic = *work->op.atomic;
+		uwork->app_context = uwork->op.atomic.msg.context;
+		uwork->op.atomic.msg.context = uwork;
+		uwork->flags = uwork->op.atomic.flags;
+		util_work_copy_atomic(&pos, &uwork->op.atomic.msg);
+		break;
+	case FI_OP_FETCH_ATOMIC:
+		uwork->op.fetch_atomic = *work->op.fetch_atomic;
+		uwork->app_context = uwork->op.fetch_atomic.msg.context;
+		uwork->op.fetch_atomic.msg.context = uwork;
+		uwork->flags = uwork->op.fetch_atomic.flags;
+		util_work_copy_atomic(&pos, &uwork->op.fetch_atomic.msg);
+		fetch = &uwork->op.fetch_atomic.fetch;
+		util_work_copy_ioc(&pos, (const struct fi_ioc **) &fetch->msg_iov,
+				   &fetch->desc, fetch->iov_count);
+		break;
+	case FI_OP_COMPARE_ATOMIC:
+		uwork->op.compare_atomic = *work->op.compare_atomic;
+		uwork->app_context = uwork->op.compare_atomic.msg.context;
+		uwork->op.compare_atomic.msg.context = uwork;
+		uwork->flags = uwork->op.compare_atomic.flags;
+		util_work_copy_atomic(&pos, &uwork->op.compare_atomic.msg);
+		fetch = &uwork->op.compare_atomic.fetch;
+		util_work_copy_ioc(&pos, (const struct fi_ioc **) &fetch->msg_iov,
+				   &fetch->desc, fetch->iov_count);
+		util_work_copy_ioc(&pos, &uwork->op.compare_atomic.compare.msg_iov,
+				   &uwork->op.compare_atomic.compare.desc,
+				   uwork->op.compare_atomic.compare.iov_count);
+		break;
+	default:
+		uwork->op.cntr = *work->op.cntr;
+		break;
+	}
+
+	return uwork;
+}
+
+static struct util_ep *util_work_ep(const struct fi_deferred_work *work)
+{
+	struct fid_ep *ep;
+
+	switch (work->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_SEND:
+		ep = work->op.msg->ep;
+		break;
+	case FI_OP_TRECV:
+	case FI_OP_TSEND:
+		ep = work->op.tagged->ep;
+		break;
+	case FI_OP_READ:
+	case FI_OP_WRITE:
+		ep = work->op.rma->ep;
+		break;
+	case FI_OP_ATOMIC:
+		ep = work->op.atomic->ep;
+		break;
+	case FI_OP_FETCH_ATOMIC:
+		ep = work->op.fetch_atomic->ep;
+		break;
+	default:
+		ep = work->op.compare_atomic->ep;
+		break;
+	}
+	return ofi_ep_unalias(ep);
+}
+
+static inline int util_work_is_recv(enum fi_op_type op_type)
+{
+	return op_type == FI_OP_RECV || op_type == FI_OP_TRECV;
+}
+
+/* Returns the endpoint counter that the data transfer updates, if bound */
+static struct fid_cntr *util_work_ep_cntr(const struct fi_deferred_work *work)
+{
+	struct util_ep *ep = util_work_ep(work);
+	struct util_cntr *cntr;
+
+	switch (work->op_type) {
+	case FI_OP_RECV:
+	case FI_OP_TRECV:
+		cntr = ep->rx_cntr;
+		break;
+	case FI_OP_SEND:
+	case FI_OP_TSEND:
+		cntr = ep->tx_cntr;
+		break;
+	case FI_OP_WRITE:
+	case FI_OP_ATOMIC:
+		cntr = ep->wr_cntr;
+		break;
+	default:
+		cntr = ep->rd_cntr;
+		break;
+	}
+	return cntr ? &cntr->cntr_fid : NULL;
+}
+
+/*
+ * Issued work is completed from the CQ write path, so data transfers are
+ * refused on endpoints without a CQ in their direction, such as endpoints
+ * that only have counters bound.
+ */
+static int util_work_check(struct util_domain *domain,
+			   const struct fi_deferred_work *work)
+{
+	struct util_cntr *cntr;
+	struct util_ep *ep;
+
+	if (!work || !work->triggering_cntr)
+		return -FI_EINVAL;
+
+	cntr = container_of(work->triggering_cntr, struct util_cntr, cntr_fid);
+	if (cntr->domain != domain) {
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"triggering counter belongs to another domain\n");
+		return -FI_EINVAL;
+	}
+
+	switch (work->op_type) {
+	case FI_OP_CNTR_SET:
+	case FI_OP_CNTR_ADD:
+		/* only the referenced counter is updated */
+		return work->completion_cntr ? -FI_EINVAL : 0;
+	default:
+		if (util_work_data_size(work) < 0)
+			return -FI_ENOSYS;
+		break;
+	}
+
+	ep = util_work_ep(work);
+	if (ep->domain != domain) {
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"endpoint belongs to another domain\n");
+		return -FI_EINVAL;
+	}
+
+	if (!(util_work_is_recv(work->op_type) ? ep->rx_cq : ep->tx_cq)) {
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"deferred data transfers require a CQ on the endpoint\n");
+		return -FI_EINVAL;
+	}
+	return 0;
+}
+
+static int util_work_is_cntr_op(struct util_work *uwork)
+{
+	return uwork->op_type == FI_OP_CNTR_SET ||
+	       uwork->op_type == FI_OP_CNTR_ADD;
+}
+
+/*
+ * Completions are always requested, so that the completion counter can be
+ * updated.  They only reach the CQ if the application asked for them.
+ */
+static ssize_t util_work_start(struct util_work *uwork)
+{
+	struct fi_op_fetch_atomic *fetch_atomic;
+	struct fi_op_compare_atomic *compare_atomic;
+	uint64_t flags = uwork->flags | FI_COMPLETION;
+
+	switch (uwork->op_type) {
+	case FI_OP_RECV:
+		return fi_recvmsg(uwork->op.msg.ep, &uwork->op.msg.msg, flags);
+	case FI_OP_SEND:
+		return fi_sendmsg(uwork->op.msg.ep, &uwork->op.msg.msg, flags);
+	case FI_OP_TRECV:
+		return fi_trecvmsg(uwork->op.tagged.ep, &uwork->op.tagged.msg,
+				   flags);
+	case FI_OP_TSEND:
+		return fi_tsendmsg(uwork->op.tagged.ep, &uwork->op.tagged.msg,
+				   flags);
+	case FI_OP_READ:
+		return fi_readmsg(uwork->op.rma.ep, &uwork->op.rma.msg, flags);
+	case FI_OP_WRITE:
+		return fi_writemsg(uwork->op.rma.ep, &uwork->op.rma.msg, flags);
+	case FI_OP_ATOMIC:
+		return fi_atomicmsg(uwork->op.atomic.ep, &uwork->op.atomic.msg,
+				    flags);
+	case FI_OP_FETCH_ATOMIC:
+		fetch_atomic = &uwork->op.fetch_atomic;
+		return fi_fetch_atomicmsg(fetch_atomic->ep, &fetch_atomic->msg,
+					  fetch_atomic->fetch.msg_iov,
+					  fetch_atomic->fetch.desc,
+					  fetch_atomic->fetch.iov_count, flags);
+	case FI_OP_COMPARE_ATOMIC:
+		compare_atomic = &uwork->op.compare_atomic;
+		return fi_compare_atomicmsg(compare_atomic->ep,
+					    &compare_atomic->msg,
+					    compare_atomic->compare.msg_iov,
+					    compare_atomic->compare.desc,
+					    compare_atomic->compare.iov_count,
+					    compare_atomic->fetch.msg_iov,
+					    compare_atomic->fetch.desc,
+					    compare_atomic->fetch.iov_count,
+					    flags);
+	case FI_OP_CNTR_SET:
+		return fi_cntr_set(uwork->op.cntr.cntr, uwork->op.cntr.value);
+	case FI_OP_CNTR_ADD:
+		return fi_cntr_add(uwork->op.cntr.cntr, uwork->op.cntr.value);
+	default:
+		assert(0);
+		return -FI_ENOSYS;
+	}
+}
+
+static int util_work_untrack(struct util_domain *domain,
+			     struct util_work *uwork)
+{
+	struct ofi_rbnode *node;
+
+	fastlock_acquire(&domain->work_lock);
+	node = ofi_rbmap_find(&domain->work_map, uwork);
+	if (node) {
+		ofi_rbmap_delete(&domain->work_map, node);
+		ofi_atomic_dec32(&domain->work_active);
+	}
+	fastlock_release(&domain->work_lock);
+	return node != NULL;
+}
+
+/* Issued work is tracked before it starts, as it may complete inline */
+static ssize_t util_work_issue(struct util_domain *domain,
+			       struct util_work *uwork)
+{
+	ssize_t ret;
+
+	fastlock_acquire(&domain->work_lock);
+	ret = ofi_rbmap_insert(&domain->work_map, uwork, uwork);
+	if (!ret)
+		ofi_atomic_inc32(&domain->work_active);
+	fastlock_release(&domain->work_lock);
+	if (ret)
+		return ret;
+
+	ret = util_work_start(uwork);
+	if (ret)
+		(void) util_work_untrack(domain, uwork);
+	return ret;
+}
+
+/* Returns the ready work with the lowest threshold of the first counter */
+static int util_work_pop(struct util_domain *domain,
+			 struct util_trigger *trigger)
+{
+	struct util_cntr *cntr;
+
+	dlist_foreach_container(&domain->work_cntr_list, struct util_cntr,
+				cntr, work_entry) {
+		if (util_cntr_reached(cntr, cntr->work_heap[0].threshold)) {
+			*trigger = cntr->work_heap[0];
+			util_heap_remove(cntr, 0);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Issue all work whose threshold has been reached, in threshold order per
+ * counter.  Only the top of each counter's heap is examined.  Work that
+ * cannot be started for lack of resources is put back and retried on the
+ * next call.
+ */
+void ofi_run_work(struct util_domain *domain)
+{
+	struct util_trigger trigger;
+	struct util_work *uwork;
+	struct util_cntr *cntr;
+	ssize_t ret;
+
+	for (;;) {
+		fastlock_acquire(&domain->work_lock);
+		ret = util_work_pop(domain, &trigger);
+		fastlock_release(&domain->work_lock);
+		if (!ret)
+			break;
+
+		/* counter updates complete at once, and have no completion */
+		uwork = trigger.work;
+		if (util_work_is_cntr_op(uwork)) {
+			ret = util_work_start(uwork);
+			if (!ret) {
+				free(uwork);
+				continue;
+			}
+		} else {
+			ret = util_work_issue(domain, uwork);
+			if (!ret)
+				continue;
+		}
+
+		if (ret == -FI_EAGAIN) {
+			cntr = container_of(uwork->triggering_cntr,
+					    struct util_cntr, cntr_fid);
+			fastlock_acquire(&domain->work_lock);
+			ret = util_heap_push(domain, cntr, &trigger);
+			fastlock_release(&domain->work_lock);
+			if (!ret)
+				break;
+		}
+
+		FI_WARN(domain->prov, FI_LOG_DOMAIN,
+			"unable to start deferred work: %s\n",
+			fi_strerror((int) -ret));
+		if (uwork->completion_cntr)
+			fi_cntr_adderr(uwork->completion_cntr, 1);
+		free(uwork);
+	}
+}
+
+/* Triggered operations have no application request to cancel */
+static int util_queue_work(struct util_domain *domain,
+			   struct fi_deferred_work *work,
+			   struct fi_deferred_work *app_work)
+{
+	struct util_trigger trigger;
+	struct util_cntr *cntr;
+	int ret;
+
+	ret = util_work_check(domain, work);
+	if (ret)
+		return ret;
+
+	trigger.work = util_work_alloc(work);
+	if (!trigger.work)
+		return -FI_ENOMEM;
+	trigger.work->app_work = app_work;
+	if (!util_work_is_cntr_op(trigger.work))
+		trigger.work->ep_cntr = util_work_ep_cntr(work);
+
+	cntr = container_of(work->triggering_cntr, struct util_cntr, cntr_fid);
+	trigger.threshold = work->threshold;
+
+	fastlock_acquire(&domain->work_lock);
+	trigger.seq = domain->work_seq++;
+	ret = util_heap_push(domain, cntr, &trigger);
+	fastlock_release(&domain->work_lock);
+	if (ret) {
+		free(trigger.work);
+		return ret;
+	}
+
+	if (util_cntr_reached(cntr, work->threshold))
+		ofi_run_work(domain);
+	return 0;
+}
+
+int ofi_queue_work(struct util_domain *domain, struct fi_deferred_work *work)
+{
+	return util_queue_work(domain, work, work);
+}
+
+/*
+ * Triggered operations:
+ * A data transfer call made with FI_TRIGGER is queued as deferred work,
+ * with the threshold and counter of the fi_triggered_context passed as its
+ * context.  The completion is reported to the endpoint's CQ and counter
+ * as for any other transfer, with the triggered context as its context.
+ * Data is not copied, so FI_INJECT is not supported.
+ */
+static int util_trigger_init(struct fi_deferred_work *work,
+			     struct fid_ep *ep_fid, void *context,
+			     uint64_t *flags, enum fi_op_type op_type)
+{
+	struct fi_triggered_context *trig_context = context;
+	struct util_ep *ep;
+
+	if (!trig_context ||
+	    trig_context->event_type != FI_TRIGGER_THRESHOLD ||
+	    *flags & FI_INJECT)
+		return -FI_EINVAL;
+
+	ep = container_of(ep_fid, struct util_ep, ep_fid);
+	*flags &= ~FI_TRIGGER;
+	*flags |= util_work_is_recv(op_type) ?
+		  ep->rx_msg_flags : ep->tx_msg_flags;
+
+	memset(work, 0, sizeof(*work));
+	work->threshold = trig_context->trigger.threshold.threshold;
+	work->triggering_cntr = trig_context->trigger.threshold.cntr;
+	work->op_type = op_type;
+	return 0;
+}
+
+static inline struct util_domain *util_trigger_domain(struct fid_ep *ep_fid)
+{
+	return container_of(ep_fid, struct util_ep, ep_fid)->domain;
+}
+
+int ofi_trigger_msg(struct fid_ep *ep, const struct fi_msg *msg,
+		    uint64_t flags, enum fi_op_type op_type)
+{
+	struct fi_deferred_work work;
+	struct fi_op_msg op = {
+		.ep = ep,
+		.msg = *msg,
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags, op_type);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.msg = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_trigger_tagged(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		       uint64_t flags, enum fi_op_type op_type)
+{
+	struct fi_deferred_work work;
+	struct fi_op_tagged op = {
+		.ep = ep,
+		.msg = *msg,
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags, op_type);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.tagged = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_trigger_rma(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		    uint64_t flags, enum fi_op_type op_type)
+{
+	struct fi_deferred_work work;
+	struct fi_op_rma op = {
+		.ep = ep,
+		.msg = *msg,
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags, op_type);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.rma = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_trigger_atomic(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       uint64_t flags)
+{
+	struct fi_deferred_work work;
+	struct fi_op_atomic op = {
+		.ep = ep,
+		.msg = *msg,
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags,
+				FI_OP_ATOMIC);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.atomic = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_trigger_fetch_atomic(struct fid_ep *ep,
+			     const struct fi_msg_atomic *msg,
+			     struct fi_ioc *resultv, void **result_desc,
+			     size_t result_count, uint64_t flags)
+{
+	struct fi_deferred_work work;
+	struct fi_op_fetch_atomic op = {
+		.ep = ep,
+		.msg = *msg,
+		.fetch = {
+			.msg_iov = resultv,
+			.desc = result_desc,
+			.iov_count = result_count,
+		},
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags,
+				FI_OP_FETCH_ATOMIC);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.fetch_atomic = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_trigger_compare_atomic(struct fid_ep *ep,
+			       const struct fi_msg_atomic *msg,
+			       const struct fi_ioc *comparev,
+			       void **compare_desc, size_t compare_count,
+			       struct fi_ioc *resultv, void **result_desc,
+			       size_t result_count, uint64_t flags)
+{
+	struct fi_deferred_work work;
+	struct fi_op_compare_atomic op = {
+		.ep = ep,
+		.msg = *msg,
+		.fetch = {
+			.msg_iov = resultv,
+			.desc = result_desc,
+			.iov_count = result_count,
+		},
+		.compare = {
+			.msg_iov = comparev,
+			.desc = compare_desc,
+			.iov_count = compare_count,
+		},
+	};
+	int ret;
+
+	ret = util_trigger_init(&work, ep, msg->context, &flags,
+				FI_OP_COMPARE_ATOMIC);
+	if (ret)
+		return ret;
+
+	op.flags = flags;
+	work.op.compare_atomic = &op;
+	return util_queue_work(util_trigger_domain(ep), &work, NULL);
+}
+
+int ofi_cancel_work(struct util_domain *domain, struct fi_deferred_work *work)
+{
+	struct util_work *uwork = NULL;
+	struct util_cntr *cntr;
+	size_t i;
+
+	if (!work || !work->triggering_cntr)
+		return -FI_EINVAL;
+
+	cntr = container_of(work->triggering_cntr, struct util_cntr, cntr_fid);
+	if (cntr->domain != domain)
+		return -FI_EINVAL;
+
+	fastlock_acquire(&domain->work_lock);
+	for (i = 0; i < cntr->work_cnt; i++) {
+		if (cntr->work_heap[i].work->app_work == work) {
+			uwork = cntr->work_heap[i].work;
+			util_heap_remove(cntr, i);
+			break;
+		}
+	}
+	fastlock_release(&domain->work_lock);
+
+	if (!uwork)
+		return -FI_ENOENT;
+	free(uwork);
+	return 0;
+}
+
+static void util_cntr_flush_work(struct util_cntr *cntr)
+{
+	while (cntr->work_cnt)
+		free(cntr->work_heap[--cntr->work_cnt].work);
+	dlist_remove_init(&cntr->work_entry);
+}
+
+/* Cancel the queued work of one counter, or of all counters if NULL */
+int ofi_flush_work(struct util_domain *domain, struct util_cntr *cntr)
+{
+	if (cntr && cntr->domain != domain)
+		return -FI_EINVAL;
+
+	fastlock_acquire(&domain->work_lock);
+	if (cntr) {
+		util_cntr_flush_work(cntr);
+	} else {
+		while (!dlist_empty(&domain->work_cntr_list)) {
+			cntr = container_of(domain->work_cntr_list.next,
+					    struct util_cntr, work_entry);
+			util_cntr_flush_work(cntr);
+		}
+	}
+	fastlock_release(&domain->work_lock);
+	return 0;
+}
+
+/*
+ * Called from the progress of the endpoint, which may hold the locks taken
+ * by the provider's counter calls, so the counter is updated directly.
+ */
+int ofi_complete_work(struct util_domain *domain, void **context, int err)
+{
+	struct util_work *uwork = *context;
+	int ret;
+
+	if (!util_work_untrack(domain, uwork))
+		return 0;
+
+	/* the endpoint has already counted the operation on its own counter */
+	if (uwork->completion_cntr && uwork->completion_cntr != uwork->ep_cntr) {
+		if (err)
+			ofi_cntr_adderr(uwork->completion_cntr, 1);
+		else
+			ofi_cntr_add(uwork->completion_cntr, 1);
+	}
+
+	ret = !(uwork->flags & FI_COMPLETION);
+	*context = uwork->app_context;
+	free(uwork);
+	return ret;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks every build of the reduce handlers that the CPU can run, and the
+ * one selected by ofi_atomic_reduce_init(), against the write handlers.
+ * Each handler is run for counts covering several vectors plus every tail
+ * length, with the source and target at each misalignment within an
+ * element.  The write handlers run on aligned copies of the same data.
+ * The kernels are static, so the source file is included here.
+ */
+#include "../src/util_atomic_reduce.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* logged to by ofi_atomic_reduce_init(), not exported by the library */
+struct fi_provider core_prov = {
+	.name = "core",
+};
+
+#if defined(__GNUC__)
+
+#define TEST_MAX_CNT	(3 * 64 + 63)	/* 3 AVX-512 vectors of bytes + tail */
+#define TEST_BUF_SIZE	(TEST_MAX_CNT * sizeof(uint64_t) + sizeof(uint64_t))
+
+typedef void (*reduce_func)(void *dst, const void *src, size_t cnt);
+
+static uint64_t test_seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t test_rand(void)
+{
+	test_seed ^= test_seed << 13;
+	test_seed ^= test_seed >> 7;
+	test_seed ^= test_seed << 17;
+	return test_seed;
+}
+
+/* Reals are kept to small multiples of 1/8, so that no NaN or -0.0
+ * makes MIN and MAX depend on the order of their operands. */
+static void test_fill(enum fi_datatype datatype, void *buf, size_t cnt)
+{
+	size_t i;
+
+	switch (datatype) {
+	case FI_FLOAT:
+		for (i = 0; i < cnt; i++)
+			((float *) buf)[i] =
+				(float) ((int) (test_rand() % 2001) - 1000) / 8;
+		break;
+	case FI_DOUBLE:
+		for (i = 0; i < cnt; i++)
+			((double *) buf)[i] =
+				(double) ((int) (test_rand() % 2001) - 1000) / 8;
+		break;
+	default:
+		for (i = 0; i < cnt * ofi_datatype_size(datatype); i++)
+			((uint8_t *) buf)[i] = (uint8_t) test_rand();
+		break;
+	}
+}
+
+/* fi_tostr() returns a static buffer, so only one call per printf */
+static void test_report(const char *isa, enum fi_op op,
+			enum fi_datatype datatype)
+{
+	printf("%s: %s ", isa, fi_tostr(&op, FI_TYPE_ATOMIC_OP));
+	printf("%s: ", fi_tostr(&datatype, FI_TYPE_ATOMIC_TYPE));
+}
+
+static int test_handler(const char *isa, enum fi_op op,
+			enum fi_datatype datatype, reduce_func func)
+{
+	uint64_t ref_dst[TEST_MAX_CNT], ref_src[TEST_MAX_CNT];
+	uint8_t dst_buf[TEST_BUF_SIZE], src_buf[TEST_BUF_SIZE];
+	size_t size = ofi_datatype_size(datatype);
+	size_t cnt, dst_off, src_off;
+	uint8_t *dst, *src;
+
+	for (cnt = 0; cnt <= TEST_MAX_CNT; cnt++) {
+		for (dst_off = 0; dst_off < size; dst_off++) {
+			for (src_off = 0; src_off < size; src_off++) {
+				test_fill(datatype, ref_dst, cnt);
+				test_fill(datatype, ref_src, cnt);
+				dst = dst_buf + dst_off;
+				src = src_buf + src_off;
+				memcpy(dst, ref_dst, cnt * size);
+				memcpy(src, ref_src, cnt * size);
+
+				ofi_atomic_write_handlers[op][datatype](
+					ref_dst, ref_src, cnt);
+				func(dst, src, cnt);
+
+				if (memcmp(dst, ref_dst, cnt * size) ||
+				    memcmp(src, ref_src, cnt * size)) {
+					test_report(isa, op, datatype);
+					printf("cnt %zu dst offset %zu src offset "
+					       "%zu: mismatch\n",
+					       cnt, dst_off, src_off);
+					return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+static int test_table(const char *isa,
+		      reduce_func table[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST])
+{
+	int op, datatype, cnt = 0, ret = 0;
+
+	for (op = 0; op < OFI_WRITE_OP_LAST; op++) {
+		for (datatype = 0; datatype < FI_DATATYPE_LAST; datatype++) {
+			if (!table[op][datatype])
+				continue;
+
+			if (!ofi_atomic_write_handlers[op][datatype]) {
+				test_report(isa, op, datatype);
+				printf("no write handler\n");
+				ret = -1;
+				continue;
+			}
+
+			if (test_handler(isa, op, datatype, table[op][datatype]))
+				ret = -1;
+			cnt++;
+		}
+	}
+
+	printf("%s: %d handlers %s\n", isa, cnt, ret ? "FAILED" : "passed");
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+
+	if (test_table("generic", ofi_reduce_vec_handlers))
+		ret = 1;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		if (test_table("AVX2", ofi_reduce_avx2_handlers))
+			ret = 1;
+	} else {
+		printf("AVX2: not supported by the CPU, skipped\n");
+	}
+
+	if (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("avx512dq") &&
+	    __builtin_cpu_supports("avx512vl")) {
+		if (test_table("AVX-512", ofi_reduce_avx512_handlers))
+			ret = 1;
+	} else {
+		printf("AVX-512: not supported by the CPU, skipped\n");
+	}
+#endif
+
+	ofi_atomic_reduce_init();
+	if (test_table("selected", ofi_atomic_reduce_handlers))
+		ret = 1;
+
+	return ret;
+}
+
+#else /* __GNUC__ */
+
+int main(void)
+{
+	/* no reduce handlers are built, report the test as skipped */
+	return 77;
+}
+
+#endif /* __GNUC__ */
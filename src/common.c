@@ -45,6 +45,7 @@
 #include <poll.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <inttypes.h>
 #include <netinet/in.h>
@@ -234,6 +235,19 @@ uint64_t fi_gettime_us(void)
 	return now.tv_sec * 1000000 + now.tv_usec;
 }
 
+/* Monotonic time, where available, for timing intervals */
+uint64_t ofi_gettime_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#else
+	return fi_gettime_us() * 1000;
+#endif
+}
+
 uint16_t ofi_get_sa_family(const struct fi_info *info)
 {
 	if (!info)
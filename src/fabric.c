@@ -46,11 +46,14 @@
 #include "shared/ofi_str.h"
 #include "ofi_prov.h"
 #include "ofi_perf.h"
+#include "ofi_atomic.h"
 
 #ifdef HAVE_LIBDL
 #include <dlfcn.h>
 #endif
 
+#define OFI_PROV_LIST_MAX	256
+
 struct ofi_prov {
 	struct ofi_prov		*next;
 	char			*prov_name;
@@ -200,6 +203,18 @@ static int ofi_getinfo_filter(const struct fi_provider *provider)
 	return ofi_apply_prov_init_filter(&prov_filter, provider->name);
 }
 
+/*
+ * Same as ofi_getinfo_filter(), for providers that have not been loaded
+ * or initialized yet.  The type of a provider is derived from its name.
+ */
+static int ofi_prov_ini_filter(const char *name)
+{
+	if (!prov_filter.negated && ofi_has_util_prefix(name))
+		return 0;
+
+	return ofi_apply_prov_init_filter(&prov_filter, name);
+}
+
 static void ofi_filter_info(struct fi_info **info)
 {
 	struct fi_info *cur, *prev, *tmp;
@@ -337,7 +352,7 @@ static void ofi_ordered_provs_init(void)
 		/* These are hooking providers only.  Their order
 		 * doesn't matter
 		 */
-		"ofi_perf_hook", "ofi_noop_hook",
+		"ofi_perf_hook", "ofi_trace_hook", "ofi_noop_hook",
 	};
 	int num_provs = sizeof(ordered_prov_names)/sizeof(ordered_prov_names[0]), i;
 
@@ -456,6 +471,18 @@ cleanup:
 	return ret;
 }
 
+/* Built-in providers excluded by FI_PROVIDER are not initialized */
+#define ofi_register_builtin(name, init)				\
+	do {								\
+		if (ofi_prov_ini_filter(name))				\
+			FI_INFO(&core_prov, FI_LOG_CORE,		\
+				"\"%s\" filtered by provider "		\
+				"include/exclude list, skipping\n",	\
+				name);					\
+		else							\
+			ofi_register_provider(init, NULL);		\
+	} while (0)
+
 #ifdef HAVE_LIBDL
 static int lib_filter(const struct dirent *entry)
 {
@@ -492,6 +519,37 @@ void ofi_create_filter(struct fi_filter *filter, const char *raw_filter)
 }
 
 #ifdef HAVE_LIBDL
+/*
+ * Provider libraries are named lib<name>-<FI_LIB_SUFFIX>.  Libraries of
+ * known providers that are excluded by FI_PROVIDER are not loaded.  Other
+ * libraries are loaded and filtered once their provider registers.
+ */
+static int ofi_lib_filter(const char *lib)
+{
+	char name[FI_NAME_MAX + 4];
+	struct ofi_prov *prov;
+	size_t len;
+
+	len = strlen(lib);
+	if (!prov_filter.names || strncmp(lib, "lib", 3) ||
+	    len <= 3 + strlen("-" FI_LIB_SUFFIX))
+		return 0;
+
+	len -= 3 + strlen("-" FI_LIB_SUFFIX);
+	if (len >= FI_NAME_MAX ||
+	    strcmp(&lib[3 + len], "-" FI_LIB_SUFFIX))
+		return 0;
+
+	snprintf(name, sizeof(name), "ofi_%.*s", (int) len, &lib[3]);
+	for (prov = prov_head; prov; prov = prov->next) {
+		if (!strcasecmp(prov->prov_name, name))
+			return ofi_prov_ini_filter(prov->prov_name);
+		if (!strcasecmp(prov->prov_name, &name[4]))
+			return ofi_prov_ini_filter(prov->prov_name);
+	}
+	return 0;
+}
+
 static void ofi_ini_dir(const char *dir)
 {
 	int n = 0;
@@ -510,6 +568,15 @@ static void ofi_ini_dir(const char *dir)
 			       "asprintf failed to allocate memory\n");
 			goto libdl_done;
 		}
+		if (ofi_lib_filter(liblist[n]->d_name)) {
+			FI_INFO(&core_prov, FI_LOG_CORE,
+				"%s filtered by provider include/exclude "
+				"list, skipping\n", lib);
+			free(liblist[n]);
+			free(lib);
+			continue;
+		}
+
 		FI_DBG(&core_prov, FI_LOG_CORE, "opening provider lib %s\n", lib);
 
 		dlhandle = dlopen(lib, RTLD_NOW);
@@ -540,6 +607,7 @@ libdl_done:
 
 void fi_ini(void)
 {
+	struct ofi_prov *prov;
 	char *param_val = NULL;
 
 	pthread_mutex_lock(&common_locks.ini_lock);
@@ -553,7 +621,11 @@ void fi_ini(void)
 	ofi_osd_init();
 	ofi_mem_init();
 	ofi_pmem_init();
+	ofi_copy_init();
 	ofi_perf_init();
+	ofi_cntr_stripe_init();
+	ofi_atomic_reduce_init();
+	ofi_info_cache_init();
 	ofi_hook_init();
 	ofi_monitor_init();
 
@@ -603,26 +675,32 @@ void fi_ini(void)
 libdl_done:
 #endif
 
-	ofi_register_provider(PSM2_INIT, NULL);
-	ofi_register_provider(PSM_INIT, NULL);
-	ofi_register_provider(USNIC_INIT, NULL);
-	ofi_register_provider(MLX_INIT, NULL);
-	ofi_register_provider(GNI_INIT, NULL);
-	ofi_register_provider(BGQ_INIT, NULL);
-	ofi_register_provider(NETDIR_INIT, NULL);
-	ofi_register_provider(SHM_INIT, NULL);
-	ofi_register_provider(RXM_INIT, NULL);
-	ofi_register_provider(VERBS_INIT, NULL);
+	ofi_register_builtin("psm2", PSM2_INIT);
+	ofi_register_builtin("psm", PSM_INIT);
+	ofi_register_builtin("usnic", USNIC_INIT);
+	ofi_register_builtin("mlx", MLX_INIT);
+	ofi_register_builtin("gni", GNI_INIT);
+	ofi_register_builtin("bgq", BGQ_INIT);
+	ofi_register_builtin("netdir", NETDIR_INIT);
+	ofi_register_builtin("shm", SHM_INIT);
+	ofi_register_builtin("ofi_rxm", RXM_INIT);
+	ofi_register_builtin("verbs", VERBS_INIT);
 	/* ofi_register_provider(RSTREAM_INIT, NULL); - no support */
-	ofi_register_provider(MRAIL_INIT, NULL);
-	ofi_register_provider(RXD_INIT, NULL);
-	ofi_register_provider(EFA_INIT, NULL);
-	ofi_register_provider(UDP_INIT, NULL);
-	ofi_register_provider(SOCKETS_INIT, NULL);
-	ofi_register_provider(TCP_INIT, NULL);
+	ofi_register_builtin("ofi_mrail", MRAIL_INIT);
+	ofi_register_builtin("ofi_rxd", RXD_INIT);
+	ofi_register_builtin("efa", EFA_INIT);
+	ofi_register_builtin("UDP", UDP_INIT);
+	ofi_register_builtin("sockets", SOCKETS_INIT);
+	ofi_register_builtin("tcp", TCP_INIT);
 
-	ofi_register_provider(PERF_HOOK_INIT, NULL);
-	ofi_register_provider(NOOP_HOOK_INIT, NULL);
+	ofi_register_builtin("ofi_perf_hook", PERF_HOOK_INIT);
+	ofi_register_builtin("ofi_trace_hook", TRACE_HOOK_INIT);
+	ofi_register_builtin("ofi_noop_hook", NOOP_HOOK_INIT);
+
+	for (prov = prov_head; prov; prov = prov->next) {
+		if (prov->provider)
+			ofi_info_cache_add_prov(prov->provider);
+	}
 
 	ofi_init = 1;
 
@@ -637,6 +715,7 @@ FI_DESTRUCTOR(fi_fini(void))
 	if (!ofi_init)
 		return;
 
+	fi_log_async_fini();
 	while (prov_head) {
 		prov = prov_head;
 		prov_head = prov->next;
@@ -647,6 +726,9 @@ FI_DESTRUCTOR(fi_fini(void))
 
 	ofi_free_filter(&prov_filter);
 	ofi_monitor_cleanup();
+	ofi_info_cache_fini();
+	ofi_cntr_stripe_fini();
+	ofi_perf_fini();
 	ofi_mem_fini();
 	fi_log_fini();
 	fi_param_fini();
@@ -837,9 +919,12 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 {
 	struct ofi_prov *prov;
 	struct fi_info *tail, *cur;
+	struct ofi_info_key key;
+	const char *cached_provs;
+	char prov_list[OFI_PROV_LIST_MAX] = ",";
 	char **prov_vec = NULL;
 	size_t count = 0;
-	int ret;
+	int ret, cached, record;
 
 	if (!ofi_init)
 		fi_ini();
@@ -854,15 +939,27 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 		return ofi_getprovinfo(info);
 	}
 
+	cached_provs = NULL;
+	cached = !ofi_info_key_init(&key, version, node, service, flags, hints);
+	if (cached && !ofi_info_cache_get(&key, info, &cached_provs)) {
+		ofi_info_key_free(&key);
+		return *info ? 0 : -FI_ENODATA;
+	}
+	record = cached && !cached_provs;
+
 	if (hints && hints->fabric_attr && hints->fabric_attr->prov_name) {
 		prov_vec = ofi_split_and_alloc(hints->fabric_attr->prov_name,
 					       ";", &count);
-		if (!prov_vec)
+		if (!prov_vec) {
+			if (cached)
+				ofi_info_key_free(&key);
 			return -FI_ENOMEM;
+		}
 		FI_DBG(&core_prov, FI_LOG_CORE, "hints prov_name: %s\n",
 		       hints->fabric_attr->prov_name);
 	}
 
+retry:
 	*info = tail = NULL;
 	for (prov = prov_head; prov; prov = prov->next) {
 		if (!prov->provider || !prov->provider->getinfo)
@@ -881,6 +978,10 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 			continue;
 		}
 
+		if (cached_provs &&
+		    !ofi_info_cache_listed(cached_provs, prov->provider->name))
+			continue;
+
 		ret = prov->provider->getinfo(version, node, service, flags,
 					      hints, &cur);
 		if (ret) {
@@ -897,6 +998,13 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 			continue;
 		}
 
+		if (strlen(prov_list) + strlen(prov->provider->name) + 2 >
+		    sizeof(prov_list))
+			record = 0;
+		else
+			ofi_strncatf(prov_list, sizeof(prov_list), "%s,",
+				     prov->provider->name);
+
 		if (!*info)
 			*info = cur;
 		else
@@ -909,11 +1017,24 @@ int DEFAULT_SYMVER_PRE(fi_getinfo)(uint32_t version, const char *node,
 		ofi_set_prov_attr(tail->fabric_attr, prov->provider);
 		tail->fabric_attr->api_version = version;
 	}
+
+	/* The providers recorded for these arguments returned nothing, the
+	 * node may have changed since: query all of them and record again */
+	if (!*info && cached_provs) {
+		cached_provs = NULL;
+		record = 1;
+		goto retry;
+	}
 	ofi_free_string_array(prov_vec);
 
 	if (!(flags & (OFI_CORE_PROV_ONLY | OFI_GETINFO_INTERNAL)))
 		ofi_filter_info(info);
 
+	if (cached) {
+		ofi_info_cache_put(&key, *info, record ? prov_list : NULL);
+		ofi_info_key_free(&key);
+	}
+
 	return *info ? 0 : -FI_ENODATA;
 }
 CURRENT_SYMVER(fi_getinfo_, fi_getinfo);
@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <ofi.h>
+#include <ofi_list.h>
+#include <fasthash.h>
+#include <rdma/providers/fi_log.h>
+
+#define INFO_CACHE_MAX		64
+#define INFO_CACHE_LINE		1024
+
+struct info_cache_entry {
+	struct dlist_entry	entry;
+	struct ofi_info_key	key;
+	struct fi_info		*info;
+};
+
+/* Providers listed in the cache file for a key */
+struct info_file_entry {
+	struct dlist_entry	entry;
+	uint64_t		hash;
+	char			*provs;
+};
+
+static pthread_mutex_t	info_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int		info_cache_enabled;
+static char		*info_cache_path;
+static char		*info_cache_filter;
+static struct dlist_entry info_cache_list;
+static size_t		info_cache_cnt;
+static struct dlist_entry info_file_list;
+static int		info_file_loaded;
+/* Hash of the library version and of the providers that are loaded, so
+ * that entries written by another build or installation are not used */
+static uint64_t		info_cache_seed;
+
+void ofi_info_cache_init(void)
+{
+	dlist_init(&info_cache_list);
+	dlist_init(&info_file_list);
+
+	fi_param_define(NULL, "getinfo_cache", FI_PARAM_BOOL,
+			"Keep the results of fi_getinfo calls and return "
+			"copies of them to later calls with the same "
+			"arguments (default: no)");
+	fi_param_define(NULL, "getinfo_cache_file", FI_PARAM_STRING,
+			"Path of a file recording which providers returned "
+			"results for each set of fi_getinfo arguments.  "
+			"Later processes only query those providers, or "
+			"all of them if those return nothing.  The file "
+			"should be removed when the node's hardware or "
+			"network configuration changes (default: none)");
+
+	fi_param_get_bool(NULL, "getinfo_cache", &info_cache_enabled);
+	fi_param_get_str(NULL, "getinfo_cache_file", &info_cache_path);
+	fi_param_get_str(NULL, "provider", &info_cache_filter);
+
+	info_cache_seed = fasthash64(PACKAGE_VERSION, strlen(PACKAGE_VERSION),
+				     0);
+}
+
+/* Called for each provider loaded, before fi_getinfo is first used */
+void ofi_info_cache_add_prov(const struct fi_provider *provider)
+{
+	info_cache_seed = fasthash64(provider->name, strlen(provider->name),
+				     info_cache_seed);
+	info_cache_seed = fasthash64(&provider->version,
+				     sizeof(provider->version),
+				     info_cache_seed);
+}
+
+void ofi_info_cache_fini(void)
+{
+	struct info_cache_entry *cache_entry;
+	struct info_file_entry *file_entry;
+
+	if (!info_cache_list.next)
+		return;
+
+	while (!dlist_empty(&info_cache_list)) {
+		dlist_pop_front(&info_cache_list, struct info_cache_entry,
+				cache_entry, entry);
+		fi_freeinfo(cache_entry->info);
+		free(cache_entry->key.data);
+		free(cache_entry);
+	}
+	info_cache_cnt = 0;
+
+	while (!dlist_empty(&info_file_list)) {
+		dlist_pop_front(&info_file_list, struct info_file_entry,
+				file_entry, entry);
+		free(file_entry->provs);
+		free(file_entry);
+	}
+	info_file_loaded = 0;
+}
+
+static void info_key_add(struct ofi_info_key *key, const void *data,
+			 size_t len)
+{
+	uint8_t *buf;
+	size_t size;
+
+	if (!key->data)
+		return;
+
+	if (key->len + len > key->size) {
+		size = MAX(key->size * 2, key->len + len);
+		buf = realloc(key->data, size);
+		if (!buf) {
+			free(key->data);
+			key->data = NULL;
+			return;
+		}
+		key->data = buf;
+		key->size = size;
+	}
+	memcpy(key->data + key->len, data, len);
+	key->len += len;
+}
+
+#define INFO_KEY_ADD(key, val) info_key_add(key, &(val), sizeof(val))
+
+static void info_key_add_buf(struct ofi_info_key *key, const void *buf,
+			     size_t len)
+{
+	if (!buf)
+		len = 0;
+	INFO_KEY_ADD(key, len);
+	if (len)
+		info_key_add(key, buf, len);
+}
+
+static void info_key_add_str(struct ofi_info_key *key, const char *str)
+{
+	info_key_add_buf(key, str, str ? strlen(str) + 1 : 0);
+}
+
+/* The presence of each attribute is encoded ahead of its fields */
+static void info_key_add_attrs(struct ofi_info_key *key,
+			       const struct fi_info *hints)
+{
+	const struct fi_tx_attr *tx = hints->tx_attr;
+	const struct fi_rx_attr *rx = hints->rx_attr;
+	const struct fi_ep_attr *ep = hints->ep_attr;
+	const struct fi_domain_attr *dom = hints->domain_attr;
+	const struct fi_fabric_attr *fab = hints->fabric_attr;
+	uint8_t present;
+
+	present = (tx != NULL) | (rx != NULL) << 1 | (ep != NULL) << 2 |
+		  (dom != NULL) << 3 | (fab != NULL) << 4;
+	INFO_KEY_ADD(key, present);
+
+	INFO_KEY_ADD(key, hints->caps);
+	INFO_KEY_ADD(key, hints->mode);
+	INFO_KEY_ADD(key, hints->addr_format);
+	info_key_add_buf(key, hints->src_addr, hints->src_addrlen);
+	info_key_add_buf(key, hints->dest_addr, hints->dest_addrlen);
+
+	if (tx) {
+		INFO_KEY_ADD(key, tx->caps);
+		INFO_KEY_ADD(key, tx->mode);
+		INFO_KEY_ADD(key, tx->op_flags);
+		INFO_KEY_ADD(key, tx->msg_order);
+		INFO_KEY_ADD(key, tx->comp_order);
+		INFO_KEY_ADD(key, tx->inject_size);
+		INFO_KEY_ADD(key, tx->size);
+		INFO_KEY_ADD(key, tx->iov_limit);
+		INFO_KEY_ADD(key, tx->rma_iov_limit);
+	}
+
+	if (rx) {
+		INFO_KEY_ADD(key, rx->caps);
+		INFO_KEY_ADD(key, rx->mode);
+		INFO_KEY_ADD(key, rx->op_flags);
+		INFO_KEY_ADD(key, rx->msg_order);
+		INFO_KEY_ADD(key, rx->comp_order);
+		INFO_KEY_ADD(key, rx->total_buffered_recv);
+		INFO_KEY_ADD(key, rx->size);
+		INFO_KEY_ADD(key, rx->iov_limit);
+	}
+
+	if (ep) {
+		INFO_KEY_ADD(key, ep->type);
+		INFO_KEY_ADD(key, ep->protocol);
+		INFO_KEY_ADD(key, ep->protocol_version);
+		INFO_KEY_ADD(key, ep->max_msg_size);
+		INFO_KEY_ADD(key, ep->msg_prefix_size);
+		INFO_KEY_ADD(key, ep->max_order_raw_size);
+		INFO_KEY_ADD(key, ep->max_order_war_size);
+		INFO_KEY_ADD(key, ep->max_order_waw_size);
+		INFO_KEY_ADD(key, ep->mem_tag_format);
+		INFO_KEY_ADD(key, ep->tx_ctx_cnt);
+		INFO_KEY_ADD(key, ep->rx_ctx_cnt);
+		info_key_add_buf(key, ep->auth_key, ep->auth_key_size);
+	}
+
+	if (dom) {
+		info_key_add_str(key, dom->name);
+		INFO_KEY_ADD(key, dom->threading);
+		INFO_KEY_ADD(key, dom->control_progress);
+		INFO_KEY_ADD(key, dom->data_progress);
+		INFO_KEY_ADD(key, dom->resource_mgmt);
+		INFO_KEY_ADD(key, dom->av_type);
+		INFO_KEY_ADD(key, dom->mr_mode);
+		INFO_KEY_ADD(key, dom->mr_key_size);
+		INFO_KEY_ADD(key, dom->cq_data_size);
+		INFO_KEY_ADD(key, dom->cq_cnt);
+		INFO_KEY_ADD(key, dom->ep_cnt);
+		INFO_KEY_ADD(key, dom->tx_ctx_cnt);
+		INFO_KEY_ADD(key, dom->rx_ctx_cnt);
+		INFO_KEY_ADD(key, dom->max_ep_tx_ctx);
+		INFO_KEY_ADD(key, dom->max_ep_rx_ctx);
+		INFO_KEY_ADD(key, dom->max_ep_stx_ctx);
+		INFO_KEY_ADD(key, dom->max_ep_srx_ctx);
+		INFO_KEY_ADD(key, dom->cntr_cnt);
+		INFO_KEY_ADD(key, dom->mr_iov_limit);
+		INFO_KEY_ADD(key, dom->caps);
+		INFO_KEY_ADD(key, dom->mode);
+		info_key_add_buf(key, dom->auth_key, dom->auth_key_size);
+		INFO_KEY_ADD(key, dom->max_err_data);
+		INFO_KEY_ADD(key, dom->mr_cnt);
+	}
+
+	if (fab) {
+		info_key_add_str(key, fab->name);
+		info_key_add_str(key, fab->prov_name);
+		INFO_KEY_ADD(key, fab->prov_version);
+		INFO_KEY_ADD(key, fab->api_version);
+	}
+}
+
+/*
+ * Hints that refer to open objects are not cached, since the objects may
+ * be closed and their addresses reused.
+ */
+int ofi_info_key_init(struct ofi_info_key *key, uint32_t version,
+		      const char *node, const char *service, uint64_t flags,
+		      const struct fi_info *hints)
+{
+	uint8_t has_hints = hints != NULL;
+
+	if (!info_cache_enabled && !info_cache_path)
+		return -FI_ENOSYS;
+
+	if (hints && (hints->handle || hints->nic ||
+		      (hints->domain_attr && hints->domain_attr->domain) ||
+		      (hints->fabric_attr && hints->fabric_attr->fabric)))
+		return -FI_ENOSYS;
+
+	key->size = 256;
+	key->len = 0;
+	key->data = malloc(key->size);
+
+	INFO_KEY_ADD(key, version);
+	INFO_KEY_ADD(key, flags);
+	info_key_add_str(key, node);
+	info_key_add_str(key, service);
+	info_key_add_str(key, info_cache_filter);
+	INFO_KEY_ADD(key, has_hints);
+	if (hints)
+		info_key_add_attrs(key, hints);
+
+	if (!key->data)
+		return -FI_ENOMEM;
+
+	key->hash = fasthash64(key->data, key->len, info_cache_seed);
+	return 0;
+}
+
+void ofi_info_key_free(struct ofi_info_key *key)
+{
+	free(key->data);
+	key->data = NULL;
+}
+
+static int info_dup_list(const struct fi_info *info, struct fi_info **dup)
+{
+	struct fi_info *tail, *cur;
+
+	*dup = tail = NULL;
+	for (; info; info = info->next) {
+		cur = fi_dupinfo(info);
+		if (!cur) {
+			fi_freeinfo(*dup);
+			*dup = NULL;
+			return -FI_ENOMEM;
+		}
+
+		if (tail)
+			tail->next = cur;
+		else
+			*dup = cur;
+		tail = cur;
+	}
+	return 0;
+}
+
+/* A later line for the same key replaces the earlier one */
+static struct info_file_entry *info_file_add(uint64_t hash, const char *provs)
+{
+	struct info_file_entry *entry;
+	char *dup;
+
+	dup = strdup(provs);
+	if (!dup)
+		return NULL;
+
+	dlist_foreach_container(&info_file_list, struct info_file_entry,
+				entry, entry) {
+		if (entry->hash == hash) {
+			free(entry->provs);
+			entry->provs = dup;
+			return entry;
+		}
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		free(dup);
+		return NULL;
+	}
+
+	entry->provs = dup;
+	entry->hash = hash;
+	dlist_insert_tail(&entry->entry, &info_file_list);
+	return entry;
+}
+
+/*
+ * Each line of the file holds the hash of a key, followed by the names of
+ * the providers that returned results, delimited and surrounded by commas.
+ * Keys without results are not recorded, so an empty list is skipped.
+ */
+static void info_file_load(void)
+{
+	char line[INFO_CACHE_LINE], provs[INFO_CACHE_LINE];
+	uint64_t hash;
+	FILE *file;
+
+	info_file_loaded = 1;
+	file = fopen(info_cache_path, "r");
+	if (!file)
+		return;
+
+	while (fgets(line, sizeof line, file)) {
+		if (sscanf(line, "%" SCNx64 " %1023s", &hash, provs) != 2 ||
+		    provs[0] != ',' || !provs[1])
+			continue;
+		info_file_add(hash, provs);
+	}
+	fclose(file);
+
+	FI_INFO(&core_prov, FI_LOG_CORE, "loaded getinfo cache file %s\n",
+		info_cache_path);
+}
+
+static void info_file_save(uint64_t hash, const char *provs)
+{
+	FILE *file;
+
+	if (!info_file_add(hash, provs))
+		return;
+
+	file = fopen(info_cache_path, "a");
+	if (!file) {
+		FI_WARN(&core_prov, FI_LOG_CORE,
+			"unable to open getinfo cache file %s\n",
+			info_cache_path);
+		return;
+	}
+	fprintf(file, "%016" PRIx64 " %s\n", hash, provs);
+	fclose(file);
+}
+
+/*
+ * Returns 0 with a copy of the cached results, or -FI_ENOENT.  On a miss,
+ * provs is set to the providers recorded in the cache file, if any.
+ */
+int ofi_info_cache_get(struct ofi_info_key *key, struct fi_info **info,
+		       const char **provs)
+{
+	struct info_cache_entry *cache_entry;
+	struct info_file_entry *file_entry;
+	int ret = -FI_ENOENT;
+
+	*provs = NULL;
+	pthread_mutex_lock(&info_cache_lock);
+	if (info_cache_enabled) {
+		dlist_foreach_container(&info_cache_list,
+					struct info_cache_entry,
+					cache_entry, entry) {
+			if (cache_entry->key.len == key->len &&
+			    !memcmp(cache_entry->key.data, key->data,
+				    key->len)) {
+				ret = info_dup_list(cache_entry->info, info);
+				goto unlock;
+			}
+		}
+	}
+
+	if (info_cache_path) {
+		if (!info_file_loaded)
+			info_file_load();
+
+		dlist_foreach_container(&info_file_list,
+					struct info_file_entry,
+					file_entry, entry) {
+			if (file_entry->hash == key->hash) {
+				*provs = file_entry->provs;
+				break;
+			}
+		}
+	}
+unlock:
+	pthread_mutex_unlock(&info_cache_lock);
+	return ret;
+}
+
+/*
+ * Cache the results for the key, which is consumed.  The list of
+ * providers is added to the cache file unless it is NULL.  Calls that
+ * returned no results are not cached.
+ */
+void ofi_info_cache_put(struct ofi_info_key *key, const struct fi_info *info,
+			const char *provs)
+{
+	struct info_cache_entry *cache_entry;
+
+	if (!info)
+		return;
+
+	pthread_mutex_lock(&info_cache_lock);
+	if (provs && info_cache_path)
+		info_file_save(key->hash, provs);
+
+	if (!info_cache_enabled)
+		goto unlock;
+
+	cache_entry = calloc(1, sizeof(*cache_entry));
+	if (!cache_entry)
+		goto unlock;
+
+	if (info_dup_list(info, &cache_entry->info)) {
+		free(cache_entry);
+		goto unlock;
+	}
+
+	cache_entry->key = *key;
+	key->data = NULL;
+	dlist_insert_tail(&cache_entry->entry, &info_cache_list);
+
+	if (++info_cache_cnt > INFO_CACHE_MAX) {
+		dlist_pop_front(&info_cache_list, struct info_cache_entry,
+				cache_entry, entry);
+		fi_freeinfo(cache_entry->info);
+		free(cache_entry->key.data);
+		free(cache_entry);
+		info_cache_cnt--;
+	}
+unlock:
+	pthread_mutex_unlock(&info_cache_lock);
+}
+
+int ofi_info_cache_listed(const char *provs, const char *prov_name)
+{
+	size_t len = strlen(prov_name);
+	const char *pos;
+
+	for (pos = strstr(provs, prov_name); pos;
+	     pos = strstr(pos + 1, prov_name)) {
+		if (pos[-1] == ',' && pos[len] == ',')
+			return 1;
+	}
+	return 0;
+}
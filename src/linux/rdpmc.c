@@ -167,8 +167,33 @@ static uint64_t rdpmc_hw_id(uint32_t cntr_id)
 
 static uint64_t rdpmc_cache_id(uint32_t cntr_id, uint32_t flags)
 {
-	/* TODO */
-	return ~0;
+	uint64_t id, op, result;
+
+	switch (cntr_id) {
+	case OFI_PMC_CACHE_L1_DATA:
+		id = PERF_COUNT_HW_CACHE_L1D;
+		break;
+	case OFI_PMC_CACHE_L1_INSTR:
+		id = PERF_COUNT_HW_CACHE_L1I;
+		break;
+	case OFI_PMC_CACHE_TLB_DATA:
+		id = PERF_COUNT_HW_CACHE_DTLB;
+		break;
+	case OFI_PMC_CACHE_TLB_INSTR:
+		id = PERF_COUNT_HW_CACHE_ITLB;
+		break;
+	case OFI_PMC_CACHE_LL:
+		id = PERF_COUNT_HW_CACHE_LL;
+		break;
+	default:
+		return ~0;
+	}
+
+	op = (flags & OFI_PMC_FLAG_WRITE) ? PERF_COUNT_HW_CACHE_OP_WRITE :
+					    PERF_COUNT_HW_CACHE_OP_READ;
+	result = (flags & OFI_PMC_FLAG_MISS) ? PERF_COUNT_HW_CACHE_RESULT_MISS :
+					       PERF_COUNT_HW_CACHE_RESULT_ACCESS;
+	return id | (op << 8) | (result << 16);
 }
 
 static uint64_t rdpmc_sw_id(uint32_t cntr_id)
@@ -176,56 +201,122 @@ static uint64_t rdpmc_sw_id(uint32_t cntr_id)
 	switch (cntr_id) {
 	case OFI_PMC_OS_PAGE_FAULT:
 		return PERF_COUNT_SW_PAGE_FAULTS;
+	case OFI_PMC_OS_CTX_SWITCH:
+		return PERF_COUNT_SW_CONTEXT_SWITCHES;
 	default:
 		return ~0;
 	}
 }
 
-int ofi_pmu_open(struct ofi_perf_ctx **ctx, enum ofi_perf_domain domain,
-		 uint32_t cntr_id, uint32_t flags)
+static int rdpmc_init_attr(struct perf_event_attr *attr,
+			   const struct ofi_perf_cntr *cntr)
 {
-	struct perf_event_attr attr = {
-		.size = PERF_ATTR_SIZE_VER0,
-		.sample_type = PERF_SAMPLE_READ,
-		.exclude_kernel = 1,
-	};
-	int ret;
+	memset(attr, 0, sizeof(*attr));
+	attr->size = PERF_ATTR_SIZE_VER0;
+	attr->read_format = PERF_FORMAT_GROUP;
 
-	*ctx = calloc(1, sizeof **ctx);
-	if (!*ctx)
-		return -FI_ENOMEM;
-
-	switch(domain) {
+	switch (cntr->domain) {
 	case OFI_PMU_CPU:
-		attr.type = PERF_TYPE_HARDWARE;
-		attr.config = rdpmc_hw_id(cntr_id);
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = rdpmc_hw_id(cntr->cntr_id);
+		attr->exclude_kernel = 1;
 		break;
 	case OFI_PMU_CACHE:
-		attr.type = PERF_TYPE_HW_CACHE;
-		attr.config = rdpmc_cache_id(cntr_id, flags);
+		attr->type = PERF_TYPE_HW_CACHE;
+		attr->config = rdpmc_cache_id(cntr->cntr_id, cntr->flags);
+		attr->exclude_kernel = 1;
 		break;
 	case OFI_PMU_OS:
-		attr.type = PERF_TYPE_SOFTWARE;
-		attr.config = rdpmc_sw_id(cntr_id);
+		/* OS events occur in the kernel on behalf of the thread */
+		attr->type = PERF_TYPE_SOFTWARE;
+		attr->config = rdpmc_sw_id(cntr->cntr_id);
 		break;
 	default:
 		return -FI_ENOSYS;
 	}
 
-	if (attr.config == ~0)
-		return -FI_ENOSYS;
+	return attr->config == ~0 ? -FI_ENOSYS : 0;
+}
+
+/*
+ * The counters are opened as a group led by the first one, so that the
+ * kernel schedules them together.  They are read with rdpmc if all of them
+ * allow it, and otherwise with a single read of the group.
+ */
+int ofi_pmu_open(struct ofi_perf_ctx **ctx,
+		 const struct ofi_perf_cntr *cntrs, size_t cnt)
+{
+	struct perf_event_attr attr;
+	struct rdpmc_ctx *pmc;
+	size_t i;
+	int ret;
+
+	assert(cnt && cnt <= OFI_PERF_MAX_CNTRS);
+	*ctx = calloc(1, sizeof **ctx);
+	if (!*ctx)
+		return -FI_ENOMEM;
+
+	(*ctx)->rdpmc = 1;
+	for (i = 0; i < cnt; i++) {
+		ret = rdpmc_init_attr(&attr, &cntrs[i]);
+		if (ret)
+			goto err;
 
-	ret = rdpmc_open_attr(&attr, &(*ctx)->ctx, NULL);
-	return ret ? -errno : 0;
+		pmc = &(*ctx)->ctx[i];
+		pmc->fd = perf_event_open(&attr, 0, -1,
+					  i ? (*ctx)->ctx[0].fd : -1, 0);
+		if (pmc->fd < 0) {
+			ret = -errno;
+			goto err;
+		}
+		(*ctx)->cnt++;
+
+		pmc->buf = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ,
+				MAP_SHARED, pmc->fd, 0);
+		if (pmc->buf == MAP_FAILED) {
+			pmc->buf = NULL;
+			(*ctx)->rdpmc = 0;
+		} else if (!pmc->buf->cap_user_rdpmc || !pmc->buf->index) {
+			(*ctx)->rdpmc = 0;
+		}
+	}
+	return 0;
+
+err:
+	ofi_pmu_close(*ctx);
+	*ctx = NULL;
+	return ret;
 }
 
-inline uint64_t ofi_pmu_read(struct ofi_perf_ctx *ctx)
+void ofi_pmu_read(struct ofi_perf_ctx *ctx, uint64_t *values)
 {
-	return rdpmc_read(&ctx->ctx);
+	uint64_t buf[OFI_PERF_MAX_CNTRS + 1];
+	size_t i;
+
+	if (ctx->rdpmc) {
+		for (i = 0; i < ctx->cnt; i++)
+			values[i] = rdpmc_read(&ctx->ctx[i]);
+		return;
+	}
+
+	/* PERF_FORMAT_GROUP: the number of counters followed by their values */
+	if (read(ctx->ctx[0].fd, buf, sizeof(*buf) * (ctx->cnt + 1)) <= 0) {
+		memset(values, 0, sizeof(*values) * ctx->cnt);
+		return;
+	}
+
+	for (i = 0; i < ctx->cnt; i++)
+		values[i] = buf[i + 1];
 }
 
-inline void ofi_pmu_close(struct ofi_perf_ctx *ctx)
+void ofi_pmu_close(struct ofi_perf_ctx *ctx)
 {
-	rdpmc_close(&ctx->ctx);
+	size_t i;
+
+	for (i = ctx->cnt; i > 0; i--) {
+		if (ctx->ctx[i - 1].buf)
+			munmap(ctx->ctx[i - 1].buf, sysconf(_SC_PAGESIZE));
+		close(ctx->ctx[i - 1].fd);
+	}
 	free(ctx);
 }
@@ -35,10 +35,14 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
 
 #include <rdma/fi_errno.h>
 
 #include "ofi.h"
+#include "ofi_list.h"
+#include "ofi_atom.h"
 
 
 static const char * const log_subsys[] = {
@@ -83,6 +87,86 @@ struct fi_filter prov_log_filter;
 
 static pid_t pid;
 
+/*
+ * Asynchronous logging:
+ * Each thread that logs gets its own ring, which only that thread writes
+ * to.  A log call captures the timestamp, the format string pointer and
+ * the raw arguments into the ring, copying only %s strings.  A background
+ * thread drains the rings, merging records by timestamp, and does the
+ * formatting and output.  The format strings and function names of
+ * providers are referenced by pointer, so the rings are drained before
+ * providers are unloaded.
+ */
+enum {
+	LOG_OVERFLOW_DROP,
+	LOG_OVERFLOW_BLOCK,
+};
+
+#define LOG_ASYNC_RING_SIZE	(64 * 1024)
+#define LOG_ASYNC_INTERVAL	10	/* ms */
+#define LOG_ASYNC_BATCH		(16 * 1024)
+#define LOG_REC_MAX		1024
+#define LOG_REC_STR_MAX		256
+#define LOG_REC_PAD		UINT16_MAX
+#define LOG_SPEC_MAX		28
+
+struct log_rec {
+	uint32_t		size;
+	uint16_t		argc;
+	uint8_t			level;
+	uint8_t			subsys;
+	int			line;
+	uint64_t		time;
+	const struct fi_provider *prov;
+	const char		*func;
+	const char		*fmt;
+	uint64_t		data[];
+};
+
+struct log_ring {
+	struct dlist_entry	entry;
+	ofi_atomic64_t		head;
+	ofi_atomic64_t		tail;
+	ofi_atomic64_t		dropped;
+	ofi_atomic32_t		orphan;
+	uint64_t		reported;
+	size_t			size;
+	uint8_t			*buf;
+};
+
+static struct {
+	int			enabled;
+	int			overflow;
+	size_t			ring_size;
+	int			stop;
+	pthread_t		thread;
+	pthread_key_t		key;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	pthread_cond_t		space_cond;
+	struct dlist_entry	ring_list;
+} log_async;
+
+struct log_spec {
+	const char		*len;	/* start of length modifier */
+	const char		*end;	/* just past the conversion */
+	int			stars;
+	char			mod;
+	char			conv;
+};
+
+enum {
+	LOG_MOD_NONE,
+	LOG_MOD_HH,
+	LOG_MOD_H,
+	LOG_MOD_L,
+	LOG_MOD_LL,
+	LOG_MOD_LD,
+	LOG_MOD_J,
+	LOG_MOD_Z,
+	LOG_MOD_T,
+};
+
 static int fi_convert_log_str(const char *value)
 {
 	int i;
@@ -97,6 +181,625 @@ static int fi_convert_log_str(const char *value)
 	return 0;
 }
 
+/*
+ * Parse the printf conversion that follows the '%' at fmt.  Returns
+ * 0 if the conversion is not understood, in which case the arguments
+ * that follow cannot be located either.
+ */
+static int log_parse_spec(const char *fmt, struct log_spec *spec)
+{
+	const char *p = fmt + 1;
+
+	spec->stars = 0;
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+
+	spec->len = p;
+	switch (*p) {
+	case 'h':
+		spec->mod = (p[1] == 'h') ? LOG_MOD_HH : LOG_MOD_H;
+		p += (p[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		spec->mod = (p[1] == 'l') ? LOG_MOD_LL : LOG_MOD_L;
+		p += (p[1] == 'l') ? 2 : 1;
+		break;
+	case 'q':
+		spec->mod = LOG_MOD_LL;
+		p++;
+		break;
+	case 'L':
+		spec->mod = LOG_MOD_LD;
+		p++;
+		break;
+	case 'j':
+		spec->mod = LOG_MOD_J;
+		p++;
+		break;
+	case 'z':
+	case 'Z':
+		spec->mod = LOG_MOD_Z;
+		p++;
+		break;
+	case 't':
+		spec->mod = LOG_MOD_T;
+		p++;
+		break;
+	default:
+		spec->mod = LOG_MOD_NONE;
+		break;
+	}
+
+	/* Leave room to replace the length modifier when formatting */
+	if (p - fmt > LOG_SPEC_MAX)
+		return 0;
+
+	spec->conv = *p;
+	spec->end = p + 1;
+	switch (spec->conv) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+	case 'a': case 'A': case 'p': case 'n':
+		return 1;
+	case 'c': case 's':
+		return spec->mod == LOG_MOD_NONE;
+	default:
+		return 0;
+	}
+}
+
+static int64_t log_get_int(struct log_spec *spec, va_list *vargs)
+{
+	switch (spec->mod) {
+	case LOG_MOD_HH:
+		return (signed char) va_arg(*vargs, int);
+	case LOG_MOD_H:
+		return (short) va_arg(*vargs, int);
+	case LOG_MOD_L:
+		return va_arg(*vargs, long);
+	case LOG_MOD_LL:
+		return va_arg(*vargs, long long);
+	case LOG_MOD_J:
+		return va_arg(*vargs, intmax_t);
+	case LOG_MOD_Z:
+		return (ssize_t) va_arg(*vargs, size_t);
+	case LOG_MOD_T:
+		return va_arg(*vargs, ptrdiff_t);
+	default:
+		return va_arg(*vargs, int);
+	}
+}
+
+static uint64_t log_get_uint(struct log_spec *spec, va_list *vargs)
+{
+	switch (spec->mod) {
+	case LOG_MOD_HH:
+		return (unsigned char) va_arg(*vargs, unsigned int);
+	case LOG_MOD_H:
+		return (unsigned short) va_arg(*vargs, unsigned int);
+	case LOG_MOD_L:
+		return va_arg(*vargs, unsigned long);
+	case LOG_MOD_LL:
+		return va_arg(*vargs, unsigned long long);
+	case LOG_MOD_J:
+		return va_arg(*vargs, uintmax_t);
+	case LOG_MOD_Z:
+		return va_arg(*vargs, size_t);
+	case LOG_MOD_T:
+		return va_arg(*vargs, ptrdiff_t);
+	default:
+		return va_arg(*vargs, unsigned int);
+	}
+}
+
+/*
+ * Copy the arguments referenced by fmt into rec->data, one 8 byte slot
+ * per value and width or precision, and inline for strings.  Returns the
+ * number of conversions captured, which is less than the number in fmt
+ * if the record filled up or a conversion is not understood.
+ */
+static int log_capture(struct log_rec *rec, const char *fmt, va_list *vargs)
+{
+	uint64_t *slot = rec->data;
+	uint64_t *end = (uint64_t *) ((char *) rec + LOG_REC_MAX);
+	struct log_spec spec;
+	const char *str;
+	size_t len;
+	double d;
+	int argc, i;
+
+	for (argc = 0; (fmt = strchr(fmt, '%')); argc++) {
+		while (fmt && fmt[1] == '%')
+			fmt = strchr(fmt + 2, '%');
+		if (!fmt || !log_parse_spec(fmt, &spec))
+			break;
+		fmt = spec.end;
+
+		if (slot + spec.stars + 1 > end)
+			break;
+		for (i = 0; i < spec.stars; i++)
+			*slot++ = (int64_t) va_arg(*vargs, int);
+
+		switch (spec.conv) {
+		case 'd': case 'i':
+			*slot++ = (uint64_t) log_get_int(&spec, vargs);
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			*slot++ = log_get_uint(&spec, vargs);
+			break;
+		case 'c':
+			*slot++ = (int64_t) va_arg(*vargs, int);
+			break;
+		case 'p':
+		case 'n':
+			*slot++ = (uintptr_t) va_arg(*vargs, void *);
+			break;
+		case 's':
+			str = va_arg(*vargs, const char *);
+			if (!str)
+				str = "(null)";
+			len = MIN(strlen(str), MIN(LOG_REC_STR_MAX - 1,
+				  (size_t) ((char *) end - (char *) slot) - 1));
+			memcpy(slot, str, len);
+			((char *) slot)[len] = '\0';
+			slot += (len + sizeof(*slot)) / sizeof(*slot);
+			break;
+		default:
+			d = (spec.mod == LOG_MOD_LD) ?
+			    (double) va_arg(*vargs, long double) :
+			    va_arg(*vargs, double);
+			memcpy(slot++, &d, sizeof(d));
+			break;
+		}
+	}
+
+	rec->argc = (uint16_t) argc;
+	rec->size = (uint32_t) ((char *) slot - (char *) rec);
+	return argc;
+}
+
+#define LOG_PRINT(buf, size, spec, stars, star, val)			\
+	((stars) == 0 ? snprintf(buf, size, spec, val) :		\
+	 (stars) == 1 ? snprintf(buf, size, spec, star[0], val) :	\
+	 snprintf(buf, size, spec, star[0], star[1], val))
+
+/*
+ * Replay the conversions of a record, one snprintf per conversion.
+ * Returns the length of the formatted message.
+ */
+static size_t log_format(char *buf, size_t size, const struct log_rec *rec)
+{
+	const uint64_t *slot = rec->data;
+	const char *fmt = rec->fmt, *next;
+	struct log_spec spec;
+	char cspec[LOG_SPEC_MAX + 4];
+	size_t len;
+	int star[2];
+	int argc, i, ret;
+	double d;
+
+	ret = snprintf(buf, size, "%s:%d:%" PRIu64 ".%06" PRIu64
+		       ":%s:%s:%s():%d<%s> ", PACKAGE, pid,
+		       rec->time / 1000000, rec->time % 1000000,
+		       rec->prov->name, log_subsys[rec->subsys], rec->func,
+		       rec->line, log_levels[rec->level]);
+	len = MIN((size_t) ret, size - 1);
+
+	for (argc = 0; len < size - 1; ) {
+		next = strchr(fmt, '%');
+		if (!next) {
+			ret = snprintf(buf + len, size - len, "%s", fmt);
+			len += MIN((size_t) ret, size - len - 1);
+			break;
+		}
+
+		ret = snprintf(buf + len, size - len, "%.*s",
+			       (int) (next - fmt), fmt);
+		len += MIN((size_t) ret, size - len - 1);
+		if (next[1] == '%') {
+			ret = snprintf(buf + len, size - len, "%%");
+			len += MIN((size_t) ret, size - len - 1);
+			fmt = next + 2;
+			continue;
+		}
+
+		/* The arguments that follow were not captured */
+		if (argc++ == rec->argc) {
+			ret = snprintf(buf + len, size - len, "...\n");
+			len += MIN((size_t) ret, size - len - 1);
+			break;
+		}
+
+		log_parse_spec(next, &spec);
+		fmt = spec.end;
+		for (i = 0; i < spec.stars; i++)
+			star[i] = (int) *slot++;
+
+		/* Rebuild the conversion around the type stored in the slot */
+		memcpy(cspec, next, spec.len - next);
+		i = (int) (spec.len - next);
+		switch (spec.conv) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			cspec[i++] = 'l';
+			cspec[i++] = 'l';
+			break;
+		default:
+			break;
+		}
+		cspec[i++] = spec.conv;
+		cspec[i] = '\0';
+
+		switch (spec.conv) {
+		case 'd': case 'i':
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, (long long) *slot);
+			slot++;
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, (unsigned long long) *slot);
+			slot++;
+			break;
+		case 'c':
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, (int) *slot);
+			slot++;
+			break;
+		case 'p':
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, (void *) (uintptr_t) *slot);
+			slot++;
+			break;
+		case 'n':
+			ret = 0;
+			slot++;
+			break;
+		case 's':
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, (const char *) slot);
+			slot += (strlen((const char *) slot) + sizeof(*slot)) /
+				sizeof(*slot);
+			break;
+		default:
+			memcpy(&d, slot++, sizeof(d));
+			ret = LOG_PRINT(buf + len, size - len, cspec, spec.stars,
+					star, d);
+			break;
+		}
+		if (ret > 0)
+			len += MIN((size_t) ret, size - len - 1);
+	}
+	return len;
+}
+
+static void log_sync_write(const struct fi_provider *prov,
+			   enum fi_log_level level, enum fi_log_subsys subsys,
+			   const char *func, int line, const char *fmt,
+			   va_list vargs)
+{
+	char buf[1024];
+	int size;
+
+	size = snprintf(buf, sizeof(buf), "%s:%d:%s:%s:%s():%d<%s> ", PACKAGE,
+			pid, prov->name, log_subsys[subsys], func, line,
+			log_levels[level]);
+	vsnprintf(buf + size, sizeof(buf) - size, fmt, vargs);
+
+	fprintf(stderr, "%s", buf);
+}
+
+static void log_ring_release(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	ofi_atomic_set32(&ring->orphan, 1);
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring;
+
+	ring = pthread_getspecific(log_async.key);
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof(*ring) + log_async.ring_size);
+	if (!ring)
+		return NULL;
+
+	ring->buf = (uint8_t *) (ring + 1);
+	ring->size = log_async.ring_size;
+	ofi_atomic_initialize64(&ring->head, 0);
+	ofi_atomic_initialize64(&ring->tail, 0);
+	ofi_atomic_initialize64(&ring->dropped, 0);
+	ofi_atomic_initialize32(&ring->orphan, 0);
+	if (pthread_setspecific(log_async.key, ring)) {
+		free(ring);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&log_async.lock);
+	dlist_insert_tail(&ring->entry, &log_async.ring_list);
+	pthread_mutex_unlock(&log_async.lock);
+	return ring;
+}
+
+/* Wait for the drain thread to make room in a full ring */
+static int log_ring_wait(void)
+{
+	int stop;
+
+	pthread_mutex_lock(&log_async.lock);
+	stop = log_async.stop;
+	if (!stop) {
+		pthread_cond_signal(&log_async.cond);
+		fi_wait_cond(&log_async.space_cond, &log_async.lock, 1);
+	}
+	pthread_mutex_unlock(&log_async.lock);
+	return stop;
+}
+
+static int log_ring_write(struct log_ring *ring, struct log_rec *rec)
+{
+	struct log_rec *pad;
+	uint64_t head, tail;
+	size_t offset, contig, need;
+
+	head = ofi_atomic_get64(&ring->head);
+	for (;;) {
+		tail = ofi_atomic_get64(&ring->tail);
+		offset = head % ring->size;
+		contig = ring->size - offset;
+		need = rec->size + (contig < rec->size ? contig : 0);
+		if (ring->size - (head - tail) >= need)
+			break;
+
+		if (log_async.overflow != LOG_OVERFLOW_BLOCK || log_ring_wait()) {
+			ofi_atomic_inc64(&ring->dropped);
+			return -FI_EAGAIN;
+		}
+	}
+
+	if (contig < rec->size) {
+		pad = (struct log_rec *) (ring->buf + offset);
+		pad->size = (uint32_t) contig;
+		pad->argc = LOG_REC_PAD;
+		head += contig;
+		offset = 0;
+	}
+	memcpy(ring->buf + offset, rec, rec->size);
+	ofi_atomic_set64(&ring->head, head + rec->size);
+
+	/* Wake up the drain thread early once the ring is half full */
+	if ((head - tail) < ring->size / 2 &&
+	    (head + rec->size - tail) >= ring->size / 2)
+		pthread_cond_signal(&log_async.cond);
+	return 0;
+}
+
+static void log_async_write(const struct fi_provider *prov,
+			    enum fi_log_level level, enum fi_log_subsys subsys,
+			    const char *func, int line, const char *fmt,
+			    va_list vargs)
+{
+	uint64_t buf[LOG_REC_MAX / sizeof(uint64_t)];
+	struct log_rec *rec = (struct log_rec *) buf;
+	struct log_ring *ring;
+	va_list args;
+
+	rec->time = fi_gettime_us();
+	ring = log_ring_get();
+	if (!ring) {
+		log_sync_write(prov, level, subsys, func, line, fmt, vargs);
+		return;
+	}
+
+	rec->level = (uint8_t) level;
+	rec->subsys = (uint8_t) subsys;
+	rec->line = line;
+	rec->prov = prov;
+	rec->func = func;
+	rec->fmt = fmt;
+	va_copy(args, vargs);
+	log_capture(rec, fmt, &args);
+	va_end(args);
+
+	(void) log_ring_write(ring, rec);
+}
+
+/*
+ * Return the next record of a ring, skipping the padding at the end of
+ * the buffer, or NULL if the ring is empty.
+ */
+static struct log_rec *log_ring_peek(struct log_ring *ring)
+{
+	struct log_rec *rec;
+	uint64_t tail, head;
+
+	tail = ofi_atomic_get64(&ring->tail);
+	head = ofi_atomic_get64(&ring->head);
+	while (tail != head) {
+		rec = (struct log_rec *) (ring->buf + tail % ring->size);
+		if (rec->argc != LOG_REC_PAD)
+			return rec;
+		tail += rec->size;
+		ofi_atomic_set64(&ring->tail, tail);
+	}
+	return NULL;
+}
+
+static void log_ring_report(struct log_ring *ring)
+{
+	uint64_t dropped;
+
+	dropped = ofi_atomic_get64(&ring->dropped);
+	if (dropped == ring->reported)
+		return;
+
+	fprintf(stderr, "%s:%d:core:core:%s():%d<warn> "
+		"log ring full, %" PRIu64 " messages dropped\n", PACKAGE, pid,
+		__func__, __LINE__, dropped - ring->reported);
+	ring->reported = dropped;
+}
+
+/*
+ * Called with the lock held.  Output all records, oldest first, batching
+ * the writes to stderr.
+ */
+static void log_async_drain(void)
+{
+	struct log_ring *ring, *min_ring;
+	struct dlist_entry *item, *tmp;
+	struct log_rec *rec, *min_rec;
+	char buf[LOG_ASYNC_BATCH];
+	size_t len = 0;
+
+	for (;;) {
+		min_ring = NULL;
+		min_rec = NULL;
+		dlist_foreach_safe(&log_async.ring_list, item, tmp) {
+			ring = container_of(item, struct log_ring, entry);
+			rec = log_ring_peek(ring);
+			if (!rec) {
+				log_ring_report(ring);
+				if (ofi_atomic_get32(&ring->orphan)) {
+					dlist_remove(&ring->entry);
+					free(ring);
+				}
+				continue;
+			}
+			if (!min_rec || rec->time < min_rec->time) {
+				min_rec = rec;
+				min_ring = ring;
+			}
+		}
+		if (!min_rec)
+			break;
+
+		pthread_mutex_unlock(&log_async.lock);
+		len += log_format(buf + len, LOG_REC_MAX, min_rec);
+		pthread_mutex_lock(&log_async.lock);
+		ofi_atomic_add64(&min_ring->tail, min_rec->size);
+
+		if (len > sizeof(buf) - LOG_REC_MAX) {
+			fwrite(buf, 1, len, stderr);
+			len = 0;
+			pthread_cond_broadcast(&log_async.space_cond);
+		}
+	}
+
+	if (len)
+		fwrite(buf, 1, len, stderr);
+	pthread_cond_broadcast(&log_async.space_cond);
+}
+
+static void *log_async_thread(void *arg)
+{
+	pthread_mutex_lock(&log_async.lock);
+	while (!log_async.stop) {
+		log_async_drain();
+		fi_wait_cond(&log_async.cond, &log_async.lock,
+			     LOG_ASYNC_INTERVAL);
+	}
+	log_async_drain();
+	pthread_mutex_unlock(&log_async.lock);
+	return NULL;
+}
+
+static void log_async_init(void)
+{
+	char *overflow = NULL;
+	size_t ring_size = LOG_ASYNC_RING_SIZE;
+	int enabled = 0;
+
+	fi_param_define(NULL, "log_async", FI_PARAM_BOOL,
+			"Format and write log messages from a background "
+			"thread instead of the thread that logs (default: no)");
+	fi_param_define(NULL, "log_async_size", FI_PARAM_SIZE_T,
+			"Size in bytes of the per thread buffer holding log "
+			"messages until they are written (default: 65536)");
+	fi_param_define(NULL, "log_async_overflow", FI_PARAM_STRING,
+			"Action when a thread's log buffer is full: drop the "
+			"message or block until there is room (default: drop)");
+
+	fi_param_get_bool(NULL, "log_async", &enabled);
+	if (!enabled)
+		return;
+
+	fi_param_get_size_t(NULL, "log_async_size", &ring_size);
+	log_async.ring_size = MAX(ofi_get_aligned_size(ring_size,
+					sizeof(uint64_t)), 2 * LOG_REC_MAX);
+
+	fi_param_get_str(NULL, "log_async_overflow", &overflow);
+	log_async.overflow = (overflow && !strcasecmp(overflow, "block")) ?
+			     LOG_OVERFLOW_BLOCK : LOG_OVERFLOW_DROP;
+
+	dlist_init(&log_async.ring_list);
+	log_async.stop = 0;
+	if (pthread_key_create(&log_async.key, log_ring_release))
+		return;
+
+	pthread_mutex_init(&log_async.lock, NULL);
+	pthread_cond_init(&log_async.cond, NULL);
+	pthread_cond_init(&log_async.space_cond, NULL);
+	if (pthread_create(&log_async.thread, NULL, log_async_thread, NULL)) {
+		pthread_cond_destroy(&log_async.space_cond);
+		pthread_cond_destroy(&log_async.cond);
+		pthread_mutex_destroy(&log_async.lock);
+		pthread_key_delete(log_async.key);
+		return;
+	}
+	log_async.enabled = 1;
+}
+
+/*
+ * Write out all buffered messages and return to synchronous logging.
+ * Messages logged while shutting down are written directly.
+ */
+void fi_log_async_fini(void)
+{
+	struct log_ring *ring;
+
+	if (!log_async.enabled)
+		return;
+
+	log_async.enabled = 0;
+	pthread_mutex_lock(&log_async.lock);
+	log_async.stop = 1;
+	pthread_cond_signal(&log_async.cond);
+	pthread_cond_broadcast(&log_async.space_cond);
+	pthread_mutex_unlock(&log_async.lock);
+	pthread_join(log_async.thread, NULL);
+
+	pthread_key_delete(log_async.key);
+	while (!dlist_empty(&log_async.ring_list)) {
+		dlist_pop_front(&log_async.ring_list, struct log_ring,
+				ring, entry);
+		log_ring_report(ring);
+		free(ring);
+	}
+	pthread_cond_destroy(&log_async.space_cond);
+	pthread_cond_destroy(&log_async.cond);
+	pthread_mutex_destroy(&log_async.lock);
+}
+
 void fi_log_init(void)
 {
 	struct fi_filter subsys_filter;
@@ -125,10 +828,13 @@ void fi_log_init(void)
 	}
 	ofi_free_filter(&subsys_filter);
 	pid = getpid();
+
+	log_async_init();
 }
 
 void fi_log_fini(void)
 {
+	fi_log_async_fini();
 	ofi_free_filter(&prov_log_filter);
 }
 
@@ -150,19 +856,13 @@ void DEFAULT_SYMVER_PRE(fi_log)(const struct fi_provider *prov, enum fi_log_leve
 		enum fi_log_subsys subsys, const char *func, int line,
 		const char *fmt, ...)
 {
-	char buf[1024];
-	int size;
-
 	va_list vargs;
 
-	size = snprintf(buf, sizeof(buf), "%s:%d:%s:%s:%s():%d<%s> ", PACKAGE,
-			pid, prov->name, log_subsys[subsys], func, line,
-			log_levels[level]);
-
 	va_start(vargs, fmt);
-	vsnprintf(buf + size, sizeof(buf) - size, fmt, vargs);
+	if (log_async.enabled)
+		log_async_write(prov, level, subsys, func, line, fmt, vargs);
+	else
+		log_sync_write(prov, level, subsys, func, line, fmt, vargs);
 	va_end(vargs);
-
-	fprintf(stderr, "%s", buf);
 }
 DEFAULT_SYMVER(fi_log_, fi_log, FABRIC_1.0);
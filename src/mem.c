@@ -154,3 +154,137 @@ void ofi_pmem_init(void)
 	if (ofi_pmem_commit)
 		OFI_RMA_PMEM = FI_RMA_PMEM;
 }
+
+
+/*
+ * Copy engine:
+ * Copies below ofi_copy_large_threshold are left to memcpy.  Larger ones
+ * use 'rep movsb' on CPUs with enhanced rep movsb (ERMS), and copies of
+ * at least FI_COPY_NT_THRESHOLD bytes use non-temporal stores, so that
+ * bulk data does not evict the working set of the copying core.
+ */
+#define OFI_COPY_ERMS_MIN	4096
+#define OFI_COPY_NT_DEF		(1024 * 1024)
+
+size_t ofi_copy_large_threshold = SIZE_MAX;
+static size_t ofi_copy_nt_threshold = SIZE_MAX;
+static void *(*ofi_copy_mid)(void *dst, const void *src, size_t size) = memcpy;
+static void *(*ofi_copy_nt)(void *dst, const void *src, size_t size) = memcpy;
+
+void *ofi_memcpy_large(void *dst, const void *src, size_t size)
+{
+	if (size >= ofi_copy_nt_threshold)
+		return ofi_copy_nt(dst, src, size);
+	return ofi_copy_mid(dst, src, size);
+}
+
+#if defined(HAVE_CPUID) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+static void *copy_erms(void *dst, const void *src, size_t size)
+{
+	void *ret = dst;
+
+	asm volatile("rep movsb"
+		     : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+	return ret;
+}
+
+/*
+ * Stream whole vectors to the aligned part of dst, and copy the unaligned
+ * head and tail through the cache.  The stores are fenced before return,
+ * so the copy is visible to other threads like one done with memcpy.
+ */
+#define OFI_DEF_COPY_NT(name, target, vec, width, load, stream)	\
+static target void *name(void *dst, const void *src, size_t size)	\
+{									\
+	const char *s = src;						\
+	char *d = dst;							\
+	size_t head;							\
+	vec v0, v1, v2, v3;						\
+									\
+	head = MIN((-(uintptr_t) d) & (width - 1), size);		\
+	memcpy(d, s, head);						\
+	d += head;							\
+	s += head;							\
+	size -= head;							\
+									\
+	for (; size >= 4 * width; size -= 4 * width) {			\
+		v0 = load((const vec *) s);				\
+		v1 = load((const vec *) (s + width));			\
+		v2 = load((const vec *) (s + 2 * width));		\
+		v3 = load((const vec *) (s + 3 * width));		\
+		stream((vec *) d, v0);					\
+		stream((vec *) (d + width), v1);			\
+		stream((vec *) (d + 2 * width), v2);			\
+		stream((vec *) (d + 3 * width), v3);			\
+		d += 4 * width;						\
+		s += 4 * width;						\
+	}								\
+	_mm_sfence();							\
+	memcpy(d, s, size);						\
+	return dst;							\
+}
+
+OFI_DEF_COPY_NT(copy_nt_sse2, , __m128i, 16,
+		_mm_loadu_si128, _mm_stream_si128)
+OFI_DEF_COPY_NT(copy_nt_avx2, __attribute__((target("avx2"))), __m256i, 32,
+		_mm256_loadu_si256, _mm256_stream_si256)
+OFI_DEF_COPY_NT(copy_nt_avx512, __attribute__((target("avx512f"))),
+		__m512i, 64, _mm512_loadu_si512, _mm512_stream_si512)
+
+static const char *ofi_copy_select(void)
+{
+	const char *nt = "SSE2";
+
+	ofi_copy_nt = copy_nt_sse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		ofi_copy_nt = copy_nt_avx512;
+		nt = "AVX-512";
+	} else if (__builtin_cpu_supports("avx2")) {
+		ofi_copy_nt = copy_nt_avx2;
+		nt = "AVX2";
+	}
+
+	if (ofi_cpu_supports(0x7, OFI_ERMS_REG, OFI_ERMS_BIT)) {
+		ofi_copy_mid = copy_erms;
+		ofi_copy_large_threshold = OFI_COPY_ERMS_MIN;
+	}
+	return nt;
+}
+
+#else /* HAVE_CPUID && __x86_64__ && __GNUC__ */
+
+static const char *ofi_copy_select(void)
+{
+	return NULL;
+}
+
+#endif /* HAVE_CPUID && __x86_64__ && __GNUC__ */
+
+void ofi_copy_init(void)
+{
+	size_t nt_threshold = OFI_COPY_NT_DEF;
+	const char *nt;
+
+	fi_param_define(NULL, "copy_nt_threshold", FI_PARAM_SIZE_T,
+			"Size in bytes from which data copies done by "
+			"providers use non-temporal stores, where supported. "
+			"0 disables their use (default: %d)", OFI_COPY_NT_DEF);
+	fi_param_get_size_t(NULL, "copy_nt_threshold", &nt_threshold);
+
+	nt = ofi_copy_select();
+	if (nt && nt_threshold) {
+		ofi_copy_nt_threshold = nt_threshold;
+		ofi_copy_large_threshold = MIN(ofi_copy_large_threshold,
+					       nt_threshold);
+		FI_INFO(&core_prov, FI_LOG_CORE, "Using %s non-temporal "
+			"stores for copies from %zu bytes\n", nt, nt_threshold);
+	}
+	if (ofi_copy_mid != memcpy)
+		FI_INFO(&core_prov, FI_LOG_CORE,
+			"Using rep movsb for copies from %d bytes\n",
+			OFI_COPY_ERMS_MIN);
+}
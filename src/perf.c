@@ -38,52 +38,182 @@
 #include <inttypes.h>
 
 #include <rdma/fi_errno.h>
+#include <ofi.h>
 #include <ofi_perf.h>
+#include <shared/ofi_str.h>
 #include <rdma/providers/fi_log.h>
 
 
-enum ofi_perf_domain	perf_domain = OFI_PMU_CPU;
-uint32_t		perf_cntr = OFI_PMC_CPU_INSTR;
-uint32_t		perf_flags;
+static const struct ofi_perf_cntr perf_cntr_list[] = {
+	{ OFI_PMU_CPU, OFI_PMC_CPU_CYCLES, 0, "cpu_cycles" },
+	{ OFI_PMU_CPU, OFI_PMC_CPU_INSTR, 0, "cpu_instr" },
+	{ OFI_PMU_CACHE, OFI_PMC_CACHE_L1_DATA,
+	  OFI_PMC_FLAG_READ | OFI_PMC_FLAG_MISS, "l1d_miss" },
+	{ OFI_PMU_CACHE, OFI_PMC_CACHE_L1_INSTR,
+	  OFI_PMC_FLAG_READ | OFI_PMC_FLAG_MISS, "l1i_miss" },
+	{ OFI_PMU_CACHE, OFI_PMC_CACHE_LL,
+	  OFI_PMC_FLAG_READ | OFI_PMC_FLAG_MISS, "llc_miss" },
+	{ OFI_PMU_CACHE, OFI_PMC_CACHE_TLB_DATA,
+	  OFI_PMC_FLAG_READ | OFI_PMC_FLAG_MISS, "dtlb_miss" },
+	{ OFI_PMU_CACHE, OFI_PMC_CACHE_TLB_INSTR,
+	  OFI_PMC_FLAG_READ | OFI_PMC_FLAG_MISS, "itlb_miss" },
+	{ OFI_PMU_OS, OFI_PMC_OS_PAGE_FAULT, 0, "page_fault" },
+	{ OFI_PMU_OS, OFI_PMC_OS_CTX_SWITCH, 0, "ctx_switch" },
+};
 
+struct ofi_perf_cntr	perf_cntrs[OFI_PERF_MAX_CNTRS] = {
+	{ OFI_PMU_CPU, OFI_PMC_CPU_INSTR, 0, "cpu_instr" },
+};
+size_t			perf_cntr_cnt = 1;
+
+pthread_key_t		ofi_perf_key;
+static int		perf_key_valid;
+static pthread_mutex_t	perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dlist_entry perf_thread_list;
+
+
+static const struct ofi_perf_cntr *ofi_perf_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(perf_cntr_list) / sizeof(perf_cntr_list[0]); i++) {
+		if (!strcasecmp(name, perf_cntr_list[i].name))
+			return &perf_cntr_list[i];
+	}
+	return NULL;
+}
+
+static void ofi_perf_parse_cntrs(const char *param_val)
+{
+	const struct ofi_perf_cntr *cntr;
+	char **names;
+	size_t i, cnt = 0;
+
+	names = ofi_split_and_alloc(param_val, ",", NULL);
+	if (!names)
+		return;
+
+	for (i = 0; names[i]; i++) {
+		cntr = ofi_perf_find(names[i]);
+		if (!cntr) {
+			FI_WARN(&core_prov, FI_LOG_CORE,
+				"unknown performance counter %s\n", names[i]);
+			continue;
+		}
+		if (cnt == OFI_PERF_MAX_CNTRS) {
+			FI_WARN(&core_prov, FI_LOG_CORE,
+				"more than %d performance counters, "
+				"ignoring %s\n", OFI_PERF_MAX_CNTRS, names[i]);
+			continue;
+		}
+		perf_cntrs[cnt++] = *cntr;
+	}
+	ofi_free_string_array(names);
+
+	if (cnt)
+		perf_cntr_cnt = cnt;
+}
+
+static void ofi_perf_thread_free(void *arg)
+{
+	struct ofi_perf_thread *thread = arg;
+
+	pthread_mutex_lock(&perf_lock);
+	dlist_remove(&thread->entry);
+	pthread_mutex_unlock(&perf_lock);
+
+	if (thread->ctx)
+		ofi_pmu_close(thread->ctx);
+	free(thread);
+}
 
 void ofi_perf_init(void)
 {
 	char *param_val = NULL;
 
+	dlist_init(&perf_thread_list);
+	perf_key_valid = !pthread_key_create(&ofi_perf_key,
+					     ofi_perf_thread_free);
+
 	fi_param_define(NULL, "perf_cntr", FI_PARAM_STRING,
-			"Performance counter to analyze (default: cpu_instr). "
-			"Options: cpu_instr, cpu_cycles.");
+			"Comma separated list of up to 4 performance counters "
+			"to analyze (default: cpu_instr). "
+			"Options: cpu_cycles, cpu_instr, l1d_miss, l1i_miss, "
+			"llc_miss, dtlb_miss, itlb_miss, page_fault, "
+			"ctx_switch.");
 	fi_param_get_str(NULL, "perf_cntr", &param_val);
-	if (!param_val)
+	if (param_val)
+		ofi_perf_parse_cntrs(param_val);
+}
+
+/* Threads must not take measurements during or after cleanup */
+void ofi_perf_fini(void)
+{
+	struct ofi_perf_thread *thread;
+
+	if (!perf_key_valid)
 		return;
 
-	if (!strcasecmp(param_val, "cpu_cycles")) {
-		perf_domain = OFI_PMU_CPU;
-		perf_cntr = OFI_PMC_CPU_CYCLES;
+	while (!dlist_empty(&perf_thread_list)) {
+		thread = container_of(perf_thread_list.next,
+				      struct ofi_perf_thread, entry);
+		ofi_perf_thread_free(thread);
 	}
+	pthread_key_delete(ofi_perf_key);
+	perf_key_valid = 0;
 }
 
-int ofi_perfset_create(const struct fi_provider *prov,
-		       struct ofi_perfset *set, size_t size,
-		       enum ofi_perf_domain domain, uint32_t cntr_id,
-		       uint32_t flags)
+/*
+ * Open the counters of the calling thread on its first measurement.  If
+ * that fails, the thread is marked so that it does not try again.
+ */
+struct ofi_perf_thread *ofi_perf_thread_init(void)
 {
-	int ret;
+	struct ofi_perf_thread *thread;
+
+	if (!perf_key_valid)
+		return NULL;
 
-	ret = ofi_pmu_open(&set->ctx, domain, cntr_id, flags);
-	if (ret) {
-		FI_WARN(prov, FI_LOG_CORE, "Unable to open PMU %d (%s)\n",
-			ret, fi_strerror(ret));
-		return ret;
+	thread = calloc(1, sizeof(*thread));
+	if (!thread)
+		return NULL;
+
+	thread->err = ofi_pmu_open(&thread->ctx, perf_cntrs, perf_cntr_cnt);
+	if (thread->err) {
+		FI_WARN(&core_prov, FI_LOG_CORE,
+			"Unable to open PMU %d (%s)\n", thread->err,
+			fi_strerror(-thread->err));
+		thread->ctx = NULL;
 	}
 
+	pthread_mutex_lock(&perf_lock);
+	dlist_insert_tail(&thread->entry, &perf_thread_list);
+	pthread_mutex_unlock(&perf_lock);
+
+	pthread_setspecific(ofi_perf_key, thread);
+	return thread;
+}
+
+/*
+ * The counters are opened for the calling thread, to report a failure to
+ * open them to the caller.  Other threads open theirs when first used.
+ */
+int ofi_perfset_create(const struct fi_provider *prov,
+		       struct ofi_perfset *set, size_t size)
+{
+	struct ofi_perf_thread *thread;
+
+	thread = ofi_perf_thread();
+	if (!thread)
+		return -FI_ENOMEM;
+	if (thread->err)
+		return thread->err;
+
 	set->data = calloc(size, sizeof(*set->data));
-	if (!set->data) {
-		ofi_pmu_close(set->ctx);
+	if (!set->data)
 		return -FI_ENOMEM;
-	}
 
+	fastlock_init(&set->lock);
 	set->prov = prov;
 	set->size = size;
 	return 0;
@@ -91,60 +221,94 @@ int ofi_perfset_create(const struct fi_provider *prov,
 
 void ofi_perfset_close(struct ofi_perfset *set)
 {
-	ofi_pmu_close(set->ctx);
+	fastlock_destroy(&set->lock);
 	free(set->data);
 }
 
-static const char *ofi_perf_name(void)
+void ofi_perfset_add(struct ofi_perfset *dst, struct ofi_perfset *src)
 {
-	switch (perf_domain) {
-	case OFI_PMU_CPU:
-		switch (perf_cntr) {
-		case OFI_PMC_CPU_CYCLES:
-			return "CPU cycles";
-		case OFI_PMC_CPU_INSTR:
-			return "CPU instr";
-		}
-		break;
-	case OFI_PMU_CACHE:
-		switch (perf_cntr) {
-		case OFI_PMC_CACHE_L1_DATA:
-			return "L1 data cache";
-		case OFI_PMC_CACHE_L1_INSTR:
-			return "L1 instr cache";
-		case OFI_PMC_CACHE_TLB_DATA:
-			return "TLB data cache";
-		case OFI_PMC_CACHE_TLB_INSTR:
-			return "TLB instr cache";
-		}
-		break;
-	case OFI_PMU_OS:
-		switch (perf_cntr) {
-		case OFI_PMC_OS_PAGE_FAULT:
-			return "page faults";
-		}
-		break;
-	case OFI_PMU_NIC:
-		break;
+	size_t i, j;
+
+	assert(dst->size == src->size);
+	fastlock_acquire(&dst->lock);
+	fastlock_acquire(&src->lock);
+	for (i = 0; i < dst->size; i++) {
+		for (j = 0; j < perf_cntr_cnt; j++)
+			dst->data[i].sum[j] += src->data[i].sum[j];
+		dst->data[i].events += src->data[i].events;
 	}
-	return "unknown";
+	fastlock_release(&src->lock);
+	fastlock_release(&dst->lock);
 }
 
-void ofi_perfset_log(struct ofi_perfset *set, const char *names[])
+static int ofi_perf_index(enum ofi_perf_domain domain, uint32_t cntr_id)
 {
 	size_t i;
 
+	for (i = 0; i < perf_cntr_cnt; i++) {
+		if (perf_cntrs[i].domain == domain &&
+		    perf_cntrs[i].cntr_id == cntr_id)
+			return (int) i;
+	}
+	return -1;
+}
+
+/*
+ * Besides the average of each counter per call, report the instructions
+ * per cycle, and the cache and TLB misses per 1000 instructions, when the
+ * counters needed are available.
+ */
+void ofi_perfset_log(struct ofi_perfset *set, const char *names[])
+{
+	char line[256];
+	double avg[OFI_PERF_MAX_CNTRS];
+	int cycles, instr, len;
+	size_t i, j;
+
+	cycles = ofi_perf_index(OFI_PMU_CPU, OFI_PMC_CPU_CYCLES);
+	instr = ofi_perf_index(OFI_PMU_CPU, OFI_PMC_CPU_INSTR);
+
+	len = snprintf(line, sizeof(line), "\t%-20s%-10s", "Name", "Events");
+	for (j = 0; j < perf_cntr_cnt; j++)
+		len += snprintf(line + len, sizeof(line) - len, "%-12s",
+				perf_cntrs[j].name);
+	if (cycles >= 0 && instr >= 0)
+		len += snprintf(line + len, sizeof(line) - len, "%-8s", "IPC");
+	for (j = 0; instr >= 0 && j < perf_cntr_cnt; j++) {
+		if (perf_cntrs[j].domain == OFI_PMU_CACHE)
+			len += snprintf(line + len, sizeof(line) - len,
+					"%s/ki ", perf_cntrs[j].name);
+	}
+
 	FI_TRACE(set->prov, FI_LOG_CORE, "\n");
-	FI_TRACE(set->prov, FI_LOG_CORE, "\tPERF: %s\n", ofi_perf_name());
-	FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10s%s\n", "Name", "Avg", "Events");
+	FI_TRACE(set->prov, FI_LOG_CORE, "\tPERF: average per call\n");
+	FI_TRACE(set->prov, FI_LOG_CORE, "%s\n", line);
 
 	for (i = 0; i < set->size; i++) {
 		if (!set->data[i].events)
 			continue;
 
-		FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10g%" PRIu64 "\n",
-			names && names[i] ? names[i] : "unknown",
-			(double) set->data[i].sum / set->data[i].events,
-			set->data[i].events);
+		len = snprintf(line, sizeof(line), "\t%-20s%-10" PRIu64,
+			       names && names[i] ? names[i] : "unknown",
+			       set->data[i].events);
+		for (j = 0; j < perf_cntr_cnt; j++) {
+			avg[j] = (double) set->data[i].sum[j] /
+				 set->data[i].events;
+			len += snprintf(line + len, sizeof(line) - len,
+					"%-12g", avg[j]);
+		}
+		if (cycles >= 0 && instr >= 0)
+			len += snprintf(line + len, sizeof(line) - len,
+					"%-8.3g", avg[cycles] ?
+					avg[instr] / avg[cycles] : 0.0);
+		for (j = 0; instr >= 0 && j < perf_cntr_cnt; j++) {
+			if (perf_cntrs[j].domain != OFI_PMU_CACHE)
+				continue;
+			len += snprintf(line + len, sizeof(line) - len,
+					"%-*.3g", (int) strlen(perf_cntrs[j].name) + 4,
+					avg[instr] ?
+					avg[j] * 1000 / avg[instr] : 0.0);
+		}
+		FI_TRACE(set->prov, FI_LOG_CORE, "%s\n", line);
 	}
 }
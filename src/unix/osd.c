@@ -212,6 +212,33 @@ int fi_read_file(const char *dir, const char *file, char *buf, size_t size)
 	return len;
 }
 
+/* Fills buf with bytes from the kernel's random number generator */
+int ofi_getrandom(void *buf, size_t len)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			ret = ret ? -errno : -FI_EIO;
+			close(fd);
+			return (int) ret;
+		}
+		buf = (char *) buf + ret;
+		len -= ret;
+	}
+
+	close(fd);
+	return FI_SUCCESS;
+}
+
 int ofi_set_thread_affinity(const char *s)
 {
 #ifndef __APPLE__
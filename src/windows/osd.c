@@ -36,6 +36,7 @@
 
 #include <winsock2.h>
 #include <iphlpapi.h>
+#include <ntsecapi.h>
 #include <ifaddrs.h>
 
 #include "ofi.h"
@@ -147,6 +148,21 @@ int ofi_getpeername(SOCKET fd, struct sockaddr *addr, socklen_t *len)
 	return FI_SUCCESS;
 }
 
+/* Fills buf with bytes from the system's random number generator */
+int ofi_getrandom(void *buf, size_t len)
+{
+	ULONG chunk;
+
+	while (len) {
+		chunk = (ULONG) MIN(len, ULONG_MAX);
+		if (!RtlGenRandom(buf, chunk))
+			return -FI_EIO;
+		buf = (char *) buf + chunk;
+		len -= chunk;
+	}
+	return FI_SUCCESS;
+}
+
 int fi_read_file(const char *dir, const char *file, char *buf, size_t size)
 {
 	char *path = 0;
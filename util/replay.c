@@ -0,0 +1,1090 @@
+/*
+ * Copyright (c) 2019 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <poll.h>
+#include <limits.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <ofi_trace.h>
+#include <rdma/fabric.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_domain.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_eq.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_rma.h>
+#include <rdma/fi_tagged.h>
+
+#define RP_MR_BASIC_MAP (FI_MR_ALLOCATED | FI_MR_PROV_KEY | FI_MR_VIRT_ADDR)
+#define RP_MR_KEY 0xC0DE
+#define RP_CTRL_PORT 47592
+#define RP_NAME_MAX 256
+#define RP_CQ_BATCH 16
+/* give up waiting for the peer to catch up after this long */
+#define RP_STALL_NS (10 * 1000000000ULL)
+#define RP_TX_FLAGS (FI_REMOTE_CQ_DATA | FI_INJECT | FI_INJECT_COMPLETE | \
+		     FI_TRANSMIT_COMPLETE | FI_DELIVERY_COMPLETE)
+
+#define RP_PRINTERR(call, retv)                                                \
+	fprintf(stderr, "%s(): %s:%-4d, ret=%d (%s)\n", call, __FILE__,        \
+		__LINE__, (int)retv, fi_strerror((int) -retv))
+
+#define RP_ERR(fmt, ...)                                                       \
+	fprintf(stderr, "[%s] %s:%-4d: " fmt "\n", "error", __FILE__,          \
+		__LINE__, ##__VA_ARGS__)
+
+#define RP_CLOSE_FID(fd)                                                       \
+	do {                                                                   \
+		int ret;                                                       \
+		if ((fd)) {                                                    \
+			ret = fi_close(&(fd)->fid);                            \
+			if (ret)                                               \
+				RP_ERR("fi_close (%d) fid %d", ret,            \
+				       (int)(fd)->fid.fclass);                 \
+			fd = NULL;                                             \
+		}                                                              \
+	} while (0)
+
+static const char *rp_op_str[] = {
+	OFI_TRACE_FOREACH(OFI_STR)
+};
+
+struct rp_opts {
+	char *prov_name;
+	char *dst_addr;
+	uint16_t src_port;
+	uint16_t dst_port;
+	int timed;
+};
+
+/* Exchanged over the control connection, peers share a byte order */
+struct rp_peer_info {
+	uint64_t addr;
+	uint64_t key;
+	uint64_t size;
+	uint64_t namelen;
+	char name[RP_NAME_MAX];
+};
+
+struct rp_op {
+	struct fi_context2 ctx;
+	uint64_t start;
+};
+
+struct rp_stat {
+	uint64_t cnt;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t trace_lat;
+	uint64_t trace_lat_cnt;
+	uint64_t lat;
+	uint64_t lat_cnt;
+};
+
+struct rp_ctx {
+	struct rp_opts opts;
+
+	struct ofi_trace_hdr hdr;
+	struct ofi_trace_rec *recs;
+	struct rp_op *ops;
+	size_t rec_cnt;
+	uint64_t caps;
+
+	int ctrl_fd;
+
+	struct fi_info *hints;
+	struct fi_info *fi;
+	struct fid_fabric *fabric;
+	struct fid_domain *domain;
+	struct fid_av *av;
+	struct fid_cq *cq;
+	struct fid_ep *ep;
+	struct fid_mr *mr;
+	void *desc;
+	void *buf;
+	size_t buf_size;
+
+	fi_addr_t peer;
+	struct rp_peer_info peer_info;
+
+	uint64_t comp_cnt;
+	uint64_t tx_pending;
+	uint64_t last_progress;
+	uint64_t stalls;
+	uint64_t start;
+	uint64_t end;
+	struct rp_stat stats[OFI_TRACE_OP_MAX];
+};
+
+static uint64_t rp_gettime_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static long parse_ulong(char *str, long max)
+{
+	long ret;
+	char *end;
+
+	errno = 0;
+	ret = strtol(str, &end, 10);
+	if (*end != '\0' || errno != 0 || ret < 0 || ret > max) {
+		fprintf(stderr, "Error parsing \"%s\"\n", str);
+		exit(EXIT_FAILURE);
+	}
+	return ret;
+}
+
+static int rp_is_inject(int op)
+{
+	return op == OFI_TRACE_INJECT || op == OFI_TRACE_INJECTDATA ||
+	       op == OFI_TRACE_INJECT_WRITE ||
+	       op == OFI_TRACE_INJECT_WRITEDATA ||
+	       op == OFI_TRACE_TINJECT || op == OFI_TRACE_TINJECTDATA;
+}
+
+static int rp_has_data(int op)
+{
+	return op == OFI_TRACE_SENDDATA || op == OFI_TRACE_INJECTDATA ||
+	       op == OFI_TRACE_WRITEDATA ||
+	       op == OFI_TRACE_INJECT_WRITEDATA ||
+	       op == OFI_TRACE_TSENDDATA || op == OFI_TRACE_TINJECTDATA;
+}
+
+static int rp_is_read(int op)
+{
+	return op >= OFI_TRACE_READ && op <= OFI_TRACE_READMSG;
+}
+
+/*******************************************************************************
+ *                                      Trace file
+ ******************************************************************************/
+
+static int rp_load_trace(struct rp_ctx *ct, const char *path)
+{
+	struct ofi_trace_rec *rec;
+	FILE *file;
+	long size;
+	size_t i;
+	int ret = -FI_EINVAL;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		RP_ERR("unable to open %s: %s", path, strerror(errno));
+		return -errno;
+	}
+
+	if (fread(&ct->hdr, sizeof(ct->hdr), 1, file) != 1 ||
+	    memcmp(ct->hdr.magic, OFI_TRACE_MAGIC, sizeof(ct->hdr.magic))) {
+		RP_ERR("%s is not a trace file", path);
+		goto out;
+	}
+	if (ct->hdr.version != OFI_TRACE_VERSION ||
+	    ct->hdr.rec_size != sizeof(*ct->recs)) {
+		RP_ERR("unsupported trace version %u, record size %u",
+		       ct->hdr.version, ct->hdr.rec_size);
+		goto out;
+	}
+	ct->hdr.prov_name[sizeof(ct->hdr.prov_name) - 1] = '\0';
+
+	if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 ||
+	    fseek(file, sizeof(ct->hdr), SEEK_SET)) {
+		RP_ERR("unable to size %s", path);
+		goto out;
+	}
+
+	ct->rec_cnt = (size - sizeof(ct->hdr)) / sizeof(*ct->recs);
+	if (!ct->rec_cnt) {
+		RP_ERR("%s holds no records", path);
+		goto out;
+	}
+
+	ct->recs = calloc(ct->rec_cnt, sizeof(*ct->recs));
+	ct->ops = calloc(ct->rec_cnt, sizeof(*ct->ops));
+	if (!ct->recs || !ct->ops) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	if (fread(ct->recs, sizeof(*ct->recs), ct->rec_cnt, file) !=
+	    ct->rec_cnt) {
+		RP_ERR("unable to read %s", path);
+		goto out;
+	}
+
+	for (i = 0; i < ct->rec_cnt; i++) {
+		rec = &ct->recs[i];
+		if (rec->op >= OFI_TRACE_OP_MAX) {
+			RP_ERR("invalid record %zu", i);
+			goto out;
+		}
+
+		if (ofi_trace_is_xfer(rec->op) && !rec->ret) {
+			ct->buf_size = MAX(ct->buf_size, rec->len);
+			if (ofi_trace_is_tagged(rec->op))
+				ct->caps |= FI_TAGGED;
+			else if (ofi_trace_is_rma(rec->op))
+				ct->caps |= FI_RMA;
+			else
+				ct->caps |= FI_MSG;
+		} else if (rec->op == OFI_TRACE_COMP &&
+			   rec->addr < ct->rec_cnt) {
+			ct->stats[ct->recs[rec->addr].op].trace_lat +=
+				rec->value;
+			ct->stats[ct->recs[rec->addr].op].trace_lat_cnt++;
+		}
+	}
+
+	if (!ct->caps) {
+		RP_ERR("%s holds no data transfers", path);
+		goto out;
+	}
+	ret = 0;
+out:
+	fclose(file);
+	return ret;
+}
+
+/*******************************************************************************
+ *                                    Control channel
+ ******************************************************************************/
+
+static int rp_ctrl_init_client(struct rp_ctx *ct)
+{
+	struct sockaddr_in in_addr = {0};
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+		.ai_protocol = IPPROTO_TCP,
+		.ai_flags = AI_NUMERICSERV
+	};
+	struct addrinfo *results, *rp;
+	char port_s[6];
+	int errno_save = 0;
+	int ret;
+
+	snprintf(port_s, sizeof(port_s), "%" PRIu16, ct->opts.dst_port);
+	ret = getaddrinfo(ct->opts.dst_addr, port_s, &hints, &results);
+	if (ret) {
+		RP_ERR("getaddrinfo : %s", gai_strerror(ret));
+		return -EXIT_FAILURE;
+	}
+
+	ret = -1;
+	for (rp = results; rp; rp = rp->ai_next) {
+		ct->ctrl_fd = ofi_socket(rp->ai_family, rp->ai_socktype,
+					 rp->ai_protocol);
+		if (ct->ctrl_fd == INVALID_SOCKET) {
+			errno_save = ofi_sockerr();
+			continue;
+		}
+
+		if (ct->opts.src_port != 0) {
+			in_addr.sin_family = AF_INET;
+			in_addr.sin_port = htons(ct->opts.src_port);
+			in_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+			ret = bind(ct->ctrl_fd, (struct sockaddr *) &in_addr,
+				   sizeof(in_addr));
+			if (ret == -1) {
+				errno_save = ofi_sockerr();
+				ofi_close_socket(ct->ctrl_fd);
+				continue;
+			}
+		}
+
+		ret = connect(ct->ctrl_fd, rp->ai_addr, rp->ai_addrlen);
+		if (ret != -1)
+			break;
+
+		errno_save = ofi_sockerr();
+		ofi_close_socket(ct->ctrl_fd);
+	}
+
+	if (!rp || ret == -1) {
+		ret = -errno_save;
+		ct->ctrl_fd = -1;
+		RP_ERR("failed to connect: %s", strerror(errno_save));
+	}
+
+	freeaddrinfo(results);
+	return ret;
+}
+
+static int rp_ctrl_init_server(struct rp_ctx *ct)
+{
+	struct sockaddr_in ctrl_addr = {0};
+	int optval = 1;
+	SOCKET listenfd;
+	int ret;
+
+	listenfd = ofi_socket(AF_INET, SOCK_STREAM, 0);
+	if (listenfd == INVALID_SOCKET) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("socket", ret);
+		return ret;
+	}
+
+	ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
+			 (const char *) &optval, sizeof(optval));
+	if (ret == -1) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("setsockopt(SO_REUSEADDR)", ret);
+		goto out;
+	}
+
+	ctrl_addr.sin_family = AF_INET;
+	ctrl_addr.sin_port = htons(ct->opts.src_port);
+	ctrl_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	ret = bind(listenfd, (struct sockaddr *) &ctrl_addr,
+		   sizeof(ctrl_addr));
+	if (ret == -1) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("bind", ret);
+		goto out;
+	}
+
+	ret = listen(listenfd, 1);
+	if (ret == -1) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("listen", ret);
+		goto out;
+	}
+
+	ct->ctrl_fd = accept(listenfd, NULL, NULL);
+	if (ct->ctrl_fd == -1) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("accept", ret);
+	}
+out:
+	ofi_close_socket(listenfd);
+	return ret;
+}
+
+static int rp_ctrl_init(struct rp_ctx *ct)
+{
+	if (ct->opts.dst_addr) {
+		if (!ct->opts.dst_port)
+			ct->opts.dst_port = RP_CTRL_PORT;
+		return rp_ctrl_init_client(ct);
+	}
+
+	if (!ct->opts.src_port)
+		ct->opts.src_port = RP_CTRL_PORT;
+	return rp_ctrl_init_server(ct);
+}
+
+static int rp_ctrl_send(struct rp_ctx *ct, void *buf, size_t size)
+{
+	ssize_t ret;
+
+	ret = ofi_send_socket(ct->ctrl_fd, buf, size, 0);
+	if (ret < 0) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("ctrl/send", ret);
+		return (int) ret;
+	}
+	return ret == size ? 0 : -ECONNABORTED;
+}
+
+static int rp_ctrl_recv(struct rp_ctx *ct, void *buf, size_t size)
+{
+	ssize_t ret;
+
+	do {
+		ret = ofi_recv_socket(ct->ctrl_fd, buf, size, MSG_WAITALL);
+	} while (ret == -1 && OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()));
+	if (ret < 0) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("ctrl/recv", ret);
+		return (int) ret;
+	}
+	if (ret != size) {
+		RP_ERR("ctrl/recv: remote connection closed");
+		return -ECONNABORTED;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ *                                       Progress
+ ******************************************************************************/
+
+static void rp_complete(struct rp_ctx *ct, void *context, size_t len,
+			int err)
+{
+	struct rp_op *op = context;
+	struct ofi_trace_rec *rec;
+	struct rp_stat *stat;
+	uint64_t now;
+
+	ct->comp_cnt++;
+	if (!op)
+		return;
+
+	rec = &ct->recs[op - ct->ops];
+	stat = &ct->stats[rec->op];
+	if (ofi_trace_is_recv(rec->op))
+		stat->bytes += len;
+	else
+		ct->tx_pending--;
+
+	if (err) {
+		stat->errors++;
+		return;
+	}
+
+	now = rp_gettime_ns();
+	stat->lat += now - op->start;
+	stat->lat_cnt++;
+}
+
+static int rp_progress(struct rp_ctx *ct)
+{
+	struct fi_cq_msg_entry comp[RP_CQ_BATCH];
+	struct fi_cq_err_entry err_entry = {0};
+	ssize_t ret;
+	int i;
+
+	ret = fi_cq_read(ct->cq, comp, RP_CQ_BATCH);
+	if (ret > 0) {
+		for (i = 0; i < ret; i++)
+			rp_complete(ct, comp[i].op_context, comp[i].len, 0);
+		ct->last_progress = rp_gettime_ns();
+	} else if (ret == -FI_EAVAIL) {
+		ret = fi_cq_readerr(ct->cq, &err_entry, 0);
+		if (ret < 0) {
+			RP_PRINTERR("fi_cq_readerr", ret);
+			return (int) ret;
+		}
+		rp_complete(ct, err_entry.op_context, err_entry.len,
+			    err_entry.err);
+		ct->last_progress = rp_gettime_ns();
+	} else if (ret != -FI_EAGAIN) {
+		RP_PRINTERR("fi_cq_read", ret);
+		return (int) ret;
+	}
+	return 0;
+}
+
+/*
+ * The peer may never send what the application waited for when the trace
+ * was recorded, e.g. if the application used more than one endpoint.
+ * Stop waiting if nothing completed for a while.
+ */
+static int rp_stalled(struct rp_ctx *ct)
+{
+	if (rp_gettime_ns() - ct->last_progress < RP_STALL_NS)
+		return 0;
+
+	ct->stalls++;
+	ct->last_progress = rp_gettime_ns();
+	return 1;
+}
+
+static int rp_barrier(struct rp_ctx *ct)
+{
+	struct pollfd fds = {
+		.fd = ct->ctrl_fd,
+		.events = POLLIN
+	};
+	char c = 'b';
+	int ret;
+
+	ret = rp_ctrl_send(ct, &c, sizeof(c));
+	if (ret)
+		return ret;
+
+	do {
+		ret = rp_progress(ct);
+		if (ret)
+			return ret;
+		ret = poll(&fds, 1, 1);
+	} while (!ret);
+	if (ret < 0) {
+		ret = -ofi_sockerr();
+		RP_PRINTERR("poll", ret);
+		return ret;
+	}
+
+	return rp_ctrl_recv(ct, &c, sizeof(c));
+}
+
+/*******************************************************************************
+ *                                       Replay
+ ******************************************************************************/
+
+static ssize_t rp_post_msg(struct rp_ctx *ct, struct ofi_trace_rec *rec,
+			   struct rp_op *op, size_t len, uint64_t flags)
+{
+	struct iovec iov = {
+		.iov_base = ct->buf,
+		.iov_len = len
+	};
+	struct fi_msg msg = {
+		.msg_iov = &iov,
+		.desc = &ct->desc,
+		.iov_count = 1,
+		.addr = ofi_trace_is_recv(rec->op) ? FI_ADDR_UNSPEC : ct->peer,
+		.context = op,
+		.data = rec->data
+	};
+	struct fi_msg_tagged tmsg = {
+		.msg_iov = &iov,
+		.desc = &ct->desc,
+		.iov_count = 1,
+		.addr = msg.addr,
+		.tag = rec->tag,
+		.ignore = rec->data,
+		.context = op,
+		.data = rec->data
+	};
+
+	switch (rec->op) {
+	case OFI_TRACE_INJECT:
+		return fi_inject(ct->ep, ct->buf, len, ct->peer);
+	case OFI_TRACE_INJECTDATA:
+		return (flags & FI_REMOTE_CQ_DATA) ?
+			fi_injectdata(ct->ep, ct->buf, len, rec->data,
+				      ct->peer) :
+			fi_inject(ct->ep, ct->buf, len, ct->peer);
+	case OFI_TRACE_TINJECT:
+		return fi_tinject(ct->ep, ct->buf, len, ct->peer, rec->tag);
+	case OFI_TRACE_TINJECTDATA:
+		return (flags & FI_REMOTE_CQ_DATA) ?
+			fi_tinjectdata(ct->ep, ct->buf, len, rec->data,
+				       ct->peer, rec->tag) :
+			fi_tinject(ct->ep, ct->buf, len, ct->peer, rec->tag);
+	default:
+		break;
+	}
+
+	if (ofi_trace_is_tagged(rec->op)) {
+		if (ofi_trace_is_recv(rec->op)) {
+			tmsg.data = 0;
+			return fi_trecvmsg(ct->ep, &tmsg, flags);
+		}
+		return fi_tsendmsg(ct->ep, &tmsg, flags);
+	}
+
+	return ofi_trace_is_recv(rec->op) ? fi_recvmsg(ct->ep, &msg, flags) :
+					    fi_sendmsg(ct->ep, &msg, flags);
+}
+
+static ssize_t rp_post_rma(struct rp_ctx *ct, struct ofi_trace_rec *rec,
+			   struct rp_op *op, size_t len, uint64_t flags)
+{
+	struct iovec iov = {
+		.iov_base = ct->buf,
+		.iov_len = len
+	};
+	struct fi_rma_iov rma_iov = {
+		.addr = ct->peer_info.addr,
+		.len = len,
+		.key = ct->peer_info.key
+	};
+	struct fi_msg_rma msg = {
+		.msg_iov = &iov,
+		.desc = &ct->desc,
+		.iov_count = 1,
+		.addr = ct->peer,
+		.rma_iov = &rma_iov,
+		.rma_iov_count = 1,
+		.context = op,
+		.data = rec->data
+	};
+
+	switch (rec->op) {
+	case OFI_TRACE_INJECT_WRITE:
+		return fi_inject_write(ct->ep, ct->buf, len, ct->peer,
+				       rma_iov.addr, rma_iov.key);
+	case OFI_TRACE_INJECT_WRITEDATA:
+		return (flags & FI_REMOTE_CQ_DATA) ?
+			fi_inject_writedata(ct->ep, ct->buf, len, rec->data,
+					    ct->peer, rma_iov.addr,
+					    rma_iov.key) :
+			fi_inject_write(ct->ep, ct->buf, len, ct->peer,
+					rma_iov.addr, rma_iov.key);
+	default:
+		break;
+	}
+
+	return rp_is_read(rec->op) ? fi_readmsg(ct->ep, &msg, flags) :
+				     fi_writemsg(ct->ep, &msg, flags);
+}
+
+/*
+ * Transfers are posted with the length that they were recorded with, up to
+ * the size of the buffers.  Receives match any source, as the trace comes
+ * from a single peer, and all transfers but injects request a completion.
+ */
+static int rp_post(struct rp_ctx *ct, size_t idx)
+{
+	struct ofi_trace_rec *rec = &ct->recs[idx];
+	struct rp_op *op = &ct->ops[idx];
+	uint64_t flags, start;
+	size_t len;
+	ssize_t ret;
+
+	len = MIN(rec->len, ct->buf_size);
+	if (ofi_trace_is_rma(rec->op))
+		len = MIN(len, ct->peer_info.size);
+	if (rp_is_inject(rec->op))
+		len = MIN(len, ct->fi->tx_attr->inject_size);
+
+	flags = FI_COMPLETION;
+	if (!ofi_trace_is_recv(rec->op)) {
+		flags |= rec->flags & RP_TX_FLAGS;
+		if (rp_has_data(rec->op))
+			flags |= FI_REMOTE_CQ_DATA;
+		if (!ct->fi->domain_attr->cq_data_size)
+			flags &= ~FI_REMOTE_CQ_DATA;
+		if (len > ct->fi->tx_attr->inject_size)
+			flags &= ~FI_INJECT;
+	}
+
+	start = rp_gettime_ns();
+	do {
+		op->start = rp_gettime_ns();
+		ret = ofi_trace_is_rma(rec->op) ?
+		      rp_post_rma(ct, rec, op, len, flags) :
+		      rp_post_msg(ct, rec, op, len, flags);
+		if (ret != -FI_EAGAIN)
+			break;
+
+		ret = rp_progress(ct);
+		if (ret)
+			return (int) ret;
+		if (rp_gettime_ns() - start > RP_STALL_NS) {
+			RP_ERR("unable to post record %zu (%s)", idx,
+			       rp_op_str[rec->op] + strlen("OFI_TRACE_"));
+			return -FI_EAGAIN;
+		}
+	} while (1);
+
+	if (ret) {
+		RP_PRINTERR(rp_op_str[rec->op] + strlen("OFI_TRACE_"), ret);
+		return (int) ret;
+	}
+
+	if (!ofi_trace_is_recv(rec->op) && !rp_is_inject(rec->op))
+		ct->tx_pending++;
+	ct->stats[rec->op].cnt++;
+	if (!ofi_trace_is_recv(rec->op))
+		ct->stats[rec->op].bytes += len;
+	return 0;
+}
+
+/*
+ * A transfer is posted once as many completions were read as when it was
+ * recorded, which keeps the dependencies between the two peers that the
+ * application saw.  In timed mode, transfers also wait for the time at
+ * which they were recorded.
+ */
+static int rp_wait(struct rp_ctx *ct, struct ofi_trace_rec *rec)
+{
+	int ret;
+
+	ct->last_progress = rp_gettime_ns();
+	while (ct->comp_cnt < rec->value ||
+	       (ct->opts.timed && rp_gettime_ns() - ct->start < rec->time)) {
+		ret = rp_progress(ct);
+		if (ret)
+			return ret;
+		if (ct->comp_cnt < rec->value && rp_stalled(ct)) {
+			fprintf(stderr, "stalled waiting for %" PRIu64
+				" completions, continuing\n",
+				rec->value - ct->comp_cnt);
+			break;
+		}
+	}
+	return 0;
+}
+
+static int rp_replay(struct rp_ctx *ct)
+{
+	struct ofi_trace_rec *rec;
+	size_t i;
+	int ret;
+
+	ret = rp_barrier(ct);
+	if (ret)
+		return ret;
+
+	ct->start = rp_gettime_ns();
+	for (i = 0; i < ct->rec_cnt; i++) {
+		rec = &ct->recs[i];
+		if (!ofi_trace_is_xfer(rec->op) || rec->ret)
+			continue;
+
+		ret = rp_wait(ct, rec);
+		if (ret)
+			return ret;
+
+		ret = rp_post(ct, i);
+		if (ret)
+			return ret;
+	}
+
+	ct->last_progress = rp_gettime_ns();
+	while (ct->tx_pending) {
+		ret = rp_progress(ct);
+		if (ret)
+			return ret;
+		if (rp_stalled(ct)) {
+			fprintf(stderr, "%" PRIu64 " transfers did not "
+				"complete\n", ct->tx_pending);
+			break;
+		}
+	}
+	ct->end = rp_gettime_ns();
+
+	return rp_barrier(ct);
+}
+
+static void rp_show_results(struct rp_ctx *ct)
+{
+	struct rp_stat *stat, total = {0};
+	double elapsed;
+	int i;
+
+	printf("%-18s %10s %14s %16s %16s\n", "op", "count", "bytes",
+	       "trace lat(us)", "replay lat(us)");
+	for (i = 0; i < OFI_TRACE_OP_MAX; i++) {
+		stat = &ct->stats[i];
+		if (!stat->cnt)
+			continue;
+
+		printf("%-18s %10" PRIu64 " %14" PRIu64, rp_op_str[i] +
+		       strlen("OFI_TRACE_"), stat->cnt, stat->bytes);
+		if (stat->trace_lat_cnt)
+			printf(" %16.2f", stat->trace_lat /
+			       (stat->trace_lat_cnt * 1000.0));
+		else
+			printf(" %16s", "-");
+		if (stat->lat_cnt)
+			printf(" %16.2f", stat->lat / (stat->lat_cnt * 1000.0));
+		else
+			printf(" %16s", "-");
+		if (stat->errors)
+			printf("  (%" PRIu64 " errors)", stat->errors);
+		printf("\n");
+
+		total.cnt += stat->cnt;
+		total.bytes += stat->bytes;
+	}
+
+	elapsed = (ct->end - ct->start) / 1000000000.0;
+	printf("\n%" PRIu64 " transfers, %" PRIu64 " bytes in %.3f s: "
+	       "%.2f MB/sec, %.2f Kxfers/sec\n", total.cnt, total.bytes,
+	       elapsed, elapsed ? total.bytes / (elapsed * 1000000.0) : 0.0,
+	       elapsed ? total.cnt / (elapsed * 1000.0) : 0.0);
+	if (ct->stalls)
+		printf("%" PRIu64 " stalls waiting for the peer\n", ct->stalls);
+}
+
+/*******************************************************************************
+ *                                        Setup
+ ******************************************************************************/
+
+static int rp_open_res(struct rp_ctx *ct)
+{
+	struct fi_cq_attr cq_attr = {
+		.format = FI_CQ_FORMAT_MSG,
+		.wait_obj = FI_WAIT_NONE
+	};
+	struct fi_av_attr av_attr = {
+		.type = FI_AV_MAP,
+		.count = 1
+	};
+	uint64_t access;
+	int ret;
+
+	ret = fi_fabric(ct->fi->fabric_attr, &ct->fabric, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_fabric", ret);
+		return ret;
+	}
+
+	ret = fi_domain(ct->fabric, ct->fi, &ct->domain, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_domain", ret);
+		return ret;
+	}
+
+	if (ct->fi->domain_attr->av_type != FI_AV_UNSPEC)
+		av_attr.type = ct->fi->domain_attr->av_type;
+	ret = fi_av_open(ct->domain, &av_attr, &ct->av, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_av_open", ret);
+		return ret;
+	}
+
+	cq_attr.size = ct->fi->tx_attr->size + ct->fi->rx_attr->size;
+	ret = fi_cq_open(ct->domain, &cq_attr, &ct->cq, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	ret = fi_endpoint(ct->domain, ct->fi, &ct->ep, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = fi_ep_bind(ct->ep, &ct->av->fid, 0);
+	if (!ret)
+		ret = fi_ep_bind(ct->ep, &ct->cq->fid, FI_TRANSMIT | FI_RECV);
+	if (ret) {
+		RP_PRINTERR("fi_ep_bind", ret);
+		return ret;
+	}
+
+	ret = fi_enable(ct->ep);
+	if (ret) {
+		RP_PRINTERR("fi_enable", ret);
+		return ret;
+	}
+
+	ct->buf_size = MAX(ct->buf_size, sizeof(uint64_t));
+	ct->buf = calloc(1, ct->buf_size);
+	if (!ct->buf)
+		return -FI_ENOMEM;
+
+	if (!(ct->fi->domain_attr->mr_mode & FI_MR_LOCAL) &&
+	    !(ct->caps & FI_RMA))
+		return 0;
+
+	access = FI_SEND | FI_RECV;
+	if (ct->caps & FI_RMA)
+		access |= FI_READ | FI_WRITE | FI_REMOTE_READ | FI_REMOTE_WRITE;
+	ret = fi_mr_reg(ct->domain, ct->buf, ct->buf_size, access, 0,
+			RP_MR_KEY, 0, &ct->mr, NULL);
+	if (ret) {
+		RP_PRINTERR("fi_mr_reg", ret);
+		return ret;
+	}
+	ct->desc = fi_mr_desc(ct->mr);
+	return 0;
+}
+
+static int rp_exchange_info(struct rp_ctx *ct)
+{
+	struct rp_peer_info info = {0};
+	size_t namelen = sizeof(info.name);
+	int ret;
+
+	ret = fi_getname(&ct->ep->fid, info.name, &namelen);
+	if (ret) {
+		RP_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	info.namelen = namelen;
+	info.size = ct->buf_size;
+	if (ct->mr) {
+		info.key = fi_mr_key(ct->mr);
+		if (ct->fi->domain_attr->mr_mode & FI_MR_VIRT_ADDR)
+			info.addr = (uintptr_t) ct->buf;
+	}
+
+	ret = rp_ctrl_send(ct, &info, sizeof(info));
+	if (ret)
+		return ret;
+
+	ret = rp_ctrl_recv(ct, &ct->peer_info, sizeof(ct->peer_info));
+	if (ret)
+		return ret;
+
+	ret = fi_av_insert(ct->av, ct->peer_info.name, 1, &ct->peer, 0, NULL);
+	if (ret != 1) {
+		RP_PRINTERR("fi_av_insert", ret);
+		return ret < 0 ? ret : -FI_EINVAL;
+	}
+	return 0;
+}
+
+static int rp_init(struct rp_ctx *ct)
+{
+	int ret;
+
+	ct->hints = fi_allocinfo();
+	if (!ct->hints)
+		return -FI_ENOMEM;
+
+	ct->hints->caps = ct->caps;
+	ct->hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	ct->hints->ep_attr->type = FI_EP_RDM;
+	ct->hints->domain_attr->mr_mode = FI_MR_LOCAL | RP_MR_BASIC_MAP;
+	ct->hints->domain_attr->threading = FI_THREAD_DOMAIN;
+	ct->hints->fabric_attr->prov_name = strdup(ct->opts.prov_name ?
+						   ct->opts.prov_name :
+						   ct->hdr.prov_name);
+
+	ret = fi_getinfo(FI_VERSION(FI_MAJOR_VERSION, FI_MINOR_VERSION),
+			 NULL, NULL, 0, ct->hints, &ct->fi);
+	if (ret) {
+		RP_PRINTERR("fi_getinfo", ret);
+		return ret;
+	}
+
+	ret = rp_open_res(ct);
+	if (ret)
+		return ret;
+
+	ret = rp_ctrl_init(ct);
+	if (ret)
+		return ret;
+
+	return rp_exchange_info(ct);
+}
+
+static void rp_free(struct rp_ctx *ct)
+{
+	RP_CLOSE_FID(ct->ep);
+	RP_CLOSE_FID(ct->mr);
+	RP_CLOSE_FID(ct->cq);
+	RP_CLOSE_FID(ct->av);
+	RP_CLOSE_FID(ct->domain);
+	RP_CLOSE_FID(ct->fabric);
+
+	if (ct->ctrl_fd != -1)
+		ofi_close_socket(ct->ctrl_fd);
+	if (ct->fi)
+		fi_freeinfo(ct->fi);
+	if (ct->hints)
+		fi_freeinfo(ct->hints);
+	free(ct->buf);
+	free(ct->recs);
+	free(ct->ops);
+	free(ct->opts.prov_name);
+}
+
+static void rp_usage(char *name)
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "  %s [OPTIONS] <trace>\t\t\tstart server\n", name);
+	fprintf(stderr, "  %s [OPTIONS] <trace> <srv_addr>\tconnect to server\n",
+		name);
+	fprintf(stderr, "\nReplay the data transfers of a call trace recorded "
+		"with FI_HOOK=trace\nagainst a peer replaying the other side "
+		"of the trace.\n");
+
+	fprintf(stderr, "\nOptions:\n");
+	fprintf(stderr, " %-20s %s\n", "-B <src_port>",
+		"source control port number (server: 47592, client: auto)");
+	fprintf(stderr, " %-20s %s\n", "-P <dst_port>",
+		"destination control port number (client: 47592)");
+	fprintf(stderr, " %-20s %s\n", "-p <provider>",
+		"provider to replay over (provider of the trace)");
+	fprintf(stderr, " %-20s %s\n", "-t",
+		"replay transfers at the time they were recorded");
+	fprintf(stderr, " %-20s %s\n", "-h", "display this help output");
+}
+
+int main(int argc, char **argv)
+{
+	struct rp_ctx ct = {
+		.ctrl_fd = -1
+	};
+	int op, ret;
+
+	while ((op = getopt(argc, argv, "hB:P:p:t")) != -1) {
+		switch (op) {
+		case 'B':
+			ct.opts.src_port = parse_ulong(optarg, UINT16_MAX);
+			break;
+		case 'P':
+			ct.opts.dst_port = parse_ulong(optarg, UINT16_MAX);
+			break;
+		case 'p':
+			free(ct.opts.prov_name);
+			ct.opts.prov_name = strdup(optarg);
+			break;
+		case 't':
+			ct.opts.timed = 1;
+			break;
+		case '?':
+		case 'h':
+		default:
+			rp_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc || argc - optind > 2) {
+		rp_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc - optind == 2)
+		ct.opts.dst_addr = argv[optind + 1];
+
+	ret = rp_load_trace(&ct, argv[optind]);
+	if (ret)
+		goto out;
+
+	ret = rp_init(&ct);
+	if (ret)
+		goto out;
+
+	printf("provider: %s, trace: %s (%zu records)\n",
+	       ct.fi->fabric_attr->prov_name, argv[optind], ct.rec_cnt);
+
+	ret = rp_replay(&ct);
+	if (ret)
+		goto out;
+
+	rp_show_results(&ct);
+out:
+	rp_free(&ct);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}